@@ -9,7 +9,8 @@ extern "C" Object* rt_math_int_pow(Object* base, Object* exp, Object* mod)
     mpz_init(mpz);
     mpz_powm(mpz, base->mpz, exp->mpz, mod->mpz);
 
-    Object* result = track(Object::create(mpz));
+    Object* result = Object::makeInt(mpz);
+    mpz_clear(mpz);
 
     trace_debugf("Result: %s\n", result->dump().c_str());
 
@@ -22,7 +23,10 @@ extern "C" Object* rt_math_int_bitwise_and(Object* a, Object* b)
 
     mpz_and(mpz, a->mpz, b->mpz);
 
-    return track(Object::create(mpz));
+    Object* result = Object::makeInt(mpz);
+    mpz_clear(mpz);
+
+    return result;
 }
 
 extern "C" Object* rt_math_int_bitwise_or(Object* a, Object* b)
@@ -31,5 +35,8 @@ extern "C" Object* rt_math_int_bitwise_or(Object* a, Object* b)
 
     mpz_ior(mpz, a->mpz, b->mpz);
 
-    return track(Object::create(mpz));
+    Object* result = Object::makeInt(mpz);
+    mpz_clear(mpz);
+
+    return result;
 }
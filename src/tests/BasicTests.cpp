@@ -1,4 +1,9 @@
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <map>
+#include <unordered_map>
+#include <random>
 #include "../vmlib/Object.h"
 #include "../vmlib/VM.h"
 #include "../vmlib/OptParser.h"
@@ -12,6 +17,7 @@
 #include "../vmlib/ExprStore.h"
 #include "../vmlib/ExprUnaryOp.h"
 #include "../vmlib/AsmParser.h"
+#include "../vmlib/Stack.h"
 
 using namespace std;
 
@@ -149,7 +155,7 @@ void testAdd()
     vm.eval();
 }
 
-void fact()
+void fact(VM::Engine engine = VM::Engine::TreeWalker)
 {
     // This implements factorial(n) recursively to test, well, recursion
     //
@@ -162,6 +168,7 @@ void fact()
     // }
 
     VM vm;
+    vm.setEngine(engine);
 
     // Variable to hold the closure, so it can be called recursively
     size_t localFactClosureIdx = 0;
@@ -252,10 +259,1006 @@ void fact()
     // Go
     vm.eval();
 }
+
+void testIncrementalGC()
+{
+    // Tiny slices, so marking and sweeping interleave with almost every instruction
+    VM vm;
+    vm.gcMode = VM::GCMode::Incremental;
+    vm.incrementalTriggerGC = vm.nextSliceGC = 16;
+    vm.sliceInterval = 4;
+    vm.sliceBudget = 8;
+
+    // Containers are filled while being marked, and the loop keeps allocating
+    std::istringstream source(R"(
+        push array 10
+        push umap 10
+        push int 0
+        if (load abs 2; push int 2000; gt)
+        {
+            load abs 2; push int 100000; add; load abs 0; coll append
+            load abs 2; push int 0; add; load abs 2; push int 200000; add; load abs 1; coll put
+            load abs 2; inc; store abs 2
+            repeat
+        }
+        push int 1999; load abs 0; coll get
+        push int 101999 eq assert "ERROR: array element collected during incremental marking"
+        push int 1000; load abs 1; coll get
+        push int 201000 eq assert "ERROR: map value collected during incremental marking"
+        dump string "Incremental GC test completed"
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "incremental-gc");
+
+    vm.eval();
+
+    // Removed objects may still be on the gray stack, so they must be left to the sweep
+    VM removing;
+    removing.gcMode = VM::GCMode::Incremental;
+    removing.incrementalTriggerGC = removing.nextSliceGC = 16;
+    removing.sliceInterval = 1;
+    removing.sliceBudget = 1;
+
+    std::istringstream removeSource(R"(
+        push int 0
+        if (load abs 0; push int 20000; gt)
+        {
+            push array 1; dup; dup; dup; remove 3; pop
+            load abs 0; inc; store abs 0
+            repeat
+        }
+    )");
+
+    AsmParser removeParser(removing);
+    removeParser.parse(removeSource, "incremental-remove");
+
+    removing.eval();
+}
+
+void testBackgroundSweep()
+{
+    // Collect often, so most allocations happen while a sweep is running
+    VM vm;
+    vm.backgroundSweep = true;
+    vm.heapCountTriggerGC = 256;
+
+    // The function is only reachable while it's evaluated, and the remove instruction
+    // must not destruct objects on the list being swept
+    std::istringstream source(R"(
+        push array 10
+        push int 0
+        if (load abs 1; push int 5000; gt)
+        {
+            load abs 1; push int 100000; add; load abs 0; coll append
+            push string "garbage"; dup; remove 1; pop
+            function
+            {
+                current; pop
+                push string "result"; dup; swap; pop
+            }
+            invoke
+            push string "result" eq assert "ERROR: function result collected during background sweep"
+            load abs 1; inc; store abs 1
+            repeat
+        }
+        push int 4999; load abs 0; coll get
+        push int 104999 eq assert "ERROR: array element collected during background sweep"
+        gc
+        load abs 0; coll size
+        push int 5000 eq assert "ERROR: unexpected array size after background sweep"
+        dump string "Background sweep test completed"
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "background-sweep");
+
+    vm.eval();
+    vm.sweeper.finish();
+}
+
+void testParallelMark()
+{
+    // Mark with several threads, regardless of heap size
+    VM vm;
+    vm.markThreads = 4;
+    vm.parallelMarkThreshold = 0;
+
+    // Nested arrays and a map are wide enough for workers to share and steal work
+    std::istringstream source(R"(
+        push array 10; dup; swap; pop
+        push umap 10
+        push int 0
+        if (load abs 2; push int 3000; gt)
+        {
+            push array 10; dup; swap; pop
+            load abs 2; push int 0; add; load abs 3; coll append
+            load abs 2; push int 100000; add; load abs 3; coll append
+            load abs 0; coll append
+            load abs 2; push int 0; add; load abs 2; push int 200000; add; load abs 1; coll put
+            load abs 2; inc; store abs 2
+            repeat
+        }
+        gc
+        gc
+        push int 1; push int 2999; load abs 0; coll get; coll get
+        push int 102999 eq assert "ERROR: nested element collected during parallel marking"
+        push int 1500; load abs 1; coll get
+        push int 201500 eq assert "ERROR: map value collected during parallel marking"
+        dump string "Parallel mark test completed"
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "parallel-mark");
+
+    vm.eval();
+}
+
+void testHeapPages()
+{
+    // Objects of two size classes, of which only the oldest survive
+    VM vm;
+    Stack* stack = vm.root->fndata->stack;
+
+    for (int64_t i = 0; i < 100000; i++)
+    {
+        Object* obj = i % 2 == 0 ? track(Object::create(i)) : track(new Stack());
+        if (i < 1000)
+            stack->push_back(obj);
+    }
+
+    size_t pages = vm.heap.pages.size();
+    vm.gc();
+
+    size_t tracked = 0;
+    for (Page* page : vm.heap.pages)
+    {
+        for (size_t word = 0; word < Page::WORDS; word++)
+            tracked += __builtin_popcountll(page->tracked[word]);
+    }
+
+    if ((int64_t) tracked != vm.numObjects)
+        throw std::runtime_error("ERROR: tracked bitmaps don't match the object count");
+
+    if (vm.heap.pages.size() >= pages)
+        throw std::runtime_error("ERROR: empty heap pages not released");
+
+    if (mpz_get_si(stack->items[998]->mpz) != 998)
+        throw std::runtime_error("ERROR: surviving object overwritten");
+
+    std::cout << "Heap page test completed" << std::endl;
+}
+
+void testSlab()
+{
+    // Blocks are allocated by the owner and freed by another thread through a magazine
+    Slab<std::string> slab;
+    std::vector<std::string*> strings;
+
+    for (int i = 0; i < 10000; i++)
+        strings.push_back(slab.create(std::to_string(i)));
+
+    std::thread other([&]()
+    {
+        Slab<std::string>::Magazine magazine(slab);
+        for (size_t i = 0; i < strings.size(); i += 2)
+            magazine.destroy(strings[i]);
+    });
+    other.join();
+
+    // Freed blocks are reused before new chunks are reserved
+    uint64_t chunks = slab.stats().chunks;
+    for (int i = 0; i < 5000; i++)
+        slab.create("reused");
+
+    AllocStats stats = slab.stats();
+    if (stats.allocations != 15000 || stats.frees != 5000 || stats.live != 10000)
+        throw std::runtime_error("ERROR: slab statistics don't add up");
+
+    if (stats.chunks != chunks)
+        throw std::runtime_error("ERROR: slab didn't reuse freed blocks");
+
+    if (*strings[9999] != "9999")
+        throw std::runtime_error("ERROR: live slab block overwritten");
+
+    std::cout << "Slab test completed" << std::endl;
+}
+
+void testHeapLimit()
+{
+    // A string growing past the limit, which no collection can free
+    VM vm;
+    vm.setHeapLimits(1024*1024, 2.0, 4*1024*1024);
+
+    std::istringstream source(R"(
+        push string ""
+        push int 0
+        if (load abs 1; push int 1000000; gt)
+        {
+            push string "0123456789012345678901234567890123456789"; load abs 0; coll append
+            load abs 1; inc; store abs 1
+            repeat
+        }
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "heap-limit");
+
+    try
+    {
+        vm.eval();
+    }
+    catch (std::exception& ex)
+    {
+        if (std::string(ex.what()).find("Heap limit exceeded") == std::string::npos)
+            throw;
+
+        if (vm.externalBytes < 3*1024*1024)
+            throw std::runtime_error("ERROR: string growth not accounted");
+
+        std::cout << "Heap limit test completed" << std::endl;
+        return;
+    }
+
+    throw std::runtime_error("ERROR: heap limit not enforced");
+}
+
+void testGCStats()
+{
+    VM vm;
+
+    std::istringstream source(R"(
+        push array 10
+        push int 0
+        if (load abs 1; push int 1000; gt)
+        {
+            load abs 1; push int 7; mul; load abs 0; coll append
+            load abs 1; inc; store abs 1
+            repeat
+        }
+        gc
+        gc minor
+        gc stats
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "gc-stats");
+    vm.eval();
+
+    if (vm.gcStats.fullCollections == 0 || vm.gcStats.minorCollections == 0)
+        throw std::runtime_error("ERROR: collections not counted");
+
+    if (vm.gcStats.mark.count != vm.gcStats.fullCollections + vm.gcStats.minorCollections)
+        throw std::runtime_error("ERROR: collection records not added");
+
+    auto byName = vm.gcStats.allocatedByName();
+    if (byName["int"].objects == 0 || byName["int"].bytes < byName["int"].objects * Page::MIN_SLOT || byName["array"].objects == 0)
+        throw std::runtime_error("ERROR: allocations not counted per type");
+
+    Object* stats = vm.root->fndata->stack->back();
+    if (stats->otype != TokenType::TypeUnorderedMap)
+        throw std::runtime_error("ERROR: gc stats should push a map");
+
+    long full = -1;
+    for (auto& entry : *stats->umap)
+    {
+        if (entry.first->isString() && *entry.first->str_value == "full")
+            full = entry.second->asLong();
+    }
+
+    if (full < 1 || full > (long) vm.gcStats.fullCollections)
+        throw std::runtime_error("ERROR: gc stats map has the wrong full collection count");
+
+    // Integers are counted by their limbs, including those swapped in after tracking
+    vm.gc();
+    int64_t external = vm.externalBytes;
+    mpz_t value;
+    mpz_init(value);
+    mpz_ui_pow_ui(value, 2, 64 * 1000);
+    Object* big = Object::makeInt(value);
+    mpz_clear(value);
+
+    if (vm.externalBytes - external < 1000 * (int64_t) sizeof(mp_limb_t) || big->ownedBytes() != mpz_size(big->mpz) * sizeof(mp_limb_t))
+        throw std::runtime_error("ERROR: integer limbs not counted");
+
+    vm.gc();
+    if (vm.externalBytes != external)
+        throw std::runtime_error("ERROR: integer limbs not released");
+
+    std::cout << "GC stats test completed" << std::endl;
+}
+
+void testCodeArena()
+{
+    // Macros get regions of their own, released once their functions are unreachable. The
+    // array literal in the last macro escapes, so it must outlive its region.
+    VM vm;
+
+    std::istringstream source(R"(
+        push array 10
+        push int 0
+        if (load abs 1; push int 100; gt)
+        {
+            push string "push int 2; push int 3; add"
+            cast function
+            invoke
+            load abs 0; coll append
+            load abs 1; inc; store abs 1
+            repeat
+        }
+        push string "push array 3"
+        cast function
+        invoke
+        gc
+        push int 7; load abs 2; coll append
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "code-arena");
+
+    size_t nodes = vm.code.size();
+    if (nodes == 0 || vm.heap.stats().live > 64)
+        throw std::runtime_error("ERROR: instruction nodes allocated on the heap");
+
+    size_t heapBytes = vm.heap.usedBytes;
+    vm.eval();
+
+    // Each site is quickened at most once, into the arena holding it
+    if (vm.code.size() > 2 * nodes)
+        throw std::runtime_error("ERROR: macro code allocated in the program arena");
+
+    // The macros' quickened adds are released with their regions
+    if (vm.heap.usedBytes >= heapBytes + 100 * sizeof(ExprQuickened))
+        throw std::runtime_error("ERROR: quickened nodes allocated on the heap");
+
+    if (!vm.regions.empty())
+        throw std::runtime_error("ERROR: unreachable regions not released");
+
+    Stack* stack = vm.root->fndata->stack;
+    if (stack->size() != 3 || stack->at(0)->array->size() != 100 || stack->at(2)->array->size() != 1)
+        throw std::runtime_error("ERROR: wrong result after releasing regions");
+
+    // Regions count as bytes in use until released
+    int64_t external = vm.externalBytes;
+    CodeArena* region = vm.newRegion();
+    new (*region) ExprExpressionList(nullptr, region);
+
+    if (region->bytes() == 0 || vm.externalBytes != external + (int64_t) region->bytes())
+        throw std::runtime_error("ERROR: region not counted in the bytes in use");
+
+    vm.sweepRegions();
+
+    if (!vm.regions.empty() || vm.externalBytes != external)
+        throw std::runtime_error("ERROR: released region still counted in the bytes in use");
+
+    std::cout << "Code arena test completed" << std::endl;
+}
 }//ns
 
 using namespace lake;
 
+void testScratchRegions()
+{
+    // Strings appended to the array at the bottom of the stack escape their regions, as does
+    // the array stored into the commit slot. The other strings are freed as each revert runs.
+    VM vm;
+    vm.scratchRegions = true;
+
+    std::istringstream source(R"(
+        push array 10; dup; swap; pop
+        push int 0
+        if (load abs 1; push int 200; gt)
+        {
+            push object null; commit
+            push array 10; dup; swap; pop
+            push string "temp"; dup; pop; pop
+            push int 0
+            if (load abs 4; push int 20; gt)
+            {
+                push string "garbage"; dup; load abs 3; coll append; pop
+                commit
+                push string "inner"; dup; pop; pop
+                push string "kept"; dup; load abs 0; coll append; pop
+                revert
+                load abs 4; inc; store abs 4
+                repeat
+            }
+            pop
+            store commit
+            revert
+            load abs 0; coll append
+            load abs 1; inc; store abs 1
+            repeat
+        }
+        pop
+    )");
+
+    AsmParser parser(vm);
+    parser.parse(source, "scratch-regions");
+    vm.eval();
+
+    if (vm.heap.regionDepth != 0 || !vm.scratch.empty() || !vm.escaped.empty())
+        throw std::runtime_error("ERROR: scratch regions left open");
+
+    // Collections running while a region is open may free some of its garbage first
+    if (vm.gcStats.scratchRegions != 200 * 21 || vm.gcStats.scratchObjectsFreed + vm.gcStats.objectsFreed < 200 * 21)
+        throw std::runtime_error("ERROR: scratch regions not swept");
+
+    // Survivors are on pages handed to the main heap, and must survive a collection there
+    for (int pass = 0; pass < 2; pass++)
+    {
+        Object* result = vm.root->fndata->stack->at(0);
+        if (result->array->size() != 200 * 21)
+            throw std::runtime_error("ERROR: wrong number of escaped objects");
+
+        for (Object* obj : *result->array)
+        {
+            if (obj->isString() ? *obj->str_value != "kept" :
+                    obj->array->size() != 20 || *obj->array->at(19)->str_value != "garbage")
+                throw std::runtime_error("ERROR: escaped object not preserved");
+        }
+
+        vm.gc();
+    }
+
+    std::cout << "Scratch regions test completed" << std::endl;
+}
+
+void testTypedArrays()
+{
+    VM vm;
+
+    // Sizes which aren't a multiple of the vector width exercise the kernels' scalar tails
+    for (size_t n : {0, 1, 7, 33, 1000})
+    {
+        Object* ints = track(Object::create(new TypedArray(TypedArray::Kind::Int64)));
+        Object* doubles = track(Object::create(new TypedArray(TypedArray::Kind::Float64)));
+
+        for (size_t i = 0; i < n; i++)
+        {
+            ints->typed->append(Object::makeInt((int64_t) i - 500));
+            doubles->typed->append(Object::makeDouble((double) i / 4));
+        }
+
+        // The top of the stack is the left operand, so these compute i-500 - 3 and 3 - (i-500)
+        Object* three = Object::makeInt(3);
+        Object* diff = ints->sub(ints, three);
+        Object* reversed = ints->sub(three, ints);
+        Object* product = doubles->mul(doubles, doubles);
+        Object* mask = ints->less(ints, Object::makeInt((int64_t) 0));
+
+        for (size_t i = 0; i < n; i++)
+        {
+            int64_t v = (int64_t) i - 500;
+            double d = (double) i / 4;
+
+            if (diff->typed->data<int64_t>()[i] != v - 3 || reversed->typed->data<int64_t>()[i] != 3 - v ||
+                product->typed->data<double>()[i] != d * d || mask->typed->data<uint8_t>()[i] != (v < 0 ? 1 : 0))
+                throw std::runtime_error("ERROR: typed array kernel produced a wrong element");
+        }
+
+        if (diff->typed->size() != n || mask->typed->kind() != TypedArray::Kind::Uint8)
+            throw std::runtime_error("ERROR: typed array kernel produced a wrong array");
+    }
+
+    // Elements are range checked, and integer division by zero is an error
+    Object* bytes = track(Object::create(new TypedArray(TypedArray::Kind::Uint8)));
+    bytes->typed->fill(Object::makeInt(255), 40);
+
+    bool threw = false;
+    try { bytes->typed->append(Object::makeInt(256)); } catch (std::runtime_error&) { threw = true; }
+    if (!threw || bytes->typed->size() != 40)
+        throw std::runtime_error("ERROR: out of range typed array element accepted");
+
+    threw = false;
+    try { bytes->div(bytes, Object::makeInt((int64_t) 0)); } catch (std::runtime_error&) { threw = true; }
+    if (!threw)
+        throw std::runtime_error("ERROR: typed array division by zero accepted");
+
+    // Byte arithmetic wraps around
+    Object* sum = bytes->add(bytes, Object::makeInt(2));
+    if (sum->typed->data<uint8_t>()[39] != 1)
+        throw std::runtime_error("ERROR: typed array byte arithmetic did not wrap");
+
+    std::cout << "Typed arrays test completed" << std::endl;
+}
+
+void testReductions()
+{
+    VM vm;
+
+    Object* ints = track(Object::create(new TypedArray(TypedArray::Kind::Int64)));
+    Object* doubles = track(Object::create(new TypedArray(TypedArray::Kind::Float64)));
+    Object* bytes = track(Object::create(new TypedArray(TypedArray::Kind::Uint8)));
+
+    for (int64_t i = 0; i < 300; i++)
+    {
+        ints->typed->append(Object::makeInt((i * 7919) % 1000 - 500));
+        doubles->typed->append(Object::makeDouble((double) ((i * 31) % 64) / 4));
+        bytes->typed->append(Object::makeInt((i * 13) % 256));
+    }
+
+    // Ranges starting and ending off the vector width exercise the lane folding and the tails
+    for (size_t start : {0, 1, 5})
+    {
+        for (size_t end : {6, 7, 64, 131, 300})
+        {
+            const int64_t* iv = ints->typed->data<int64_t>();
+            const double* dv = doubles->typed->data<double>();
+            const uint8_t* bv = bytes->typed->data<uint8_t>();
+
+            uint64_t sum = 0, product = 1;
+            int64_t min = iv[start], max = iv[start], conj = -1, disj = 0, exor = 0, byteSum = 0;
+            double dsum = 0, dmin = dv[start];
+
+            for (size_t i = start; i < end; i++)
+            {
+                sum += (uint64_t) iv[i];
+                product *= (uint64_t) iv[i];
+                min = std::min(min, iv[i]);
+                max = std::max(max, iv[i]);
+                conj &= iv[i];
+                disj |= iv[i];
+                exor ^= iv[i];
+                byteSum += bv[i];
+                dsum += dv[i];
+                dmin = std::min(dmin, dv[i]);
+            }
+
+            if (ints->typed->reduceInt(Reduction::Sum, start, end) != (int64_t) sum ||
+                ints->typed->reduceInt(Reduction::Product, start, end) != (int64_t) product ||
+                ints->typed->reduceInt(Reduction::Min, start, end) != min ||
+                ints->typed->reduceInt(Reduction::Max, start, end) != max ||
+                ints->typed->reduceInt(Reduction::And, start, end) != conj ||
+                ints->typed->reduceInt(Reduction::Or, start, end) != disj ||
+                ints->typed->reduceInt(Reduction::Xor, start, end) != exor ||
+                ints->typed->reduceInt(Reduction::Count, start, end) != (int64_t) (end - start))
+                throw std::runtime_error("ERROR: int64 reduction failed");
+
+            if (bytes->typed->reduceInt(Reduction::Sum, start, end) != byteSum)
+                throw std::runtime_error("ERROR: byte reduction failed");
+
+            // Quarters are exact in a double, so the sum doesn't depend on the order
+            if (doubles->typed->reduceFloat(Reduction::Sum, start, end) != dsum ||
+                doubles->typed->reduceFloat(Reduction::Min, start, end) != dmin)
+                throw std::runtime_error("ERROR: f64 reduction failed");
+        }
+    }
+
+    bool threw = false;
+    try { ints->typed->reduceInt(Reduction::Min, 3, 3); } catch (std::runtime_error&) { threw = true; }
+    if (!threw)
+        throw std::runtime_error("ERROR: min of an empty range accepted");
+
+    std::cout << "Reductions test completed" << std::endl;
+}
+
+void testHashTable()
+{
+    VM vm;
+
+    std::vector<Object*> keys;
+    for (int64_t i = 0; i < 5000; i++)
+    {
+        // Integers beyond 64 bits, so lookups hash several limbs
+        Object* key = Object::create(TokenType::TypeInt);
+        mpz_ui_pow_ui(key->mpz, 3, 90);
+        mpz_add_ui(key->mpz, key->mpz, (unsigned long) i);
+        keys.push_back(track(key));
+    }
+
+    ObjectMap map;
+    for (Object* key : keys)
+        map[key] = key;
+
+    // Erasing every other key leaves tombstones which later inserts and lookups must handle
+    for (size_t i = 0; i < keys.size(); i += 2)
+    {
+        if (map.erase(keys[i]) != 1)
+            throw std::runtime_error("ERROR: hash table erase failed");
+    }
+
+    Object* probe = track(Object::create(TokenType::TypeInt));
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        mpz_set(probe->mpz, keys[i]->mpz);
+        if ((map.find(probe) != map.end()) != (i % 2 == 1))
+            throw std::runtime_error("ERROR: hash table lookup failed");
+    }
+
+    for (size_t i = 0; i < keys.size(); i += 2)
+        map[keys[i]] = keys[i];
+
+    size_t visited = 0;
+    for (const auto& entry : map)
+    {
+        if (entry.first != entry.second)
+            throw std::runtime_error("ERROR: hash table entry corrupted");
+        visited++;
+    }
+
+    if (visited != keys.size() || map.size() != keys.size())
+        throw std::runtime_error("ERROR: hash table iteration failed");
+
+    // Equal floats of different precision must hash equally
+    Object* narrow = track(Object::create(TokenType::TypeFloat));
+    Object* wide = track(Object::create(TokenType::TypeFloat));
+    mpf_set_prec(wide->mpf, 1024);
+    mpf_set_d(narrow->mpf, 1.5);
+    mpf_set_d(wide->mpf, 1.5);
+
+    ObjectSet set;
+    set.insert(narrow);
+    if (set.find(wide) == set.end() || set.insert(wide).second)
+        throw std::runtime_error("ERROR: equal floats of different precision should be one element");
+
+    std::cout << "Hash table test completed" << std::endl;
+}
+
+struct IntOrder
+{
+    int operator()(int64_t lhs, int64_t rhs) const
+    {
+        return (lhs > rhs) - (lhs < rhs);
+    }
+};
+
+void testBTree()
+{
+    // A small degree gives a deep tree, so splits, merges and borrowing all happen
+    BTree<int64_t, int64_t, IntOrder, 3> tree;
+    std::map<int64_t, int64_t> reference;
+    std::mt19937 rng(7);
+
+    for (int i = 0; i < 20000; i++)
+    {
+        int64_t key = (int64_t) (rng() % 2000);
+        if (rng() % 3 == 0)
+        {
+            if (tree.erase(key) != (reference.erase(key) == 1))
+                throw std::runtime_error("ERROR: B-tree erase failed");
+        }
+        else
+        {
+            tree[key] = i;
+            reference[key] = i;
+        }
+    }
+
+    if (tree.size() != reference.size())
+        throw std::runtime_error("ERROR: B-tree size is wrong");
+
+    auto expected = reference.begin();
+    for (auto itr = tree.begin(); !itr.atEnd(); ++itr, ++expected)
+    {
+        if (itr.key() != expected->first || itr.value() != expected->second)
+            throw std::runtime_error("ERROR: B-tree iteration failed");
+    }
+
+    for (int64_t key = -1; key <= 2001; key++)
+    {
+        auto lower = tree.lowerBound(key);
+        auto expectedLower = reference.lower_bound(key);
+        if (lower.atEnd() != (expectedLower == reference.end()) || (!lower.atEnd() && lower.key() != expectedLower->first))
+            throw std::runtime_error("ERROR: B-tree lower bound failed");
+
+        auto upper = tree.upperBound(key);
+        auto expectedUpper = reference.upper_bound(key);
+        if (upper.atEnd() != (expectedUpper == reference.end()) || (!upper.atEnd() && upper.key() != expectedUpper->first))
+            throw std::runtime_error("ERROR: B-tree upper bound failed");
+    }
+
+    std::vector<int64_t> reversed;
+    tree.forEach([&reversed](int64_t key, int64_t) { reversed.push_back(key); }, true);
+    if (!std::equal(reversed.begin(), reversed.end(), reference.rbegin(),
+                    [](int64_t key, const std::pair<const int64_t, int64_t>& entry) { return key == entry.first; }))
+        throw std::runtime_error("ERROR: B-tree reverse visit failed");
+
+    // Numbers are ordered by value across representations
+    VM vm;
+    Object* big = Object::create(TokenType::TypeInt);
+    mpz_ui_pow_ui(big->mpz, 2, 100);
+    track(big);
+    Object* half = track(Object::create(TokenType::TypeFloat));
+    mpf_set_d(half->mpf, 0.5);
+
+    OrderedSet set;
+    set.insert(big, NoValue());
+    set.insert(Object::makeDouble(std::nan("")), NoValue());
+    set.insert(half, NoValue());
+    set.insert(Object::makeDouble(-1), NoValue());
+    set.insert(Object::makeInt(1), NoValue());
+
+    std::string order;
+    set.forEach([&order](Object* key, NoValue) { order += key->toString() + " "; });
+    if (order != "-1 0.5 1 1267650600228229401496703205376 nan ")
+        throw std::runtime_error("ERROR: numbers are ordered incorrectly: " + order);
+
+    std::cout << "B-tree test completed" << std::endl;
+}
+
+void testPersistent()
+{
+    VM vm;
+    std::mt19937 rng(11);
+
+    std::vector<Object*> values;
+    for (int64_t i = 0; i < 40000; i++)
+        values.push_back(Object::makeInt(i));
+
+    // Enough elements for a tree of four levels, checking that old versions are unaffected by later updates
+    std::vector<std::pair<PersistentVector, std::vector<Object*>>> versions;
+    PersistentVector vec;
+    std::vector<Object*> expected;
+
+    for (Object* value : values)
+    {
+        vec = vec.append(value);
+        expected.push_back(value);
+
+        if (rng() % 4000 == 0)
+            versions.emplace_back(PersistentVector(vec), expected);
+    }
+
+    for (int i = 0; i < 2000; i++)
+    {
+        size_t index = rng() % expected.size();
+        Object* value = values[rng() % values.size()];
+
+        vec = vec.set(index, value);
+        expected[index] = value;
+    }
+
+    versions.emplace_back(PersistentVector(vec), expected);
+
+    // Popping down to empty shrinks the tree a level at a time
+    while (expected.size() > 0)
+    {
+        vec = vec.pop();
+        expected.pop_back();
+
+        if (expected.size() % 9999 == 0)
+            versions.emplace_back(PersistentVector(vec), expected);
+    }
+
+    for (const auto& version : versions)
+    {
+        if (version.first.size() != version.second.size())
+            throw std::runtime_error("ERROR: persistent vector version has the wrong size");
+
+        size_t index = 0;
+        version.first.forEach([&](Object* value)
+        {
+            if (value != version.second[index] || version.first.get(index) != value)
+                throw std::runtime_error("ERROR: persistent vector version changed");
+            index++;
+        });
+    }
+
+    PersistentVector small = versions.front().first.insert(3, values[7]).erase(0);
+    if (small.get(2) != values[7] || small.size() != versions.front().first.size())
+        throw std::runtime_error("ERROR: persistent vector insert or erase failed");
+
+    // Versions sharing nodes visit them once per epoch, as the collector does
+    PersistentVector full;
+    for (Object* value : values)
+        full = full.append(value);
+
+    PersistentVector updated = full.set(0, values[1]);
+    size_t visits = 0;
+    full.forEachUnvisited(1, [&](Object*) { visits++; });
+    updated.forEachUnvisited(1, [&](Object*) { visits++; });
+    if (visits != full.size() + PersistentVector::WIDTH)
+        throw std::runtime_error("ERROR: persistent vector nodes shared by versions should be visited once");
+
+    visits = 0;
+    updated.forEachUnvisited(2, [&](Object*) { visits++; });
+    if (visits != updated.size())
+        throw std::runtime_error("ERROR: persistent vector nodes should be visited again in a new epoch");
+
+    // Maps, checked against a reference map at every version kept
+    std::vector<std::pair<PersistentMap, std::unordered_map<Object*, Object*>>> maps;
+    PersistentMap map;
+    std::unordered_map<Object*, Object*> reference;
+
+    for (int i = 0; i < 30000; i++)
+    {
+        Object* key = values[rng() % 10000];
+        if (rng() % 3 == 0)
+        {
+            map = map.erase(key);
+            reference.erase(key);
+        }
+        else
+        {
+            map = map.put(key, values[i]);
+            reference[key] = values[i];
+        }
+
+        if (i % 5000 == 0)
+            maps.emplace_back(PersistentMap(map), reference);
+    }
+
+    maps.emplace_back(PersistentMap(map), reference);
+
+    for (const auto& version : maps)
+    {
+        if (version.first.size() != version.second.size())
+            throw std::runtime_error("ERROR: persistent map version has the wrong size");
+
+        for (const auto& entry : version.second)
+        {
+            if (version.first.find(entry.first) != entry.second)
+                throw std::runtime_error("ERROR: persistent map lookup failed");
+        }
+
+        size_t visited = 0;
+        version.first.forEach([&](Object* key, Object* value)
+        {
+            if (version.second.at(key) != value)
+                throw std::runtime_error("ERROR: persistent map iteration failed");
+            visited++;
+        });
+
+        if (visited != version.second.size())
+            throw std::runtime_error("ERROR: persistent map iteration failed");
+    }
+
+    PersistentMap updatedMap = map.put(values[0], values[1]);
+    size_t mapVisits = 0;
+    map.forEachUnvisited(1, [&](Object*, Object*) { mapVisits++; });
+    updatedMap.forEachUnvisited(1, [&](Object*, Object*) { mapVisits++; });
+    if (mapVisits >= map.size() + updatedMap.size() / 2)
+        throw std::runtime_error("ERROR: persistent map nodes shared by versions should be visited once");
+
+    // Erasing everything leaves the empty map
+    for (const auto& entry : reference)
+        map = map.erase(entry.first);
+
+    if (map.size() != 0 || !map.sameVersion(PersistentMap()))
+        throw std::runtime_error("ERROR: persistent map should be empty");
+
+    std::cout << "Persistent collections test completed" << std::endl;
+}
+
+void testRope()
+{
+    std::mt19937 rng(13);
+
+    // Random edits, checked against a string, with copies taken along the way to check sharing
+    std::vector<std::pair<Rope, std::string>> versions;
+    Rope rope;
+    std::string expected;
+
+    for (int i = 0; i < 20000; i++)
+    {
+        std::string piece(rng() % 40, (char) ('a' + rng() % 26));
+        size_t op = rng() % 10;
+
+        if (op < 6 || expected.empty())
+        {
+            rope.append(piece);
+            expected += piece;
+        }
+        else if (op == 6)
+        {
+            size_t index = rng() % (expected.size() + 1);
+            rope.insert(index, Rope(piece));
+            expected.insert(index, piece);
+        }
+        else if (op == 7)
+        {
+            size_t index = rng() % expected.size();
+            rope.erase(index);
+            expected.erase(index, 1);
+        }
+        else if (op == 8)
+        {
+            size_t index = rng() % expected.size();
+            rope.set(index, 'Z');
+            expected[index] = 'Z';
+        }
+        else
+        {
+            // Appending a slice of itself
+            size_t start = rng() % expected.size();
+            size_t end = start + rng() % (std::min(expected.size() - start, (size_t) 2000) + 1);
+            rope.append(rope.slice(start, end));
+            expected += expected.substr(start, end - start);
+        }
+
+        if (i % 2000 == 0)
+            versions.emplace_back(Rope(rope), expected);
+    }
+
+    versions.emplace_back(Rope(rope), expected);
+
+    for (const auto& version : versions)
+    {
+        if (version.first.size() != version.second.size() || version.first.flatten() != version.second)
+            throw std::runtime_error("ERROR: rope version changed");
+
+        for (int i = 0; i < 100 && !version.second.empty(); i++)
+        {
+            size_t index = rng() % version.second.size();
+            if (version.first.at(index) != version.second[index])
+                throw std::runtime_error("ERROR: rope at failed");
+        }
+
+        // Kept balanced
+        size_t leaves = version.first.size() / Rope::LEAF_SIZE + 1;
+        if (version.first.depth() > 2 * (size_t) std::log2(leaves) + 4)
+            throw std::runtime_error("ERROR: rope is unbalanced");
+    }
+
+    // Appending single chars extends the last leaf in place
+    Rope builder;
+    for (int i = 0; i < 100000; i++)
+    {
+        char ch = (char) ('0' + i % 10);
+        builder.append(&ch, 1);
+    }
+
+    if (builder.size() != 100000 || builder.at(12345) != '5' || builder.depth() > 20)
+        throw std::runtime_error("ERROR: rope builder failed");
+
+    std::cout << "Rope test completed" << std::endl;
+}
+
+void testIntern()
+{
+    InternTable& table = InternTable::instance();
+
+    InternedString* held = table.intern("interned literal");
+    if (table.intern(std::string("interned ") + "literal") != held || held->hash != std::hash<std::string>()("interned literal"))
+        throw std::runtime_error("ERROR: interning the same text should give the same string");
+    table.release(held);
+
+    // Literals of programs parsed by different VMs share the text
+    for (int i = 0; i < 2; i++)
+    {
+        VM vm;
+        std::istringstream source("push string \"interned literal\"\npush symbol \"interned literal\"\n");
+
+        AsmParser parser(vm);
+        parser.parse(source, "intern");
+        vm.eval();
+
+        Stack* stack = vm.root->fndata->stack;
+        Object* literal = stack->at(stack->size() - 2);
+        Object* symbol = stack->back();
+        if (literal->str_value != held || symbol->str_value != held || !literal->hasFlag(FLAG_INTERNED))
+            throw std::runtime_error("ERROR: literals should share the interned text");
+    }
+
+    table.release(held);
+
+    // Threads interning and releasing the same texts, like the mutator and the background sweeper
+    size_t initial = table.size();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&table]()
+        {
+            for (int i = 0; i < 20000; i++)
+            {
+                InternedString* str = table.intern("text " + std::to_string(i % 100));
+                InternTable::retain(str);
+                table.release(str);
+                table.release(str);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (table.size() != initial)
+        throw std::runtime_error("ERROR: released strings should leave the intern table");
+
+    std::cout << "Intern table test completed" << std::endl;
+}
+
 int main(int argc, const char * argv[])
 {
     lake::OptParser opt;
@@ -298,6 +1301,23 @@ int main(int argc, const char * argv[])
         testAdd();
         testIfElse();
         fact();
+        fact(VM::Engine::Bytecode);
+        testIncrementalGC();
+        testBackgroundSweep();
+        testParallelMark();
+        testHeapPages();
+        testSlab();
+        testHeapLimit();
+        testGCStats();
+        testCodeArena();
+        testScratchRegions();
+        testTypedArrays();
+        testReductions();
+        testHashTable();
+        testBTree();
+        testPersistent();
+        testRope();
+        testIntern();
     }
     catch (std::exception& ex)
     {
@@ -0,0 +1,178 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include "../vmlib/Object.h"
+#include "../vmlib/VM.h"
+#include "../vmlib/OptParser.h"
+
+/*
+ * Compares umap storage with std::unordered_map hashing keys through toString(), which
+ * is how umap worked before it had its own table. Keys are long: big integers, floats
+ * with many limbs and long strings. Lookups use distinct key objects equal to the
+ * stored ones, so every lookup hashes its key. Each measurement is the best round.
+ *
+ *   bench-hash [--keys N] [--rounds N]
+ */
+
+using namespace std;
+
+namespace lake {
+
+// The hash umap used previously: numbers were converted to strings
+struct StringConversionHash
+{
+    size_t operator()(Object* o) const
+    {
+        if (o->otype == TokenType::TypeInt || o->otype == TokenType::TypeFloat)
+        {
+            size_t seed = 0;
+            hash_combine(seed, o->otype);
+            hash_combine(seed, o->toString());
+            return seed;
+        }
+
+        return std::hash<Object*>()(o);
+    }
+};
+
+using LegacyMap = std::unordered_map<Object*, Object*, StringConversionHash, std::equal_to<Object*>>;
+
+Object* longInt(int64_t i)
+{
+    Object* res = Object::create(TokenType::TypeInt);
+    mpz_ui_pow_ui(res->mpz, 2, 256);
+    mpz_add_ui(res->mpz, res->mpz, (unsigned long) i * 7919);
+    return res;
+}
+
+Object* longFloat(int64_t i)
+{
+    Object* res = Object::create(TokenType::TypeFloat);
+    mpf_set_si(res->mpf, i);
+    mpf_div_ui(res->mpf, res->mpf, 7);
+    return res;
+}
+
+Object* longString(int64_t i)
+{
+    std::string str = std::string(56, 'k') + std::to_string(i);
+    return Object::create((char*) str.c_str());
+}
+
+// Builds a map with 'fill' each round, and times 'work' on it
+template <typename Map>
+double measure(int rounds, std::function<void(Map&)> fill, std::function<void(Map&)> work)
+{
+    double best = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        Map map;
+        fill(map);
+
+        auto start = chrono::steady_clock::now();
+        work(map);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        if (i == 0 || ms < best)
+            best = ms;
+    }
+
+    return best;
+}
+
+template <typename Map>
+void bench(const char* impl, const char* name, const std::vector<Object*>& keys,
+           const std::vector<Object*>& probes, const std::vector<Object*>& misses, int rounds)
+{
+    Object* value = &Object::trueObject();
+
+    auto none = [](Map&) {};
+    auto insert = [&](Map& map)
+    {
+        for (Object* key : keys)
+            map[key] = value;
+    };
+
+    size_t found = 0;
+    auto lookup = [&](Map& map)
+    {
+        for (Object* probe : probes)
+            found += map.find(probe) != map.end() ? 1 : 0;
+        for (Object* miss : misses)
+            found += map.find(miss) != map.end() ? 1 : 0;
+    };
+
+    double insertMs = measure<Map>(rounds, none, insert);
+    double lookupMs = measure<Map>(rounds, insert, lookup);
+
+    if (found != probes.size() * rounds)
+        throw std::runtime_error("Lookups found the wrong number of keys");
+
+    cout << left << setw(8) << impl << setw(8) << name
+         << right << setw(10) << keys.size() << " keys"
+         << setw(10) << fixed << setprecision(2) << insertMs << " ms insert"
+         << setw(10) << lookupMs << " ms lookup" << endl;
+}
+
+void benchKeys(const char* name, Object* (*make)(int64_t), int64_t count, int rounds)
+{
+    std::vector<Object*> keys, probes, misses;
+    for (int64_t i = 0; i < count; i++)
+    {
+        keys.push_back(make(i));
+        probes.push_back(make(i));
+        misses.push_back(make(count + i));
+    }
+
+    std::shuffle(probes.begin(), probes.end(), std::mt19937(42));
+
+    bench<LegacyMap>("string", name, keys, probes, misses, rounds);
+    bench<ObjectMap>("flat", name, keys, probes, misses, rounds);
+}
+
+}//ns
+
+using namespace lake;
+
+int main(int argc, const char * argv[])
+{
+    lake::OptParser opt;
+    opt.addOption("help", "h", "Display usage information");
+    opt.addOption("keys", "", "Number of keys per map", 1);
+    opt.addOption("rounds", "", "Number of times each map is built", 1);
+
+    const char* error = opt.parse(argc, argv);
+    if(error)
+    {
+        printf("Invalid options: %s\n", error);
+        return 1;
+    }
+
+    if(opt.hasOption("help"))
+    {
+        opt.printUsage();
+        return 0;
+    }
+
+    int64_t keys = opt.hasOption("keys") ? std::stoll(opt.getFirstValue("keys")) : 200000;
+    int rounds = opt.hasOption("rounds") ? std::stoi(opt.getFirstValue("rounds")) : 5;
+
+    try
+    {
+        VM vm;
+
+        benchKeys("int", longInt, keys, rounds);
+        benchKeys("float", longFloat, keys, rounds);
+        benchKeys("string", longString, keys, rounds);
+    }
+    catch (std::exception& ex)
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
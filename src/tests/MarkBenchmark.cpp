@@ -0,0 +1,178 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include "../vmlib/Object.h"
+#include "../vmlib/VM.h"
+#include "../vmlib/Stack.h"
+#include "../vmlib/OptParser.h"
+
+/*
+ * Measures mark throughput on deep and wide object graphs. Each graph is rooted on the
+ * stack and marked a number of rounds, reporting the best round. Sweeping in between
+ * only clears the marks, as everything is reachable.
+ *
+ *   bench-mark [--objects N] [--rounds N] [--threads N]
+ */
+
+using namespace std;
+
+namespace lake {
+
+Object* newInt(int64_t value)
+{
+    return track(Object::create(value));
+}
+
+Object* newPair(Object* first, Object* second)
+{
+    return track(Object::create(new std::pair<Object*,Object*>(first, second)));
+}
+
+Object* newArray()
+{
+    return track(Object::create(new std::vector<Object*>()));
+}
+
+// Pairs linked through their second element, allocated in list order
+Object* pairChain(int64_t count)
+{
+    Object* head = nullptr;
+    for (int64_t i = 0; i < count; i++)
+        head = newPair(newInt(i), head);
+
+    return head;
+}
+
+// Pairs linked in random order, so following the chain jumps around the heap
+Object* shuffledPairChain(int64_t count)
+{
+    std::vector<Object*> pairs;
+    for (int64_t i = 0; i < count; i++)
+        pairs.push_back(newPair(newInt(i), nullptr));
+
+    std::shuffle(pairs.begin(), pairs.end(), std::mt19937(42));
+
+    for (size_t i = 1; i < pairs.size(); i++)
+        pairs[i-1]->pair->second = pairs[i];
+
+    return pairs.front();
+}
+
+// Each array holds an integer and the next array
+Object* arrayChain(int64_t count)
+{
+    Object* head = newArray();
+    Object* tail = head;
+    for (int64_t i = 0; i < count; i++)
+    {
+        Object* next = newArray();
+        tail->array->push_back(newInt(i));
+        tail->array->push_back(next);
+        tail = next;
+    }
+
+    return head;
+}
+
+// A single array of integers
+Object* wideArray(int64_t count)
+{
+    Object* arr = newArray();
+    for (int64_t i = 0; i < count; i++)
+        arr->array->push_back(newInt(i));
+
+    return arr;
+}
+
+// An array of arrays, each holding 16 integers
+Object* wideTree(int64_t count)
+{
+    Object* arr = newArray();
+    for (int64_t i = 0; i < count / 16; i++)
+    {
+        Object* inner = newArray();
+        for (int j = 0; j < 16; j++)
+            inner->array->push_back(newInt(i * 16 + j));
+        arr->array->push_back(inner);
+    }
+
+    return arr;
+}
+
+void bench(const char* name, std::function<Object*(int64_t)> build, int64_t count, int rounds, int threads)
+{
+    VM vm;
+    vm.markThreads = threads;
+    vm.parallelMarkThreshold = 0;
+
+    // The root function's stack is marked even before evaluation starts
+    vm.root->fndata->stack->push_back(build(count));
+
+    double best = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        vm.mark();
+        auto end = chrono::steady_clock::now();
+
+        vm.sweep();
+
+        double ms = chrono::duration<double, milli>(end - start).count();
+        if (i == 0 || ms < best)
+            best = ms;
+    }
+
+    cout << left << setw(22) << name
+         << right << setw(10) << vm.numObjects << " objects"
+         << setw(10) << fixed << setprecision(2) << best << " ms"
+         << setw(10) << setprecision(1) << (vm.numObjects / best / 1000.0) << " Mobj/s" << endl;
+}
+
+}//ns
+
+using namespace lake;
+
+int main(int argc, const char * argv[])
+{
+    lake::OptParser opt;
+    opt.addOption("help", "h", "Display usage information");
+    opt.addOption("objects", "", "Approximate number of objects per graph", 1);
+    opt.addOption("rounds", "", "Number of times each graph is marked", 1);
+    opt.addOption("threads", "", "Number of marking threads", 1);
+
+    const char* error = opt.parse(argc, argv);
+    if(error)
+    {
+        printf("Invalid options: %s\n", error);
+        return 1;
+    }
+
+    if(opt.hasOption("help"))
+    {
+        opt.printUsage();
+        return 0;
+    }
+
+    int64_t objects = opt.hasOption("objects") ? std::stoll(opt.getFirstValue("objects")) : 1000000;
+    int rounds = opt.hasOption("rounds") ? std::stoi(opt.getFirstValue("rounds")) : 5;
+    int threads = opt.hasOption("threads") ? std::stoi(opt.getFirstValue("threads")) : 1;
+
+    try
+    {
+        bench("pair chain", pairChain, objects / 2, rounds, threads);
+        bench("pair chain, shuffled", shuffledPairChain, objects / 2, rounds, threads);
+        bench("array chain", arrayChain, objects / 2, rounds, threads);
+        bench("wide array", wideArray, objects, rounds, threads);
+        bench("wide tree", wideTree, objects, rounds, threads);
+    }
+    catch (std::exception& ex)
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -24,7 +24,7 @@ int main(int argc, const char * argv[])
 
             VM vm;
 
-            std::istringstream str(std::string(res->data));
+            std::istringstream str(std::string(res->data, res->length));
             AsmParser(vm).parse(str, res->path);
 
             vm.eval();
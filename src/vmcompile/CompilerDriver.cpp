@@ -5,12 +5,34 @@
 #include "../vmlib/OptParser.h"
 #include "../vmlib/AsmParser.h"
 #include "../vmlib/Bundles.h"
+#include "../vmlib/Image.h"
 #include "../vmplatform/Platform.h"
 
 using namespace std;
 
 using namespace lake;
 
+/**
+ * Parses a byte count, with an optional K, M or G suffix
+ */
+static int64_t parseBytes(const std::string& value)
+{
+    size_t end = 0;
+    int64_t bytes = std::stoll(value, &end);
+
+    std::string suffix = value.substr(end);
+    if (suffix == "K" || suffix == "k")
+        bytes *= 1024;
+    else if (suffix == "M" || suffix == "m")
+        bytes *= 1024 * 1024;
+    else if (suffix == "G" || suffix == "g")
+        bytes *= 1024 * 1024 * 1024;
+    else if (!suffix.empty())
+        throw std::invalid_argument("invalid byte count " + value);
+
+    return bytes;
+}
+
 int main(int argc, const char * argv[])
 {
     int exitcode = 0;
@@ -23,12 +45,29 @@ int main(int argc, const char * argv[])
     opt.addOption("run", "r", "Execute files directly. Specify input files with --source.");
     opt.addOption("source", "s", "Parse input file(s)", -1);
     opt.addOption("externalize", "", "Write assembly to file", 1);
+    opt.addOption("image", "", "Write precompiled binary image (.lakeb) to file. Images can be passed to --source.", 1);
     opt.addOption("dbg", "", "Include and use debug information. This may substantially affect performance.", -1);
     opt.addOption("appname", "", "Optional application name. Used as user subdir when exporting resources.", 1);
     opt.addOption("resource", "", "Embed these files", -1);
     opt.addOption("build", "b", "Create a binary with the given name. Requires --build-interpreter and --source, optionally --resource.", 1);
     opt.addOption("build-interpreter","", "Path to interpreter. The source input will be compressed and added to this executable.",1);
+    opt.addOption("precompile", "", "Bundle sources as precompiled images when using --build");
     opt.addOption("exec", "e", "Execute bundle attached to this executable");
+    opt.addOption("engine", "", "Execution engine: tree (default) or bytecode", 1);
+    opt.addOption("quicken", "", "Specialize instructions on observed operand types in the tree walker: on (default) or off", 1);
+    opt.addOption("gc", "", "Garbage collector mode: full (default), generational or incremental", 1);
+    opt.addOption("gc-sweep", "", "Sweeping in full mode: inline (default) or background", 1);
+    opt.addOption("gc-threads", "", "Number of threads marking the heap in full and minor collections", 1);
+    opt.addOption("nursery", "", "Number of new objects which triggers a minor collection in generational mode", 1);
+    opt.addOption("gc-slice", "", "Maximum number of objects traced or swept per slice in incremental mode", 1);
+    opt.addOption("gc-slice-us", "", "Maximum duration of a slice in microseconds in incremental mode", 1);
+    opt.addOption("heap-target", "", "Minimum heap size in bytes which triggers a full collection, with an optional K, M or G suffix", 1);
+    opt.addOption("heap-growth", "", "Heap growth between full collections, relative to the bytes surviving a collection", 1);
+    opt.addOption("heap-limit", "", "Maximum heap size in bytes, with an optional K, M or G suffix. Exceeding it is a runtime error.", 1);
+    opt.addOption("gc-log", "", "Append a JSON line per collection to this file", 1);
+    opt.addOption("scratch-regions", "", "Allocate between commit and revert in a heap region, whose unreachable objects are freed on revert");
+    opt.addOption("huge-pages", "", "Back slab allocators with huge pages where available");
+    opt.addOption("numcache", "", "Number of recycled int/float values kept per size class. 0 disables the cache.", 1);
 
     const char* error = opt.parse(argc, argv);
     if(error)
@@ -74,6 +113,125 @@ int main(int argc, const char * argv[])
         return 0;
     }
 
+    VM::Engine engine = VM::Engine::TreeWalker;
+    if (opt.hasOption("engine"))
+    {
+        std::string name = opt.getFirstValue("engine");
+        if (name == "bytecode")
+            engine = VM::Engine::Bytecode;
+        else if (name != "tree")
+        {
+            printf("Invalid options: unknown engine %s\n", name.c_str());
+            return 1;
+        }
+    }
+
+    bool quicken = true;
+    if (opt.hasOption("quicken"))
+    {
+        std::string value = opt.getFirstValue("quicken");
+        if (value == "off")
+            quicken = false;
+        else if (value != "on")
+        {
+            printf("Invalid options: quicken must be on or off\n");
+            return 1;
+        }
+    }
+
+    VM::GCMode gcMode = VM::GCMode::Full;
+    if (opt.hasOption("gc"))
+    {
+        std::string name = opt.getFirstValue("gc");
+        if (name == "generational")
+            gcMode = VM::GCMode::Generational;
+        else if (name == "incremental")
+            gcMode = VM::GCMode::Incremental;
+        else if (name != "full")
+        {
+            printf("Invalid options: unknown gc mode %s\n", name.c_str());
+            return 1;
+        }
+    }
+
+    bool backgroundSweep = false;
+    if (opt.hasOption("gc-sweep"))
+    {
+        std::string value = opt.getFirstValue("gc-sweep");
+        if (value == "background")
+            backgroundSweep = true;
+        else if (value != "inline")
+        {
+            printf("Invalid options: gc-sweep must be inline or background\n");
+            return 1;
+        }
+    }
+
+    int markThreads = 1;
+    if (opt.hasOption("gc-threads"))
+    {
+        markThreads = std::max(1, std::stoi(opt.getFirstValue("gc-threads")));
+    }
+
+    int64_t nursery = 0;
+    if (opt.hasOption("nursery"))
+    {
+        nursery = std::stoll(opt.getFirstValue("nursery"));
+    }
+
+    int64_t sliceBudget = 0;
+    if (opt.hasOption("gc-slice"))
+    {
+        sliceBudget = std::stoll(opt.getFirstValue("gc-slice"));
+    }
+
+    int64_t sliceMicros = 0;
+    if (opt.hasOption("gc-slice-us"))
+    {
+        sliceMicros = std::stoll(opt.getFirstValue("gc-slice-us"));
+    }
+
+    int64_t heapTarget = 0;
+    int64_t heapLimit = 0;
+    double heapGrowth = 0;
+    try
+    {
+        if (opt.hasOption("heap-target"))
+            heapTarget = parseBytes(opt.getFirstValue("heap-target"));
+        if (opt.hasOption("heap-limit"))
+            heapLimit = parseBytes(opt.getFirstValue("heap-limit"));
+        if (opt.hasOption("heap-growth"))
+            heapGrowth = std::stod(opt.getFirstValue("heap-growth"));
+    }
+    catch (std::exception& ex)
+    {
+        printf("Invalid options: %s\n", ex.what());
+        return 1;
+    }
+
+    if (opt.hasOption("heap-growth") && heapGrowth <= 1.0)
+    {
+        printf("Invalid options: heap-growth must be greater than 1\n");
+        return 1;
+    }
+
+    std::ofstream gcLog;
+    if (opt.hasOption("gc-log"))
+    {
+        gcLog.open(opt.getFirstValue("gc-log"), std::ios::app);
+        if (!gcLog)
+        {
+            printf("Invalid options: cannot open gc-log file %s\n", opt.getFirstValue("gc-log").c_str());
+            return 1;
+        }
+    }
+
+    size_t numcache = NumCache::DEFAULT_CAPACITY;
+    if (opt.hasOption("numcache"))
+    {
+        numcache = (size_t) std::stoul(opt.getFirstValue("numcache"));
+    }
+
     auto start = chrono::steady_clock::now();
 
     // Test self-execution. An actual bundle executable will pass arguments directly to the VM.
@@ -96,8 +254,21 @@ int main(int argc, const char * argv[])
                 std::cout << "Resource: " << entry.first.c_str() << ", len: " << res->length << std::endl;
 
                 VM vm;
+                vm.setEngine(engine);
+                vm.quicken = quicken;
+                vm.gcMode = gcMode;
+                vm.backgroundSweep = backgroundSweep;
+                vm.markThreads = markThreads;
+                vm.scratchRegions = opt.hasOption("scratch-regions");
+                if (nursery > 0) vm.nurseryTriggerGC = nursery;
+                if (sliceBudget > 0) vm.sliceBudget = sliceBudget;
+                vm.sliceMicros = sliceMicros;
+                vm.numcache.setCapacity(numcache);
+                vm.fnpool.setHugePages(opt.hasOption("huge-pages"));
+                vm.setHeapLimits(heapTarget, heapGrowth, heapLimit);
+                if (gcLog.is_open()) vm.gcStats.log = &gcLog;
 
-                std::istringstream str(std::string(res->data));
+                std::istringstream str(std::string(res->data, res->length));
                 AsmParser(vm).parse(str, res->path);
 
                 vm.eval();
@@ -110,11 +281,24 @@ int main(int argc, const char * argv[])
     // This code is basically all a hosting interpreter frontend needs to do in order to
     // parse and execute generated Lake code. This allows vmlib to be linked, along with runtime
     // libraries for the host language, producing a single binary for the frontend.
-    if (opt.hasOption("run") || opt.hasOption("build") || opt.hasOption("externalize"))
+    if (opt.hasOption("run") || opt.hasOption("build") || opt.hasOption("externalize") || opt.hasOption("image"))
     {
         try
         {
             VM vm;
+            vm.setEngine(engine);
+            vm.quicken = quicken;
+            vm.gcMode = gcMode;
+            vm.backgroundSweep = backgroundSweep;
+            vm.markThreads = markThreads;
+            vm.scratchRegions = opt.hasOption("scratch-regions");
+            if (nursery > 0) vm.nurseryTriggerGC = nursery;
+            if (sliceBudget > 0) vm.sliceBudget = sliceBudget;
+            vm.sliceMicros = sliceMicros;
+            vm.numcache.setCapacity(numcache);
+            vm.fnpool.setHugePages(opt.hasOption("huge-pages"));
+            vm.setHeapLimits(heapTarget, heapGrowth, heapLimit);
+            if (gcLog.is_open()) vm.gcStats.log = &gcLog;
             Object::setDefaultPrecision(128);
 
             // Only parses the first file (TODO: the rest...)
@@ -130,6 +314,11 @@ int main(int argc, const char * argv[])
                 os.close();
             }
 
+            if (opt.hasOption("image"))
+            {
+                ImageWriter::write(opt.getFirstValue("source"), opt.getFirstValue("image"));
+            }
+
             if (opt.hasOption("run"))
             {
                 vm.eval();
@@ -138,7 +327,8 @@ int main(int argc, const char * argv[])
             {
                 if (opt.hasOption("build-interpreter"))
                 {
-                    BundleWriter bw(opt.getFirstValue("build"), opt.getFirstValue("build-interpreter"), opt.getOption("source")->values);
+                    BundleWriter bw(opt.getFirstValue("build"), opt.getFirstValue("build-interpreter"), opt.getOption("source")->values,
+                                    opt.hasOption("precompile"));
                     bw.execute();
                 }
                 else
@@ -151,6 +341,7 @@ int main(int argc, const char * argv[])
             if (Process::instance().traceLevel >= Process::DEBUG)
             {
                 std::cout << "Execution completed successfully" << std::endl;
+                vm.dumpAllocStats();
             }
         }
         catch (std::exception& ex)
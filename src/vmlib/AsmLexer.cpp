@@ -3,6 +3,8 @@
 
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
+#include <iterator>
 
 namespace lake
 {
@@ -58,7 +60,7 @@ std::unordered_set<TokenInfo> cache
                 {TOK_COLLGET,                    174, TokenType::CollGet},
                 {TOK_COLLPUT,                    175, TokenType::CollPut},
                 {TOK_COLLDEL,                    176, TokenType::CollDel},
-                {TOK_COLLCONTAINS,               176, TokenType::CollContains},
+                {TOK_COLLCONTAINS,               253, TokenType::CollContains},
                 {TOK_FRAME,                      177, TokenType::Frame},
                 {TOK_GC,                         178, TokenType::GC},
                 {TOK_EVAL,                       179, TokenType::Eval},
@@ -72,6 +74,7 @@ std::unordered_set<TokenInfo> cache
                 {TOK_TYPEOBJECT,                 187, TokenType::TypeObject},
                 {TOK_TYPEINT,                    188, TokenType::TypeInt},
                 {TOK_TYPEFLOAT,                  189, TokenType::TypeFloat},
+                {TOK_TYPEDOUBLE,                 254, TokenType::TypeDouble},
                 {TOK_TYPESTRING,                 190, TokenType::TypeString},
                 {TOK_TYPECHAR,                   191, TokenType::TypeChar},
                 {TOK_TYPEBOOL,                   192, TokenType::TypeBool},
@@ -112,6 +115,15 @@ std::unordered_set<TokenInfo> cache
                 {TOK_CHECKPOINT,                 227, TokenType::Checkpoint},
                 {TOK_TYPEUNORDEREDMAP,           228, TokenType::TypeUnorderedMap},
                 {TOK_TYPEUNORDEREDSET,           229, TokenType::TypeUnorderedSet},
+                {TOK_TYPEORDEREDMAP,             142, TokenType::TypeOrderedMap},
+                {TOK_TYPEORDEREDSET,             255, TokenType::TypeOrderedSet},
+
+                // Codes from 128 up are taken, so further keywords continue after the fixed codes
+                {TOK_TYPEPERSISTENTVECTOR,       8,   TokenType::TypePersistentVector},
+                {TOK_TYPEPERSISTENTMAP,          9,   TokenType::TypePersistentMap},
+                {TOK_TYPEROPE,                   10,  TokenType::TypeRope},
+                {TOK_TYPESYMBOL,                 11,  TokenType::TypeSymbol},
+
                 {TOK_COLLFOREACH,                230, TokenType::CollForeach},
                 {TOK_COLL,                       231, TokenType::Coll},
                 {TOK_COLLAPPEND,                 232, TokenType::CollAppend},
@@ -137,6 +149,77 @@ std::unordered_set<TokenInfo> cache
                 {TOK_EXPRLIST,                   252, TokenType::TypeExprListObject},
         };
 
+// Binary codes for tokens that aren't keywords. These must never change, since
+// they're part of the precompiled image format.
+static const TokenInfo nonKeywordTokens[]
+        {
+                {"\n",                           1, TokenType::NewLine},
+                {"",                             2, TokenType::Identifier},
+                {"-",                            3, TokenType::Minus},
+                {"",                             4, TokenType::IntegerLiteral},
+                {"",                             5, TokenType::FloatLiteral},
+                {"",                             6, TokenType::CharLiteral},
+                {"",                             7, TokenType::StringLiteral},
+        };
+
+/**
+ * Code <-> type lookup tables for precompiled images, built from the keyword table
+ * on first use.
+ */
+struct TokenCodeTable
+{
+    uint8_t codes[256] = {};
+    TokenType types[256];
+    const char* lexemes[256] = {};
+
+    TokenCodeTable()
+    {
+        std::fill(std::begin(types), std::end(types), TokenType::Invalid);
+
+        auto add = [this](const TokenInfo& info)
+        {
+            // Tokens injected by frontends may lack a code
+            if (info.code == 0)
+                return;
+
+            types[info.code] = info.type;
+            lexemes[info.code] = info.lexeme;
+
+            // Several lexemes may map to the same type; keep the lowest code
+            auto& code = codes[(uint8_t) info.type];
+            if (code == 0 || info.code < code)
+                code = info.code;
+        };
+
+        for (const auto& info : nonKeywordTokens)
+            add(info);
+        for (const auto& info : cache)
+            add(info);
+    }
+
+    static const TokenCodeTable& instance()
+    {
+        static TokenCodeTable table;
+        return table;
+    }
+};
+
+uint8_t Lexer::getTokenCode(TokenType type)
+{
+    return TokenCodeTable::instance().codes[(uint8_t) type];
+}
+
+TokenType Lexer::getTokenType(uint8_t code)
+{
+    return TokenCodeTable::instance().types[code];
+}
+
+const char* Lexer::getTokenLexeme(uint8_t code)
+{
+    auto lexeme = TokenCodeTable::instance().lexemes[code];
+    return lexeme != nullptr ? lexeme : "";
+}
+
 Lexer::Lexer(std::istream& stream, size_t fileIndex, bool skipNewLine)
         : input(stream), skipNewLine(skipNewLine)
 {
@@ -146,13 +146,13 @@ public:
     inline bool isBasicTypeName()
     {
         return isNumericTypeName() ||
-               type == TokenType::TypeString || type == TokenType::TypeBool ||
+               type == TokenType::TypeString || type == TokenType::TypeSymbol || type == TokenType::TypeBool ||
                type == TokenType::TypeChar || type == TokenType::TypeViewPointer;
     }
 
     inline bool isNumericTypeName()
     {
-        return type == TokenType::TypeInt || type == TokenType::TypeFloat;
+        return type == TokenType::TypeInt || type == TokenType::TypeFloat || type == TokenType::TypeDouble;
     }
 
     inline bool isComparison()
@@ -228,11 +228,39 @@ namespace std
 
 namespace lake {
 
+/**
+ * Supplies tokens to the parser. The Lexer produces tokens from textual assembly,
+ * while the ImageReader replays tokens from a precompiled binary image.
+ */
+class TokenSource
+{
+public:
+
+    virtual ~TokenSource() {}
+
+    /**
+     * Reads the next token
+     *
+     * @param token Receives the token
+     */
+    virtual void tokenize(Token& token) = 0;
+
+    /**
+     * Bookmarks the current position, see restore()
+     */
+    virtual void mark() = 0;
+
+    /**
+     * Rewind to the last mark position.
+     */
+    virtual void restore() = 0;
+};
+
 /**
  * Lexical analyzer; turns a stream of characters into a set of
  * Token objects.
  */
-class Lexer
+class Lexer : public TokenSource
 {
 public:
 
@@ -250,7 +278,7 @@ public:
      *
      * @param token Receives the token
      */
-    void tokenize(Token& token);
+    void tokenize(Token& token) override;
 
     /**
      * Bookmarks the current position. The lexer can be later rewound to the mark by
@@ -258,12 +286,12 @@ public:
      *
      * The mark position is invalidated by calls to rewind() and restore()
      */
-    void mark();
+    void mark() override;
 
     /**
      * Rewind to the last mark position.
      */
-    void restore();
+    void restore() override;
 
     /**
      * Rewind the input stream pointer.
@@ -293,6 +321,23 @@ public:
      */
     void expandLexer(TokenInfo info);
 
+    /**
+     * Returns the binary code of a token type, as used by precompiled images. Keywords
+     * use the codes in the keyword table; identifiers, literals and newlines have
+     * fixed codes below 128. Returns 0 if the token type has no binary representation.
+     */
+    static uint8_t getTokenCode(TokenType type);
+
+    /**
+     * Returns the token type of a binary code, or TokenType::Invalid if the code is unknown.
+     */
+    static TokenType getTokenType(uint8_t code);
+
+    /**
+     * Returns the keyword of a binary code. This is empty for codes of identifiers and literals.
+     */
+    static const char* getTokenLexeme(uint8_t code);
+
 private:
 
     /**
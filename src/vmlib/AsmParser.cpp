@@ -14,6 +14,7 @@
 #include "ExprConditionalChain.h"
 #include "ExprAssertTrue.h"
 #include "ExprFFI.h"
+#include "Image.h"
 
 namespace lake
 {
@@ -26,24 +27,36 @@ AsmParser::AsmParser(VM& _vm) : vm(_vm)
     localeInfo = localeconv();
 }
 
-void AsmParser::parse(std::string filename, ExprExpressionList* exprList)
+void AsmParser::parse(std::string filename, ExprExpressionList* exprList, CodeArena* arena)
 {
     std::ifstream stream(filename, std::ios::binary);
     if (!stream.good())
         throw AsmException(std::string("Could not open assembly file for reading: ") + filename, Location(0,0,0));
 
-    parse(stream, filename, exprList);
+    parse(stream, filename, exprList, arena);
 }
 
-void AsmParser::parse(std::istream& stream, std::string sourcename, ExprExpressionList* exprList)
+void AsmParser::parse(std::istream& stream, std::string sourcename, ExprExpressionList* exprList, CodeArena* arena)
 {
+    code = arena != nullptr ? arena : &vm.code;
     fileIndex = Process::instance().filenameCount();
+
+    // Precompiled images supply tokens directly; diagnostics refer to the original source
+    if (ImageReader::isImage(stream))
+    {
+        auto reader = std::make_unique<ImageReader>(stream, fileIndex);
+        sourcename = reader->getSourceName();
+        lexer = std::move(reader);
+    }
+    else
+    {
+        lexer = std::make_unique<Lexer>(stream, fileIndex, false /*keep newline*/);
+    }
+
     Process::instance().addFilename(sourcename);
 
     expressionList = exprList != nullptr ? exprList : vm.root->fndata->body;
 
-    lexer = std::make_unique<Lexer>(stream, fileIndex, false /*keep newline*/);
-
     parseExpressions(TokenType::EndOfStream);
 
     if (Process::instance().traceLevel >= Process::DEBUG)
@@ -56,6 +69,12 @@ void AsmParser::parse(std::istream& stream, std::string sourcename, ExprExpressi
     }
 }
 
+Object* AsmParser::literal(Object* obj)
+{
+    code->addRoot(obj);
+    return obj;
+}
+
 void AsmParser::parseExpressions(TokenType until)
 {
     while (true)
@@ -399,38 +418,26 @@ Object* AsmParser::getDefine(bool tokenize)
 
 Object* AsmParser::intToObject(std::string digits)
 {
-    static std::vector<Object> SMALL_CONSTANTS;
-    if (SMALL_CONSTANTS.size() == 0)
-    {
-        SMALL_CONSTANTS.reserve(2049);
-
-        for (int i=-1024; i <= 1024; i++)
-        {
-            mpz_t valInt;
-            mpz_init(valInt);
-            mpz_set_si(valInt, i);
-            SMALL_CONSTANTS.emplace_back(valInt);
-            mpz_clear(valInt);
-        }
-    }
-
-    if (digits.length() <= 4)
-    {
-        int intval = std::stoi(digits);
-        if (intval <= 1024 && intval >= -1024)
-            return &SMALL_CONSTANTS[intval+1024];
-    }
-
     Object* res = nullptr;
 
     mpz_t valInt;
     mpz_init(valInt);
-    mpz_set_str(valInt, digits.c_str(), 0 /* use leading char to determine radix */);
+    if (mpz_set_str(valInt, digits.c_str(), 0 /* use leading char to determine radix */) != 0)
+    {
+        mpz_clear(valInt);
+        throw std::runtime_error("Invalid integer literal: " + digits);
+    }
+
+    // Small literals share the immediates
+    if (mpz_fits_slong_p(valInt) && mpz_cmp_si(valInt, Object::IMMEDIATE_INT_MIN) >= 0 &&
+        mpz_cmp_si(valInt, Object::IMMEDIATE_INT_MAX) <= 0)
+        res = Object::immediate((int64_t) mpz_get_si(valInt));
+    else
+        res = track(new Object(valInt));
 
-    res = new Object(valInt);
     mpz_clear(valInt);
 
-    return track(res);
+    return res;
 }
 
 Object* AsmParser::floatToObject(std::string value, int base)
@@ -451,6 +458,22 @@ Object* AsmParser::floatToObject(std::string value, int base)
     return track(res);
 }
 
+Object* AsmParser::doubleToObject(std::string value)
+{
+    // As with mpf_set_str, strtod expects the locale's decimal point
+    std::replace(value.begin(), value.end(), '.', localeInfo->decimal_point[0]);
+
+    char* end = nullptr;
+    double valDouble = strtod(value.c_str(), &end);
+    if (end == value.c_str() || *end != '\0')
+        throw std::runtime_error("Invalid f64 literal: " + value);
+
+    Object* res = new Object(TokenType::TypeDouble);
+    res->double_value = valDouble;
+
+    return track(res);
+}
+
 std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
 {
     Object* res = nullptr;
@@ -461,7 +484,9 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
     if (tok.isBasicTypeName() || tok.getType() == TokenType::TypeFunction ||
         tok.getType() == TokenType::TypeArray || tok.getType() == TokenType::TypePair ||
         tok.getType() == TokenType::TypeUnorderedMap || tok.getType() == TokenType::TypeUnorderedSet ||
-        tok.getType() == TokenType::TypeObject)
+        tok.getType() == TokenType::TypeOrderedMap || tok.getType() == TokenType::TypeOrderedSet ||
+        tok.getType() == TokenType::TypePersistentVector || tok.getType() == TokenType::TypePersistentMap ||
+        tok.getType() == TokenType::TypeRope || tok.getType() == TokenType::TypeObject)
     {
         Token literalToken;
         lexer->tokenize(literalToken);
@@ -504,6 +529,13 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
             else
                 res = floatToObject(value);
         }
+        else if (tok.getType() == TokenType::TypeDouble)
+        {
+            if (literalToken.getType() == TokenType::Null)
+                res = &Object::nullObject<TokenType::TypeDouble>();
+            else
+                res = doubleToObject(value);
+        }
         else if (tok.getType() == TokenType::TypeBool)
         {
             if (literalToken.getType() == TokenType::Null)
@@ -522,25 +554,30 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
                 res = &Object::nullObject<TokenType::TypeString>();
             else
             {
-                // Grab a copy
-                size_t len = literalToken.getLexeme().length();
-                char* copy = new char[len + 1];
-                literalToken.getLexeme().copy(copy, len, 0);
-                copy[len] = '\0';
-
-                res = track(new Object(copy, FLAG_FREESTORE));
+                // Literals share the interned text, and get a copy of their own if changed
+                res = track(Object::create(InternTable::instance().intern(literalToken.getLexeme()), TokenType::TypeString));
             }
         }
+        else if (tok.getType() == TokenType::TypeSymbol)
+        {
+            if (literalToken.getType() == TokenType::Null)
+                res = &Object::nullObject<TokenType::TypeSymbol>();
+            else
+                res = track(Object::create(InternTable::instance().intern(literalToken.getLexeme()), TokenType::TypeSymbol));
+        }
+        else if (tok.getType() == TokenType::TypeRope)
+        {
+            if (literalToken.getType() == TokenType::Null)
+                res = &Object::nullObject<TokenType::TypeRope>();
+            else
+                res = track(Object::create(new Rope(literalToken.getLexeme())));
+        }
         else if (tok.getType() == TokenType::TypeChar)
         {
             if (literalToken.getType() == TokenType::Null)
                 res = &Object::nullObject<TokenType::TypeChar>();
             else
-            {
-                res = track(new Object(TokenType::TypeChar));
-
-                res->char_value = literalToken.getLexeme().c_str()[0];
-            }
+                res = Object::immediate(literalToken.getLexeme().c_str()[0]);
         }
 
         else if (tok.getType() == TokenType::TypePair)
@@ -552,8 +589,16 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
         }
         else if (tok.getType() == TokenType::TypeArray)
         {
+            TypedArray::Kind kind;
+
             if (literalToken.getType() == TokenType::Null)
                 res = &Object::nullObject<TokenType::TypeArray>();
+            else if (TypedArray::kindOf(literalToken.getType(), kind))
+            {
+                // push array int|f64|_uint8 N creates a typed array
+                long initialSize = getIntFromLiteralOrDef(true);
+                res = track(Object::create(new TypedArray(kind, initialSize > 1 ? (size_t) initialSize : 0)));
+            }
             else
             {
                 tok = literalToken;
@@ -575,7 +620,7 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
             {
                 tok = literalToken;
                 long initialSize = getIntFromLiteralOrDef(false);
-                auto map = new std::unordered_map<Object*, Object*>();
+                auto map = new ObjectMap();
                 if (initialSize > 1)
                     map->reserve((size_t) initialSize);
 
@@ -592,7 +637,7 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
             {
                 tok = literalToken;
                 long initialSize = getIntFromLiteralOrDef(false);
-                auto set = new std::unordered_set<Object*>();
+                auto set = new ObjectSet();
                 if (initialSize > 1)
                     set->reserve((size_t) initialSize);
 
@@ -600,6 +645,44 @@ std::tuple<Object*, TokenType> AsmParser::getTypedLiteral(bool tokenizeType)
                 res = track(Object::create(set));
             }
         }
+        else if (tok.getType() == TokenType::TypeOrderedMap || tok.getType() == TokenType::TypeOrderedSet)
+        {
+            if (literalToken.getType() == TokenType::Null)
+                res = tok.getType() == TokenType::TypeOrderedMap ? &Object::nullObject<TokenType::TypeOrderedMap>() :
+                                                                   &Object::nullObject<TokenType::TypeOrderedSet>();
+            else
+            {
+                bool isMap = tok.getType() == TokenType::TypeOrderedMap;
+
+                // B-trees allocate a node at a time, so the initial size is accepted but unused
+                tok = literalToken;
+                getIntFromLiteralOrDef(false);
+
+                if (isMap)
+                    res = track(Object::create(new OrderedMap()));
+                else
+                    res = track(Object::create(new OrderedSet()));
+            }
+        }
+        else if (tok.getType() == TokenType::TypePersistentVector || tok.getType() == TokenType::TypePersistentMap)
+        {
+            if (literalToken.getType() == TokenType::Null)
+                res = tok.getType() == TokenType::TypePersistentVector ? &Object::nullObject<TokenType::TypePersistentVector>() :
+                                                                         &Object::nullObject<TokenType::TypePersistentMap>();
+            else
+            {
+                bool isVector = tok.getType() == TokenType::TypePersistentVector;
+
+                // The empty version, which every push shares as it's never mutated. The initial size is unused.
+                tok = literalToken;
+                getIntFromLiteralOrDef(false);
+
+                if (isVector)
+                    res = track(Object::create(new PersistentVector()));
+                else
+                    res = track(Object::create(new PersistentMap()));
+            }
+        }
         else
             throw AsmException("Invalid type", tok.getLocation());
     }
@@ -636,11 +719,11 @@ void AsmParser::onDuplicate()
 
     auto onRel = [this]()
     {
-        expressionList->addExpression(track(new ExprLoad((size_t) getIntObject()->asLong(), TokenType::Rel)), DI);
+        expressionList->addExpression(new (*code) ExprLoad((size_t) getIntObject()->asLong(), TokenType::Rel), DI);
     };
     auto onAbs = [this]()
     {
-        expressionList->addExpression(track(new ExprLoad((size_t) getIntObject()->asLong(), TokenType::Abs)), DI);
+        expressionList->addExpression(new (*code) ExprLoad((size_t) getIntObject()->asLong(), TokenType::Abs), DI);
     };
 
     match({std::make_pair(TokenType::NewLine, ignore),
@@ -661,11 +744,11 @@ void AsmParser::onCopy()
 
     auto onRel = [this]()
     {
-        expressionList->addExpression(track(new ExprLoad((size_t) getIntObject()->asLong(), TokenType::Rel)), DI);
+        expressionList->addExpression(new (*code) ExprLoad((size_t) getIntObject()->asLong(), TokenType::Rel), DI);
     };
     auto onAbs = [this]()
     {
-        expressionList->addExpression(track(new ExprLoad((size_t) getIntObject()->asLong(), TokenType::Abs)), DI);
+        expressionList->addExpression(new (*code) ExprLoad((size_t) getIntObject()->asLong(), TokenType::Abs), DI);
     };
 
     match({std::make_pair(TokenType::NewLine, ignore),
@@ -684,6 +767,7 @@ void AsmParser::onDump()
 
     static ExprDumpSweepList dumpSweepList;
     static ExprDumpFreeList dumpFreeList;
+    static ExprDumpNumCache dumpNumCache;
 
     static ExprPop pop;
 
@@ -697,6 +781,8 @@ void AsmParser::onDump()
             expressionList->addExpression(&dumpSweepList, DI);
         else if (tok.getLexeme().compare(TOK_FREELIST) == 0)
             expressionList->addExpression(&dumpFreeList, DI);
+        else if (tok.getLexeme().compare(TOK_NUMCACHE) == 0)
+            expressionList->addExpression(&dumpNumCache, DI);
         else
             throw std::runtime_error("Unexpected identifier");
     };
@@ -719,9 +805,7 @@ void AsmParser::onDump()
         TokenType tt;
         std::tie(lit, tt) = getTypedLiteral(false);
 
-        // track(lit); // cannot track yet, it may be a define
-
-        expressionList->addExpression(track(new ExprDump(lit)), DI);
+        expressionList->addExpression(new (*code) ExprDump(literal(lit)), DI);
     };
 
     match({std::make_pair(TokenType::NewLine, onNewLine),
@@ -745,17 +829,15 @@ void AsmParser::onInc()
 
 void AsmParser::onInvoke()
 {
-    static ExprInvoke invoke(false);
-    static ExprInvoke invokeTail(true);
-
+    // Per-site, as invokes are quickened
     auto onNewLine = [this]()
     {
-        expressionList->addExpression(&invoke, DI);
+        expressionList->addExpression(new (*code) ExprInvoke(false), DI);
     };
 
     auto onArg = [this]()
     {
-        expressionList->addExpression(&invokeTail, DI);
+        expressionList->addExpression(new (*code) ExprInvoke(true), DI);
     };
 
     match({std::make_pair(TokenType::NewLine, onNewLine),
@@ -831,7 +913,7 @@ void AsmParser::onPush()
 
     if (tok.getType() == TokenType::Define)
     {
-        expressionList->addExpression(track(new ExprPush(getDefine(true))), DI);
+        expressionList->addExpression(new (*code) ExprPush(literal(getDefine(true))), DI);
     }
     else if (tok.getType() == TokenType::TypeFunction)
     {
@@ -847,7 +929,7 @@ void AsmParser::onPush()
         TokenType tt;
 
         std::tie(lit, tt) = getTypedLiteral(false);
-        expressionList->addExpression(track(new ExprPush(lit)), DI);
+        expressionList->addExpression(new (*code) ExprPush(literal(lit)), DI);
     }
 }
 
@@ -862,7 +944,7 @@ void AsmParser::onPop()
     match({std::make_pair(TokenType::NewLine, ignore),
            std::make_pair(TokenType::Any, onArg)});
 
-    expressionList->addExpression(track(new ExprPop((size_t) count)), DI);
+    expressionList->addExpression(new (*code) ExprPop((size_t) count), DI);
 
 }
 
@@ -877,7 +959,7 @@ void AsmParser::onRemove()
     match({std::make_pair(TokenType::NewLine, ignore),
            std::make_pair(TokenType::Any, onArg)});
 
-    expressionList->addExpression(track(new ExprRemove((size_t) count)), DI);
+    expressionList->addExpression(new (*code) ExprRemove((size_t) count), DI);
 }
 
 void AsmParser::onStackSize()
@@ -910,37 +992,37 @@ void AsmParser::onLoad()
 {
     auto onAbs = [&]()
     {
-        expressionList->addExpression(track(new ExprLoad(getIntFromLiteralOrDef(), TokenType::Abs)), DI);
+        expressionList->addExpression(new (*code) ExprLoad(getIntFromLiteralOrDef(), TokenType::Abs), DI);
     };
     auto onRel = [&]()
     {
-        expressionList->addExpression(track(new ExprLoad(getIntFromLiteralOrDef(), TokenType::Rel)), DI);
+        expressionList->addExpression(new (*code) ExprLoad(getIntFromLiteralOrDef(), TokenType::Rel), DI);
     };
     auto onAbsParent = [&]()
     {
         expressionList->addExpression(
-                track(new ExprLoad(getIntFromLiteralOrDef(), TokenType::Parent, getIntFromLiteralOrDef())), DI);
+                new (*code) ExprLoad(getIntFromLiteralOrDef(), TokenType::Parent, getIntFromLiteralOrDef()), DI);
     };
     auto onAbsRoot = [&]()
     {
         expressionList->addExpression(
-                track(new ExprLoad(getIntFromLiteralOrDef(), TokenType::AbsRoot, -1 /*root stack*/)), DI);
+                new (*code) ExprLoad(getIntFromLiteralOrDef(), TokenType::AbsRoot, -1 /*root stack*/), DI);
     };
     // Top-relative addressing
     auto onIntLiteral = [this]()
     {
         expressionList->addExpression(
-                track(new ExprLoad(getIntFromLiteralOrDef(false), TokenType::IntegerLiteral)), DI);
+                new (*code) ExprLoad(getIntFromLiteralOrDef(false), TokenType::IntegerLiteral), DI);
     };
     auto onLocal = [this]()
     {
         expressionList->addExpression(
-                track(new ExprLoad(getIntFromLiteralOrDef(), TokenType::Local)), DI);
+                new (*code) ExprLoad(getIntFromLiteralOrDef(), TokenType::Local), DI);
     };
     auto onArg = [this]()
     {
         expressionList->addExpression(
-                track(new ExprLoad(getIntFromLiteralOrDef(), TokenType::Arg)), DI);
+                new (*code) ExprLoad(getIntFromLiteralOrDef(), TokenType::Arg), DI);
     };
     auto onModule = [&]()
     {
@@ -949,7 +1031,7 @@ void AsmParser::onLoad()
 
         // Parse module, put in module map. If already there, grab module (to allow circular imports)
         AsmParser p(vm);
-        p.parse(fileName, expressionList);
+        p.parse(fileName, expressionList, code);
     };
 
     match({std::make_pair(TokenType::Abs, onAbs),
@@ -969,43 +1051,43 @@ void AsmParser::onStore()
     auto onAbs = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(), TokenType::Abs)), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(), TokenType::Abs), DI);
     };
     auto onRel = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(), TokenType::Rel)), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(), TokenType::Rel), DI);
     };
     auto onAbsParent = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(), TokenType::Parent, getIntFromLiteralOrDef())), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(), TokenType::Parent, getIntFromLiteralOrDef()), DI);
     };
     auto onAbsRoot = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(), TokenType::AbsRoot, -1 /*Root*/)), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(), TokenType::AbsRoot, -1 /*Root*/), DI);
     };
     auto onCommit = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(0, TokenType::Commit)), DI);
+                new (*code) ExprStore(0, TokenType::Commit), DI);
     };
     auto onLocal = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(), TokenType::Local)), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(), TokenType::Local), DI);
     };
     auto onArg = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(), TokenType::Arg)), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(), TokenType::Arg), DI);
     };
     // Top-relative addressing
     auto onIntLiteral = [this]()
     {
         expressionList->addExpression(
-                track(new ExprStore(getIntFromLiteralOrDef(false), TokenType::IntegerLiteral)), DI);
+                new (*code) ExprStore(getIntFromLiteralOrDef(false), TokenType::IntegerLiteral), DI);
     };
 
     match({std::make_pair(TokenType::Abs, onAbs),
@@ -1033,7 +1115,7 @@ void AsmParser::onFunctionDefinition()
         }
     };
 
-    Object* function = track(new Object(new (vm.fnpool.malloc()) FunctionData(nullptr, "")));
+    Object* function = track(new Object(vm.fnpool.create((Stack*) nullptr, "")));
     std::string id = "";
 
     auto onId = [this, &id]()
@@ -1074,7 +1156,8 @@ void AsmParser::onFunctionDefinition()
     if (done)
         return;
 
-    function->fndata->body = (ExprExpressionList*) lake::track(new ExprExpressionList(function));
+    function->fndata->body = new (*code) ExprExpressionList(function, code);
+    function->fndata->code = code;
     function->fndata->name = id;
 
     auto oldExprList = expressionList;
@@ -1083,7 +1166,7 @@ void AsmParser::onFunctionDefinition()
     parseBlock();
 
     this->expressionList = oldExprList;
-    this->expressionList->addExpression(lake::track(new ExprPush(function)), DI);
+    this->expressionList->addExpression(new (*code) ExprPush(literal(function)), DI);
 }
 
 void AsmParser::onIf()
@@ -1096,7 +1179,7 @@ void AsmParser::onIf()
 
     for (; ;)
     {
-        auto link = new ExprConditionalChain();
+        auto link = new (*code) ExprConditionalChain();
         if (first == nullptr)
             first = link;
         if (prev != nullptr)
@@ -1104,12 +1187,8 @@ void AsmParser::onIf()
 
         prev = link;
 
-        link->guard = new ExprExpressionList(link);
-        link->body = new ExprExpressionList(link);
-
-        track(link);
-        track(link->guard);
-        track(link->body);
+        link->guard = new (*code) ExprExpressionList(link, code);
+        link->body = new (*code) ExprExpressionList(link, code);
 
         this->expressionList = link->guard;
 
@@ -1142,8 +1221,8 @@ void AsmParser::onIf()
 
 void AsmParser::onForeach()
 {
-    ExprCollForeach* foreach = (ExprCollForeach *) track(new ExprCollForeach());
-    foreach->exprlist = (ExprExpressionList *) track(new ExprExpressionList());
+    ExprCollForeach* foreach = new (*code) ExprCollForeach();
+    foreach->exprlist = new (*code) ExprExpressionList(nullptr, code);
 
     auto oldExprList = expressionList;
     expressionList = foreach->exprlist;
@@ -1157,69 +1236,80 @@ void AsmParser::onForeach()
 
 void AsmParser::onMul()
 {
-    static ExprBinOp mul(&Object::mul, TokenType::Mul, TOK_MUL);
-    expressionList->addExpression(&mul, DI);
+    expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::mul, ArithImpl<MulKernel>>(TokenType::Mul, TOK_MUL), DI);
 }
 
 void AsmParser::onDiv()
 {
-    static ExprBinOp div(&Object::div, TokenType::Div, TOK_DIV);
-    expressionList->addExpression(&div, DI);
+    expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::div, ArithImpl<DivKernel>>(TokenType::Div, TOK_DIV), DI);
 }
 
 void AsmParser::onAdd()
 {
-    static ExprBinOp add(&Object::add, TokenType::Add, TOK_ADD);
-    expressionList->addExpression(&add, DI);
+    expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::add, ArithImpl<AddKernel>>(TokenType::Add, TOK_ADD), DI);
 }
 
 void AsmParser::onSub()
 {
-    static ExprBinOp sub(&Object::sub,TokenType::Sub, TOK_SUB);
-    expressionList->addExpression(&sub, DI);
+    expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::sub, ArithImpl<SubKernel>>(TokenType::Sub, TOK_SUB), DI);
 }
 
 void AsmParser::onAccumulate()
 {
     static ExprAccumulate acc;
-    expressionList->addExpression(&acc, DI);
+
+    auto onNewLine = [this]()
+    {
+        expressionList->addExpression(&acc, DI);
+    };
+
+    // A reduction name selects a built-in reduction; and/or are keywords, the others identifiers
+    auto onReduction = [this]()
+    {
+        Reduction reduction;
+        if (!ExprAccumulate::reductionOf(tok.getLexeme(), reduction))
+            throw std::runtime_error("Unknown reduction: " + tok.getLexeme());
+
+        expressionList->addExpression(new (*code) ExprAccumulate(reduction), DI);
+    };
+
+    match({std::make_pair(TokenType::NewLine, onNewLine),
+           std::make_pair(TokenType::Identifier, onReduction),
+           std::make_pair(TokenType::And, onReduction),
+           std::make_pair(TokenType::Or, onReduction)},
+          "Expected newline or a reduction (sum, product, min, max, count, and, or, xor) after accumulate");
 }
 
 void AsmParser::onLogicalOr()
 {
-    static ExprBinOp logicalOr(&Object::logicalOr, TokenType::Or, TOK_OR);
+    static ExprKernelBinOp<&Object::logicalOr> logicalOr(TokenType::Or, TOK_OR);
     expressionList->addExpression(&logicalOr, DI);
 }
 
 void AsmParser::onLogicalAnd()
 {
-    static ExprBinOp logicalAnd(&Object::logicalAnd, TokenType::And, TOK_AND);
+    static ExprKernelBinOp<&Object::logicalAnd> logicalAnd(TokenType::And, TOK_AND);
     expressionList->addExpression(&logicalAnd, DI);
 }
 
 void AsmParser::onComparison()
 {
-    static ExprBinOp equals(&Object::equals, TokenType::Equal, TOK_EQUAL);
-    static ExprBinOp notEquals(&Object::notEquals, TokenType::NotEqual, TOK_NOTEQUAL);
-    static ExprBinOp lessEqual(&Object::lessEqual, TokenType::LessEqual, TOK_LESSEQUAL);
-    static ExprBinOp greaterEquals(&Object::greaterEqual, TokenType::GreaterEqual, TOK_GREATEREQUAL);
-    static ExprBinOp less(&Object::less, TokenType::LessThan, TOK_LESSTHAN);
-    static ExprBinOp greater(&Object::greater, TokenType::GreaterThan, TOK_GREATERTHAN);
-    static ExprBinOp same(&Object::same, TokenType::Same, TOK_SAME, false);
-    static ExprBinOp is(&Object::is, TokenType::Is, TOK_IS, false);
+    static ExprKernelBinOp<&Object::same> same(TokenType::Same, TOK_SAME, false);
+    static ExprKernelBinOp<&Object::is> is(TokenType::Is, TOK_IS, false);
 
+    // Numeric comparisons are created per site, so that each can be quickened
     if (tok.getType() == TokenType::Equal)
-        expressionList->addExpression(&equals, DI);
+        expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::equals, EqualImpl>(TokenType::Equal, TOK_EQUAL), DI);
     else if (tok.getType() == TokenType::NotEqual)
-        expressionList->addExpression(&notEquals, DI);
+        expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::notEquals, CompareImpl<NotEqualKernel>>(TokenType::NotEqual, TOK_NOTEQUAL), DI);
     else if (tok.getType() == TokenType::LessEqual)
-        expressionList->addExpression(&lessEqual, DI);
+        expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::lessEqual, CompareImpl<LessEqualKernel>>(TokenType::LessEqual, TOK_LESSEQUAL), DI);
     else if (tok.getType() == TokenType::GreaterEqual)
-        expressionList->addExpression(&greaterEquals, DI);
+        expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::greaterEqual, CompareImpl<GreaterEqualKernel>>(TokenType::GreaterEqual, TOK_GREATEREQUAL), DI);
     else if (tok.getType() == TokenType::LessThan)
-        expressionList->addExpression(&less, DI);
+        expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::less, CompareImpl<LessKernel>>(TokenType::LessThan, TOK_LESSTHAN), DI);
     else if (tok.getType() == TokenType::GreaterThan)
-        expressionList->addExpression(&greater, DI);
+        expressionList->addExpression(new (*code) ExprKernelBinOp<&Object::greater, CompareImpl<GreaterKernel>>(TokenType::GreaterThan, TOK_GREATERTHAN), DI);
     else if (tok.getType() == TokenType::Same)
         expressionList->addExpression(&same, DI);
     else if (tok.getType() == TokenType::Is)
@@ -1237,7 +1327,7 @@ void AsmParser::onAssertTrue()
 {
     this->getStringLiteral();
     expressionList->addExpression(
-            track(new ExprAssertTrue(tok.getLexeme())), DI);
+            new (*code) ExprAssertTrue(tok.getLexeme()), DI);
 }
 
 void AsmParser::onSwap()
@@ -1280,21 +1370,21 @@ void AsmParser::onLift()
     match({std::make_pair(TokenType::NewLine, ignore),
            std::make_pair(TokenType::Any, onArg)});
 
-    expressionList->addExpression(track(new ExprLift((size_t) count)), DI);
+    expressionList->addExpression(new (*code) ExprLift((size_t) count), DI);
 }
 
 void AsmParser::onSink()
 {
     // "drop 1" and "drop 2" are so going to be so common they should be static instances (same for adopt)
     long val = getIntFromLiteralOrDef();
-    expressionList->addExpression(track(new ExprSink((size_t) val)));
+    expressionList->addExpression(new (*code) ExprSink((size_t) val));
 }
 
 void AsmParser::onSquash()
 {
     long count = getIntFromLiteralOrDef();
 
-    expressionList->addExpression(track(new ExprSquash((size_t) count)), DI);
+    expressionList->addExpression(new (*code) ExprSquash((size_t) count), DI);
 }
 
 void AsmParser::onLoadStack()
@@ -1311,10 +1401,8 @@ void AsmParser::onUnloadStack()
 
 void AsmParser::onCollection()
 {
-    static ExprCollPut putParameterized(IndexType::Parameterized);
     static ExprCollPut putAppend(IndexType::Append);
     static ExprCollPut putInsert(IndexType::Insert);
-    static ExprCollGet collGet;
     static ExprCollReverse collReverse;
     static ExprCollDel collDel;
     static ExprCollSize collSize;
@@ -1323,11 +1411,13 @@ void AsmParser::onCollection()
     static ExprCollSpread spread(false);
     static ExprCollSpread reverseSpread(true);
     static ExprCollProjection collProjection;
+    static ExprCollFill collFill;
 
-    auto onPut = [this]() { expressionList->addExpression(&putParameterized); };
+    // Per-site, as these are quickened
+    auto onPut = [this]() { expressionList->addExpression(new (*code) ExprCollPut(IndexType::Parameterized)); };
     auto onAppend = [this]() { expressionList->addExpression(&putAppend); };
     auto onInsert = [this]() { expressionList->addExpression(&putInsert); };
-    auto onGet = [this]() { expressionList->addExpression(&collGet); };
+    auto onGet = [this]() { expressionList->addExpression(new (*code) ExprCollGet()); };
     auto onDel = [this]() { expressionList->addExpression(&collDel); };
     auto onSize = [this]() { expressionList->addExpression(&collSize); };
     auto onContains = [this]() { expressionList->addExpression(&collContains); };
@@ -1336,6 +1426,13 @@ void AsmParser::onCollection()
     auto onRevSpread = [this]() { expressionList->addExpression(&reverseSpread); };
     auto onReverse = [this]() { expressionList->addExpression(&collReverse); };
     auto onProjection = [this]() { expressionList->addExpression(&collProjection); };
+    auto onId = [this]()
+    {
+        if (tok.getLexeme().compare(TOK_COLLFILL) == 0)
+            expressionList->addExpression(&collFill);
+        else
+            throw AsmException("Invalid collection syntax", tok.getLocation());
+    };
 
     match({std::make_pair(TokenType::CollPut, onPut),
            std::make_pair(TokenType::CollAppend, onAppend),
@@ -1348,7 +1445,8 @@ void AsmParser::onCollection()
            std::make_pair(TokenType::CollProjection, onProjection),
            std::make_pair(TokenType::CollSpread, onSpread),
            std::make_pair(TokenType::CollReverseSpread, onRevSpread),
-           std::make_pair(TokenType::Clear, onClear)},
+           std::make_pair(TokenType::Clear, onClear),
+           std::make_pair(TokenType::Identifier, onId)},
           "Invalid collection syntax");
 }
 
@@ -1359,14 +1457,14 @@ void AsmParser::onFfi()
         auto onNewLine = [this]()
         {
             // The alias and path will be on the stack (path first, then alias)
-            expressionList->addExpression(track(new ExprFFILoad("", "")));
+            expressionList->addExpression(new (*code) ExprFFILoad("", ""));
         };
         auto onArg = [this]()
         {
 
             std::string path(getStringLiteral(false));
             std::string alias(getIdentifier());
-            expressionList->addExpression(track(new ExprFFILoad(path, alias)));
+            expressionList->addExpression(new (*code) ExprFFILoad(path, alias));
         };
 
         match({std::make_pair(TokenType::NewLine, onNewLine),
@@ -1394,7 +1492,7 @@ void AsmParser::onFfi()
                 throw AsmException("Expected ffi compatible argument type list", tok.getLocation());
         }
 
-        expressionList->addExpression(track(new ExprFFISym(libname, symbol, types)));
+        expressionList->addExpression(new (*code) ExprFFISym(libname, symbol, types));
     };
 
     auto onStruct = [this]()
@@ -1414,7 +1512,7 @@ void AsmParser::onFfi()
                 throw AsmException("Expected ffi compatible struct type list", tok.getLocation());
         }
 
-        expressionList->addExpression(track(new ExprFFIStruct{structname, types}));
+        expressionList->addExpression(new (*code) ExprFFIStruct{structname, types});
     };
 
     static ExprFFICall ffiCall;
@@ -1434,10 +1532,13 @@ void AsmParser::onCast()
 {
     static ExprCast intCast(TokenType::TypeInt);
     static ExprCast floatCast(TokenType::TypeFloat);
+    static ExprCast doubleCast(TokenType::TypeDouble);
     static ExprCast strCast(TokenType::TypeString);
     static ExprCast boolCast(TokenType::TypeBool);
     static ExprCast arrCast(TokenType::TypeArray);
     static ExprCast funcCast(TokenType::TypeFunction);
+    static ExprCast ropeCast(TokenType::TypeRope);
+    static ExprCast symbolCast(TokenType::TypeSymbol);
 
     lexer->tokenize(tok);
 
@@ -1447,7 +1548,12 @@ void AsmParser::onCast()
     }
     else if (tok.isNumericTypeName())
     {
-        expressionList->addExpression(tok.getType() == TokenType::TypeInt ? &intCast : &floatCast, DI);
+        if (tok.getType() == TokenType::TypeInt)
+            expressionList->addExpression(&intCast, DI);
+        else if (tok.getType() == TokenType::TypeDouble)
+            expressionList->addExpression(&doubleCast, DI);
+        else
+            expressionList->addExpression(&floatCast, DI);
     }
     else if (tok.getType() == TokenType::TypeBool)
     {
@@ -1463,6 +1569,14 @@ void AsmParser::onCast()
     {
         expressionList->addExpression(&funcCast, DI);
     }
+    else if (tok.getType() == TokenType::TypeRope)
+    {
+        expressionList->addExpression(&ropeCast, DI);
+    }
+    else if (tok.getType() == TokenType::TypeSymbol)
+    {
+        expressionList->addExpression(&symbolCast, DI);
+    }
     else
     {
         throw AsmException("Unsupported argument to cast instruction", tok.getLocation());
@@ -1471,8 +1585,28 @@ void AsmParser::onCast()
 
 void AsmParser::onGC()
 {
-    static ExprGC gc;
-    expressionList->addExpression(&gc, DI);
+    static ExprGC gc(false);
+    static ExprGC gcMinor(true);
+    static ExprGCStats gcStats;
+
+    auto onNewLine = [this]()
+    {
+        expressionList->addExpression(&gc, DI);
+    };
+
+    auto onId = [this]()
+    {
+        if (tok.getLexeme().compare(TOK_GCMINOR) == 0)
+            expressionList->addExpression(&gcMinor, DI);
+        else if (tok.getLexeme().compare(TOK_GCSTATS) == 0)
+            expressionList->addExpression(&gcStats, DI);
+        else
+            throw std::runtime_error("Unexpected identifier");
+    };
+
+    match({std::make_pair(TokenType::NewLine, onNewLine),
+           std::make_pair(TokenType::Identifier, onId)},
+          "Expected newline, 'minor' or 'stats' after gc");
 }
 
 void AsmParser::onHalt()
@@ -1492,7 +1626,7 @@ void AsmParser::onHalt()
     if (popExitCode)
         expressionList->addExpression(&exprHalt, DI);
     else
-        expressionList->addExpression(track(new ExprHalt(exitCode)), DI);
+        expressionList->addExpression(new (*code) ExprHalt(exitCode), DI);
 }
 
 void AsmParser::onRaise()
@@ -1508,13 +1642,13 @@ void AsmParser::onErrorLabel()
 void AsmParser::onChangeDefaultPrecision()
 {
     long precision = getIntFromLiteralOrDef(true);
-    expressionList->addExpression(track(new ExprDefaultPrecision(precision)));
+    expressionList->addExpression(new (*code) ExprDefaultPrecision(precision));
 }
 
 void AsmParser::onChangeDefaultEpsilon()
 {
     Object* eps = getFloatObject(true);
-    expressionList->addExpression(track(new ExprDefaultEpsilon(eps)));
+    expressionList->addExpression(new (*code) ExprDefaultEpsilon(literal(eps)));
 }
 
 void AsmParser::onCurrent()
@@ -1532,7 +1666,7 @@ void AsmParser::onRoot()
 void AsmParser::onParent()
 {
     expressionList->addExpression(
-            track(new ExprParentFunction(getIntFromLiteralOrDef(true))));
+            new (*code) ExprParentFunction(getIntFromLiteralOrDef(true)));
 }
 
 void AsmParser::onReserve()
@@ -1547,7 +1681,7 @@ void AsmParser::onReserve()
 
     if (count > 0)
     {
-        expressionList->addExpression(track(new ExprReserve((size_t) count)), DI);
+        expressionList->addExpression(new (*code) ExprReserve((size_t) count), DI);
     }
 }
 
@@ -1579,14 +1713,17 @@ void AsmParser::onSaveArgs()
 
 void AsmParser::onExpressionListObject()
 {
-    auto el = new ExprExpressionListObject();
+    // Expression list objects are never collected, so neither is the code they hold
+    code->pin();
+
+    auto el = new ExprExpressionListObject(code);
     auto oldExprList = expressionList;
     this->expressionList = el->getExpressions();
 
     parseBlock();
 
     this->expressionList = oldExprList;
-    this->expressionList->addExpression(lake::track(new ExprPush(el)), DI);
+    this->expressionList->addExpression(new (*code) ExprPush(el), DI);
 }
 
 }//ns
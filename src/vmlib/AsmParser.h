@@ -14,6 +14,7 @@ namespace lake {
 
 class Object;
 class ExprExpressionList;
+class CodeArena;
 
 /**
  * Consumes tokens and builds an AST representation of the input, ready
@@ -25,10 +26,15 @@ public:
 
     AsmParser(VM& vm);
 
-    void parse(std::string filename, ExprExpressionList* exprList = nullptr);
-    void parse(std::istream& stream, std::string sourcename, ExprExpressionList* exprList = nullptr);
+    /**
+     * Parses into exprList, or the root function if null. Instruction nodes are allocated
+     * from 'arena', or the VM's code arena if null.
+     */
+    void parse(std::string filename, ExprExpressionList* exprList = nullptr, CodeArena* arena = nullptr);
+    void parse(std::istream& stream, std::string sourcename, ExprExpressionList* exprList = nullptr, CodeArena* arena = nullptr);
 
     Object* floatToObject(std::string value, int base=10);
+    Object* doubleToObject(std::string value);
     Object* intToObject(std::string digits);
 
 private:
@@ -41,12 +47,23 @@ private:
      */
     ExprExpressionList* expressionList;
 
+    /**
+     * The arena instruction nodes are allocated from
+     */
+    CodeArena* code = nullptr;
+
     lconv* localeInfo;
-    std::unique_ptr<Lexer> lexer;
+    std::unique_ptr<TokenSource> lexer;
     Token tok;
 
     void parseExpressions(TokenType until);
 
+    /**
+     * Adds an object referenced by an instruction to the roots of the code arena, which
+     * keeps it alive as long as the code, and returns it
+     */
+    Object* literal(Object* obj);
+
     /**
      * Parses a type name followed by a literal or macro identifier
      *
@@ -0,0 +1,709 @@
+#ifndef LAKE_BTREE_H
+#define LAKE_BTREE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+namespace lake {
+
+/**
+ * Value type of B-trees used as sets
+ */
+struct NoValue
+{
+};
+
+/**
+ * In-memory B-tree mapping keys to values, kept in the order given by Order, a three-way
+ * comparison returning a negative, zero or positive int.
+ *
+ * Nodes are wide: with the default minimum degree of 16, a node holds up to 31 keys in a
+ * contiguous array, which is binary searched, and the values in a parallel array. Trees
+ * are thus shallow, and a lookup visits a handful of nodes, each spanning a few cache
+ * lines. Leaves have no child array.
+ *
+ * Insertion splits full nodes and deletion refills minimal nodes on the way down, so
+ * both are a single root-to-leaf pass. Lookup, insertion and deletion are O(log n).
+ *
+ * Iterators hold the path from the root, so nodes need no parent pointers. Any insertion
+ * or deletion invalidates them; version() changes whenever that may have happened.
+ */
+template <typename K, typename V, typename Order, size_t T = 16>
+class BTree
+{
+    static_assert(T >= 2, "The minimum degree of a B-tree is 2");
+
+public:
+
+    static constexpr size_t MAX_KEYS = 2 * T - 1;
+
+private:
+
+    struct Node
+    {
+        uint16_t count = 0;
+        bool leaf = true;
+        K keys[MAX_KEYS];
+        V values[MAX_KEYS];
+    };
+
+    struct Internal : Node
+    {
+        Node* children[MAX_KEYS + 1];
+    };
+
+    // Enough for any tree that fits in memory, as every node below the root has T children or more
+    static constexpr size_t MAX_DEPTH = 32;
+
+public:
+
+    class Iterator
+    {
+    public:
+
+        Iterator() = default;
+
+        const K& key() const
+        {
+            return path[depth-1].node->keys[path[depth-1].index];
+        }
+
+        V& value() const
+        {
+            return path[depth-1].node->values[path[depth-1].index];
+        }
+
+        bool atEnd() const
+        {
+            return depth == 0;
+        }
+
+        /**
+         * Moves to the next key in order
+         */
+        Iterator& operator++()
+        {
+            Level& top = path[depth-1];
+
+            if (!top.node->leaf)
+            {
+                // The next key is the leftmost one of the right subtree
+                top.index++;
+                descendLeftmost(BTree::child(top.node, top.index));
+                return *this;
+            }
+
+            top.index++;
+
+            // Climb until a node has a key right of the subtree just finished
+            while (depth > 0 && path[depth-1].index >= path[depth-1].node->count)
+            {
+                depth--;
+            }
+
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            if (depth == 0 || other.depth == 0)
+                return depth == other.depth;
+
+            return path[depth-1].node == other.path[other.depth-1].node &&
+                   path[depth-1].index == other.path[other.depth-1].index;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+
+        friend class BTree;
+
+        struct Level
+        {
+            Node* node;
+
+            // For the last level, the current key. Above it, the child descended into.
+            uint16_t index;
+        };
+
+        void push(Node* node, size_t index)
+        {
+            path[depth].node = node;
+            path[depth].index = (uint16_t) index;
+            depth++;
+        }
+
+        void descendLeftmost(Node* node)
+        {
+            while (true)
+            {
+                push(node, 0);
+                if (node->leaf)
+                    break;
+
+                node = BTree::child(node, 0);
+            }
+        }
+
+        Level path[MAX_DEPTH];
+        size_t depth = 0;
+    };
+
+    BTree() = default;
+
+    BTree(const BTree& copy) : count(copy.count), nodes(copy.nodes), internalNodes(copy.internalNodes)
+    {
+        root = copy.root != nullptr ? clone(copy.root) : nullptr;
+    }
+
+    BTree& operator=(const BTree&) = delete;
+
+    ~BTree()
+    {
+        if (root != nullptr)
+            release(root);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    /**
+     * Changes whenever keys are inserted or erased
+     */
+    uint64_t version() const
+    {
+        return modifications;
+    }
+
+    size_t allocatedBytes() const
+    {
+        return (nodes - internalNodes) * sizeof(Node) + internalNodes * sizeof(Internal);
+    }
+
+    Iterator begin() const
+    {
+        Iterator it;
+        if (root != nullptr && root->count > 0)
+            it.descendLeftmost(root);
+
+        return it;
+    }
+
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    Iterator find(const K& key) const
+    {
+        Iterator it;
+        Node* node = root;
+
+        while (node != nullptr)
+        {
+            bool found;
+            size_t i = search(node, key, found);
+            it.push(node, i);
+
+            if (found)
+                return it;
+
+            node = node->leaf ? nullptr : child(node, i);
+        }
+
+        return Iterator();
+    }
+
+    /**
+     * The first key not less than 'key'
+     */
+    Iterator lowerBound(const K& key) const
+    {
+        return bound(key, false);
+    }
+
+    /**
+     * The first key greater than 'key'
+     */
+    Iterator upperBound(const K& key) const
+    {
+        return bound(key, true);
+    }
+
+    /**
+     * Returns the value of 'key', inserting it with a default value if it's absent. An
+     * existing key object is kept.
+     */
+    V& operator[](const K& key)
+    {
+        return *insert(key, V()).first;
+    }
+
+    /**
+     * Inserts 'key' unless an equal key is present. Returns the value slot of the key, and
+     * whether it was inserted.
+     */
+    std::pair<V*, bool> insert(const K& key, const V& value)
+    {
+        if (root == nullptr)
+            root = newNode(true);
+
+        if (root->count == MAX_KEYS)
+        {
+            Node* top = newNode(false);
+            child(top, 0) = root;
+            root = top;
+            split(top, 0);
+        }
+
+        Node* node = root;
+        while (true)
+        {
+            bool found;
+            size_t i = search(node, key, found);
+            if (found)
+                return std::make_pair(&node->values[i], false);
+
+            if (node->leaf)
+            {
+                std::move_backward(node->keys + i, node->keys + node->count, node->keys + node->count + 1);
+                std::move_backward(node->values + i, node->values + node->count, node->values + node->count + 1);
+                node->keys[i] = key;
+                node->values[i] = value;
+                node->count++;
+
+                count++;
+                modifications++;
+                return std::make_pair(&node->values[i], true);
+            }
+
+            if (child(node, i)->count == MAX_KEYS)
+            {
+                split(node, i);
+
+                // The median moved up to position i; the key belongs left of it, right of it or is it
+                int cmp = order(key, node->keys[i]);
+                if (cmp == 0)
+                    return std::make_pair(&node->values[i], false);
+                else if (cmp > 0)
+                    i++;
+            }
+
+            node = child(node, i);
+        }
+    }
+
+    /**
+     * Removes 'key', returning false if it's absent
+     */
+    bool erase(const K& key)
+    {
+        if (root == nullptr)
+            return false;
+
+        bool erased = eraseFrom(root, key);
+
+        if (root->count == 0)
+        {
+            Node* old = root;
+            root = root->leaf ? nullptr : child(root, 0);
+            freeNode(old);
+        }
+
+        if (erased)
+        {
+            count--;
+            modifications++;
+        }
+
+        return erased;
+    }
+
+    void clear()
+    {
+        if (root != nullptr)
+            release(root);
+
+        root = nullptr;
+        count = 0;
+        nodes = internalNodes = 0;
+        modifications++;
+    }
+
+    /**
+     * Calls fn(key, value) for every entry, in order or in reverse order. Recursion
+     * makes this faster than iterating.
+     */
+    template <typename Fn>
+    void forEach(Fn fn, bool reverse = false) const
+    {
+        if (root != nullptr)
+            visit(root, fn, reverse);
+    }
+
+private:
+
+    static Node*& child(Node* node, size_t index)
+    {
+        return static_cast<Internal*>(node)->children[index];
+    }
+
+    int order(const K& lhs, const K& rhs) const
+    {
+        return Order()(lhs, rhs);
+    }
+
+    // Index of the first key not less than 'key'
+    size_t search(Node* node, const K& key, bool& found) const
+    {
+        size_t lo = 0, hi = node->count;
+        found = false;
+
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            int cmp = order(node->keys[mid], key);
+
+            if (cmp < 0)
+                lo = mid + 1;
+            else if (cmp > 0)
+                hi = mid;
+            else
+            {
+                found = true;
+                return mid;
+            }
+        }
+
+        return lo;
+    }
+
+    Iterator bound(const K& key, bool upper) const
+    {
+        Iterator it;
+        Node* node = root;
+
+        // The candidate is the last key passed on the way down which is right of 'key'
+        size_t candidateDepth = 0;
+
+        while (node != nullptr)
+        {
+            bool found;
+            size_t i = search(node, key, found);
+
+            if (found && upper)
+                i++;
+
+            it.push(node, i);
+
+            if (found && !upper)
+                return it;
+
+            if (i < node->count)
+                candidateDepth = it.depth;
+
+            node = node->leaf ? nullptr : child(node, i);
+        }
+
+        it.depth = candidateDepth;
+        return it;
+    }
+
+    Node* newNode(bool leaf)
+    {
+        Node* node = leaf ? new Node() : new Internal();
+        node->leaf = leaf;
+
+        nodes++;
+        if (!leaf)
+            internalNodes++;
+
+        return node;
+    }
+
+    void freeNode(Node* node)
+    {
+        nodes--;
+
+        if (node->leaf)
+            delete node;
+        else
+        {
+            internalNodes--;
+            delete static_cast<Internal*>(node);
+        }
+    }
+
+    void release(Node* node)
+    {
+        if (!node->leaf)
+        {
+            for (size_t i = 0; i <= node->count; i++)
+                release(child(node, i));
+        }
+
+        freeNode(node);
+    }
+
+    Node* clone(Node* node) const
+    {
+        Node* res = node->leaf ? new Node(*node) : new Internal(*static_cast<Internal*>(node));
+
+        if (!node->leaf)
+        {
+            for (size_t i = 0; i <= node->count; i++)
+                child(res, i) = clone(child(node, i));
+        }
+
+        return res;
+    }
+
+    template <typename Fn>
+    void visit(Node* node, Fn& fn, bool reverse) const
+    {
+        for (size_t n = 0; n < node->count; n++)
+        {
+            size_t i = reverse ? node->count - 1 - n : n;
+
+            if (!node->leaf)
+                visit(child(node, reverse ? i + 1 : i), fn, reverse);
+
+            fn(node->keys[i], node->values[i]);
+        }
+
+        if (!node->leaf)
+            visit(child(node, reverse ? 0 : node->count), fn, reverse);
+    }
+
+    // Moves entries [from, from+n) of 'src' to 'dst' at 'to'
+    static void moveEntries(Node* src, size_t from, Node* dst, size_t to, size_t n)
+    {
+        std::move(src->keys + from, src->keys + from + n, dst->keys + to);
+        std::move(src->values + from, src->values + from + n, dst->values + to);
+    }
+
+    // Shifts entries from 'index' on one slot right, or left if 'right' is false
+    static void shiftEntries(Node* node, size_t index, bool right)
+    {
+        if (right)
+        {
+            std::move_backward(node->keys + index, node->keys + node->count, node->keys + node->count + 1);
+            std::move_backward(node->values + index, node->values + node->count, node->values + node->count + 1);
+        }
+        else
+        {
+            std::move(node->keys + index + 1, node->keys + node->count, node->keys + index);
+            std::move(node->values + index + 1, node->values + node->count, node->values + index);
+        }
+    }
+
+    static void shiftChildren(Node* node, size_t index, bool right)
+    {
+        Node** children = static_cast<Internal*>(node)->children;
+
+        if (right)
+            std::move_backward(children + index, children + node->count + 1, children + node->count + 2);
+        else
+            std::move(children + index + 1, children + node->count + 1, children + index);
+    }
+
+    /**
+     * Splits the full child at 'index', moving its median key up into 'parent'
+     */
+    void split(Node* parent, size_t index)
+    {
+        Node* full = child(parent, index);
+        Node* right = newNode(full->leaf);
+
+        moveEntries(full, T, right, 0, T - 1);
+        if (!full->leaf)
+        {
+            for (size_t i = 0; i < T; i++)
+                child(right, i) = child(full, T + i);
+        }
+
+        right->count = T - 1;
+        full->count = T - 1;
+
+        shiftChildren(parent, index + 1, true);
+        shiftEntries(parent, index, true);
+
+        parent->keys[index] = full->keys[T - 1];
+        parent->values[index] = full->values[T - 1];
+        child(parent, index + 1) = right;
+        parent->count++;
+    }
+
+    /**
+     * Merges the child right of key 'index' into the one left of it, moving the key down
+     */
+    void merge(Node* parent, size_t index)
+    {
+        Node* left = child(parent, index);
+        Node* right = child(parent, index + 1);
+        size_t n = left->count;
+
+        left->keys[n] = parent->keys[index];
+        left->values[n] = parent->values[index];
+        moveEntries(right, 0, left, n + 1, right->count);
+
+        if (!left->leaf)
+        {
+            for (size_t i = 0; i <= right->count; i++)
+                child(left, n + 1 + i) = child(right, i);
+        }
+
+        left->count = (uint16_t) (n + 1 + right->count);
+
+        shiftEntries(parent, index, false);
+        shiftChildren(parent, index + 1, false);
+        parent->count--;
+
+        freeNode(right);
+    }
+
+    /**
+     * Moves a key from the left sibling of child 'index' through the parent into the child
+     */
+    void borrowLeft(Node* parent, size_t index)
+    {
+        Node* node = child(parent, index);
+        Node* sibling = child(parent, index - 1);
+
+        if (!node->leaf)
+            shiftChildren(node, 0, true);
+        shiftEntries(node, 0, true);
+
+        node->keys[0] = parent->keys[index - 1];
+        node->values[0] = parent->values[index - 1];
+        if (!node->leaf)
+            child(node, 0) = child(sibling, sibling->count);
+        node->count++;
+
+        parent->keys[index - 1] = sibling->keys[sibling->count - 1];
+        parent->values[index - 1] = sibling->values[sibling->count - 1];
+        sibling->count--;
+    }
+
+    /**
+     * Moves a key from the right sibling of child 'index' through the parent into the child
+     */
+    void borrowRight(Node* parent, size_t index)
+    {
+        Node* node = child(parent, index);
+        Node* sibling = child(parent, index + 1);
+
+        node->keys[node->count] = parent->keys[index];
+        node->values[node->count] = parent->values[index];
+        if (!node->leaf)
+            child(node, node->count + 1) = child(sibling, 0);
+        node->count++;
+
+        parent->keys[index] = sibling->keys[0];
+        parent->values[index] = sibling->values[0];
+
+        shiftEntries(sibling, 0, false);
+        if (!sibling->leaf)
+            shiftChildren(sibling, 0, false);
+        sibling->count--;
+    }
+
+    /**
+     * Erases 'key' from the subtree of 'node', which has at least T keys unless it's the root.
+     * Each child descended into is first given T keys, so that removing one never underflows.
+     */
+    bool eraseFrom(Node* node, K key)
+    {
+        while (true)
+        {
+            bool found;
+            size_t i = search(node, key, found);
+
+            if (found && node->leaf)
+            {
+                shiftEntries(node, i, false);
+                node->count--;
+                return true;
+            }
+            else if (found)
+            {
+                Node* left = child(node, i);
+                Node* right = child(node, i + 1);
+
+                // Replace the key by its predecessor or successor, then erase that from the subtree
+                if (left->count >= T)
+                {
+                    Node* pred = left;
+                    while (!pred->leaf)
+                        pred = child(pred, pred->count);
+
+                    node->keys[i] = pred->keys[pred->count - 1];
+                    node->values[i] = pred->values[pred->count - 1];
+                    key = node->keys[i];
+                    node = left;
+                }
+                else if (right->count >= T)
+                {
+                    Node* succ = right;
+                    while (!succ->leaf)
+                        succ = child(succ, 0);
+
+                    node->keys[i] = succ->keys[0];
+                    node->values[i] = succ->values[0];
+                    key = node->keys[i];
+                    node = right;
+                }
+                else
+                {
+                    // Both children are minimal; merge them around the key and continue in the result
+                    merge(node, i);
+                    node = left;
+                }
+            }
+            else if (node->leaf)
+            {
+                return false;
+            }
+            else
+            {
+                if (child(node, i)->count < T)
+                {
+                    if (i > 0 && child(node, i - 1)->count >= T)
+                        borrowLeft(node, i);
+                    else if (i < node->count && child(node, i + 1)->count >= T)
+                        borrowRight(node, i);
+                    else if (i < node->count)
+                        merge(node, i);
+                    else
+                        merge(node, --i);
+                }
+
+                node = child(node, i);
+            }
+        }
+    }
+
+    Node* root = nullptr;
+    size_t count = 0;
+    size_t nodes = 0;
+    size_t internalNodes = 0;
+    uint64_t modifications = 0;
+};
+
+}//ns
+
+#endif //LAKE_BTREE_H
@@ -6,6 +6,7 @@
 #include "Process.h"
 #include "lz4/lz4.h"
 #include "ExecLocation.h"
+#include "Image.h"
 
 namespace lake {
 
@@ -46,14 +47,24 @@ void BundleWriter::execute()
         std::ifstream t(path, std::ios::binary);
         std::stringstream buffer;
         buffer << t.rdbuf();
+        t.close();
+
+        if (precompile && !ImageReader::isImage(buffer))
+        {
+            std::ostringstream image;
+            ImageWriter::write(buffer, path, image);
+            buffer.str(image.str());
+        }
+
         auto str = buffer.str();
         uint64_t len = str.size();
-        t.close();
 
         // Compress it
-        char* pchCompressed = new char[len];
-        int64_t nCompressedSize = LZ4_compress_fast(str.c_str(), pchCompressed, len, len,9);
-        if (nCompressedSize < 0)
+        // Size the buffer for the worst case; precompiled images are dense and may not compress
+        int capacity = LZ4_compressBound(len);
+        char* pchCompressed = new char[capacity];
+        int64_t nCompressedSize = LZ4_compress_fast(str.c_str(), pchCompressed, len, capacity, 9);
+        if (nCompressedSize <= 0)
             throw std::runtime_error("Invalid compressed buffer length");
 
         // Write the pathname length in big endian, followed by the path
@@ -23,8 +23,11 @@ class BundleWriter
 {
 public:
 
-    BundleWriter(std::string output, std::string interpreterPath, std::vector<std::string> input)
-            : output(output), interpreterPath(interpreterPath), input(input)
+    /**
+     * @param precompile If true, assembly sources are stored as precompiled images
+     */
+    BundleWriter(std::string output, std::string interpreterPath, std::vector<std::string> input, bool precompile=false)
+            : output(output), interpreterPath(interpreterPath), input(input), precompile(precompile)
     {
     }
 
@@ -35,7 +38,7 @@ private:
     std::string output;
     std::string interpreterPath;
     std::vector<std::string> input;
-
+    bool precompile;
 };
 
 struct Resource
@@ -0,0 +1,729 @@
+#include "Bytecode.h"
+#include "Object.h"
+#include "Stack.h"
+#include "ExprExpressionList.h"
+#include "ExprConditionalChain.h"
+#include "ExprStackOps.h"
+#include "ExprLoad.h"
+#include "ExprStore.h"
+#include "ExprBinOp.h"
+#include "ExprInvoke.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define LAKE_COMPUTED_GOTO
+#endif
+
+namespace lake {
+
+namespace {
+
+/**
+ * Forward references during compilation. Jump operands and origin targets hold
+ * label ids until the block is complete, at which point they're resolved to pcs.
+ */
+struct Labels
+{
+    std::vector<ssize_t> pcs;
+    std::vector<size_t> fixups;
+
+    ssize_t create()
+    {
+        pcs.push_back(-1);
+        return (ssize_t) pcs.size() - 1;
+    }
+};
+
+thread_local Labels* labels = nullptr;
+
+inline ssize_t newLabel()
+{
+    return labels->create();
+}
+
+}//anon
+
+size_t BytecodeCompiler::here() const
+{
+    return block->code.size();
+}
+
+size_t BytecodeCompiler::emit(Opcode op, const BytecodeOrigin& origin)
+{
+    size_t pos = here();
+    block->code.push_back((intptr_t) op);
+    block->origins.push_back(origin);
+    return pos;
+}
+
+void BytecodeCompiler::emitOperand(intptr_t operand)
+{
+    block->code.push_back(operand);
+    block->origins.push_back(BytecodeOrigin {nullptr, -1, -1, -1});
+}
+
+BytecodeBlock* BytecodeCompiler::compile(ExprExpressionList* list)
+{
+    if (list->bytecode != nullptr && list->bytecode->sourceSize == list->expressions.size())
+        return list->bytecode;
+
+    Labels pending;
+    labels = &pending;
+
+    BytecodeCompiler compiler;
+    compiler.block = new BytecodeBlock();
+    compiler.block->sourceSize = list->expressions.size();
+
+    // Breaking out of the body leaves the block
+    compiler.emitList(list, -1);
+    compiler.emit(Opcode::End, BytecodeOrigin {list, -1, -1, -1});
+
+    // Resolve labels
+    BytecodeBlock* block = compiler.block;
+    for (size_t pos : pending.fixups)
+        block->code[pos] = (intptr_t) pending.pcs.at((size_t) block->code[pos]);
+
+    for (auto& origin : block->origins)
+    {
+        if (origin.raiseTarget >= 0)
+            origin.raiseTarget = pending.pcs.at((size_t) origin.raiseTarget);
+        if (origin.breakTarget >= 0)
+            origin.breakTarget = pending.pcs.at((size_t) origin.breakTarget);
+    }
+
+    labels = nullptr;
+
+    delete list->bytecode;
+    list->bytecode = block;
+
+    return block;
+}
+
+void BytecodeCompiler::emitList(ExprExpressionList* list, ssize_t breakTarget)
+{
+    auto& expressions = list->expressions;
+
+    // A raise goes to the error label if the list has one, otherwise it leaves the list
+    ssize_t errorLabel = -1;
+    if (list->errorLabelIndex >= 0)
+        errorLabel = newLabel();
+
+    ssize_t count = (ssize_t) expressions.size();
+
+    // A trailing repeat in a conditional body is compiled as a jump by emitChain
+    if (list->owner != nullptr && !expressions.empty())
+    {
+        Object* last = expressions.back();
+        if (dynamic_cast<ExprConditionalChain*>(list->owner) != nullptr &&
+            ((ExprConditionalChain*)list->owner)->body == list &&
+            (last == &Object::repeatObject() || last == &Object::repeatIfTrueObject() || last == &Object::repeatIfFalseObject()))
+        {
+            count--;
+        }
+    }
+
+    for (ssize_t idx = 0; idx < count; idx++)
+    {
+        Object* expr = expressions[idx];
+        BytecodeOrigin origin {list, idx, errorLabel >= 0 ? errorLabel : breakTarget, breakTarget};
+
+        if (idx == list->errorLabelIndex)
+            labels->pcs[errorLabel] = here();
+
+        emitExpression(expr, origin);
+    }
+}
+
+void BytecodeCompiler::emitChain(ExprConditionalChain* chain, BytecodeOrigin origin)
+{
+    ssize_t end = newLabel();
+
+    for (ExprConditionalChain* link = chain; link != nullptr; link = link->nextChain)
+    {
+        ssize_t linkStart = newLabel();
+        ssize_t next = newLabel();
+
+        labels->pcs[linkStart] = here();
+
+        if (link->guard != nullptr)
+        {
+            // Leaving the guard early continues with the condition test, like the tree walker
+            ssize_t test = newLabel();
+            emitList(link->guard, test);
+            labels->pcs[test] = here();
+
+            emit(Opcode::JumpIfFalse, origin);
+            labels->fixups.push_back(here());
+            emitOperand(next);
+        }
+
+        Object* last = nullptr;
+        if (link->body != nullptr)
+        {
+            emitList(link->body, end);
+
+            if (!link->body->expressions.empty())
+                last = link->body->expressions.back();
+        }
+
+        Opcode tail = Opcode::BodyEnd;
+        if (last == nullptr)
+            tail = Opcode::Jump;
+        else if (last == &Object::repeatObject())
+            tail = Opcode::Repeat;
+        else if (last == &Object::repeatIfTrueObject())
+            tail = Opcode::RepeatIfTrue;
+        else if (last == &Object::repeatIfFalseObject())
+            tail = Opcode::RepeatIfFalse;
+
+        emit(tail, origin);
+
+        if (tail != Opcode::Jump)
+        {
+            labels->fixups.push_back(here());
+            emitOperand(linkStart);
+        }
+
+        if (tail != Opcode::Repeat)
+        {
+            labels->fixups.push_back(here());
+            emitOperand(end);
+        }
+
+        labels->pcs[next] = here();
+    }
+
+    // The chain itself evaluates to null
+    labels->pcs[end] = here();
+    emit(Opcode::ClearResult, origin);
+}
+
+void BytecodeCompiler::emitExpression(Object* expr, const BytecodeOrigin& origin)
+{
+    if (expr == &Object::raiseRequestObject())
+    {
+        emit(Opcode::Raise, origin);
+    }
+    else if (expr == &Object::errorLabelObject() || expr == &Object::repeatObject() ||
+             expr == &Object::repeatIfTrueObject() || expr == &Object::repeatIfFalseObject())
+    {
+        emit(Opcode::SetResult, origin);
+        emitOperand((intptr_t) expr);
+    }
+    else if (auto chain = dynamic_cast<ExprConditionalChain*>(expr))
+    {
+        emitChain(chain, origin);
+    }
+    else if (auto push = dynamic_cast<ExprPush*>(expr))
+    {
+        emit(Opcode::Push, origin);
+        emitOperand((intptr_t) push->operand);
+    }
+    else if (auto pop = dynamic_cast<ExprPop*>(expr))
+    {
+        emit(Opcode::Pop, origin);
+        emitOperand((intptr_t) pop->count);
+    }
+    else if (auto load = dynamic_cast<ExprLoad*>(expr))
+    {
+        switch (load->addressingMode)
+        {
+            case TokenType::Abs:
+            case TokenType::Parent:
+                emit(Opcode::LoadAbs, origin);
+                emitOperand((intptr_t) load->index);
+                emitOperand((intptr_t) load->parentIndex);
+                break;
+            case TokenType::Rel:
+                emit(Opcode::LoadRel, origin);
+                emitOperand((intptr_t) load->index);
+                break;
+            case TokenType::AbsRoot:
+                emit(Opcode::LoadRoot, origin);
+                emitOperand((intptr_t) load->index);
+                break;
+            case TokenType::IntegerLiteral:
+                emit(Opcode::LoadTop, origin);
+                emitOperand((intptr_t) load->index);
+                break;
+            default:
+                emit(Opcode::Generic, origin);
+                emitOperand((intptr_t) expr);
+        }
+    }
+    else if (auto store = dynamic_cast<ExprStore*>(expr))
+    {
+        switch (store->addressingMode)
+        {
+            case TokenType::Abs:
+            case TokenType::Parent:
+                emit(Opcode::StoreAbs, origin);
+                emitOperand((intptr_t) store->index);
+                emitOperand((intptr_t) store->parentIndex);
+                break;
+            case TokenType::Rel:
+                emit(Opcode::StoreRel, origin);
+                emitOperand((intptr_t) store->index);
+                break;
+            case TokenType::AbsRoot:
+                emit(Opcode::StoreRoot, origin);
+                emitOperand((intptr_t) store->index);
+                break;
+            case TokenType::IntegerLiteral:
+                emit(Opcode::StoreTop, origin);
+                emitOperand((intptr_t) store->index);
+                break;
+            default:
+                emit(Opcode::Generic, origin);
+                emitOperand((intptr_t) expr);
+        }
+    }
+    else if (auto binop = dynamic_cast<ExprBinOp*>(expr))
+    {
+        Opcode op = Opcode::Generic;
+
+        switch (binop->otype)
+        {
+            case TokenType::Add: op = Opcode::Add; break;
+            case TokenType::Sub: op = Opcode::Sub; break;
+            case TokenType::Mul: op = Opcode::Mul; break;
+            case TokenType::Div: op = Opcode::Div; break;
+            case TokenType::LessThan: op = Opcode::Less; break;
+            case TokenType::LessEqual: op = Opcode::LessEqual; break;
+            case TokenType::GreaterThan: op = Opcode::Greater; break;
+            case TokenType::GreaterEqual: op = Opcode::GreaterEqual; break;
+            case TokenType::Equal: op = Opcode::Equal; break;
+            case TokenType::NotEqual: op = Opcode::NotEqual; break;
+            default: break;
+        }
+
+        emit(op, origin);
+        if (op == Opcode::Generic)
+            emitOperand((intptr_t) expr);
+    }
+    else if (dynamic_cast<ExprSwap*>(expr) != nullptr)
+    {
+        emit(Opcode::Swap, origin);
+    }
+    else if (auto squash = dynamic_cast<ExprSquash*>(expr))
+    {
+        emit(Opcode::Squash, origin);
+        emitOperand((intptr_t) squash->count);
+    }
+    else if (auto invoke = dynamic_cast<ExprInvoke*>(expr))
+    {
+        emit(invoke->tail ? Opcode::InvokeTail : Opcode::Invoke, origin);
+    }
+    else
+    {
+        emit(Opcode::Generic, origin);
+        emitOperand((intptr_t) expr);
+    }
+}
+
+namespace {
+
+inline Object* pop(VM& vm)
+{
+    auto& items = vm.stacks.back()->items;
+    if (items.empty())
+        throw std::runtime_error("Empty stack");
+
+    Object* res = items.back();
+    items.pop_back();
+    return res;
+}
+
+inline void push(VM& vm, Object* obj)
+{
+    vm.stacks.back()->items.push_back(obj);
+}
+
+// Operands may be expression list objects, which are evaluated before the operation
+inline Object* operand(Object* obj)
+{
+    return (obj->otype == TokenType::TypeOperation || obj->otype == TokenType::TypeExprListObject) ? obj->eval() : obj;
+}
+
+inline void checkIndex(int64_t idx, Stack* stack, const char* error)
+{
+    if (idx < 0 || idx >= (int64_t) stack->items.size())
+        throw std::runtime_error(error);
+}
+
+}//anon
+
+Object* BytecodeInterpreter::run(ExprExpressionList* body)
+{
+    VM& vm = lake::vm();
+
+    Object* const tailcallSentinel = &Object::tailcallRequestObject();
+    Object* const raiseSentinel = &Object::raiseRequestObject();
+    Object* const exitScopeSentinel = &Object::exitScopeObject();
+    Object* const exitSentinel = &Object::exitRequestObject();
+
+    BytecodeBlock* block = BytecodeCompiler::compile(body);
+    const intptr_t* code = block->code.data();
+    const intptr_t* ip = code;
+    const intptr_t* opStart = ip;
+    Object* res = nullptr;
+
+#ifdef LAKE_COMPUTED_GOTO
+    // Must be in Opcode order
+    static void* dispatchTable[] = {
+        &&L_Push, &&L_Pop, &&L_LoadAbs, &&L_LoadRel, &&L_LoadRoot, &&L_LoadTop,
+        &&L_StoreAbs, &&L_StoreRel, &&L_StoreRoot, &&L_StoreTop,
+        &&L_Add, &&L_Sub, &&L_Mul, &&L_Div,
+        &&L_Less, &&L_LessEqual, &&L_Greater, &&L_GreaterEqual, &&L_Equal, &&L_NotEqual,
+        &&L_Swap, &&L_Squash, &&L_Invoke, &&L_InvokeTail, &&L_Raise, &&L_SetResult,
+        &&L_Jump, &&L_JumpIfFalse, &&L_BodyEnd, &&L_Repeat, &&L_RepeatIfTrue, &&L_RepeatIfFalse,
+        &&L_ClearResult, &&L_Generic, &&L_End
+    };
+    static_assert(sizeof(dispatchTable)/sizeof(dispatchTable[0]) == (size_t) Opcode::OpcodeCount,
+                  "Dispatch table out of sync with Opcode");
+
+    #define OP(name) L_##name:
+    #define NEXT() do { opStart = ip; goto *dispatchTable[*ip++]; } while (0)
+#else
+    #define OP(name) case Opcode::name:
+    #define NEXT() continue
+#endif
+
+    #define BINOP(fn) \
+    { \
+        Object* first = pop(vm); \
+        Object* second = pop(vm); \
+        second = operand(second); \
+        first = operand(first); \
+        ExprBinOp::checkOperandTypes(first, second, false); \
+        res = first->fn(first, second); \
+        push(vm, res); \
+        NEXT(); \
+    }
+
+    // Jumps to the target, or leaves the block if the target is -1
+    #define GOTO_TARGET(target) \
+    { \
+        ssize_t t = (target); \
+        if (t < 0) goto leave; \
+        ip = code + t; \
+        NEXT(); \
+    }
+
+    try
+    {
+#ifdef LAKE_COMPUTED_GOTO
+        NEXT();
+#else
+        for (;;)
+        {
+            opStart = ip;
+            switch ((Opcode) *ip++)
+            {
+#endif
+        OP(Push)
+        {
+            res = (Object*) *ip++;
+            push(vm, res);
+            NEXT();
+        }
+        OP(Pop)
+        {
+            res = vm.pop((size_t) *ip++);
+            NEXT();
+        }
+        OP(LoadAbs)
+        {
+            int64_t idx = (int64_t) *ip++;
+            int64_t parent = (int64_t) *ip++;
+            Stack* stack = *(vm.stacks.end() - (parent+1));
+            checkIndex(idx, stack, "Attempt to read outside stack");
+            push(vm, stack->items[idx]);
+            res = nullptr;
+            NEXT();
+        }
+        OP(LoadRel)
+        {
+            Stack* stack = vm.stacks.back();
+            int64_t idx = stack->getStackBase() + (int64_t) *ip++ + 1;
+            checkIndex(idx, stack, "Attempt to read outside stack");
+            push(vm, stack->items[idx]);
+            res = nullptr;
+            NEXT();
+        }
+        OP(LoadRoot)
+        {
+            Stack* stack = vm.root->fndata->stack;
+            int64_t idx = (int64_t) *ip++;
+            checkIndex(idx, stack, "Attempt to read outside stack");
+            push(vm, stack->items[idx]);
+            res = nullptr;
+            NEXT();
+        }
+        OP(LoadTop)
+        {
+            Stack* stack = vm.stacks.back();
+            int64_t idx = (int64_t) stack->items.size() - 1 + (int64_t) *ip++;
+            checkIndex(idx, stack, "Attempt to read outside stack");
+            push(vm, stack->items[idx]);
+            res = nullptr;
+            NEXT();
+        }
+        OP(StoreAbs)
+        {
+            int64_t idx = (int64_t) *ip++;
+            int64_t parent = (int64_t) *ip++;
+            Stack* stack = *(vm.stacks.end() - (parent+1));
+            checkIndex(idx, stack, "Attempt to write outside stack");
+            Object* value = pop(vm);
+            if (idx < (int64_t) stack->items.size())
+                stack->items[idx] = value;
+            res = nullptr;
+            NEXT();
+        }
+        OP(StoreRel)
+        {
+            Stack* stack = vm.stacks.back();
+            int64_t idx = stack->getStackBase() + (int64_t) *ip++ + 1;
+            checkIndex(idx, stack, "Attempt to write outside stack");
+            Object* value = pop(vm);
+            if (idx < (int64_t) stack->items.size())
+                stack->items[idx] = value;
+            res = nullptr;
+            NEXT();
+        }
+        OP(StoreRoot)
+        {
+            Stack* stack = vm.root->fndata->stack;
+            int64_t idx = (int64_t) *ip++;
+            checkIndex(idx, stack, "Attempt to write outside stack");
+            Object* value = pop(vm);
+            if (idx < (int64_t) stack->items.size())
+                stack->items[idx] = value;
+            res = nullptr;
+            NEXT();
+        }
+        OP(StoreTop)
+        {
+            Stack* stack = vm.stacks.back();
+            int64_t idx = (int64_t) stack->items.size() - 2 + (int64_t) *ip++;
+            checkIndex(idx, stack, "Attempt to write outside stack");
+            Object* value = pop(vm);
+            if (idx < (int64_t) stack->items.size())
+                stack->items[idx] = value;
+            res = nullptr;
+            NEXT();
+        }
+        OP(Add) BINOP(add)
+        OP(Sub) BINOP(sub)
+        OP(Mul) BINOP(mul)
+        OP(Div) BINOP(div)
+        OP(Less) BINOP(less)
+        OP(LessEqual) BINOP(lessEqual)
+        OP(Greater) BINOP(greater)
+        OP(GreaterEqual) BINOP(greaterEqual)
+        OP(Equal) BINOP(equals)
+        OP(NotEqual) BINOP(notEquals)
+        OP(Swap)
+        {
+            vm.swap();
+            res = nullptr;
+            NEXT();
+        }
+        OP(Squash)
+        {
+            vm.squash((ssize_t) *ip++);
+            res = nullptr;
+            NEXT();
+        }
+        OP(Invoke)
+        {
+            Object* evalObject = pop(vm);
+
+            if (evalObject->otype == TokenType::TypeFunction)
+                res = evalObject->fndata->evaluateBody(evalObject);
+            else
+                res = evalObject->eval();
+
+            goto checkSentinel;
+        }
+        OP(InvokeTail)
+        {
+            Object* evalObject = pop(vm);
+
+            if (evalObject->otype == TokenType::TypeFunction)
+            {
+                // Switch to the target body without growing the native stack
+                block = BytecodeCompiler::compile(evalObject->fndata->body);
+                code = block->code.data();
+                ip = code;
+                NEXT();
+            }
+
+            res = evalObject->eval();
+            goto checkSentinel;
+        }
+        OP(Raise)
+        {
+            res = raiseSentinel;
+            GOTO_TARGET(block->origins[opStart - code].raiseTarget);
+        }
+        OP(SetResult)
+        {
+            res = (Object*) *ip++;
+            NEXT();
+        }
+        OP(Jump)
+        {
+            ip = code + *ip;
+            NEXT();
+        }
+        OP(JumpIfFalse)
+        {
+            Object* cond = pop(vm);
+            if (cond == nullptr || cond->otype != TokenType::TypeBool)
+                throw std::runtime_error("Expected bool expression in condition");
+
+            if (!cond->bool_value)
+                ip = code + *ip;
+            else
+                ip++;
+
+            res = nullptr;
+            NEXT();
+        }
+        OP(BodyEnd)
+        {
+            intptr_t linkStart = *ip++;
+            intptr_t end = *ip++;
+
+            if (res == &Object::repeatObject())
+            {
+                vm.gcIfNeeded();
+                ip = code + linkStart;
+            }
+            else if (res == &Object::repeatIfTrueObject() || res == &Object::repeatIfFalseObject())
+            {
+                bool expected = res == &Object::repeatIfTrueObject();
+                Object* boolval = pop(vm);
+                if (boolval->otype == TokenType::TypeBool && boolval->bool_value == expected)
+                {
+                    vm.gcIfNeeded();
+                    ip = code + linkStart;
+                }
+                else
+                    ip = code + end;
+            }
+            else
+                ip = code + end;
+
+            NEXT();
+        }
+        OP(Repeat)
+        {
+            vm.gcIfNeeded();
+            ip = code + *ip;
+            NEXT();
+        }
+        OP(RepeatIfTrue)
+        {
+            Object* boolval = pop(vm);
+            if (boolval->otype == TokenType::TypeBool && boolval->bool_value)
+            {
+                vm.gcIfNeeded();
+                ip = code + ip[0];
+            }
+            else
+                ip = code + ip[1];
+
+            NEXT();
+        }
+        OP(RepeatIfFalse)
+        {
+            Object* boolval = pop(vm);
+            if (boolval->otype == TokenType::TypeBool && !boolval->bool_value)
+            {
+                vm.gcIfNeeded();
+                ip = code + ip[0];
+            }
+            else
+                ip = code + ip[1];
+
+            NEXT();
+        }
+        OP(ClearResult)
+        {
+            res = nullptr;
+            NEXT();
+        }
+        OP(Generic)
+        {
+            res = ((Object*) *ip++)->eval();
+            goto checkSentinel;
+        }
+        OP(End)
+        {
+            goto leave;
+        }
+
+#ifndef LAKE_COMPUTED_GOTO
+            default:
+                throw std::runtime_error("Invalid opcode");
+            }
+#endif
+
+    checkSentinel:
+
+        // Sentinels are static singletons; the common case is a plain result
+        if (res == tailcallSentinel)
+        {
+            block = BytecodeCompiler::compile(vm.tailcallRequest->fndata->body);
+            vm.tailcallRequest = nullptr;
+            code = block->code.data();
+            ip = code;
+            NEXT();
+        }
+        else if (res == raiseSentinel)
+        {
+            GOTO_TARGET(block->origins[opStart - code].raiseTarget);
+        }
+        else if (res == exitScopeSentinel)
+        {
+            GOTO_TARGET(block->origins[opStart - code].breakTarget);
+        }
+        else if (res == exitSentinel)
+        {
+            return res;
+        }
+
+        NEXT();
+#ifndef LAKE_COMPUTED_GOTO
+        }
+#endif
+    }
+    catch (EvalException& evalEx)
+    {
+        throw;
+    }
+    catch (const std::exception& e)
+    {
+        const BytecodeOrigin& origin = block->origins[opStart - code];
+
+        if (origin.list != nullptr && origin.index >= 0)
+            origin.list->rethrowWithDebugInfo(e, origin.index);
+
+        throw;
+    }
+
+    #undef OP
+    #undef NEXT
+    #undef BINOP
+    #undef GOTO_TARGET
+
+leave:
+
+    vm.gcIfNeeded();
+
+    return res;
+}
+
+}//ns
@@ -0,0 +1,140 @@
+#ifndef LAKE_BYTECODE_H
+#define LAKE_BYTECODE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace lake {
+
+class Object;
+class ExprExpressionList;
+class ExprConditionalChain;
+
+/**
+ * Opcodes of the compact bytecode engine. Operands follow the opcode inline in the
+ * code array, one word each.
+ *
+ * Instructions without a dedicated opcode are executed through Generic, which calls
+ * eval() on the original expression object. This keeps the engine complete while the
+ * hot paths (stack traffic, arithmetic, comparisons, invoke and conditionals) run
+ * without virtual dispatch.
+ */
+enum class Opcode : intptr_t
+{
+    Push,           // object
+    Pop,            // count
+    LoadAbs,        // index, parent
+    LoadRel,        // index
+    LoadRoot,       // index
+    LoadTop,        // index (<= 0)
+    StoreAbs,       // index, parent
+    StoreRel,       // index
+    StoreRoot,      // index
+    StoreTop,       // index (<= 0)
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    Swap,
+    Squash,         // count
+    Invoke,
+    InvokeTail,
+    Raise,
+    SetResult,      // object
+    Jump,           // target
+    JumpIfFalse,    // target
+    BodyEnd,        // link start, chain end
+    Repeat,         // link start
+    RepeatIfTrue,   // link start, chain end
+    RepeatIfFalse,  // link start, chain end
+    ClearResult,
+    Generic,        // expression object
+    End,
+
+    OpcodeCount
+};
+
+/**
+ * Where a bytecode instruction came from, and where control goes when a sentinel
+ * (raise, exit scope) is returned while executing it. The table is only consulted
+ * on slow paths.
+ */
+struct BytecodeOrigin
+{
+    ExprExpressionList* list;
+    ssize_t index;
+
+    // Target pc for a raise; the error label of the innermost list, or its break target
+    ssize_t raiseTarget;
+
+    // Target pc when the innermost list is left early. -1 means leaving the block.
+    ssize_t breakTarget;
+};
+
+/**
+ * A function body lowered to a flat instruction array. Conditional chains are inlined
+ * as jumps, so a loop written as "if (...) { ...; repeat }" never leaves the block.
+ */
+struct BytecodeBlock
+{
+    std::vector<intptr_t> code;
+
+    // Parallel to code; only entries at opcode positions are meaningful
+    std::vector<BytecodeOrigin> origins;
+
+    // Number of expressions in the source list when compiled. Used to detect
+    // lists that have grown since (the parser appends to the root body)
+    size_t sourceSize = 0;
+};
+
+/**
+ * Lowers expression lists to bytecode blocks. Blocks are cached on the expression list.
+ */
+class BytecodeCompiler
+{
+public:
+
+    /**
+     * Returns the bytecode block for the given list, compiling it if necessary.
+     */
+    static BytecodeBlock* compile(ExprExpressionList* list);
+
+private:
+
+    BytecodeBlock* block;
+
+    void emitList(ExprExpressionList* list, ssize_t breakTarget);
+    void emitChain(ExprConditionalChain* chain, BytecodeOrigin origin);
+    void emitExpression(Object* expr, const BytecodeOrigin& origin);
+
+    size_t emit(Opcode op, const BytecodeOrigin& origin);
+    void emitOperand(intptr_t operand);
+    size_t here() const;
+};
+
+/**
+ * Executes bytecode blocks. Uses computed goto dispatch where the compiler supports it,
+ * and a switch statement otherwise.
+ */
+class BytecodeInterpreter
+{
+public:
+
+    /**
+     * Evaluates a function body. Returns the last evaluated result, which may be a
+     * sentinel object, exactly like ExprExpressionList::eval
+     */
+    static Object* run(ExprExpressionList* body);
+};
+
+}//ns
+
+#endif //LAKE_BYTECODE_H
@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include "CodeArena.h"
+#include "Object.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace lake {
+
+// Passed by reference to std::min and std::max, so C++14 requires definitions
+constexpr size_t CodeArena::CHUNK_SIZE;
+constexpr size_t CodeArena::REGION_CHUNK_SIZE;
+
+CodeArena::~CodeArena()
+{
+    for (Object* node : nodes)
+        node->~Object();
+
+    for (auto& chunk : chunks)
+    {
+#ifdef _WIN32
+        _aligned_free(chunk.first);
+#else
+        ::free(chunk.first);
+#endif
+    }
+
+    if (accounted != nullptr)
+        *accounted -= (int64_t) reserved;
+}
+
+void CodeArena::refill(size_t size)
+{
+    // Regions double their chunks, starting small
+    size_t chunk = collectable ? std::min(CHUNK_SIZE, std::max(REGION_CHUNK_SIZE, reserved)) : CHUNK_SIZE;
+    size_t bytes = std::max(size, chunk);
+    void* mem = nullptr;
+
+#ifdef _WIN32
+    mem = _aligned_malloc(bytes, ALIGN);
+#else
+    if (posix_memalign(&mem, ALIGN, bytes) != 0)
+        mem = nullptr;
+#endif
+
+    if (mem == nullptr)
+        throw std::runtime_error("Out of memory allocating code arena chunk");
+
+    chunks.emplace_back((char*) mem, bytes);
+    reserved += bytes;
+
+    if (accounted != nullptr)
+        *accounted += (int64_t) bytes;
+
+    next = (char*) mem;
+    end = next + bytes;
+}
+
+void CodeArena::discard(void* ptr)
+{
+    if (!nodes.empty() && nodes.back() == ptr)
+        nodes.pop_back();
+}
+
+void CodeArena::addRoot(Object* obj)
+{
+    if (obj != nullptr && obj->hasFlag(FLAG_GC_TRACKED))
+        roots.push_back(obj);
+}
+
+void CodeArena::markRoots()
+{
+    for (Object* obj : roots)
+        obj->mark();
+}
+
+}//ns
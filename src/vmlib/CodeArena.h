@@ -0,0 +1,141 @@
+#ifndef LAKE_CODEARENA_H
+#define LAKE_CODEARENA_H
+
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace lake {
+
+class Object;
+
+/**
+ * Memory for instruction nodes. Nodes are bump allocated from large chunks in the order
+ * the parser creates them, which for straight-line code is the order they're evaluated
+ * in, so evaluation walks memory mostly forward.
+ *
+ * Nodes in an arena are never tracked, so the collector neither marks nor sweeps them.
+ * The data they reference, such as pushed literals and function objects, lives on the
+ * heap like any other object. The parser adds it to the arena's roots, which the
+ * collector marks instead of tracing the code.
+ *
+ * The VM's arena holds the program, and lives as long as the VM. Code created at runtime,
+ * by casting a string to a function, gets a collectable arena of its own, called a region.
+ * A region is marked through the functions whose body it holds, and is released by the
+ * mutator once a full collection finds it unmarked. Regions start with a small chunk, as
+ * most hold a few nodes, and count their chunks in the VM's bytes in use, so creating
+ * code triggers collections like allocating objects does.
+ */
+class CodeArena
+{
+public:
+
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t REGION_CHUNK_SIZE = 1024;
+    static constexpr size_t ALIGN = 16;
+
+    /**
+     * If 'accounted' is set, reserved chunks are added to it, and subtracted when the arena
+     * is released
+     */
+    explicit CodeArena(bool collectable = false, int64_t* accounted = nullptr) : collectable(collectable), accounted(accounted) {}
+    CodeArena(const CodeArena&) = delete;
+    CodeArena& operator=(const CodeArena&) = delete;
+
+    /**
+     * Destructs the nodes and releases the chunks
+     */
+    ~CodeArena();
+
+    /**
+     * Allocates memory for a node of 'size' bytes
+     */
+    inline void* allocate(size_t size)
+    {
+        size = (size + ALIGN - 1) & ~(ALIGN - 1);
+
+        if (size > (size_t) (end - next))
+            refill(size);
+
+        void* ptr = next;
+        next += size;
+
+        nodes.push_back((Object*) ptr);
+        return ptr;
+    }
+
+    /**
+     * Forgets an allocation whose constructor threw. The memory is not reused.
+     */
+    void discard(void* ptr);
+
+    /**
+     * Keeps a tracked object referenced by the code alive for as long as the arena is.
+     * Untracked objects, such as defines, need no root and are ignored.
+     */
+    void addRoot(Object* obj);
+
+    /**
+     * Marks the roots
+     */
+    void markRoots();
+
+    /**
+     * Marks a region and its roots, unless it's already marked in this cycle. Called for
+     * each function whose body is in the arena, possibly by several marking threads.
+     */
+    inline void mark()
+    {
+        if (collectable && !marked.exchange(true, std::memory_order_relaxed))
+            markRoots();
+    }
+
+    /**
+     * Keeps a region for the lifetime of the VM. Used when its code escapes as a value
+     * which is never collected, such as an expression list object.
+     */
+    inline void pin()
+    {
+        pinned = true;
+    }
+
+    // Number of nodes allocated
+    inline size_t size() const
+    {
+        return nodes.size();
+    }
+
+    // Bytes reserved for chunks
+    inline size_t bytes() const
+    {
+        return reserved;
+    }
+
+    const bool collectable;
+    bool pinned = false;
+
+    // Set when a collection finds a region reachable; cleared by VM::sweepRegions
+    std::atomic<bool> marked {false};
+
+private:
+
+    void refill(size_t size);
+
+    char* next = nullptr;
+    char* end = nullptr;
+
+    std::vector<std::pair<char*, size_t>> chunks;
+    size_t reserved = 0;
+    int64_t* accounted;
+
+    // Nodes in allocation order, destructed with the arena
+    std::vector<Object*> nodes;
+
+    std::vector<Object*> roots;
+};
+
+}//ns
+
+#endif //LAKE_CODEARENA_H
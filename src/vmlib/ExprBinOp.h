@@ -3,31 +3,74 @@
 
 #include <sstream>
 #include <numeric>
+#include <algorithm>
 #include "Object.h"
 #include "Process.h"
 #include "VM.h"
 #include "ExprInvoke.h"
 #include "ExprColl.h"
+#include "ExprQuickened.h"
 
 namespace lake {
 
-    inline void recursiveIterator(Object* val, std::function<void(Object*)> fn)
+    /**
+     * Visits the values given to accumulate, flattening arrays, sets and projections
+     * deeply. Typed arrays, and projections of them, are passed to onRange as an element
+     * range of the typed array object; everything else is passed to onValue.
+     */
+    template <typename OnValue, typename OnRange>
+    inline void forEachInput(Object* val, OnValue& onValue, OnRange& onRange)
     {
         if (val->isArray())
         {
             for (Object* elem : *val->array)
             {
-                recursiveIterator(elem, fn);
+                forEachInput(elem, onValue, onRange);
             }
         }
         else if (val->isUnorderedSet())
         {
             for (Object* elem : *val->uset)
             {
-                recursiveIterator(elem, fn);
+                forEachInput(elem, onValue, onRange);
             }
         }
-        else if (val->isProjection())
+        else if (val->isPersistentVector())
+        {
+            val->pvec->forEach([&](Object* elem)
+            {
+                forEachInput(elem, onValue, onRange);
+            });
+        }
+        else if (val->isOrderedSet())
+        {
+            val->oset->forEach([&](Object* elem, NoValue)
+            {
+                forEachInput(elem, onValue, onRange);
+            });
+        }
+        else if (val->isProjection() && val->projection->collection->isOrderedSet())
+        {
+            forEachInRange(val->projection, [&](Object* elem, Object*)
+            {
+                forEachInput(elem, onValue, onRange);
+            });
+        }
+        else if (val->isTypedArray())
+        {
+            if (val->typed->size() > 0)
+                onRange(val, 0, val->typed->size());
+        }
+        else if (val->isProjection() && val->projection->collection->isTypedArray())
+        {
+            Object* coll = val->projection->collection;
+            size_t start = (size_t) val->projection->start;
+            size_t end = coll->typed->size() - std::min((size_t) val->projection->end, coll->typed->size());
+
+            if (start < end)
+                onRange(coll, start, end);
+        }
+        else if (val->isProjection() && val->projection->collection->isArray())
         {
             auto from = val->projection->collection->array->begin();
             auto to = val->projection->collection->array->end();
@@ -37,15 +80,223 @@ namespace lake {
 
             for (auto elem=from; elem != to; ++elem)
             {
-                recursiveIterator(*elem, fn);
+                forEachInput(*elem, onValue, onRange);
             }
         }
         else
         {
-            fn(val);
+            onValue(val);
         }
     }
 
+/**
+ * State of a built-in reduction. The result has the type of the initial value, or of the
+ * first value if the initial value is null. Values are combined into native or scratch GMP
+ * accumulators, so no objects are created until the result is pushed.
+ */
+class Reducer
+{
+public:
+
+    Reducer(Reduction reduction, Object* initial) :
+        reduction(reduction), initial(initial), intAcc(Object::scratchInt()), floatAcc(Object::scratchFloat())
+    {
+        mpz_init(operand);
+
+        if (reduction == Reduction::Count)
+        {
+            // Counts add to an integer, which starts at zero if there's no initial value
+            type = TokenType::TypeInt;
+            mpz_set_ui(intAcc, 0);
+
+            if (!initial->hasFlag(FLAG_ISNULL))
+            {
+                if (!initial->isInteger())
+                    throw std::runtime_error("accumulate count requires an integer initial value");
+
+                mpz_set(intAcc, initial->mpz);
+            }
+        }
+        else if (!initial->hasFlag(FLAG_ISNULL))
+        {
+            seed(initial);
+        }
+    }
+
+    ~Reducer()
+    {
+        mpz_clear(operand);
+    }
+
+    void add(Object* value)
+    {
+        if (reduction == Reduction::Count)
+            mpz_add_ui(intAcc, intAcc, 1);
+        else if (type == TokenType::Invalid)
+            seed(value);
+        else if (value->otype != type)
+            throw std::runtime_error("accumulate reductions require values of the same type. Missing cast?");
+        else if (type == TokenType::TypeInt)
+            combineInt(value->mpz);
+        else if (type == TokenType::TypeFloat)
+            combineFloat(value->mpf);
+        else if (type == TokenType::TypeDouble)
+            combineDouble(value->double_value);
+        else
+            combineBool(value->bool_value);
+    }
+
+    /**
+     * Adds the elements in [start, end) of a typed array, reducing them with a vectorized kernel
+     */
+    void add(const TypedArray* typed, size_t start, size_t end)
+    {
+        if (reduction == Reduction::Count)
+        {
+            mpz_add_ui(intAcc, intAcc, (unsigned long) (end - start));
+        }
+        else if (typed->kind() == TypedArray::Kind::Float64)
+        {
+            double value = typed->reduceFloat(reduction, start, end);
+
+            if (type == TokenType::Invalid)
+            {
+                type = TokenType::TypeDouble;
+                doubleAcc = value;
+            }
+            else if (type != TokenType::TypeDouble)
+                throw std::runtime_error("accumulate reductions of f64 arrays require an f64 initial value");
+            else
+                combineDouble(value);
+        }
+        else
+        {
+            mpz_set_si(operand, (long) typed->reduceInt(reduction, start, end));
+
+            if (type == TokenType::Invalid)
+            {
+                type = TokenType::TypeInt;
+                mpz_set(intAcc, operand);
+            }
+            else if (type != TokenType::TypeInt)
+                throw std::runtime_error("accumulate reductions of int and _uint8 arrays require an int initial value");
+            else
+                combineInt(operand);
+        }
+    }
+
+    /**
+     * Returns the reduced value, or the null initial value if there were no values
+     */
+    Object* result()
+    {
+        if (type == TokenType::TypeInt)
+            return Object::makeInt(intAcc);
+        else if (type == TokenType::TypeFloat)
+        {
+            Object* res = lake::track(Object::create(TokenType::TypeFloat));
+            mpf_set(res->mpf, floatAcc);
+            return res;
+        }
+        else if (type == TokenType::TypeDouble)
+            return Object::makeDouble(doubleAcc);
+        else if (type == TokenType::TypeBool)
+            return boolAcc ? &Object::trueObject() : &Object::falseObject();
+        else
+            return initial;
+    }
+
+private:
+
+    inline bool isBitwise() const
+    {
+        return reduction == Reduction::And || reduction == Reduction::Or || reduction == Reduction::Xor;
+    }
+
+    void seed(Object* value)
+    {
+        type = value->otype;
+
+        if (type == TokenType::TypeInt)
+            mpz_set(intAcc, value->mpz);
+        else if (type == TokenType::TypeFloat)
+            mpf_set(floatAcc, value->mpf);
+        else if (type == TokenType::TypeDouble)
+            doubleAcc = value->double_value;
+        else if (type == TokenType::TypeBool)
+            boolAcc = value->bool_value;
+        else
+            throw std::runtime_error("accumulate reductions require number or bool values");
+
+        if (type == TokenType::TypeBool && !isBitwise())
+            throw std::runtime_error("Only and, or and xor reductions apply to bool values");
+        else if ((type == TokenType::TypeFloat || type == TokenType::TypeDouble) && isBitwise())
+            throw std::runtime_error("Bitwise reductions require int values");
+    }
+
+    void combineInt(const mpz_t value)
+    {
+        switch (reduction)
+        {
+            case Reduction::Sum: mpz_add(intAcc, intAcc, value); break;
+            case Reduction::Product: mpz_mul(intAcc, intAcc, value); break;
+            case Reduction::Min: if (mpz_cmp(value, intAcc) < 0) mpz_set(intAcc, value); break;
+            case Reduction::Max: if (mpz_cmp(value, intAcc) > 0) mpz_set(intAcc, value); break;
+            case Reduction::And: mpz_and(intAcc, intAcc, value); break;
+            case Reduction::Or: mpz_ior(intAcc, intAcc, value); break;
+            case Reduction::Xor: mpz_xor(intAcc, intAcc, value); break;
+            case Reduction::Count: break;
+        }
+    }
+
+    void combineFloat(const mpf_t value)
+    {
+        switch (reduction)
+        {
+            case Reduction::Sum: mpf_add(floatAcc, floatAcc, value); break;
+            case Reduction::Product: mpf_mul(floatAcc, floatAcc, value); break;
+            case Reduction::Min: if (mpf_cmp(value, floatAcc) < 0) mpf_set(floatAcc, value); break;
+            case Reduction::Max: if (mpf_cmp(value, floatAcc) > 0) mpf_set(floatAcc, value); break;
+            default: break;
+        }
+    }
+
+    void combineDouble(double value)
+    {
+        switch (reduction)
+        {
+            case Reduction::Sum: doubleAcc += value; break;
+            case Reduction::Product: doubleAcc *= value; break;
+            case Reduction::Min: if (value < doubleAcc) doubleAcc = value; break;
+            case Reduction::Max: if (value > doubleAcc) doubleAcc = value; break;
+            default: break;
+        }
+    }
+
+    void combineBool(bool value)
+    {
+        switch (reduction)
+        {
+            case Reduction::And: boolAcc = boolAcc && value; break;
+            case Reduction::Or: boolAcc = boolAcc || value; break;
+            case Reduction::Xor: boolAcc = boolAcc != value; break;
+            default: break;
+        }
+    }
+
+    Reduction reduction;
+    Object* initial;
+    TokenType type = TokenType::Invalid;
+
+    mpz_t& intAcc;
+    mpf_t& floatAcc;
+    double doubleAcc = 0;
+    bool boolAcc = false;
+
+    // Holds the reduction of a typed range while it's combined into intAcc
+    mpz_t operand;
+};
+
 class ExprAccumulate : public Object
 {
 public:
@@ -54,8 +305,18 @@ public:
     {
     }
 
+    /**
+     * A built-in reduction, which takes the place of the accumulation function
+     */
+    explicit ExprAccumulate(Reduction reduction) : Object(TokenType::TypeOperation), builtin(true), reduction(reduction)
+    {
+    }
+
     virtual Object* eval() override
     {
+        if (builtin)
+            return reduce();
+
         static ExprInvoke invoke(false);
 
         // First argument is an accumulation function, such as a function doing "mul"
@@ -69,16 +330,25 @@ public:
         long count = vm().pop()->asLong();
 
         // This flattens the input, accumulating deeply. Beware of cycles...
-        // Make flat-or-not a stack argument?
-        std::vector<Object*> input;
+        // Make flat-or-not a stack argument? Typed array elements are recorded as
+        // the array and an index, and boxed as they're passed to the function.
+        std::vector<std::pair<Object*, size_t>> input;
+        auto onValue = [&input](Object* obj) { input.emplace_back(obj, 0); };
+        auto onRange = [&input](Object* typed, size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; i++)
+                input.emplace_back(typed, i);
+        };
+
         for (long i=0; i < count; i++)
         {
-            recursiveIterator(vm().pop(),
-                              [&input](Object* obj) { input.push_back(obj); });
+            forEachInput(vm().pop(), onValue, onRange);
         }
 
-        auto res = std::accumulate(input.begin(), input.end(), initial, [&] (Object* res,  Object* elem)
+        auto res = std::accumulate(input.begin(), input.end(), initial, [&] (Object* res, const std::pair<Object*, size_t>& entry)
         {
+            Object* elem = entry.first->isTypedArray() ? entry.first->typed->get((int64_t) entry.second) : entry.first;
+
             // The order here is important for non-commutative ops like subtraction.
             vm().push(elem);
             vm().push(res);
@@ -93,26 +363,137 @@ public:
         return res;
     }
 
+    /**
+     * Streams the input through a Reducer. Unlike the generic path, this doesn't
+     * collect the input or invoke a function per element.
+     */
+    Object* reduce()
+    {
+        Object* initial = vm().pop();
+        long count = vm().pop()->asLong();
+
+        Reducer reducer(reduction, initial);
+        auto onValue = [&reducer](Object* obj) { reducer.add(obj); };
+        auto onRange = [&reducer](Object* typed, size_t start, size_t end) { reducer.add(typed->typed, start, end); };
+
+        for (long i=0; i < count; i++)
+        {
+            forEachInput(vm().pop(), onValue, onRange);
+        }
+
+        Object* res = reducer.result();
+        vm().push(res);
+
+        return res;
+    }
+
+    /**
+     * Maps a reduction name, such as "sum", to a reduction. Returns false for other names.
+     */
+    static bool reductionOf(const std::string& name, Reduction& reduction)
+    {
+        for (Reduction candidate : {Reduction::Sum, Reduction::Product, Reduction::Min, Reduction::Max,
+                                    Reduction::Count, Reduction::And, Reduction::Or, Reduction::Xor})
+        {
+            if (name == reductionName(candidate))
+            {
+                reduction = candidate;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static const char* reductionName(Reduction reduction)
+    {
+        switch (reduction)
+        {
+            case Reduction::Sum: return TOK_SUM;
+            case Reduction::Product: return TOK_PRODUCT;
+            case Reduction::Min: return TOK_MIN;
+            case Reduction::Max: return TOK_MAX;
+            case Reduction::Count: return TOK_COUNT;
+            case Reduction::And: return TOK_AND;
+            case Reduction::Or: return TOK_OR;
+            default: return TOK_XOR;
+        }
+    }
+
     void externalize(std::ostream &str, int indentation) const override
     {
-        str << std::string(indentation, ' ') << TOK_ACCUMULATE << "\n";
+        str << std::string(indentation, ' ') << TOK_ACCUMULATE;
+
+        if (builtin)
+            str << " " << reductionName(reduction);
+
+        str << "\n";
     }
+
+private:
+
+    bool builtin = false;
+    Reduction reduction = Reduction::Sum;
 };
 
 class ExprBinOp : public Object
 {
 public:
 
-    ExprBinOp(std::function<Object*(Object*, Object*, Object*)> op, TokenType tok, const char* token, bool evaluate=true) : Object(tok), op(op), token(token), evaluate(evaluate)
+    ExprBinOp(std::function<Object*(Object*, Object*, Object*)> op, TokenType tok, const char* token, bool evaluate=true) :
+        Object(tok), evaluate(evaluate), allowMixedTypes(tok == TokenType::Is || tok == TokenType::Same), token(token), op(op)
     {
     }
 
     virtual Object* eval() override
+    {
+        Object* first;
+        Object* second;
+        popOperands(first, second);
+
+        Object* result = op(first, first, second);
+        vm().push(result);
+
+        return result;
+    }
+
+    void externalize(std::ostream &str, int indentation) const override
+    {
+        str << std::string(indentation, ' ') << token << "\n";
+    }
+
+    /**
+     * Throws unless the operands have equal types. Mixed types are allowed for
+     * ptr- and type equality checks, and for element-wise operations where a typed
+     * array is combined with a scalar.
+     */
+    static inline void checkOperandTypes(Object* first, Object* second, bool allowMixedTypes)
+    {
+        if (second->otype != first->otype && !allowMixedTypes && !first->isTypedArray() && !second->isTypedArray())
+        {
+            if ((first->otype == TokenType::TypeInt || second->otype == TokenType::TypeInt) &&
+                (first->otype == TokenType::TypeInt || second->otype == TokenType::TypeInt))
+            {
+                throw std::runtime_error("Missing cast: Attempt to mix int and float.");
+            }
+            else
+            {
+                std::ostringstream s;
+                s << "Binary operations require equal types on stack (use cast) Types: ";
+                s << first->toString() << ", " << second->toString();
+                throw std::runtime_error(s.str().c_str());
+            }
+        }
+    }
+
+protected:
+
+    inline void popOperands(Object*& first, Object*& second)
     {
         // Pop in reverse order. This way, clients can push the first operand first, then the second
 
-        Object* first = vm().pop();
-        Object* second = vm().pop();
+        first = vm().pop();
+        second = vm().pop();
 
         // We evaluate after popping both operands, since eval() may push values
         // In some cases, we're asked not to evaluate operands, such as when comparing operand *types*
@@ -124,46 +505,170 @@ public:
 
         // Allow different types only for ptr- and type equality checks
         if (second->otype != first->otype)
-        {
-            bool _is = *op.target<decltype(&Object::is)>() == &Object::is;
-            bool _same = *op.target<decltype(&Object::same)>() == &Object::same;
+            checkOperandTypes(first, second, allowMixedTypes);
+    }
 
-            if (!_is && !_same)
-            {
-                if ((first->otype == TokenType::TypeInt || second->otype == TokenType::TypeInt) &&
-                    (first->otype == TokenType::TypeInt || second->otype == TokenType::TypeInt))
-                {
-                    throw std::runtime_error("Missing cast: Attempt to mix int and float.");
-                }
-                else
-                {
-                    std::ostringstream s;
-                    s << "Binary operations require equal types on stack (use cast) Types: ";
-                    s << first->toString() << ", " << second->toString();
-                    throw std::runtime_error(s.str().c_str());
-                }
-            }
-        }
+private:
 
-        // Turn op into a callable with bind
-        auto fun = std::bind(op, first, first, second);
-        Object* result = fun();
-        vm().push(result);
+    bool evaluate;
+    bool allowMixedTypes;
+
+    // For externalization
+    const char* token = nullptr;
+    const std::function<Object*(Object* /*this ptr*/, Object*, Object*)> op;
+};
+
+/**
+ * Specialized implementations for quickened binary operations. Each provides apply<T>
+ * for operands with representation T, and supports(T) telling which representations
+ * have a specialization.
+ */
+template <typename Kernel>
+struct ArithImpl
+{
+    template <TokenType T>
+    static inline Object* apply(Object* lhs, Object* rhs)
+    {
+        return Object::arithAs<Kernel, T>(lhs, rhs);
+    }
+
+    static inline bool supports(TokenType t)
+    {
+        return t == TokenType::TypeInt || t == TokenType::TypeFloat || t == TokenType::TypeDouble;
+    }
+};
+
+template <typename Kernel>
+struct CompareImpl
+{
+    template <TokenType T>
+    static inline Object* apply(Object* lhs, Object* rhs)
+    {
+        return Object::compareAs<Kernel, T>(lhs, rhs);
+    }
+
+    static inline bool supports(TokenType t)
+    {
+        return t == TokenType::TypeInt || t == TokenType::TypeFloat || t == TokenType::TypeDouble;
+    }
+};
+
+struct EqualImpl
+{
+    template <TokenType T>
+    static inline Object* apply(Object* lhs, Object* rhs)
+    {
+        return Object::numericEquals(lhs, rhs) ? &Object::trueObject() : &Object::falseObject();
+    }
+
+    static inline bool supports(TokenType t)
+    {
+        return t == TokenType::TypeInt || t == TokenType::TypeFloat || t == TokenType::TypeDouble;
+    }
+};
+
+/**
+ * Binary operation quickened for operands of representation T. The guard checks the
+ * types of the two operands on the stack before anything is popped.
+ */
+template <typename Impl, TokenType T>
+class ExprQuickBinOp : public ExprQuickened
+{
+public:
+
+    ExprQuickBinOp(Object* generic) : ExprQuickened(generic)
+    {
+    }
+
+    virtual Object* eval() override
+    {
+        auto& items = vm().stacks.back()->items;
+        size_t size = items.size();
+
+        if (size < 2 || items[size-1]->otype != T || items[size-2]->otype != T)
+            return deoptimize();
+
+        Object* result = Impl::template apply<T>(items[size-1], items[size-2]);
+
+        items[size-2] = result;
+        items.pop_back();
 
         return result;
     }
+};
 
-    void externalize(std::ostream &str, int indentation) const override
+template <typename Impl>
+struct QuickBinOpFactory
+{
+    static Object* create(Object* generic, TokenType t)
     {
-        str << std::string(indentation, ' ') << token << "\n";
+        if (t == TokenType::TypeInt)
+            return new (*vm().currentCode) ExprQuickBinOp<Impl, TokenType::TypeInt>(generic);
+        else if (t == TokenType::TypeFloat)
+            return new (*vm().currentCode) ExprQuickBinOp<Impl, TokenType::TypeFloat>(generic);
+        else
+            return new (*vm().currentCode) ExprQuickBinOp<Impl, TokenType::TypeDouble>(generic);
+    }
+};
+
+template <>
+struct QuickBinOpFactory<void>
+{
+    static Object* create(Object* generic, TokenType t)
+    {
+        return nullptr;
+    }
+
+    static inline bool supports(TokenType t)
+    {
+        return false;
+    }
+};
+
+/**
+ * A binary operation node specialized for one operation. The operation is a template
+ * argument, so eval() calls it directly rather than through the type-erased op held by
+ * ExprBinOp, allowing the kernel to be inlined.
+ *
+ * If an implementation for quickening is given, the first evaluation with numeric
+ * operands rewrites the site into an ExprQuickBinOp for their representation. The parser
+ * creates one node per site for this to be effective.
+ */
+template <Object* (Object::*Op)(Object*, Object*), typename Impl = void>
+class ExprKernelBinOp : public ExprBinOp
+{
+public:
+
+    ExprKernelBinOp(TokenType tok, const char* token, bool evaluate=true) : ExprBinOp(Op, tok, token, evaluate)
+    {
+    }
+
+    virtual Object* eval() override
+    {
+        Object* first;
+        Object* second;
+        popOperands(first, second);
+
+        Object* result = (first->*Op)(first, second);
+        vm().push(result);
+
+        if (!quickened && supports(first->otype) && vm().quickening())
+        {
+            quickened = true;
+            vm().requestRewrite(this, QuickBinOpFactory<Impl>::create(this, first->otype));
+        }
+
+        return result;
     }
 
 private:
 
-    bool evaluate;
-    // For externalization
-    const char* token = nullptr;
-    const std::function<Object*(Object* /*this ptr*/, Object*, Object*)> op;
+    static inline bool supports(TokenType t)
+    {
+        return std::conditional<std::is_void<Impl>::value, QuickBinOpFactory<void>, Impl>::type::supports(t);
+    }
+
+    bool quickened = false;
 };
 
 }//ns
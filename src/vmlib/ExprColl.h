@@ -3,6 +3,7 @@
 
 #include "Object.h"
 #include "ExprExpressionList.h"
+#include "ExprQuickened.h"
 
 namespace lake
 {
@@ -13,6 +14,43 @@ enum class IndexType : uint8_t
     Insert
 };
 
+/**
+ * Persistent collections are never updated in place. Instead, the coll instructions
+ * push the new version, which shares most of its nodes with the old one.
+ */
+inline void pushVersion(PersistentVector&& version)
+{
+    vm().push(lake::track(Object::create(new PersistentVector(std::move(version)))));
+}
+
+inline void pushVersion(PersistentMap&& version)
+{
+    vm().push(lake::track(Object::create(new PersistentMap(std::move(version)))));
+}
+
+/**
+ * A char, string or rope as a rope, which shares the nodes of a rope
+ */
+inline Rope toRope(Object* val)
+{
+    if (val->otype == TokenType::TypeRope)
+        return Rope(*val->rope);
+    else if (val->otype == TokenType::TypeString)
+        return Rope(*val->str_value);
+    else if (val->otype == TokenType::TypeChar)
+        return Rope(std::string(1, (char) val->char_value));
+    else
+        throw std::runtime_error("can only add string, char and rope values to ropes");
+}
+
+inline size_t ropeIndex(Object* rope, long idx, bool allowEnd = false)
+{
+    if (idx < 0 || (size_t) idx > rope->rope->size() || ((size_t) idx == rope->rope->size() && !allowEnd))
+        throw std::runtime_error("rope index out of range");
+
+    return (size_t) idx;
+}
+
 /**
  * Creates a new unordered map on the stack
  */
@@ -25,7 +63,7 @@ public:
 
     virtual Object *eval() override
     {
-        auto map = new std::unordered_map<Object*, Object*>();
+        auto map = new ObjectMap();
         if (initialSize > 1)
             map->reserve((size_t) initialSize);
 
@@ -75,6 +113,9 @@ private:
 /**
  * Implements coll-project(coll, start, end) where start/end are zero-based indices from start
  * and beginning of a collection.
+ *
+ * For omap and oset, start and end are keys, and the projection covers the keys in [start, end).
+ * A null start or end leaves that side unbounded.
  */
 class ExprCollProjection : public Object
 {
@@ -87,8 +128,9 @@ public:
     {
         // The collection we're projecting
         Object* coll = vm().pop();
-        if (coll->otype != TokenType::TypeArray)
-            throw std::runtime_error("coll projection only supports arrays for now");
+        if (coll->otype != TokenType::TypeArray && coll->otype != TokenType::TypeTypedArray &&
+            !coll->isOrderedMap() && !coll->isOrderedSet() && !coll->isRope())
+            throw std::runtime_error("coll projection only supports arrays, omap, oset and ropes for now");
 
         // Zero-based start
         Object* start = vm().pop();
@@ -96,10 +138,31 @@ public:
         // Zero-based end. 0=the end, 1=except the last one, etc
         Object* end = vm().pop();
 
+        // A rope slice is a new rope sharing the chunks within the range
+        if (coll->isRope())
+        {
+            long first = start->asLong();
+            long last = (long) coll->rope->size() - end->asLong();
+            if (first < 0 || first > last || last > (long) coll->rope->size())
+                throw std::runtime_error("rope projection out of range");
+
+            vm().push(lake::track(Object::create(new Rope(coll->rope->slice((size_t) first, (size_t) last)))));
+            return nullptr;
+        }
+
         ProjectionData* projdata = new ProjectionData();
         projdata->collection = coll;
-        projdata->start = start->asLong();
-        projdata->end = end->asLong();
+
+        if (coll->isOrderedMap() || coll->isOrderedSet())
+        {
+            projdata->lower = start->hasFlag(FLAG_ISNULL) ? nullptr : start;
+            projdata->upper = end->hasFlag(FLAG_ISNULL) ? nullptr : end;
+        }
+        else
+        {
+            projdata->start = start->asLong();
+            projdata->end = end->asLong();
+        }
 
         Object* projection = Object::create(projdata);
 
@@ -147,6 +210,28 @@ public:
             else
                 vm().push(&Object::falseObject());
         }
+        else if (arr->otype == TokenType::TypeOrderedMap)
+        {
+            vm().push(arr->omap->find(val).atEnd() ? &Object::falseObject() : &Object::trueObject());
+        }
+        else if (arr->otype == TokenType::TypeOrderedSet)
+        {
+            vm().push(arr->oset->find(val).atEnd() ? &Object::falseObject() : &Object::trueObject());
+        }
+        else if (arr->otype == TokenType::TypePersistentVector)
+        {
+            bool found = false;
+            arr->pvec->forEach([&](Object* obj)
+            {
+                found = found || std::equal_to<Object*>()(obj, val);
+            });
+
+            vm().push(found ? &Object::trueObject() : &Object::falseObject());
+        }
+        else if (arr->otype == TokenType::TypePersistentMap)
+        {
+            vm().push(arr->pmap->find(val) != nullptr ? &Object::trueObject() : &Object::falseObject());
+        }
         else if (arr->otype == TokenType::TypeArray)
         {
             for (const Object* obj : *arr->array)
@@ -160,6 +245,10 @@ public:
 
             vm().push(&Object::falseObject());
         }
+        else if (arr->otype == TokenType::TypeTypedArray)
+        {
+            vm().push(arr->typed->contains(val) ? &Object::trueObject() : &Object::falseObject());
+        }
         else if (arr->otype == TokenType::TypeString)
         {
             for (char ch : *arr->str_value)
@@ -173,6 +262,16 @@ public:
 
             vm().push(&Object::falseObject());
         }
+        else if (arr->otype == TokenType::TypeRope)
+        {
+            bool found = false;
+            arr->rope->forEachChunk([&](const char* data, size_t length)
+            {
+                found = found || memchr(data, (char) val->char_value, length) != nullptr;
+            });
+
+            vm().push(found ? &Object::trueObject() : &Object::falseObject());
+        }
         else throw std::runtime_error("contains expected a collection type on the stack");
 
         return nullptr;
@@ -184,6 +283,49 @@ public:
     }
 };
 
+/**
+ * Put quickened for arrays indexed by an integer. Deoptimizes on any other operand types.
+ */
+class ExprQuickArrayPut : public ExprQuickened
+{
+public:
+
+    ExprQuickArrayPut(Object* generic) : ExprQuickened(generic)
+    { }
+
+    virtual Object* eval() override
+    {
+        auto& items = vm().stacks.back()->items;
+        size_t size = items.size();
+
+        if (size < 3 || items[size-1]->otype != TokenType::TypeArray || items[size-3]->otype != TokenType::TypeInt)
+            return deoptimize();
+
+        Object* arr = items[size-1];
+        Object* val = items[size-2];
+        long idx = items[size-3]->asLong();
+        items.resize(size-3);
+
+        if (idx != -1)
+        {
+            if (idx >= arr->array->size())
+                throw std::runtime_error("put offset is out of range");
+
+            arr->array->at(idx) = val;
+        }
+        else
+        {
+            size_t before = arr->ownedBytes();
+            arr->array->push_back(val);
+            accountGrowth(arr, before);
+        }
+
+        writeBarrier(arr, val);
+
+        return nullptr;
+    }
+};
+
 class ExprCollPut : public Object
 {
 public:
@@ -195,17 +337,31 @@ public:
         Object* arr = vm().pop();
         Object* val = vm().pop();
 
+        size_t before = arr->ownedBytes();
+
         if (arr->otype == TokenType::TypePair)
         {
             Object* first = vm().pop();
             arr->pair->first = first;
             arr->pair->second = val;
+
+            writeBarrier(arr, first);
+            writeBarrier(arr, val);
         }
         else if (arr->otype == TokenType::TypeArray)
         {
             long idx = indexType == IndexType::Append ? -1 : 0;
             if (indexType == IndexType::Parameterized)
-                idx = vm().pop()->asLong();
+            {
+                Object* index = vm().pop();
+                idx = index->asLong();
+
+                if (!quickened && index->otype == TokenType::TypeInt && vm().quickening())
+                {
+                    quickened = true;
+                    vm().requestRewrite(this, new (*vm().currentCode) ExprQuickArrayPut(this));
+                }
+            }
 
             if (indexType == IndexType::Insert)
                 arr->array->insert(arr->array->begin(), val);
@@ -218,6 +374,22 @@ public:
             }
             else
                 arr->array->push_back(val);
+
+            writeBarrier(arr, val);
+        }
+        else if (arr->otype == TokenType::TypeTypedArray)
+        {
+            // Elements are stored unboxed, so there's no reference for the write barrier
+            long idx = indexType == IndexType::Append ? -1 : 0;
+            if (indexType == IndexType::Parameterized)
+                idx = vm().pop()->asLong();
+
+            if (indexType == IndexType::Insert)
+                arr->typed->insert(0, val);
+            else if (idx != -1)
+                arr->typed->set(idx, val);
+            else
+                arr->typed->append(val);
         }
         else if (arr->otype == TokenType::TypeString)
         {
@@ -225,6 +397,8 @@ public:
             if (indexType == IndexType::Parameterized)
                 idx = vm().pop()->asLong();
 
+            arr->ownString();
+
             // Insert at beginning
             if (indexType == IndexType::Insert)
             {
@@ -255,18 +429,79 @@ public:
 
             }
         }
+        else if (arr->otype == TokenType::TypeRope)
+        {
+            long idx = indexType == IndexType::Append ? -1 : 0;
+            if (indexType == IndexType::Parameterized)
+                idx = vm().pop()->asLong();
+
+            // Like strings, putting a char replaces the char at the index, while strings and ropes are inserted
+            if (indexType == IndexType::Insert)
+                arr->rope->insert(0, toRope(val));
+            else if (idx != -1 && val->otype == TokenType::TypeChar)
+                arr->rope->set(ropeIndex(arr, idx), (char) val->char_value);
+            else if (idx != -1)
+                arr->rope->insert(ropeIndex(arr, idx, true), toRope(val));
+            else if (val->otype == TokenType::TypeChar)
+            {
+                char ch = (char) val->char_value;
+                arr->rope->append(&ch, 1);
+            }
+            else if (val->otype == TokenType::TypeString)
+                arr->rope->append(*val->str_value);
+            else
+                arr->rope->append(toRope(val));
+        }
         else if (arr->otype == TokenType::TypeUnorderedMap)
         {
             Object* key = vm().pop();
 
             (*arr->umap)[key] = val;
+
+            writeBarrier(arr, key);
+            writeBarrier(arr, val);
         }
         else if (arr->otype == TokenType::TypeUnorderedSet)
         {
             arr->uset->insert(val);
+            writeBarrier(arr, val);
+        }
+        else if (arr->otype == TokenType::TypeOrderedMap)
+        {
+            Object* key = vm().pop();
+
+            (*arr->omap)[key] = val;
+
+            writeBarrier(arr, key);
+            writeBarrier(arr, val);
+        }
+        else if (arr->otype == TokenType::TypeOrderedSet)
+        {
+            arr->oset->insert(val, NoValue());
+            writeBarrier(arr, val);
+        }
+        else if (arr->otype == TokenType::TypePersistentVector)
+        {
+            long idx = indexType == IndexType::Append ? -1 : 0;
+            if (indexType == IndexType::Parameterized)
+                idx = vm().pop()->asLong();
+
+            if (indexType == IndexType::Insert)
+                pushVersion(arr->pvec->insert(0, val));
+            else if (idx != -1)
+                pushVersion(arr->pvec->set((size_t) idx, val));
+            else
+                pushVersion(arr->pvec->append(val));
+        }
+        else if (arr->otype == TokenType::TypePersistentMap)
+        {
+            Object* key = vm().pop();
+            pushVersion(arr->pmap->put(key, val));
         }
         else throw std::runtime_error("put expected a collection type on the stack");
 
+        accountGrowth(arr, before);
+
         return nullptr;
     }
 
@@ -288,6 +523,35 @@ public:
 
 private:
     IndexType indexType;
+    bool quickened = false;
+};
+
+/**
+ * Get quickened for arrays indexed by an integer. Deoptimizes on any other operand types.
+ */
+class ExprQuickArrayGet : public ExprQuickened
+{
+public:
+
+    ExprQuickArrayGet(Object* generic) : ExprQuickened(generic)
+    { }
+
+    virtual Object* eval() override
+    {
+        auto& items = vm().stacks.back()->items;
+        size_t size = items.size();
+
+        if (size < 2 || items[size-1]->otype != TokenType::TypeArray || items[size-2]->otype != TokenType::TypeInt)
+            return deoptimize();
+
+        Object* arr = items[size-1];
+        long idx = items[size-2]->asLong();
+        items.pop_back();
+
+        items.back() = idx != -1 ? arr->array->at(idx) : arr->array->back();
+
+        return nullptr;
+    }
 };
 
 /**
@@ -307,6 +571,13 @@ public:
     {
         Object* arr = vm().pop();
         get(arr);
+
+        if (!quickened && arr->otype == TokenType::TypeArray && indexType == IndexType::Parameterized && vm().quickening())
+        {
+            quickened = true;
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickArrayGet(this));
+        }
+
         return nullptr;
     }
 
@@ -339,6 +610,17 @@ public:
             else
                 vm().push(arr->array->back());
         }
+        else if (arr->otype == TokenType::TypeTypedArray)
+        {
+            long idx = indexType == IndexType::Append ? -1 : 0;
+            if (indexType == IndexType::Parameterized)
+                idx = vm().pop()->asLong();
+
+            if (idx != -1 && projection)
+                idx += projection->start;
+
+            vm().push(arr->typed->get(idx));
+        }
         else if (arr->otype == TokenType::TypeProjection)
         {
             get(arr->projection->collection, arr->projection);
@@ -356,7 +638,18 @@ public:
             else
                 ch = arr->str_value->back();
 
-            vm().push(lake::track(Object::create(ch)));
+            vm().push(Object::immediate(ch));
+        }
+        else if (arr->otype == TokenType::TypeRope)
+        {
+            long idx = indexType == IndexType::Append ? -1 : 0;
+            if (indexType == IndexType::Parameterized)
+                idx = vm().pop()->asLong();
+
+            if (idx == -1)
+                idx = (long) arr->rope->size() - 1;
+
+            vm().push(Object::immediate(arr->rope->at(ropeIndex(arr, idx))));
         }
         else if (arr->otype == TokenType::TypeUnorderedMap)
         {
@@ -377,6 +670,43 @@ public:
             else
                 vm().push(*itr);
         }
+        else if (arr->otype == TokenType::TypeOrderedMap || arr->otype == TokenType::TypeOrderedSet)
+        {
+            Object* key = vm().pop();
+
+            // Projections only see the keys in their range
+            if (projection && ((projection->lower && Object::order(key, projection->lower) < 0) ||
+                               (projection->upper && Object::order(key, projection->upper) >= 0)))
+            {
+                vm().push(&Object::nullObject<TokenType::TypeObject>());
+            }
+            else if (arr->otype == TokenType::TypeOrderedMap)
+            {
+                auto itr = arr->omap->find(key);
+                vm().push(itr.atEnd() ? &Object::nullObject<TokenType::TypeObject>() : itr.value());
+            }
+            else
+            {
+                auto itr = arr->oset->find(key);
+                vm().push(itr.atEnd() ? &Object::nullObject<TokenType::TypeObject>() : itr.key());
+            }
+        }
+        else if (arr->otype == TokenType::TypePersistentVector)
+        {
+            long idx = indexType == IndexType::Append ? -1 : 0;
+            if (indexType == IndexType::Parameterized)
+                idx = vm().pop()->asLong();
+
+            if (idx == -1 && arr->pvec->size() == 0)
+                throw std::runtime_error("get of the last element of an empty pvec");
+
+            vm().push(arr->pvec->get(idx != -1 ? (size_t) idx : arr->pvec->size() - 1));
+        }
+        else if (arr->otype == TokenType::TypePersistentMap)
+        {
+            Object* value = arr->pmap->find(vm().pop());
+            vm().push(value != nullptr ? value : &Object::nullObject<TokenType::TypeObject>());
+        }
         else throw std::runtime_error("get expected a collection type on the stack");
     }
 
@@ -387,6 +717,7 @@ public:
 
 private:
     IndexType indexType;
+    bool quickened = false;
 };
 
 class ExprCollDel : public Object
@@ -399,6 +730,8 @@ public:
     {
         Object* coll = vm().pop();
 
+        size_t before = coll->ownedBytes();
+
         if (coll->otype == TokenType::TypePair)
         {
             long idx = vm().pop()->asLong();
@@ -415,14 +748,27 @@ public:
             else
                 coll->array->pop_back();
         }
+        else if (coll->otype == TokenType::TypeTypedArray)
+        {
+            coll->typed->erase(vm().pop()->asLong());
+        }
         else if (coll->otype == TokenType::TypeString)
         {
             long idx = vm().pop()->asLong();
+            coll->ownString();
             if (idx != -1)
                 coll->str_value->erase((size_t)idx, 1);
             else if (coll->str_value->length() > 0)
                 coll->str_value->erase(coll->str_value->length()-1, 1);
         }
+        else if (coll->otype == TokenType::TypeRope)
+        {
+            long idx = vm().pop()->asLong();
+            if (idx != -1)
+                coll->rope->erase(ropeIndex(coll, idx));
+            else if (coll->rope->size() > 0)
+                coll->rope->erase(coll->rope->size() - 1);
+        }
         else if (coll->otype == TokenType::TypeUnorderedMap)
         {
             Object* key = vm().pop();
@@ -443,8 +789,30 @@ public:
                 coll->uset->erase(val);
             }
         }
+        else if (coll->otype == TokenType::TypeOrderedMap)
+        {
+            coll->omap->erase(vm().pop());
+        }
+        else if (coll->otype == TokenType::TypeOrderedSet)
+        {
+            coll->oset->erase(vm().pop());
+        }
+        else if (coll->otype == TokenType::TypePersistentVector)
+        {
+            long idx = vm().pop()->asLong();
+            if (idx != -1)
+                pushVersion(coll->pvec->erase((size_t) idx));
+            else
+                pushVersion(coll->pvec->pop());
+        }
+        else if (coll->otype == TokenType::TypePersistentMap)
+        {
+            pushVersion(coll->pmap->erase(vm().pop()));
+        }
         else throw std::runtime_error("del expected a collection type on the stack");
 
+        accountGrowth(coll, before);
+
         return nullptr;
     }
 
@@ -463,19 +831,35 @@ public:
     virtual Object* eval() override
     {
         Object* coll = vm().pop();
+
+        size_t before = coll->ownedBytes();
+
         if (coll->otype == TokenType::TypeArray)
         {
             std::reverse(coll->array->begin(), coll->array->end());
         }
+        else if (coll->otype == TokenType::TypeTypedArray)
+        {
+            coll->typed->reverse();
+        }
         else if (coll->otype == TokenType::TypeString)
         {
+            coll->ownString();
             std::reverse(coll->str_value->begin(), coll->str_value->end());
         }
+        else if (coll->otype == TokenType::TypeRope)
+        {
+            std::string text = coll->rope->flatten();
+            std::reverse(text.begin(), text.end());
+            *coll->rope = Rope(text);
+        }
         else 
         {
             throw std::runtime_error("reverse expected array type on stack");
         }
 
+        accountGrowth(coll, before);
+
         return nullptr;
     }
 
@@ -491,12 +875,6 @@ public:
     ExprCollForeach() : Object(TokenType::TypeOperation)
     { }
 
-    void mark() override
-    {
-        setFlag(FLAG_GC_REACHABLE);
-        exprlist->mark();
-    }
-
     virtual Object* eval() override
     {
         Object* coll = vm().pop();
@@ -525,6 +903,49 @@ public:
                 exprlist->eval();
             }
         }
+        else if (coll->otype == TokenType::TypeOrderedMap)
+        {
+            iterateOrdered(coll, *coll->omap, nullptr, [](Object* key, Object* value)
+            {
+                vm().push(key);
+                vm().push(value);
+            });
+        }
+        else if (coll->otype == TokenType::TypeOrderedSet)
+        {
+            iterateOrdered(coll, *coll->oset, nullptr, [](Object* key, NoValue)
+            {
+                vm().push(key);
+            });
+        }
+        else if (coll->otype == TokenType::TypePersistentVector || coll->otype == TokenType::TypePersistentMap)
+        {
+            // The body commonly replaces the collection with a new version, leaving this one
+            // unreachable, so it's a root until the loop is done
+            auto& roots = vm().activeFunctions;
+            size_t depth = roots.size();
+            roots.push_back(coll);
+
+            if (coll->otype == TokenType::TypePersistentVector)
+            {
+                coll->pvec->forEach([this](Object* obj)
+                {
+                    vm().push(obj);
+                    exprlist->eval();
+                });
+            }
+            else
+            {
+                coll->pmap->forEach([this](Object* key, Object* value)
+                {
+                    vm().push(key);
+                    vm().push(value);
+                    exprlist->eval();
+                });
+            }
+
+            roots.resize(depth);
+        }
         else if (coll->otype == TokenType::TypePair)
         {
             vm().push(coll->pair->first);
@@ -548,6 +969,35 @@ public:
                 exprlist->eval();
             }
         }
+        else if (coll->otype == TokenType::TypeTypedArray)
+        {
+            // Elements are boxed as they're visited. The size is checked on each iteration,
+            // since the body may shrink the array.
+            size_t skip = end != -1 ? (size_t) end : 0;
+
+            for (size_t i = (size_t) start; i + skip < coll->typed->size(); i++)
+            {
+                vm().push(coll->typed->get((int64_t) i));
+                exprlist->eval();
+            }
+        }
+        else if (coll->otype == TokenType::TypeProjection && coll->projection->collection->isOrderedMap())
+        {
+            iterateOrdered(coll->projection->collection, *coll->projection->collection->omap, coll->projection,
+                           [](Object* key, Object* value)
+            {
+                vm().push(key);
+                vm().push(value);
+            });
+        }
+        else if (coll->otype == TokenType::TypeProjection && coll->projection->collection->isOrderedSet())
+        {
+            iterateOrdered(coll->projection->collection, *coll->projection->collection->oset, coll->projection,
+                           [](Object* key, NoValue)
+            {
+                vm().push(key);
+            });
+        }
         else if (coll->otype == TokenType::TypeProjection)
         {
             iterate(coll->projection->collection, coll->projection->start, coll->projection->end);
@@ -556,14 +1006,65 @@ public:
         {
             for (char ch : *coll->str_value)
             {
-                vm().push(lake::track(Object::create(ch)));
+                vm().push(Object::immediate(ch));
 
                 exprlist->eval();
             }
         }
+        else if (coll->otype == TokenType::TypeRope)
+        {
+            // Iterates a copy, which keeps the chunks unchanged if the body changes the rope
+            Rope rope(*coll->rope);
+            rope.forEachChunk([this](const char* data, size_t length)
+            {
+                for (size_t i = 0; i < length; i++)
+                {
+                    vm().push(Object::immediate(data[i]));
+
+                    exprlist->eval();
+                }
+            });
+        }
         else throw std::runtime_error("foreach expected collection type on stack");
     }
 
+    /**
+     * Visits the keys of an omap or oset in order, optionally limited to the range of a projection.
+     * The body may insert and delete keys, which invalidates the tree iterator; when the tree's
+     * version has changed, iteration resumes at the first key after the one last visited.
+     */
+    template <typename Tree, typename Push>
+    void iterateOrdered(Object* coll, Tree& tree, const ProjectionData* range, Push push)
+    {
+        // The collection may be popped, and the last key deleted, by the body, but both are needed
+        // to continue. They're roots until the loop is done.
+        auto& roots = vm().activeFunctions;
+        size_t depth = roots.size();
+        roots.push_back(coll);
+        roots.push_back(coll);
+
+        auto itr = range && range->lower ? tree.lowerBound(range->lower) : tree.begin();
+        while (!itr.atEnd())
+        {
+            Object* key = itr.key();
+            if (range && range->upper && Object::order(key, range->upper) >= 0)
+                break;
+
+            roots[depth + 1] = key;
+            uint64_t version = tree.version();
+
+            push(key, itr.value());
+            exprlist->eval();
+
+            if (tree.version() != version)
+                itr = tree.upperBound(key);
+            else
+                ++itr;
+        }
+
+        roots.resize(depth);
+    }
+
     void externalize(std::ostream &str, int indentation) const override
     {
         str << std::string(indentation, ' ') << TOK_COLLFOREACH << std::endl;
@@ -592,6 +1093,11 @@ public:
 
         if (coll->otype == TokenType::TypeArray)
             size = (int64_t) coll->array->size();
+        else if (coll->otype == TokenType::TypeTypedArray)
+            size = (int64_t) coll->typed->size();
+        else if (coll->otype == TokenType::TypeProjection &&
+                 (coll->projection->collection->isOrderedMap() || coll->projection->collection->isOrderedSet()))
+            forEachInRange(coll->projection, [&size](Object*, Object*) { size++; });
         else if (coll->otype == TokenType::TypeProjection)
         {
             pushSize(coll->projection->collection);
@@ -603,11 +1109,21 @@ public:
             size = (int64_t) coll->umap->size();
         else if (coll->otype == TokenType::TypeUnorderedSet)
             size = (int64_t) coll->uset->size();
+        else if (coll->otype == TokenType::TypeOrderedMap)
+            size = (int64_t) coll->omap->size();
+        else if (coll->otype == TokenType::TypeOrderedSet)
+            size = (int64_t) coll->oset->size();
+        else if (coll->otype == TokenType::TypePersistentVector)
+            size = (int64_t) coll->pvec->size();
+        else if (coll->otype == TokenType::TypePersistentMap)
+            size = (int64_t) coll->pmap->size();
         else if (coll->otype == TokenType::TypeString)
             size = (int64_t) coll->str_value->size();
+        else if (coll->otype == TokenType::TypeRope)
+            size = (int64_t) coll->rope->size();
         else throw std::runtime_error("size expected collection type on stack");
 
-        vm().push(lake::track(Object::create(size)));
+        vm().push(Object::makeInt(size));
     }
 
     void externalize(std::ostream &str, int indentation) const override
@@ -626,18 +1142,37 @@ public:
     {
         Object* coll = vm().pop();
 
+        size_t before = coll->ownedBytes();
+
         if (coll->otype == TokenType::TypeArray)
             coll->array->clear();
+        else if (coll->otype == TokenType::TypeTypedArray)
+            coll->typed->clear();
         else if (coll->otype == TokenType::TypePair)
         {   coll->pair->first = nullptr; coll->pair->second = nullptr; }
         else if (coll->otype == TokenType::TypeUnorderedMap)
             coll->umap->clear();
         else if (coll->otype == TokenType::TypeUnorderedSet)
             coll->uset->clear();
+        else if (coll->otype == TokenType::TypeOrderedMap)
+            coll->omap->clear();
+        else if (coll->otype == TokenType::TypeOrderedSet)
+            coll->oset->clear();
+        else if (coll->otype == TokenType::TypePersistentVector)
+            pushVersion(PersistentVector());
+        else if (coll->otype == TokenType::TypePersistentMap)
+            pushVersion(PersistentMap());
         else if (coll->otype == TokenType::TypeString)
+        {
+            coll->ownString();
             coll->str_value->clear();
+        }
+        else if (coll->otype == TokenType::TypeRope)
+            coll->rope->clear();
         else throw std::runtime_error("clear expected collection type on stack");
 
+        accountGrowth(coll, before);
+
         return nullptr;
     }
 
@@ -647,6 +1182,40 @@ public:
     }
 };
 
+/**
+ * Implements coll-fill(typed array, value, count), resizing a typed array to count elements
+ * which are all set to value
+ */
+class ExprCollFill : public Object
+{
+public:
+    ExprCollFill() : Object(TokenType::TypeOperation)
+    { }
+
+    virtual Object* eval() override
+    {
+        Object* coll = vm().pop();
+        Object* value = vm().pop();
+        long count = vm().pop()->asLong();
+
+        if (coll->otype != TokenType::TypeTypedArray)
+            throw std::runtime_error("fill expected a typed array on the stack");
+        if (count < 0)
+            throw std::runtime_error("fill count must not be negative");
+
+        size_t before = coll->ownedBytes();
+        coll->typed->fill(value, (size_t) count);
+        accountGrowth(coll, before);
+
+        return nullptr;
+    }
+
+    void externalize(std::ostream &str, int indentation) const override
+    {
+        str << std::string(indentation, ' ') << TOK_COLL << " " << TOK_COLLFILL << std::endl;
+    }
+};
+
 /**
  * Pops a collection off the stack, pushes all the elements in order, or reverse order
  */
@@ -678,10 +1247,30 @@ public:
                 }
             }
         }
+        else if (arr->otype == TokenType::TypeTypedArray)
+        {
+            size_t size = arr->typed->size();
+            for (size_t i = 0; i < size; i++)
+                vm().push(arr->typed->get((int64_t) (reverse ? size - 1 - i : i)));
+        }
         else if (arr->otype == TokenType::TypeString)
         {
             for (char& ch : *arr->str_value)
-                vm().push(lake::track(Object::create(ch)));
+                vm().push(Object::immediate(ch));
+        }
+        else if (arr->otype == TokenType::TypeRope)
+        {
+            const std::string& text = arr->rope->flatten();
+            if (reverse)
+            {
+                for (auto it = text.rbegin(); it != text.rend(); ++it)
+                    vm().push(Object::immediate(*it));
+            }
+            else
+            {
+                for (char ch : text)
+                    vm().push(Object::immediate(ch));
+            }
         }
         else if (arr->otype == TokenType::TypeUnorderedMap)
         {
@@ -700,6 +1289,37 @@ public:
                 vm().push(v);
             }
         }
+        else if (arr->otype == TokenType::TypeOrderedMap)
+        {
+            arr->omap->forEach([](Object* key, Object* value)
+            {
+                vm().push(key);
+                vm().push(value);
+            }, reverse);
+        }
+        else if (arr->otype == TokenType::TypeOrderedSet)
+        {
+            arr->oset->forEach([](Object* key, NoValue)
+            {
+                vm().push(key);
+            }, reverse);
+        }
+        else if (arr->otype == TokenType::TypePersistentVector)
+        {
+            arr->pvec->forEach([](Object* obj)
+            {
+                vm().push(obj);
+            }, reverse);
+        }
+        else if (arr->otype == TokenType::TypePersistentMap)
+        {
+            // Like umap, pmap is unordered, so the flag is ignored
+            arr->pmap->forEach([](Object* key, Object* value)
+            {
+                vm().push(key);
+                vm().push(value);
+            });
+        }
         else if (arr->otype == TokenType::TypePair)
         {
             if (reverse)
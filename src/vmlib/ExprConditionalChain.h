@@ -24,7 +24,9 @@ public:
         // If the guard is missing, trueObject is used (such as an unconditional else branch)
         if (guard != nullptr)
         {
-            guard->eval();
+            if (guard->eval() == &Object::tailcallRequestObject())
+                return &Object::tailcallRequestObject();
+
             res = vm().pop();
         }
 
@@ -59,7 +61,8 @@ public:
         }
         else if (nextChain != nullptr)
         {
-            nextChain->eval();
+            // Tail calls in else-branches must reach the function's expression list
+            return nextChain->eval();
         }
         else
         {
@@ -91,21 +94,6 @@ public:
             nextChain->externalize(str, indentation, TOK_ELSE);
     }
 
-    void mark() override
-    {
-        if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-            return;
-
-        setFlag(FLAG_GC_REACHABLE);
-
-        if (guard)
-            guard->mark();
-        if (body)
-            body->mark();
-        if (nextChain)
-            nextChain->mark();
-    }
-
     /**
      * After evaluating this list, an boolean object is expected
      * to be left on the stack. If null, the branch is unconditional.
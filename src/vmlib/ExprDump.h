@@ -27,6 +27,15 @@ public:
 
         if (Process::instance().traceLevel >= Process::DEBUG)
         {trace_debugf("%s", val == nullptr ? "<null>" : val->dump().c_str());}
+        else if (val != nullptr && val->isRope() && Process::instance().traceLevel >= Process::INFO)
+        {
+            // Ropes are written a chunk at a time rather than flattened
+            val->rope->forEachChunk([](const char* data, size_t length)
+            {
+                fwrite(data, 1, length, stdout);
+            });
+            printf("\n");
+        }
         else
         {trace_infof("%s", val == nullptr ? "<null>" : val->toString().c_str());}
 
@@ -43,17 +52,6 @@ public:
         }
         str << "\n";
     }
-
-    void mark() override
-    {
-        if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-            return;
-
-        setFlag(FLAG_GC_REACHABLE);
-
-        if (operand)
-            operand->mark();
-    }
 };
 
 class ExprDumpStack : public Object
@@ -107,6 +105,23 @@ public:
     }
 };
 
+class ExprDumpNumCache : public Object
+{
+public:
+    ExprDumpNumCache() : Object(TokenType::TypeOperation) { }
+
+    virtual Object *eval() override
+    {
+        vm().numcache.dump();
+        return nullptr;
+    }
+
+    void externalize(std::ostream &str, int indentation) const override
+    {
+        str << std::string(indentation, ' ') <<  TOK_DUMP << " " << TOK_NUMCACHE << "\n";
+    }
+};
+
 class ExprDumpFreeList : public Object
 {
 public:
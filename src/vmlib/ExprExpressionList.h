@@ -7,6 +7,7 @@
 #include "Exceptions.h"
 #include "ExprInvoke.h"
 #include "DebugInfo.h"
+#include "Bytecode.h"
 
 
 namespace lake {
@@ -21,24 +22,21 @@ public:
     ssize_t errorLabelIndex = -1;
     ssize_t prependCount = 0;
 
-    ExprExpressionList(Object* _owner = nullptr) : Object(TokenType::TypeOperation), owner(_owner)
+    /**
+     * Lowered form of this list, created on first use by the bytecode engine
+     */
+    BytecodeBlock* bytecode = nullptr;
+
+    /**
+     * 'code' is the arena holding the list and its expressions, if any
+     */
+    ExprExpressionList(Object* _owner = nullptr, CodeArena* code = nullptr) : Object(TokenType::TypeOperation), owner(_owner), code(code)
     {
     }
 
-    void mark() override
+    ~ExprExpressionList() override
     {
-        if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-            return;
-
-        setFlag(FLAG_GC_REACHABLE);
-
-        for (auto& expr : expressions)
-        {
-            expr->mark();
-        }
-
-        if (owner != nullptr)
-            owner->mark();
+        delete bytecode;
     }
 
     // TODO: need to be able to externalize expressionlist objects,
@@ -112,6 +110,8 @@ public:
     virtual Object* eval() override
     {
         Object* res = nullptr;
+        VM& machine = vm();
+        CodeScope scope(machine, code);
 
         std::vector<Object*>* exprlist = &expressions;
 
@@ -124,13 +124,24 @@ public:
                 auto& expr = exprlist->at(idx);
                 res = expr->eval();
 
+                // Install a quickened (or deoptimized) replacement for the node in this slot
+                if (machine.rewriteFrom != nullptr)
+                {
+                    if (machine.rewriteFrom == expr)
+                        expr = machine.rewriteTo;
+
+                    machine.rewriteFrom = nullptr;
+                }
+
                 if (res == &Object::tailcallRequestObject())
                 {
                     if (owner != nullptr && owner->otype != TokenType::TypeFunction)
                         return res;
 
                     // Grab the expression list from the target tail function and start over
-                    exprlist = &vm().tailcallRequest->fndata->body->expressions;
+                    ExprExpressionList* target = vm().tailcallRequest->fndata->body;
+                    exprlist = &target->expressions;
+                    scope.enter(target->code);
                     vm().tailcallRequest = nullptr;
                     goto restart;
                 }
@@ -166,24 +177,7 @@ public:
             }
             catch (const std::exception& e)
             {
-                if (idx < prependCount)
-                    idx = -idx;
-                else
-                    idx = idx - prependCount;
-
-                const auto& match = Process::instance().debugMap.find(
-                        StableExprListReference {(ptrdiff_t) &expressions, (ssize_t)(idx)});
-
-                if (match != Process::instance().debugMap.end())
-                {
-                    const auto& di = match->second;
-
-                    // Rethrow as exception with debug info.
-                    // This is the only place where an EvalException is created.
-                    throw EvalException(e.what(), di);
-                }
-
-                throw;
+                rethrowWithDebugInfo(e, idx);
             }
 
             if (res == &Object::exitScopeObject())
@@ -201,27 +195,76 @@ public:
         return res;
     }
 
+    /**
+     * Called while handling an exception thrown by the expression at the given index. The
+     * exception is rethrown as an EvalException if debug information is available.
+     */
+    [[noreturn]] void rethrowWithDebugInfo(const std::exception& e, ssize_t idx)
+    {
+        if (idx < prependCount)
+            idx = -idx;
+        else
+            idx = idx - prependCount;
+
+        const auto& match = Process::instance().debugMap.find(
+                StableExprListReference {(ptrdiff_t) &expressions, (ssize_t)(idx)});
+
+        if (match != Process::instance().debugMap.end())
+        {
+            const auto& di = match->second;
+
+            // Rethrow as exception with debug info.
+            // This is the only place where an EvalException is created.
+            throw EvalException(e.what(), di);
+        }
+
+        throw;
+    }
+
 protected:
+    friend class BytecodeCompiler;
+
+    /**
+     * Sets VM::currentCode while a list is evaluated, and restores it when evaluation ends,
+     * including by an exception. Lists without an arena keep the enclosing one.
+     */
+    class CodeScope
+    {
+    public:
+
+        CodeScope(VM& machine, CodeArena* code) : machine(machine), outer(machine.currentCode)
+        {
+            enter(code);
+        }
+
+        ~CodeScope()
+        {
+            machine.currentCode = outer;
+        }
+
+        inline void enter(CodeArena* code)
+        {
+            if (code != nullptr)
+                machine.currentCode = code;
+        }
+
+    private:
+
+        VM& machine;
+        CodeArena* outer;
+    };
+
     std::vector<Object*> expressions;
     Object* owner;
+    CodeArena* code;
 };
 
 class ExprExpressionListObject : public Object
 {
 public:
 
-    ExprExpressionListObject() : Object(TokenType::TypeExprListObject)
-    {
-    }
-
-    void mark() override
+    ExprExpressionListObject(CodeArena* code) : Object(TokenType::TypeExprListObject), expressionList(nullptr, code)
     {
-        if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-            return;
-
-        setFlag(FLAG_GC_REACHABLE);
-
-        expressionList.mark();
     }
 
     Object* eval() override
@@ -3,9 +3,40 @@
 
 #include "Object.h"
 #include "VM.h"
+#include "Stack.h"
+#include "ExprQuickened.h"
 
 namespace lake {
 
+/**
+ * Invoke quickened for function objects. Deoptimizes if anything else is invoked.
+ */
+template <bool Tail>
+class ExprQuickInvoke : public ExprQuickened
+{
+public:
+
+    ExprQuickInvoke(Object* generic) : ExprQuickened(generic) { }
+
+    virtual Object* eval() override
+    {
+        Stack* stack = vm().stacks.back();
+        if (stack->items.empty() || stack->items.back()->otype != TokenType::TypeFunction)
+            return deoptimize();
+
+        Object* evalObject = stack->items.back();
+        stack->items.pop_back();
+
+        if (Tail)
+        {
+            vm().tailcallRequest = evalObject;
+            return &Object::tailcallRequestObject();
+        }
+
+        return evalObject->fndata->evaluateBody(evalObject);
+    }
+};
+
 /**
  * Evaluates the object on the stack. If the object is a function object,
  * the body is evaluated.
@@ -41,6 +72,17 @@ public:
                 // This may return a sentinel as well (raise)
                 res =  evalObject->fndata->evaluateBody(evalObject);
             }
+
+            // Requested after the body is evaluated, as the body's lists consume pending requests
+            if (!quickened && vm().quickening())
+            {
+                quickened = true;
+
+                if (tail)
+                    vm().requestRewrite(this, new (*vm().currentCode) ExprQuickInvoke<true>(this));
+                else
+                    vm().requestRewrite(this, new (*vm().currentCode) ExprQuickInvoke<false>(this));
+            }
         }
         else
             res = evalObject->eval();
@@ -59,7 +101,10 @@ public:
     }
 
 private:
+    friend class BytecodeCompiler;
+
     bool tail = false;
+    bool quickened = false;
 };
 
 }//ns
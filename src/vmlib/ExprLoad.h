@@ -5,9 +5,41 @@
 #include "Process.h"
 #include "VM.h"
 #include "Stack.h"
+#include "ExprQuickened.h"
 
 namespace lake {
 
+/**
+ * Load quickened for one addressing mode. The addressing mode of a site never changes,
+ * so there is no guard.
+ */
+template <TokenType Mode>
+class ExprQuickLoad : public ExprQuickened
+{
+public:
+
+    ExprQuickLoad(Object* generic, int64_t index) : ExprQuickened(generic), index(index)
+    {
+    }
+
+    virtual Object *eval() override
+    {
+        Stack* stack = Mode == TokenType::AbsRoot ? vm().root->fndata->stack : vm().stacks.back();
+        int64_t idx = Mode == TokenType::Rel ? stack->getStackBase() + index + 1 : index;
+
+        if (idx < 0 || idx >= (int64_t) stack->items.size())
+            throw std::runtime_error("Attempt to read outside stack");
+
+        vm().push(stack->items[(size_t) idx]);
+
+        return nullptr;
+    }
+
+private:
+
+    int64_t index;
+};
+
 /**
  * Read local variable at the given index from the start of the stack/locals-vector,
  * and push it to top of stack.
@@ -84,6 +116,9 @@ public:
 
         vm().push(res);
 
+        if (!quickened && vm().quickening())
+            quicken();
+
         return nullptr;
     }
 
@@ -112,9 +147,24 @@ public:
     }
 
 private:
+    friend class BytecodeCompiler;
+
+    void quicken()
+    {
+        quickened = true;
+
+        if (addressingMode == TokenType::Abs)
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickLoad<TokenType::Abs>(this, index));
+        else if (addressingMode == TokenType::Rel)
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickLoad<TokenType::Rel>(this, index));
+        else if (addressingMode == TokenType::AbsRoot)
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickLoad<TokenType::AbsRoot>(this, index));
+    }
+
     int64_t index = 0;
     int64_t parentIndex = 0;
     TokenType addressingMode;
+    bool quickened = false;
 };
 
 }//ns
@@ -0,0 +1,54 @@
+#ifndef LAKE_EXPRQUICKENED_H
+#define LAKE_EXPRQUICKENED_H
+
+#include "Object.h"
+#include "Process.h"
+#include "VM.h"
+
+namespace lake {
+
+/**
+ * Base class for nodes installed by quickening.
+ *
+ * A quickened node replaces a generic node in its expression list slot, and runs a
+ * specialized path for as long as its guard holds. When the guard fails, the site is
+ * deoptimized: the generic node evaluates the instruction and is put back in the slot.
+ * A generic node quickens at most once, so polymorphic sites settle on the generic node.
+ *
+ * Like the nodes they replace, quickened nodes are never tracked, so the collector doesn't
+ * visit them. They are allocated in VM::currentCode, the arena of the list holding the
+ * site, and are released with it.
+ */
+class ExprQuickened : public Object
+{
+public:
+
+    ExprQuickened(Object* generic) : Object(generic->otype), generic(generic)
+    {
+    }
+
+    void externalize(std::ostream &str, int indentation) const override
+    {
+        generic->externalize(str, indentation);
+    }
+
+protected:
+
+    /**
+     * Evaluates the generic node and rewrites the slot back to it. Must be called
+     * before the node has changed any state.
+     */
+    inline Object* deoptimize()
+    {
+        Object* res = generic->eval();
+        vm().requestRewrite(this, generic);
+
+        return res;
+    }
+
+    Object* generic;
+};
+
+}//ns
+
+#endif //LAKE_EXPRQUICKENED_H
@@ -33,6 +33,7 @@ public:
             auto idx = stack->getStackBase() - i;
 
             args.push_back((Object*)stack->at((size_t)idx));
+            writeBarrier(vm().current, args.back());
         }
 
         return nullptr;
@@ -46,7 +47,8 @@ public:
 
 /**
  * Saves the current stack size; used to initiate scratch-usage of the stack.
- * Restore the stack size by calling ExprRevertStack.
+ * Restore the stack size by calling ExprRevertStack. With scratch regions enabled,
+ * this also opens a heap region which the matching revert closes; see VM::scratchRegions.
  */
 class ExprCommitStack : public Object
 {
@@ -55,7 +57,9 @@ public:
 
     virtual Object *eval() override
     {
-        vm().stacks.back()->commit();
+        Stack* stack = vm().stacks.back();
+        stack->commit();
+        vm().openScratch(stack);
         return nullptr;
     }
 
@@ -75,7 +79,7 @@ public:
 
     virtual Object *eval() override
     {
-        vm().push(lake::track(Object::create((int64_t)vm().stacks.back()->commitIndex())));
+        vm().push(Object::makeInt((int64_t)vm().stacks.back()->commitIndex()));
         return nullptr;
     }
 
@@ -92,7 +96,10 @@ public:
 
     virtual Object *eval() override
     {
-        vm().stacks.back()->revert();
+        Stack* stack = vm().stacks.back();
+        size_t commits = stack->commitDepth();
+        stack->revert();
+        vm().closeScratch(stack, commits);
         return nullptr;
     }
 
@@ -136,6 +143,7 @@ public:
     Object *eval() override
     {
         vm().peek()->fndata->creator = vm().current;
+        writeBarrier(vm().peek(), vm().current);
         return nullptr;
     }
 
@@ -237,6 +245,7 @@ public:
     Object *eval() override
     {
         mpf_set(vm().epsilon, this->epsilon->mpf);
+        vm().doubleEpsilon = mpf_get_d(this->epsilon->mpf);
         return nullptr;
     }
 
@@ -247,12 +256,6 @@ public:
         str << std::endl;
     }
 
-    void mark() override
-    {
-        setFlag(FLAG_GC_REACHABLE);
-        epsilon->mark();
-    }
-
 private:
     Object* epsilon;
 };
@@ -318,24 +321,55 @@ private:
 };
 
 /**
- * Force a GC cycle
+ * Force a GC cycle. A minor cycle only collects the nursery.
  */
 class ExprGC : public Object
 {
 public:
 
-    ExprGC() : Object(TokenType::TypeOperation) {}
+    ExprGC(bool minor) : Object(TokenType::TypeOperation), minor(minor) {}
 
     virtual Object* eval() override
     {
-        vm().gc();
+        if (minor)
+            vm().minorGC();
+        else
+            vm().gc();
 
         return nullptr;
     }
 
     void externalize(std::ostream &str, int indentation) const override
     {
-        str << std::string(indentation, ' ') << TOK_GC << std::endl;
+        str << std::string(indentation, ' ') << TOK_GC;
+        if (minor) str << " " << TOK_GCMINOR;
+        str << std::endl;
+    }
+
+private:
+    bool minor;
+};
+
+/**
+ * Pushes a map of collector and allocation statistics, keyed by name; see GCStats
+ */
+class ExprGCStats : public Object
+{
+public:
+
+    ExprGCStats() : Object(TokenType::TypeOperation) {}
+
+    virtual Object* eval() override
+    {
+        Object* stats = vm().gcStats.toObject(vm());
+        vm().push(stats);
+
+        return stats;
+    }
+
+    void externalize(std::ostream &str, int indentation) const override
+    {
+        str << std::string(indentation, ' ') << TOK_GC << " " << TOK_GCSTATS << std::endl;
     }
 };
 
@@ -434,7 +468,7 @@ public:
 
     virtual Object *eval() override
     {
-        vm().stacks.pop_back();
+        vm().popStack();
         return nullptr;
     }
 
@@ -477,7 +511,7 @@ public:
 
     virtual Object *eval() override
     {
-        vm().push(lake::track(Object::create((int64_t)vm().stacks.back()->size())));
+        vm().push(Object::makeInt((int64_t)vm().stacks.back()->size()));
         return nullptr;
     }
 
@@ -500,7 +534,10 @@ public:
 
         val = lake::track(Object::create(*val));
 
+        // Casts such as rope to string change the size of the heap data
+        size_t before = val->ownedBytes();
         val->castTo(target);
+        accountGrowth(val, before);
 
         vm().push(val);
 
@@ -592,6 +629,8 @@ public:
     }
 
 private:
+    friend class BytecodeCompiler;
+
     size_t count;
 };
 
@@ -614,6 +653,8 @@ public:
 
 class ExprPush : public Object
 {
+    friend class BytecodeCompiler;
+
     Object* operand = nullptr;
 
 public:
@@ -634,16 +675,6 @@ public:
         operand->externalize(str, indentation);
         str << std::endl;
     }
-
-    void mark() override
-    {
-        if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-            return;
-
-        setFlag(FLAG_GC_REACHABLE);
-        if (operand)
-            operand->mark();
-    }
 };
 
 class ExprPop : public Object
@@ -663,6 +694,8 @@ public:
     }
 
 private:
+    friend class BytecodeCompiler;
+
     size_t count;
 };
 
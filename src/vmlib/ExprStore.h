@@ -5,9 +5,42 @@
 #include "Process.h"
 #include "VM.h"
 #include <inttypes.h>
+#include "Stack.h"
+#include "ExprQuickened.h"
 
 namespace lake {
 
+/**
+ * Store quickened for one addressing mode. The addressing mode of a site never changes,
+ * so there is no guard.
+ */
+template <TokenType Mode>
+class ExprQuickStore : public ExprQuickened
+{
+public:
+
+    ExprQuickStore(Object* generic, int64_t index) : ExprQuickened(generic), index(index)
+    {
+    }
+
+    virtual Object *eval() override
+    {
+        Stack* stack = Mode == TokenType::AbsRoot ? vm().root->fndata->stack : vm().stacks.back();
+        int64_t idx = Mode == TokenType::Rel ? stack->getStackBase() + index + 1 : index;
+
+        if (idx < 0 || idx >= (int64_t) stack->items.size())
+            throw std::runtime_error("Attempt to write outside stack");
+
+        stack->items[(size_t) idx] = vm().pop();
+
+        return nullptr;
+    }
+
+private:
+
+    int64_t index;
+};
+
 /**
  * Pops a stack value and writes it to the local variable at the
  * given stack location.
@@ -45,6 +78,7 @@ public:
             if (function->fndata->locals.size() <= index)
                 function->fndata->locals.resize(index+1);
             function->fndata->locals[index] = value;
+            writeBarrier(function, value);
             return nullptr;
         }
         else if (addressingMode == TokenType::Arg)
@@ -55,6 +89,7 @@ public:
             if (function->fndata->args.size() <= index)
                 function->fndata->args.resize(index+1);
             function->fndata->args[index] = value;
+            writeBarrier(function, value);
             return nullptr;
         }
         else if (addressingMode == TokenType::IntegerLiteral)
@@ -88,6 +123,9 @@ public:
 
         stack->at((size_t)idx) = vm().pop();
 
+        if (!quickened && vm().quickening())
+            quicken();
+
         return nullptr;
     }
 
@@ -116,9 +154,24 @@ public:
     }
 
 private:
+    friend class BytecodeCompiler;
+
+    void quicken()
+    {
+        quickened = true;
+
+        if (addressingMode == TokenType::Abs)
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickStore<TokenType::Abs>(this, index));
+        else if (addressingMode == TokenType::Rel)
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickStore<TokenType::Rel>(this, index));
+        else if (addressingMode == TokenType::AbsRoot)
+            vm().requestRewrite(this, new (*vm().currentCode) ExprQuickStore<TokenType::AbsRoot>(this, index));
+    }
+
     int64_t index;
     int64_t parentIndex = 0;
     TokenType addressingMode;
+    bool quickened = false;
 };
 
 }//ns
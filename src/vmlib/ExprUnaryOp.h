@@ -20,15 +20,31 @@ public:
     virtual Object* eval() override
     {
         Object* first = vm().pop();
+        Object* result = nullptr;
 
-        // Don't touch the original as unary methods on Object updates in-place
-        Object* result = lake::track(Object::create(*first));
+        // Don't touch the original as unary methods on Object updates in-place. Integers and
+        // bools are updated in a temporary instead, so that results can be immediates.
+        if (first->isInteger())
+        {
+            Object tmp(TokenType::TypeInt);
+            mpz_set(tmp.mpz, first->mpz);
+            op(&tmp);
 
-        // Turn op into a callable
-        auto unaryop = std::bind(op, result);
-        unaryop();
+            result = Object::makeInt(tmp.mpz);
+            mpz_clear(tmp.mpz);
+        }
+        else if (first->otype == TokenType::TypeBool)
+        {
+            Object tmp(first->bool_value);
+            op(&tmp);
 
-        //result->setDebug("unary result");
+            result = tmp.bool_value ? &Object::trueObject() : &Object::falseObject();
+        }
+        else
+        {
+            result = lake::track(Object::create(*first));
+            op(result);
+        }
 
         vm().push(result);
 
@@ -0,0 +1,250 @@
+#include <iomanip>
+#include "GCStats.h"
+#include "VM.h"
+#include "Object.h"
+
+namespace lake {
+
+void Histogram::add(uint64_t micros)
+{
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && micros >= (1ULL << bucket))
+        bucket++;
+
+    buckets[bucket]++;
+    count++;
+    totalMicros += micros;
+    maxMicros = std::max(maxMicros, micros);
+}
+
+uint64_t Histogram::percentile(double fraction) const
+{
+    uint64_t target = (uint64_t) (fraction * (double) count);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < BUCKETS - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen > target || seen == count)
+            return std::min((uint64_t) 1 << i, maxMicros);
+    }
+
+    return maxMicros;
+}
+
+const char* CollectionRecord::kindName(Kind kind)
+{
+    switch (kind)
+    {
+        case Kind::Full:
+            return "full";
+        case Kind::Minor:
+            return "minor";
+        case Kind::Incremental:
+            return "incremental";
+    }
+
+    return "unknown";
+}
+
+std::string GCStats::typeName(TokenType type)
+{
+    if (type == TokenType::TypeOperation)
+        return "operation";
+    else if (type == TokenType::TypeTypedArray)
+        return "typed-array";
+
+    std::string name = Object::nullObject().typestring(type);
+    return name == "invalid-type" ? "other" : name;
+}
+
+std::map<std::string, GCStats::TypeCount> GCStats::allocatedByName() const
+{
+    std::map<std::string, TypeCount> result;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (types[i].objects == 0)
+            continue;
+
+        TypeCount& count = result[typeName((TokenType) i)];
+        count.objects += types[i].objects;
+        count.bytes += types[i].bytes;
+    }
+
+    return result;
+}
+
+void GCStats::collected(CollectionRecord record, VM& vm)
+{
+    record.sequence = fullCollections + minorCollections + incrementalCycles + 1;
+
+    if (record.kind == CollectionRecord::Kind::Minor)
+    {
+        minorCollections++;
+        minorSurvival = record.survival();
+    }
+    else
+    {
+        if (record.kind == CollectionRecord::Kind::Full)
+            fullCollections++;
+        else
+            incrementalCycles++;
+
+        fullSurvival = record.survival();
+    }
+
+    mark.add(record.markMicros);
+    sweep.add(record.sweepMicros);
+
+    objectsFreed += (uint64_t) record.objectsFreed;
+    bytesFreed += (uint64_t) std::max<int64_t>(record.bytesFreed, 0);
+
+    last = record;
+
+    if (log != nullptr)
+    {
+        *log << "{\"event\":\"collection\",\"kind\":\"" << CollectionRecord::kindName(record.kind) << "\""
+             << ",\"seq\":" << record.sequence
+             << ",\"mark_us\":" << record.markMicros
+             << ",\"sweep_us\":" << record.sweepMicros
+             << ",\"objects_before\":" << record.objectsBefore
+             << ",\"objects_freed\":" << record.objectsFreed
+             << ",\"survival\":" << std::fixed << std::setprecision(4) << record.survival() << std::defaultfloat
+             << ",\"bytes_before\":" << record.bytesBefore
+             << ",\"bytes_after\":" << record.bytesAfter
+             << ",\"next_gc_bytes\":" << vm.nextGCBytes
+             << ",\"heap_pages\":" << vm.heap.pages.size()
+             << "}" << std::endl;
+    }
+}
+
+static void writeHistogram(std::ostream& out, const char* name, const Histogram& histogram)
+{
+    out << "\"" << name << "\":{\"count\":" << histogram.count
+        << ",\"total_us\":" << histogram.totalMicros
+        << ",\"max_us\":" << histogram.maxMicros
+        << ",\"p50_us\":" << histogram.percentile(0.5)
+        << ",\"p99_us\":" << histogram.percentile(0.99) << "}";
+}
+
+static void writeAllocStats(std::ostream& out, const char* name, const AllocStats& stats)
+{
+    out << "\"" << name << "\":{\"allocations\":" << stats.allocations
+        << ",\"frees\":" << stats.frees
+        << ",\"live\":" << stats.live
+        << ",\"peak\":" << stats.peak
+        << ",\"chunks\":" << stats.chunks
+        << ",\"bytes\":" << stats.bytes << "}";
+}
+
+void GCStats::writeJson(std::ostream& out, VM& vm) const
+{
+    out << "{\"collections\":{\"full\":" << fullCollections
+        << ",\"minor\":" << minorCollections
+        << ",\"incremental\":" << incrementalCycles
+        << ",\"slices\":" << slices << "},";
+
+    writeHistogram(out, "mark", mark);
+    out << ",";
+    writeHistogram(out, "sweep", sweep);
+    out << ",";
+    writeHistogram(out, "slice", slice);
+
+    out << ",\"objects\":" << vm.numObjects
+        << ",\"bytes\":" << vm.heapBytes()
+        << ",\"objects_freed\":" << objectsFreed
+        << ",\"bytes_freed\":" << bytesFreed
+        << ",\"full_survival\":" << std::fixed << std::setprecision(4) << fullSurvival
+        << ",\"minor_survival\":" << minorSurvival << std::defaultfloat << ",";
+
+    out << "\"allocated\":{";
+    bool first = true;
+    for (const auto& entry : allocatedByName())
+    {
+        out << (first ? "" : ",") << "\"" << entry.first << "\":{\"objects\":" << entry.second.objects
+            << ",\"bytes\":" << entry.second.bytes << "}";
+        first = false;
+    }
+    out << "},";
+
+    writeAllocStats(out, "heap", vm.heap.stats());
+    out << ",";
+    writeAllocStats(out, "fndata", vm.fnpool.stats());
+
+    out << ",\"code\":{\"nodes\":" << vm.code.size()
+        << ",\"bytes\":" << vm.code.bytes()
+        << ",\"regions\":" << vm.regions.size() << "}";
+
+    out << ",\"scratch\":{\"regions\":" << scratchRegions
+        << ",\"objects_freed\":" << scratchObjectsFreed << "}";
+
+    out << ",\"numcache\":{\"cached\":" << vm.numcache.size()
+        << ",\"hits\":" << vm.numcache.hits
+        << ",\"misses\":" << vm.numcache.misses << "}}";
+}
+
+// Map entries of the "gc stats" instruction
+static void put(ObjectMap* map, const std::string& key, Object* value)
+{
+    Object* name = Object::create(TokenType::TypeString);
+    name->str_value = new std::string(key);
+
+    (*map)[track(name)] = track(value);
+}
+
+static void put(ObjectMap* map, const std::string& key, uint64_t value)
+{
+    put(map, key, Object::create((int64_t) value));
+}
+
+Object* GCStats::toObject(VM& vm) const
+{
+    auto map = new ObjectMap();
+
+    put(map, "full", fullCollections);
+    put(map, "minor", minorCollections);
+    put(map, "incremental", incrementalCycles);
+    put(map, "slices", slices);
+
+    for (auto& entry : {std::make_pair("mark", &mark), std::make_pair("sweep", &sweep), std::make_pair("slice", &slice)})
+    {
+        std::string name = entry.first;
+        put(map, name + "_us", entry.second->totalMicros);
+        put(map, name + "_max_us", entry.second->maxMicros);
+        put(map, name + "_p99_us", entry.second->percentile(0.99));
+    }
+
+    put(map, "objects", (uint64_t) vm.numObjects);
+    put(map, "bytes", (uint64_t) vm.heapBytes());
+    put(map, "objects_freed", objectsFreed);
+    put(map, "bytes_freed", bytesFreed);
+    put(map, "full_survival", Object::create(fullSurvival));
+    put(map, "minor_survival", Object::create(minorSurvival));
+
+    AllocStats heap = vm.heap.stats();
+    put(map, "heap_pages", heap.chunks);
+    put(map, "heap_page_bytes", heap.bytes);
+    put(map, "fndata_live", vm.fnpool.stats().live);
+    put(map, "numcache", vm.numcache.size());
+    put(map, "code_nodes", vm.code.size());
+    put(map, "code_bytes", vm.code.bytes());
+    put(map, "code_regions", vm.regions.size());
+    put(map, "scratch_regions", scratchRegions);
+    put(map, "scratch_objects_freed", scratchObjectsFreed);
+
+    auto objects = new ObjectMap();
+    auto bytes = new ObjectMap();
+    for (const auto& entry : allocatedByName())
+    {
+        put(objects, entry.first, entry.second.objects);
+        put(bytes, entry.first, entry.second.bytes);
+    }
+
+    put(map, "allocated", Object::create(objects));
+    put(map, "allocated_bytes", Object::create(bytes));
+
+    return track(Object::create(map));
+}
+
+}//ns
@@ -0,0 +1,160 @@
+#ifndef LAKE_GCSTATS_H
+#define LAKE_GCSTATS_H
+
+#include <chrono>
+#include <string>
+#include <map>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include "VMTypes.h"
+
+namespace lake {
+
+class VM;
+class Object;
+
+/**
+ * Distribution of durations. Bucket i counts durations of less than 2^i microseconds,
+ * and the last bucket counts everything longer.
+ */
+struct Histogram
+{
+    static constexpr int BUCKETS = 24;
+
+    void add(uint64_t micros);
+
+    static inline uint64_t micros(std::chrono::steady_clock::duration duration)
+    {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+
+    /**
+     * Upper bound, in microseconds, of the bucket holding the given fraction of the samples
+     */
+    uint64_t percentile(double fraction) const;
+
+    uint64_t buckets[BUCKETS] = {};
+    uint64_t count = 0;
+    uint64_t totalMicros = 0;
+    uint64_t maxMicros = 0;
+};
+
+/**
+ * Telemetry of a single collection, or of an incremental cycle
+ */
+struct CollectionRecord
+{
+    enum class Kind { Full, Minor, Incremental };
+
+    Kind kind = Kind::Full;
+
+    // Sequence number, counting collections of all kinds
+    uint64_t sequence = 0;
+
+    uint64_t markMicros = 0;
+    uint64_t sweepMicros = 0;
+
+    // Objects considered by the collection, which is the nursery in minor collections
+    int64_t objectsBefore = 0;
+    int64_t objectsFreed = 0;
+
+    // Bytes in use before and surviving the collection; see VM::heapBytes
+    int64_t bytesBefore = 0;
+    int64_t bytesAfter = 0;
+
+    // Bytes freed, which is also counted while a background sweep or incremental cycle runs
+    int64_t bytesFreed = 0;
+
+    // Fraction of the considered objects which survived
+    double survival() const
+    {
+        return objectsBefore > 0 ? (double) (objectsBefore - objectsFreed) / (double) objectsBefore : 0.0;
+    }
+
+    static const char* kindName(Kind kind);
+};
+
+/**
+ * Collector and allocation telemetry of a VM, available to embedders through VM::gcStats
+ * and to Lake code through "gc stats". If a log stream is set, a JSON line is written to
+ * it for each collection.
+ */
+class GCStats
+{
+public:
+
+    // Objects and bytes tracked per object type, where bytes include the heap slot
+    struct TypeCount
+    {
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+    };
+
+    /**
+     * Counts an object being tracked
+     */
+    inline void allocated(TokenType type, size_t bytes)
+    {
+        TypeCount& count = types[(uint8_t) type];
+        count.objects++;
+        count.bytes += bytes;
+    }
+
+    /**
+     * Adds a completed collection, and logs it if a log stream is set
+     */
+    void collected(CollectionRecord record, VM& vm);
+
+    /**
+     * Writes the statistics and the VM's pool occupancy as a JSON object
+     */
+    void writeJson(std::ostream& out, VM& vm) const;
+
+    /**
+     * Returns a tracked map of the statistics, keyed by name
+     */
+    Object* toObject(VM& vm) const;
+
+    /**
+     * Name of an object type, as used in reports
+     */
+    static std::string typeName(TokenType type);
+
+    /**
+     * Allocation counts keyed by type name. Types without a name are counted as "other".
+     */
+    std::map<std::string, TypeCount> allocatedByName() const;
+
+    uint64_t fullCollections = 0;
+    uint64_t minorCollections = 0;
+    uint64_t incrementalCycles = 0;
+    uint64_t slices = 0;
+
+    // Durations of the mark and sweep phases of each collection, and of incremental slices
+    Histogram mark;
+    Histogram sweep;
+    Histogram slice;
+
+    uint64_t objectsFreed = 0;
+    uint64_t bytesFreed = 0;
+
+    // Scratch regions swept as they were closed, and the objects destructed by those sweeps
+    uint64_t scratchRegions = 0;
+    uint64_t scratchObjectsFreed = 0;
+
+    // Survival of the last full and minor collections
+    double fullSurvival = 0.0;
+    double minorSurvival = 0.0;
+
+    CollectionRecord last;
+
+    TypeCount types[256];
+
+    // Receives a JSON line per collection if set
+    std::ostream* log = nullptr;
+};
+
+}//ns
+
+#endif //LAKE_GCSTATS_H
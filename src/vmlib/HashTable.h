@@ -0,0 +1,541 @@
+#ifndef LAKE_HASHTABLE_H
+#define LAKE_HASHTABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LAKE_HASH_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace lake {
+
+namespace hashing {
+
+// Slots are probed a group at a time, with one control byte per slot
+static constexpr size_t GROUP_WIDTH = 16;
+
+// Control bytes of free slots have the sign bit set. Full slots hold the low 7 bits of the hash.
+static constexpr int8_t EMPTY = -128;
+static constexpr int8_t DELETED = -2;
+
+/**
+ * Bitmask of the slots in a group whose control byte is 'value'
+ */
+inline uint32_t match(const int8_t* group, int8_t value)
+{
+#ifdef LAKE_HASH_SSE2
+    __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; i++)
+        mask |= (uint32_t) (group[i] == value) << i;
+    return mask;
+#endif
+}
+
+/**
+ * Bitmask of the empty or deleted slots in a group
+ */
+inline uint32_t matchFree(const int8_t* group)
+{
+#ifdef LAKE_HASH_SSE2
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; i++)
+        mask |= (uint32_t) (group[i] < 0) << i;
+    return mask;
+#endif
+}
+
+inline size_t lowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return (size_t) __builtin_ctz(mask);
+#endif
+}
+
+/**
+ * Spreads the entropy of a hash over all bits, as the group index is taken from the
+ * high bits and the control byte from the low bits.
+ */
+inline size_t mix(size_t hash)
+{
+    uint64_t h = (uint64_t) hash * 0x9E3779B97F4A7C15ULL;
+    return (size_t) (h ^ (h >> 32));
+}
+
+}//ns
+
+/**
+ * Open addressing hash table with SwissTable style probing. Control bytes are kept
+ * apart from the entries and scanned 16 at a time with SSE2, so a lookup usually
+ * compares keys only for the slot that holds them, and touches one or two cache lines.
+ * Entries are stored inline, with no per-element allocation.
+ *
+ * Each entry caches the full hash of its key. Growing the table never rehashes keys,
+ * and keys whose hashes differ are never compared, which matters for keys like long
+ * strings and big integers.
+ *
+ * Iterators remain usable across insertions, but may then skip or revisit entries, and
+ * erase(iterator) returns the next position. The table is at most 7/8 full.
+ *
+ * This is the core of FlatHashMap and FlatHashSet; KeyOf extracts the key of a slot.
+ */
+template <typename Slot, typename Key, typename KeyOf, typename Hash, typename Equal>
+class FlatTable
+{
+    struct Entry
+    {
+        Slot slot;
+        size_t hash;
+    };
+
+public:
+
+    template <bool Const>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Slot;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<Const, const Slot*, Slot*>::type;
+        using reference = typename std::conditional<Const, const Slot&, Slot&>::type;
+        using Table = typename std::conditional<Const, const FlatTable*, FlatTable*>::type;
+
+        Iterator(Table table, size_t index) : table(table), index(index)
+        {
+            skipFree();
+        }
+
+        // Iterators convert to const iterators
+        operator Iterator<true>() const
+        {
+            return Iterator<true>(table, index);
+        }
+
+        reference operator*() const
+        {
+            return table->entries[index].slot;
+        }
+
+        pointer operator->() const
+        {
+            return &table->entries[index].slot;
+        }
+
+        Iterator& operator++()
+        {
+            index++;
+            skipFree();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return index == other.index;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return index != other.index;
+        }
+
+        size_t position() const
+        {
+            return index;
+        }
+
+    private:
+
+        void skipFree()
+        {
+            while (index < table->cap && table->ctrl[index] < 0)
+                index++;
+        }
+
+        Table table;
+        size_t index;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatTable() = default;
+
+    FlatTable(const FlatTable& copy)
+    {
+        if (copy.count > 0)
+        {
+            allocate(copy.cap);
+            std::memcpy(ctrl, copy.ctrl, cap);
+            std::copy(copy.entries, copy.entries + cap, entries);
+
+            count = copy.count;
+            growthLeft = copy.growthLeft;
+        }
+    }
+
+    FlatTable& operator=(const FlatTable&) = delete;
+
+    ~FlatTable()
+    {
+        delete [] ctrl;
+        delete [] entries;
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end()
+    {
+        return iterator(this, cap);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, cap);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    /**
+     * Number of slots, free or not
+     */
+    size_t bucket_count() const
+    {
+        return cap;
+    }
+
+    /**
+     * Bytes allocated for control bytes and entries
+     */
+    size_t allocatedBytes() const
+    {
+        return cap * (1 + sizeof(Entry));
+    }
+
+    iterator find(const Key& key)
+    {
+        return iterator(this, lookup(key, hashing::mix(Hash()(key))));
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        return const_iterator(this, lookup(key, hashing::mix(Hash()(key))));
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        size_t index = pos.position();
+        size_t group = index & ~(hashing::GROUP_WIDTH - 1);
+
+        // A probe stops at the first group with an empty slot. If this group already has one,
+        // no probe passes it, and the slot can be made empty rather than a tombstone.
+        if (hashing::match(ctrl + group, hashing::EMPTY) != 0)
+        {
+            ctrl[index] = hashing::EMPTY;
+            growthLeft++;
+        }
+        else
+        {
+            ctrl[index] = hashing::DELETED;
+        }
+
+        entries[index].slot = Slot();
+        count--;
+
+        return iterator(this, index + 1);
+    }
+
+    size_t erase(const Key& key)
+    {
+        auto pos = find(key);
+        if (pos == end())
+            return 0;
+
+        erase(pos);
+        return 1;
+    }
+
+    /**
+     * Removes all entries, keeping the allocation
+     */
+    void clear()
+    {
+        if (cap > 0)
+        {
+            std::memset(ctrl, hashing::EMPTY, cap);
+            std::fill(entries, entries + cap, Entry());
+        }
+
+        count = 0;
+        growthLeft = maxLoad(cap);
+    }
+
+    /**
+     * Makes room for 'size' entries without growing
+     */
+    void reserve(size_t size)
+    {
+        if (size > count + growthLeft)
+        {
+            size_t newCap = hashing::GROUP_WIDTH;
+            while (maxLoad(newCap) < size)
+                newCap *= 2;
+
+            rehash(newCap);
+        }
+    }
+
+protected:
+
+    /**
+     * Returns the position of 'key' and true, or if it's absent, the position of a new
+     * slot for it and false. The caller must then initialize the new slot.
+     */
+    std::pair<size_t, bool> insertPosition(const Key& key)
+    {
+        size_t hash = hashing::mix(Hash()(key));
+
+        size_t index = lookup(key, hash);
+        if (index != cap)
+            return std::make_pair(index, true);
+
+        if (cap == 0)
+            rehash(hashing::GROUP_WIDTH);
+
+        index = freePosition(hash);
+        if (ctrl[index] == hashing::EMPTY && growthLeft == 0)
+        {
+            // Tombstones are reclaimed in place if they account for much of the load
+            rehash(count * 2 < maxLoad(cap) ? cap : cap * 2);
+            index = freePosition(hash);
+        }
+
+        if (ctrl[index] == hashing::EMPTY)
+            growthLeft--;
+
+        ctrl[index] = control(hash);
+        entries[index].hash = hash;
+        count++;
+
+        return std::make_pair(index, false);
+    }
+
+    Slot& slotAt(size_t index)
+    {
+        return entries[index].slot;
+    }
+
+private:
+
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    static int8_t control(size_t hash)
+    {
+        return (int8_t) (hash & 0x7F);
+    }
+
+    // Group indices visited by a probe, which is triangular and thus visits every group once
+    template <typename Visit>
+    size_t probe(size_t hash, Visit visit) const
+    {
+        size_t groupMask = cap / hashing::GROUP_WIDTH - 1;
+        size_t group = (hash >> 7) & groupMask;
+
+        for (size_t step = 1; ; step++)
+        {
+            size_t result;
+            if (visit(group * hashing::GROUP_WIDTH, result))
+                return result;
+
+            group = (group + step) & groupMask;
+        }
+    }
+
+    size_t lookup(const Key& key, size_t hash) const
+    {
+        if (count == 0)
+            return cap;
+
+        int8_t tag = control(hash);
+
+        return probe(hash, [&](size_t base, size_t& result)
+        {
+            for (uint32_t mask = hashing::match(ctrl + base, tag); mask != 0; mask &= mask - 1)
+            {
+                size_t index = base + hashing::lowestBit(mask);
+                if (entries[index].hash == hash && Equal()(KeyOf()(entries[index].slot), key))
+                {
+                    result = index;
+                    return true;
+                }
+            }
+
+            result = cap;
+            return hashing::match(ctrl + base, hashing::EMPTY) != 0;
+        });
+    }
+
+    size_t freePosition(size_t hash) const
+    {
+        return probe(hash, [&](size_t base, size_t& result)
+        {
+            uint32_t mask = hashing::matchFree(ctrl + base);
+            if (mask == 0)
+                return false;
+
+            result = base + hashing::lowestBit(mask);
+            return true;
+        });
+    }
+
+    void allocate(size_t capacity)
+    {
+        cap = capacity;
+        ctrl = new int8_t[cap];
+        entries = new Entry[cap]();
+
+        std::memset(ctrl, hashing::EMPTY, cap);
+        growthLeft = maxLoad(cap);
+    }
+
+    void rehash(size_t newCap)
+    {
+        int8_t* oldCtrl = ctrl;
+        Entry* oldEntries = entries;
+        size_t oldCap = cap;
+
+        allocate(newCap);
+
+        // Hashes are cached, so keys are neither hashed nor compared again
+        for (size_t i = 0; i < oldCap; i++)
+        {
+            if (oldCtrl[i] >= 0)
+            {
+                size_t index = freePosition(oldEntries[i].hash);
+                ctrl[index] = oldCtrl[i];
+                entries[index] = std::move(oldEntries[i]);
+            }
+        }
+
+        growthLeft -= count;
+
+        delete [] oldCtrl;
+        delete [] oldEntries;
+    }
+
+    int8_t* ctrl = nullptr;
+    Entry* entries = nullptr;
+    size_t cap = 0;
+    size_t count = 0;
+    size_t growthLeft = 0;
+};
+
+template <typename K, typename V>
+struct FirstOf
+{
+    const K& operator()(const std::pair<K,V>& slot) const
+    {
+        return slot.first;
+    }
+};
+
+template <typename K>
+struct Identity
+{
+    const K& operator()(const K& slot) const
+    {
+        return slot;
+    }
+};
+
+/**
+ * Open addressing map. Iteration yields std::pair<K,V>; keys must not be changed through it.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename Equal = std::equal_to<K>>
+class FlatHashMap : public FlatTable<std::pair<K,V>, K, FirstOf<K,V>, Hash, Equal>
+{
+    using Base = FlatTable<std::pair<K,V>, K, FirstOf<K,V>, Hash, Equal>;
+
+public:
+
+    V& operator[](const K& key)
+    {
+        auto pos = this->insertPosition(key);
+        if (!pos.second)
+            this->slotAt(pos.first) = std::pair<K,V>(key, V());
+
+        return this->slotAt(pos.first).second;
+    }
+
+    std::pair<typename Base::iterator, bool> insert(const std::pair<K,V>& value)
+    {
+        auto pos = this->insertPosition(value.first);
+        if (!pos.second)
+            this->slotAt(pos.first) = value;
+
+        return std::make_pair(typename Base::iterator(this, pos.first), !pos.second);
+    }
+};
+
+/**
+ * Open addressing set. Elements must not be changed through iterators.
+ */
+template <typename K, typename Hash = std::hash<K>, typename Equal = std::equal_to<K>>
+class FlatHashSet : public FlatTable<K, K, Identity<K>, Hash, Equal>
+{
+    using Base = FlatTable<K, K, Identity<K>, Hash, Equal>;
+
+public:
+
+    std::pair<typename Base::iterator, bool> insert(const K& key)
+    {
+        auto pos = this->insertPosition(key);
+        if (!pos.second)
+            this->slotAt(pos.first) = key;
+
+        return std::make_pair(typename Base::iterator(this, pos.first), !pos.second);
+    }
+};
+
+}//ns
+
+#endif //LAKE_HASHTABLE_H
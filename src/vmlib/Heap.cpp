@@ -0,0 +1,367 @@
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include "Heap.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace lake {
+
+// Passed by reference to std::max, so C++14 requires a definition
+constexpr size_t Page::MIN_SLOT;
+
+// The first slot follows the page header, aligned to the granule
+static constexpr size_t HEADER_SIZE = (sizeof(Page) + Page::GRANULE - 1) / Page::GRANULE * Page::GRANULE;
+
+Heap::~Heap()
+{
+    for (Page* page : pages)
+        releasePage(page);
+
+    for (Page* page : spare)
+        releasePage(page);
+}
+
+Page* Heap::newPage(size_t bytes)
+{
+    void* mem = nullptr;
+
+#ifdef _WIN32
+    mem = _aligned_malloc(bytes, Page::SIZE);
+#else
+    if (posix_memalign(&mem, Page::SIZE, bytes) != 0)
+        mem = nullptr;
+#endif
+
+    if (mem == nullptr)
+        throw std::runtime_error("Out of memory allocating heap page");
+
+    pageBytes += bytes;
+
+    Page* page = new (mem) Page();
+    page->bytes = bytes;
+    return page;
+}
+
+void Heap::releasePage(Page* page)
+{
+    pageBytes -= page->bytes;
+    LAKE_UNPOISON(page, page->bytes);
+
+#ifdef _WIN32
+    _aligned_free(page);
+#else
+    ::free(page);
+#endif
+}
+
+void Heap::format(Page* page, size_t sizeClass, size_t slotSize)
+{
+    memset(page->tracked, 0, sizeof(page->tracked));
+    memset(page->marked, 0, sizeof(page->marked));
+    memset(page->old, 0, sizeof(page->old));
+
+    page->slots = (char*) page + HEADER_SIZE;
+    page->slotSize = (uint32_t) slotSize;
+    page->slotCount = sizeClass == 0 ? 1 : (uint32_t) ((page->bytes - HEADER_SIZE) / slotSize);
+    page->reciprocal = ((1ULL << 32) + slotSize - 1) / slotSize;
+    page->sizeClass = (uint32_t) sizeClass;
+    page->used = 0;
+    page->unused = 0;
+    page->freeList = nullptr;
+    page->nextAvailable = nullptr;
+    page->available = false;
+    page->pendingSweep = false;
+    page->region = regionDepth;
+
+    LAKE_POISON(page->slots, page->bytes - HEADER_SIZE);
+}
+
+void Heap::addPage(Page* page)
+{
+    pages.push_back(page);
+
+    if (regionDepth > 0)
+        regionPages.back().push_back(page);
+}
+
+void Heap::makeAvailable(Page* page)
+{
+    // Pages of an enclosing region go on its lists, which are used again once the region is current
+    Page** heads = page->region == regionDepth ? available : outerAvailable[page->region].data();
+
+    page->available = true;
+    page->nextAvailable = heads[page->sizeClass];
+    heads[page->sizeClass] = page;
+}
+
+Page* Heap::refill(size_t sizeClass)
+{
+    if (hasReturned.load(std::memory_order_acquire))
+    {
+        takeReturned();
+
+        if (available[sizeClass] != nullptr)
+            return available[sizeClass];
+    }
+
+    size_t slotSize = std::max(sizeClass * Page::GRANULE, Page::MIN_SLOT);
+
+    // Parked pages are already in the page list. One which an incremental sweep has yet to
+    // process is left alone, as the sweep would free the objects allocated on it.
+    Page* page;
+    if (!parked.empty() && !parked.back()->pendingSweep)
+    {
+        page = parked.back();
+        parked.pop_back();
+
+        format(page, sizeClass, slotSize);
+        if (regionDepth > 0)
+            regionPages.back().push_back(page);
+    }
+    else
+    {
+        if (!spare.empty())
+        {
+            page = spare.back();
+            spare.pop_back();
+        }
+        else
+            page = newPage(Page::SIZE);
+
+        format(page, sizeClass, slotSize);
+        addPage(page);
+    }
+
+    makeAvailable(page);
+
+    return page;
+}
+
+void* Heap::allocateLarge(size_t size)
+{
+    Page* page = newPage(HEADER_SIZE + size);
+    format(page, 0, size);
+    addPage(page);
+
+    page->used = page->unused = 1;
+
+    counts.allocations++;
+    if (++counts.live > counts.peak)
+        counts.peak = counts.live;
+
+    usedBytes += size;
+
+    LAKE_UNPOISON(page->slots, size);
+    return page->slots;
+}
+
+void Heap::free(void* ptr)
+{
+    Page* page = pageOf(ptr);
+    size_t index = page->indexOf(ptr);
+
+    clearBit(page->tracked, index);
+    clearBit(page->marked, index);
+    clearBit(page->old, index);
+
+    *(void**) ptr = page->freeList;
+    page->freeList = ptr;
+    LAKE_POISON(ptr, page->slotSize);
+
+    if (page->used-- == page->slotCount && page->sizeClass != 0)
+        makeAvailable(page);
+
+    counts.frees++;
+    counts.live--;
+    usedBytes -= page->slotSize;
+}
+
+void Heap::freeDetached(Page* page, size_t index)
+{
+    void* ptr = page->at(index);
+
+    clearBit(page->tracked, index);
+    clearBit(page->old, index);
+
+    *(void**) ptr = page->freeList;
+    page->freeList = ptr;
+    page->used--;
+    LAKE_POISON(ptr, page->slotSize);
+}
+
+void Heap::track(const Object* obj)
+{
+    Page* page = pageOf(obj);
+
+    if (detached && page->pendingSweep)
+        deferredTracks.push_back((Object*) obj);
+    else
+        setBit(page->tracked, page->indexOf(obj));
+}
+
+std::vector<Page*> Heap::detach()
+{
+    for (Page*& head : available)
+    {
+        for (Page* page = head; page != nullptr; page = page->nextAvailable)
+            page->available = false;
+
+        head = nullptr;
+    }
+
+    for (auto& heads : outerAvailable)
+    {
+        for (Page*& head : heads)
+        {
+            for (Page* page = head; page != nullptr; page = page->nextAvailable)
+                page->available = false;
+
+            head = nullptr;
+        }
+    }
+
+    // Parked pages are handed back like the others
+    parked.clear();
+
+    for (Page* page : pages)
+        page->pendingSweep = true;
+
+    detached = true;
+    return pages;
+}
+
+void Heap::giveBack(Page* page)
+{
+    std::lock_guard<std::mutex> lock(returnedMutex);
+
+    returned.push_back(page);
+    hasReturned.store(true, std::memory_order_release);
+}
+
+void Heap::takeReturned()
+{
+    std::lock_guard<std::mutex> lock(returnedMutex);
+
+    for (Page* page : returned)
+    {
+        page->pendingSweep = false;
+        if (!page->isFull() && page->sizeClass != 0)
+            makeAvailable(page);
+    }
+
+    returned.clear();
+    hasReturned.store(false, std::memory_order_relaxed);
+}
+
+void Heap::reattach(uint64_t freed, size_t freedBytes)
+{
+    takeReturned();
+    detached = false;
+
+    counts.frees += freed;
+    counts.live -= freed;
+    usedBytes -= freedBytes;
+
+    for (Object* obj : deferredTracks)
+        track(obj);
+
+    deferredTracks.clear();
+}
+
+void Heap::releaseEmptyPages()
+{
+    size_t kept = 0;
+
+    // Parked pages are empty, so they're released or made spare below
+    parked.clear();
+
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        Page* page = pages[i];
+
+        // Pages of open regions are kept, as the regions still reference them
+        if (page->used > 0 || page->pendingSweep || page->region > 0)
+            pages[kept++] = page;
+        else if (page->sizeClass != 0 && spare.size() < MAX_SPARE_PAGES)
+            spare.push_back(page);
+        else
+            releasePage(page);
+    }
+
+    pages.resize(kept);
+
+    // Rebuild the available lists, which may have referenced released pages
+    for (Page*& head : available)
+        head = nullptr;
+
+    for (auto& heads : outerAvailable)
+        std::fill(heads.begin(), heads.end(), nullptr);
+
+    for (Page* page : pages)
+    {
+        if (page->available)
+            makeAvailable(page);
+    }
+}
+
+void Heap::pushRegion()
+{
+    outerAvailable.emplace_back(available, available + NUM_CLASSES);
+    std::fill(available, available + NUM_CLASSES, nullptr);
+
+    regionPages.emplace_back();
+    regionDepth++;
+}
+
+std::vector<Page*> Heap::popRegion()
+{
+    for (Page*& head : available)
+    {
+        for (Page* page = head; page != nullptr; page = page->nextAvailable)
+            page->available = false;
+
+        head = nullptr;
+    }
+
+    std::copy(outerAvailable.back().begin(), outerAvailable.back().end(), available);
+    outerAvailable.pop_back();
+
+    std::vector<Page*> result = std::move(regionPages.back());
+    regionPages.pop_back();
+    regionDepth--;
+
+    return result;
+}
+
+void Heap::adopt(Page* page)
+{
+    // The slot counts of a page owned by a background sweep are not read until it's handed back
+    if (!page->pendingSweep && page->used == 0 && page->bytes == Page::SIZE)
+    {
+        page->region = 0;
+        parked.push_back(page);
+        return;
+    }
+
+    page->region = regionDepth;
+    if (regionDepth > 0)
+        regionPages.back().push_back(page);
+
+    // Pages owned by a background sweep are made available when they're handed back
+    if (!(detached && page->pendingSweep) && page->sizeClass != 0 && !page->isFull())
+        makeAvailable(page);
+}
+
+AllocStats Heap::stats() const
+{
+    AllocStats result = counts;
+    result.chunks = pages.size() + spare.size();
+    result.bytes = pageBytes;
+    return result;
+}
+
+}//ns
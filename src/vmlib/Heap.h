@@ -0,0 +1,369 @@
+#ifndef LAKE_HEAP_H
+#define LAKE_HEAP_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "Slab.h"
+
+// Free slots are poisoned in sanitizer builds, so stale references to collected objects are reported
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define LAKE_POISON(ptr, size) ASAN_POISON_MEMORY_REGION(ptr, size)
+#define LAKE_UNPOISON(ptr, size) ASAN_UNPOISON_MEMORY_REGION(ptr, size)
+#else
+#define LAKE_POISON(ptr, size)
+#define LAKE_UNPOISON(ptr, size)
+#endif
+
+namespace lake {
+
+class Object;
+
+/**
+ * A page of the heap, holding objects of a single size class. Pages are aligned to their
+ * size, so the page of an object is found by masking its address.
+ *
+ * Collector state is kept in bitmaps at the start of the page, one bit per slot, rather
+ * than in the objects. Marking thus only writes to the bitmaps, and sweeping finds the
+ * unmarked objects of a page by combining bitmap words, without visiting the survivors.
+ *
+ * Free slots are chained through their first word. Slots past 'unused' have never been
+ * allocated, so a new page is not touched until it's used.
+ */
+struct Page
+{
+    // Pages are aligned to this size; objects larger than a page get a page of their own
+    static constexpr size_t SIZE = 64 * 1024;
+
+    // Size classes are multiples of the granule, and slots are at least MIN_SLOT bytes
+    static constexpr size_t GRANULE = 8;
+    static constexpr size_t MIN_SLOT = 32;
+
+    static constexpr size_t MAX_SLOTS = SIZE / MIN_SLOT;
+    static constexpr size_t WORDS = MAX_SLOTS / 64;
+
+    // Objects tracked by the collector
+    uint64_t tracked[WORDS];
+
+    // Objects found reachable by the current collection
+    uint64_t marked[WORDS];
+
+    // Objects in the old generation, mirroring GC_OLD, so minor sweeps can skip them
+    uint64_t old[WORDS];
+
+    char* slots;
+    uint32_t slotSize;
+    uint32_t slotCount;
+
+    // Slot index of an offset is (offset * reciprocal) >> 32
+    uint64_t reciprocal;
+
+    // Number of allocated slots, and the first slot never allocated
+    uint32_t used = 0;
+    uint32_t unused = 0;
+
+    // Size class index; 0 for pages holding a single large object
+    uint32_t sizeClass;
+
+    // Bytes allocated for the page
+    size_t bytes;
+
+    void* freeList = nullptr;
+
+    // Pages of the same size class with free slots
+    Page* nextAvailable = nullptr;
+    bool available = false;
+
+    // Part of a sweep which has yet to process the page
+    bool pendingSweep = false;
+
+    // Depth of the scratch region the page belongs to; 0 for the main heap
+    uint32_t region = 0;
+
+    inline size_t indexOf(const void* ptr) const
+    {
+        return (size_t) (((uint64_t) ((const char*) ptr - slots) * reciprocal) >> 32);
+    }
+
+    inline Object* at(size_t index) const
+    {
+        return (Object*) (slots + index * slotSize);
+    }
+
+    inline bool isFull() const
+    {
+        return used == slotCount;
+    }
+};
+
+/**
+ * The VM's object heap. Every Object allocated with new, including instruction nodes and
+ * stacks, lives in a page of the heap. Small objects are segregated by size class, and
+ * each class allocates from its available pages, which have free slots.
+ *
+ * Pages left empty by a sweep are kept for reuse by any size class, up to a limit, and
+ * released otherwise.
+ *
+ * During a background sweep, the swept pages are owned by the sweeper. These are taken
+ * off the available lists by detach(), so the mutator allocates from other pages, and
+ * are handed back by the sweeper as each is swept. Objects on these pages which are
+ * tracked meanwhile are put in the tracked bitmap by reattach().
+ *
+ * Scratch regions nest, and while one is open, objects are allocated from pages of their
+ * own, bump allocated as the pages are new. The available lists of the enclosing regions
+ * are set aside until the region is closed. The VM then sweeps the region's pages, and
+ * hands them to the enclosing region with adopt(), which parks the empty ones for reuse.
+ */
+class Heap
+{
+public:
+
+    // Objects larger than this get a page of their own
+    static constexpr size_t MAX_SMALL = 1024;
+    static constexpr size_t NUM_CLASSES = MAX_SMALL / Page::GRANULE + 1;
+
+    // Number of empty pages kept for reuse
+    static constexpr size_t MAX_SPARE_PAGES = 16;
+
+    Heap() = default;
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    ~Heap();
+
+    static inline Page* pageOf(const void* ptr)
+    {
+        return (Page*) ((uintptr_t) ptr & ~(uintptr_t) (Page::SIZE - 1));
+    }
+
+    static inline bool testBit(const uint64_t* bits, size_t index)
+    {
+        return (bits[index >> 6] & (1ULL << (index & 63))) != 0;
+    }
+
+    static inline void setBit(uint64_t* bits, size_t index)
+    {
+        bits[index >> 6] |= 1ULL << (index & 63);
+    }
+
+    static inline void clearBit(uint64_t* bits, size_t index)
+    {
+        bits[index >> 6] &= ~(1ULL << (index & 63));
+    }
+
+    /**
+     * Calls fn with the index of each set bit in word, where word is the bitmap word at 'base'
+     */
+    template<typename F>
+    static inline void forEachBit(uint64_t word, size_t base, F fn)
+    {
+        while (word != 0)
+        {
+            fn(base + (size_t) __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+
+    static inline bool isMarked(const Object* obj)
+    {
+        Page* page = pageOf(obj);
+        return testBit(page->marked, page->indexOf(obj));
+    }
+
+    /**
+     * Sets the mark bit of a tracked object. Returns true if it wasn't already set. If
+     * 'atomic' is set, several threads may mark objects on the same page.
+     */
+    static inline bool mark(const Object* obj, bool atomic)
+    {
+        Page* page = pageOf(obj);
+        size_t index = page->indexOf(obj);
+        uint64_t* word = &page->marked[index >> 6];
+        uint64_t bit = 1ULL << (index & 63);
+
+        if ((__atomic_load_n(word, __ATOMIC_RELAXED) & bit) != 0)
+            return false;
+
+        if (atomic)
+            return (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) == 0;
+
+        *word |= bit;
+        return true;
+    }
+
+    static inline void clearMark(const Object* obj)
+    {
+        Page* page = pageOf(obj);
+        clearBit(page->marked, page->indexOf(obj));
+    }
+
+    static inline void setOld(const Object* obj)
+    {
+        Page* page = pageOf(obj);
+        setBit(page->old, page->indexOf(obj));
+    }
+
+    /**
+     * Allocates memory for an object of 'size' bytes
+     */
+    inline void* allocate(size_t size)
+    {
+        if (size > MAX_SMALL)
+            return allocateLarge(size);
+
+        size_t sizeClass = (size + Page::GRANULE - 1) / Page::GRANULE;
+
+        Page* page = available[sizeClass];
+        if (page == nullptr)
+            page = refill(sizeClass);
+
+        void* ptr;
+        if (page->freeList != nullptr)
+        {
+            ptr = page->freeList;
+            LAKE_UNPOISON(ptr, page->slotSize);
+            page->freeList = *(void**) ptr;
+        }
+        else
+        {
+            ptr = page->at(page->unused++);
+            LAKE_UNPOISON(ptr, page->slotSize);
+        }
+
+        if (++page->used == page->slotCount)
+        {
+            available[sizeClass] = page->nextAvailable;
+            page->available = false;
+        }
+
+        counts.allocations++;
+        if (++counts.live > counts.peak)
+            counts.peak = counts.live;
+
+        usedBytes += page->slotSize;
+
+        return ptr;
+    }
+
+    /**
+     * Returns the memory of an object to its page. The page must not be owned by the sweeper.
+     */
+    void free(void* ptr);
+
+    /**
+     * Adds an object to the tracked bitmap of its page
+     */
+    void track(const Object* obj);
+
+    /**
+     * Frees a slot of a page owned by the sweeper; the page is handed back by giveBack
+     */
+    static void freeDetached(Page* page, size_t index);
+
+    /**
+     * Takes all pages off the available lists for a background sweep, and returns them
+     */
+    std::vector<Page*> detach();
+
+    /**
+     * Hands a page swept in the background back to the mutator. Called by the sweeper.
+     */
+    void giveBack(Page* page);
+
+    /**
+     * Called by the mutator when a background sweep is done, with the number of objects it
+     * freed and the slot bytes they occupied
+     */
+    void reattach(uint64_t freed, size_t freedBytes);
+
+    /**
+     * Moves empty pages to the spare list or releases them. Called after sweeping.
+     */
+    void releaseEmptyPages();
+
+    /**
+     * Opens a scratch region, which allocates from pages of its own
+     */
+    void pushRegion();
+
+    /**
+     * Closes the innermost scratch region, and returns its pages. Each must be passed to
+     * adopt() once the caller is done with it.
+     */
+    std::vector<Page*> popRegion();
+
+    /**
+     * Moves a page of a closed region to the current region, or to the main heap. The
+     * page is parked if it's empty, and allocated from again if it has free slots.
+     */
+    void adopt(Page* page);
+
+    // Pages of the innermost open region
+    inline const std::vector<Page*>& currentRegionPages() const
+    {
+        return regionPages.back();
+    }
+
+    // Number of open scratch regions
+    uint32_t regionDepth = 0;
+
+    /**
+     * Allocation statistics, where chunks are heap pages. Objects freed by an active
+     * background sweep are counted when it finishes.
+     */
+    AllocStats stats() const;
+
+    // Pages with objects, in allocation order. Spare pages are not included.
+    std::vector<Page*> pages;
+
+    // Empty pages, which may be reused by any size class
+    std::vector<Page*> spare;
+
+    // Empty pages left by scratch regions. These are still in 'pages', and are reused
+    // before spare pages, or released with the other empty pages after a sweep.
+    std::vector<Page*> parked;
+
+    // Bytes currently allocated for pages, including spare pages
+    size_t pageBytes = 0;
+
+    // Bytes of the slots in use, which is what the collector paces itself on
+    size_t usedBytes = 0;
+
+private:
+
+    Page* refill(size_t sizeClass);
+    void takeReturned();
+    void* allocateLarge(size_t size);
+    Page* newPage(size_t bytes);
+    void format(Page* page, size_t sizeClass, size_t slotSize);
+    void makeAvailable(Page* page);
+    void addPage(Page* page);
+    void releasePage(Page* page);
+
+    // Pages with free slots, per size class
+    Page* available[NUM_CLASSES] = {};
+
+    // Available lists of the regions enclosing the current one, outermost first, and the
+    // pages of each open region
+    std::vector<std::vector<Page*>> outerAvailable;
+    std::vector<std::vector<Page*>> regionPages;
+
+    // Bytes and chunks are filled in by stats()
+    AllocStats counts;
+
+    // Tracked while their page was being swept in the background
+    std::vector<Object*> deferredTracks;
+    bool detached = false;
+
+    // Pages swept in the background, waiting to be made available
+    std::mutex returnedMutex;
+    std::vector<Page*> returned;
+    std::atomic<bool> hasReturned {false};
+};
+
+}//ns
+
+#endif //LAKE_HEAP_H
@@ -0,0 +1,330 @@
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+#include "boost/endian/conversion.hpp"
+#include "Image.h"
+#include "Exceptions.h"
+#include "Process.h"
+
+namespace lake {
+
+static void writeVarint(std::ostream& out, uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0)
+            byte |= 0x80;
+
+        out.put((char) byte);
+    }
+    while (value != 0);
+}
+
+static void writeSigned(std::ostream& out, int64_t value)
+{
+    writeVarint(out, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static void writeString(std::ostream& out, const std::string& str)
+{
+    writeVarint(out, str.size());
+    out.write(str.data(), str.size());
+}
+
+/**
+ * Identifiers and literals carry an index into the string table. The lexeme of any
+ * other token follows from its code.
+ */
+static bool hasPayload(TokenType type)
+{
+    return type == TokenType::Identifier || type == TokenType::IntegerLiteral || type == TokenType::FloatLiteral ||
+           type == TokenType::CharLiteral || type == TokenType::StringLiteral;
+}
+
+static std::string impliedLexeme(uint8_t code)
+{
+    // Single character keywords are matched without recording a lexeme
+    std::string lexeme = Lexer::getTokenLexeme(code);
+    return code >= 128 && lexeme.size() == 1 ? "" : lexeme;
+}
+
+/**
+ * Bounds checked decoding of an in-memory image
+ */
+class ImageCursor
+{
+public:
+
+    ImageCursor(const std::string& data, size_t pos) : data(data), pos(pos) {}
+
+    uint8_t byte()
+    {
+        if (pos >= data.size())
+            throw std::runtime_error("Invalid image: unexpected end of data");
+
+        return (uint8_t) data[pos++];
+    }
+
+    uint64_t varint()
+    {
+        uint64_t res = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = byte();
+            res |= (uint64_t) (b & 0x7f) << shift;
+
+            if ((b & 0x80) == 0)
+                return res;
+        }
+
+        throw std::runtime_error("Invalid image: malformed integer");
+    }
+
+    int64_t signedVarint()
+    {
+        uint64_t val = varint();
+        return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+    }
+
+    // Element counts are checked against the remaining size to reject corrupt images early
+    size_t count(size_t minElementSize)
+    {
+        uint64_t cnt = varint();
+        if (cnt > (data.size() - pos) / minElementSize)
+            throw std::runtime_error("Invalid image: count exceeds image size");
+
+        return (size_t) cnt;
+    }
+
+    std::string string()
+    {
+        size_t len = count(1);
+        std::string res = data.substr(pos, len);
+        pos += len;
+
+        return res;
+    }
+
+    uint32_t bigEndian32()
+    {
+        uint32_t res = 0;
+        for (int i = 0; i < 4; i++)
+            res = (res << 8) | byte();
+
+        return res;
+    }
+
+private:
+
+    const std::string& data;
+    size_t pos;
+};
+
+void ImageWriter::write(std::istream& source, const std::string& sourcename, std::ostream& out)
+{
+    size_t fileIndex = Process::instance().filenameCount();
+    Process::instance().addFilename(sourcename);
+
+    Lexer lexer(source, fileIndex, false /*keep newline*/);
+
+    std::vector<std::string> strings = {""};
+    std::unordered_map<std::string, uint32_t> stringIndex = {{"", 0}};
+
+    struct Entry
+    {
+        uint8_t code;
+        uint32_t lexeme;
+        int line;
+        int col;
+    };
+
+    std::vector<Entry> entries;
+
+    Token tok;
+    while (true)
+    {
+        lexer.tokenize(tok);
+
+        if (tok.getType() == TokenType::EndOfStream)
+            break;
+
+        uint32_t lexeme = 0;
+        uint8_t code = Lexer::getTokenCode(tok.getType());
+
+        if (hasPayload(tok.getType()))
+        {
+            auto res = stringIndex.emplace(tok.getLexeme(), (uint32_t) strings.size());
+            if (res.second)
+                strings.push_back(tok.getLexeme());
+
+            lexeme = res.first->second;
+        }
+        else if (!tok.getLexeme().empty())
+        {
+            // Keywords with several spellings have a code for each
+            auto info = lexer.getTokenInfo(tok.getLexeme().c_str());
+            if (info != nullptr && info->type == tok.getType() && info->code != 0)
+                code = info->code;
+        }
+
+        if (code == 0 || (!hasPayload(tok.getType()) && impliedLexeme(code) != tok.getLexeme()))
+            throw AsmException("Token has no binary representation", tok.getLocation());
+
+        entries.push_back({code, lexeme, tok.getLocation().getLine(), tok.getLocation().getCol()});
+    }
+
+    out.write(imageMagic, sizeof(imageMagic));
+
+    uint32_t version = boost::endian::native_to_big(imageVersion);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+
+    writeString(out, sourcename);
+
+    writeVarint(out, strings.size());
+    for (const auto& str : strings)
+        writeString(out, str);
+
+    writeVarint(out, entries.size());
+    for (const auto& entry : entries)
+    {
+        out.put((char) entry.code);
+
+        if (hasPayload(Lexer::getTokenType(entry.code)))
+            writeVarint(out, entry.lexeme);
+    }
+
+    int line = 0;
+    for (const auto& entry : entries)
+    {
+        writeSigned(out, entry.line - line);
+        writeSigned(out, entry.col);
+        line = entry.line;
+    }
+}
+
+void ImageWriter::write(const std::string& sourcePath, const std::string& imagePath)
+{
+    std::ifstream in(sourcePath, std::ios::binary);
+    if (!in.good())
+        throw std::runtime_error("Could not open assembly file for reading: " + sourcePath);
+
+    if (ImageReader::isImage(in))
+        throw std::runtime_error("Source is already a precompiled image: " + sourcePath);
+
+    // Write to memory first so lexical errors don't leave a truncated image behind
+    std::ostringstream image;
+    write(in, sourcePath, image);
+
+    std::ofstream out(imagePath, std::ios::binary | std::ios::trunc);
+    if (!out.good())
+        throw std::runtime_error("Could not open image file for writing: " + imagePath);
+
+    out << image.str();
+}
+
+bool ImageReader::isImage(std::istream& stream)
+{
+    auto start = stream.tellg();
+
+    char buf[sizeof(imageMagic)];
+    stream.read(buf, sizeof(buf));
+    bool res = stream.gcount() == sizeof(buf) && std::equal(buf, buf + sizeof(buf), imageMagic);
+
+    stream.clear();
+    stream.seekg(start);
+
+    return res;
+}
+
+ImageReader::ImageReader(std::istream& stream, size_t fileIndex) : fileIndex(fileIndex)
+{
+    std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    if (data.size() < sizeof(imageMagic) || !std::equal(imageMagic, imageMagic + sizeof(imageMagic), data.begin()))
+        throw std::runtime_error("Not a precompiled image");
+
+    ImageCursor in(data, sizeof(imageMagic));
+
+    uint32_t version = in.bigEndian32();
+    if (version != imageVersion)
+        throw std::runtime_error("Unsupported image version " + std::to_string(version) +
+                                 ", expected " + std::to_string(imageVersion));
+
+    sourceName = in.string();
+
+    size_t stringCount = in.count(1);
+    strings.reserve(stringCount);
+    for (size_t i = 0; i < stringCount; i++)
+        strings.push_back(in.string());
+
+    // Implied lexemes are added to the string table on first use
+    std::unordered_map<uint8_t, uint32_t> implied;
+
+    size_t tokenCount = in.count(1);
+    tokens.resize(tokenCount);
+    for (auto& token : tokens)
+    {
+        uint8_t code = in.byte();
+        token.type = Lexer::getTokenType(code);
+        if (token.type == TokenType::Invalid)
+            throw std::runtime_error("Invalid image: unknown token code " + std::to_string(code));
+
+        if (hasPayload(token.type))
+        {
+            uint64_t lexeme = in.varint();
+            if (lexeme >= strings.size())
+                throw std::runtime_error("Invalid image: string index out of range");
+
+            token.lexeme = (uint32_t) lexeme;
+        }
+        else
+        {
+            auto res = implied.emplace(code, (uint32_t) strings.size());
+            if (res.second)
+                strings.push_back(impliedLexeme(code));
+
+            token.lexeme = res.first->second;
+        }
+    }
+
+    int line = 0;
+    for (auto& token : tokens)
+    {
+        line += (int) in.signedVarint();
+        token.line = line;
+        token.col = (int) in.signedVarint();
+    }
+}
+
+void ImageReader::tokenize(Token& token)
+{
+    if (pos >= tokens.size())
+    {
+        token.getLexeme().clear();
+        token.setTokenType(TokenType::EndOfStream);
+        return;
+    }
+
+    const ImageToken& next = tokens[pos++];
+
+    token.setTokenType(next.type);
+    token.setLexeme(strings[next.lexeme]);
+    token.setLocation(next.line, next.col, (int) fileIndex);
+}
+
+void ImageReader::mark()
+{
+    markedPos = pos;
+}
+
+void ImageReader::restore()
+{
+    pos = markedPos;
+    markedPos = 0;
+}
+
+}//ns
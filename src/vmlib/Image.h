@@ -0,0 +1,109 @@
+#ifndef LAKE_IMAGE_H
+#define LAKE_IMAGE_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "AsmLexer.h"
+
+namespace lake {
+
+// A precompiled image starts with this marker
+static constexpr char imageMagic[8] = {'\x7f', 'L', 'A', 'K', 'E', 'B', '\r', '\n'};
+
+// Bump when the layout or the binary token codes change
+static constexpr uint32_t imageVersion = 1;
+
+/**
+ * Writes precompiled (.lakeb) images.
+ *
+ * An image is the lexed form of an assembly file: each token is stored as its binary
+ * code from the lexer's keyword table. Identifiers and literals are followed by an index
+ * into a string table. Source locations are kept in a separate, delta-encoded table so
+ * diagnostics still refer to the original source file. Loading an image thus skips all
+ * character-level work, and since the parser consumes the exact token sequence the
+ * lexer would have produced, the resulting expression tree is identical to parsing the
+ * source.
+ *
+ * Layout; integers are unsigned LEB128 unless noted, signed values are zigzag encoded:
+ *
+ *      magic           8 bytes, see imageMagic
+ *      version         uint32, big endian
+ *      source name     length, bytes
+ *      string table    count, then length + bytes for each string. Entry 0 is the empty string
+ *      token table     count, then a code byte for each token, followed by a string
+ *                      index for identifiers and literals
+ *      location table  line delta and column (signed) for each token
+ */
+class ImageWriter
+{
+public:
+
+    /**
+     * Lexes the assembly in the source stream and writes it as an image. Lexical
+     * errors are reported here rather than when the image is loaded.
+     *
+     * @param sourcename Name of the source, recorded in the image for diagnostics
+     */
+    static void write(std::istream& source, const std::string& sourcename, std::ostream& out);
+
+    /**
+     * Creates an image file from an assembly file
+     */
+    static void write(const std::string& sourcePath, const std::string& imagePath);
+};
+
+/**
+ * Supplies the tokens of a precompiled image to the parser.
+ */
+class ImageReader : public TokenSource
+{
+public:
+
+    /**
+     * Reads the entire image from the stream
+     *
+     * @param fileIndex Index of the source name registered with Process, for diagnostics
+     */
+    ImageReader(std::istream& stream, size_t fileIndex);
+
+    /**
+     * Returns true if the stream is positioned at an image. The stream position is
+     * not changed.
+     */
+    static bool isImage(std::istream& stream);
+
+    /**
+     * Name of the source file the image was created from
+     */
+    const std::string& getSourceName() const
+    {
+        return sourceName;
+    }
+
+    void tokenize(Token& token) override;
+    void mark() override;
+    void restore() override;
+
+private:
+
+    struct ImageToken
+    {
+        TokenType type;
+        uint32_t lexeme;
+        int line;
+        int col;
+    };
+
+    std::string sourceName;
+    std::vector<std::string> strings;
+    std::vector<ImageToken> tokens;
+
+    size_t fileIndex;
+    size_t pos = 0;
+    size_t markedPos = 0;
+};
+
+}//ns
+
+#endif //LAKE_IMAGE_H
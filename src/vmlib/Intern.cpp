@@ -0,0 +1,50 @@
+#include "Intern.h"
+
+namespace lake {
+
+InternTable& InternTable::instance()
+{
+    // Never destroyed, as objects may release their strings during static destruction
+    static InternTable* table = new InternTable();
+    return *table;
+}
+
+InternedString* InternTable::intern(const std::string& text)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto slot = entries.slotFor(text);
+    if (slot.second)
+        return retain(*slot.first);
+
+    *slot.first = new InternedString(text, std::hash<std::string>()(text));
+    return *slot.first;
+}
+
+void InternTable::release(InternedString* str)
+{
+    // Other references remain as long as the count is above one. The last reference is
+    // dropped under the lock, so intern() can't hand out a string that is being removed.
+    uint32_t refs = str->refs.load(std::memory_order_relaxed);
+    while (refs > 1)
+    {
+        if (str->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (str->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        entries.erase(*str);
+        delete str;
+    }
+}
+
+size_t InternTable::size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
+
+}//ns
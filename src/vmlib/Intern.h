@@ -0,0 +1,98 @@
+#ifndef LAKE_INTERN_H
+#define LAKE_INTERN_H
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include "HashTable.h"
+
+namespace lake {
+
+/**
+ * A string in the intern table. Each text is interned once, so two interned strings are
+ * equal exactly when they're the same object. The hash is computed when interning.
+ *
+ * Interned strings are shared and must never be changed.
+ */
+class InternedString : public std::string
+{
+public:
+
+    InternedString(const std::string& text, size_t hash) : std::string(text), hash(hash), refs(1)
+    { }
+
+    // std::hash of the text, the same as for a string that isn't interned
+    const size_t hash;
+
+private:
+
+    friend class InternTable;
+
+    std::atomic<uint32_t> refs;
+};
+
+/**
+ * Process-wide table of interned strings, used for symbols and string literals. It's shared
+ * by all VMs and threads, so a program's literals are deduplicated across the VMs running it.
+ *
+ * Entries are reference counted by the objects using them, and removed with the last one.
+ * Objects may be freed by the background sweeper, so releasing is thread safe as well.
+ */
+class InternTable
+{
+public:
+
+    static InternTable& instance();
+
+    /**
+     * Returns a new reference to the interned copy of 'text', interning it if needed
+     */
+    InternedString* intern(const std::string& text);
+
+    /**
+     * Returns a new reference to a string the caller already holds a reference to
+     */
+    static inline InternedString* retain(InternedString* str)
+    {
+        str->refs.fetch_add(1, std::memory_order_relaxed);
+        return str;
+    }
+
+    void release(InternedString* str);
+
+    /**
+     * Number of interned strings
+     */
+    size_t size() const;
+
+private:
+
+    InternTable() = default;
+
+    struct TextOf
+    {
+        const std::string& operator()(InternedString* slot) const
+        {
+            return *slot;
+        }
+    };
+
+    class Entries : public FlatTable<InternedString*, std::string, TextOf, std::hash<std::string>, std::equal_to<std::string>>
+    {
+    public:
+
+        // Returns the slot of 'text' and true, or a new slot to be filled in and false
+        std::pair<InternedString**, bool> slotFor(const std::string& text)
+        {
+            auto pos = insertPosition(text);
+            return std::make_pair(&slotAt(pos.first), pos.second);
+        }
+    };
+
+    mutable std::mutex lock;
+    Entries entries;
+};
+
+}//ns
+
+#endif //LAKE_INTERN_H
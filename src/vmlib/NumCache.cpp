@@ -0,0 +1,66 @@
+#include <iostream>
+#include "NumCache.h"
+
+namespace lake {
+
+void NumCache::setCapacity(size_t capacity)
+{
+    this->capacity = capacity;
+
+    for (int i = 0; i < SIZE_CLASSES; i++)
+    {
+        while (mpzBuckets[i].size() > capacity)
+        {
+            mpz_clear(&mpzBuckets[i].back());
+            mpzBuckets[i].pop_back();
+        }
+
+        while (mpfBuckets[i].size() > capacity)
+        {
+            mpf_clear(&mpfBuckets[i].back());
+            mpfBuckets[i].pop_back();
+        }
+    }
+}
+
+size_t NumCache::size() const
+{
+    size_t res = 0;
+
+    for (int i = 0; i < SIZE_CLASSES; i++)
+        res += mpzBuckets[i].size() + mpfBuckets[i].size();
+
+    return res;
+}
+
+void NumCache::clear()
+{
+    for (int i = 0; i < SIZE_CLASSES; i++)
+    {
+        for (auto& value : mpzBuckets[i])
+            mpz_clear(&value);
+
+        for (auto& value : mpfBuckets[i])
+            mpf_clear(&value);
+
+        mpzBuckets[i].clear();
+        mpfBuckets[i].clear();
+    }
+}
+
+void NumCache::dump() const
+{
+    std::cout << "NUMBER CACHE: capacity " << capacity << " per size class, " << size() << " cached" << std::endl;
+    std::cout << "> hits: " << hits << ", misses: " << misses << ", evictions: " << evictions << std::endl;
+
+    for (int i = 0; i < SIZE_CLASSES; i++)
+    {
+        if (mpzBuckets[i].empty() && mpfBuckets[i].empty())
+            continue;
+
+        std::cout << "> " << (1 << i) << " limbs: " << mpzBuckets[i].size() << " int, "
+                  << mpfBuckets[i].size() << " float" << std::endl;
+    }
+}
+
+}//ns
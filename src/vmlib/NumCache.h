@@ -0,0 +1,191 @@
+#ifndef LAKE_NUMCACHE_H
+#define LAKE_NUMCACHE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <mpir.h>
+
+namespace lake {
+
+/**
+ * A per-VM cache of initialized mpz/mpf values. Objects draw their GMP storage from
+ * here when created, and return it when destructed, so short lived numbers don't
+ * cause a malloc/free of limbs each time.
+ *
+ * Values are bucketed by size class, which is log2 of the number of allocated limbs.
+ * Integers are handed out from the smallest non-empty class. Floats are only reused
+ * if their precision equals the current default precision; entries with a stale
+ * precision are cleared when encountered.
+ */
+class NumCache
+{
+public:
+
+    // Values with more limbs than the largest class are never cached
+    static constexpr int SIZE_CLASSES = 8;
+
+    // Default capacity per size class
+    static constexpr size_t DEFAULT_CAPACITY = 16384;
+
+    NumCache() = default;
+    NumCache(const NumCache&) = delete;
+    NumCache& operator=(const NumCache&) = delete;
+
+    ~NumCache()
+    {
+        clear();
+    }
+
+    /**
+     * Initializes 'value' to zero, reusing a cached integer if available
+     */
+    inline void acquire(mpz_t value)
+    {
+        for (int i = 0; i < SIZE_CLASSES; i++)
+        {
+            auto& bucket = mpzBuckets[i];
+            if (!bucket.empty())
+            {
+                *value = bucket.back();
+                bucket.pop_back();
+                mpz_set_ui(value, 0);
+
+                hits++;
+                return;
+            }
+        }
+
+        misses++;
+        mpz_init(value);
+    }
+
+    /**
+     * Initializes 'value' to zero with the default precision, reusing a cached float if available
+     */
+    inline void acquire(mpf_t value)
+    {
+        mp_bitcnt_t prec = mpf_get_default_prec();
+        int sizeClass = classOf(prec / GMP_NUMB_BITS + 1);
+
+        if (sizeClass >= 0)
+        {
+            auto& bucket = mpfBuckets[sizeClass];
+            while (!bucket.empty())
+            {
+                *value = bucket.back();
+                bucket.pop_back();
+
+                if (mpf_get_prec(value) == prec)
+                {
+                    mpf_set_ui(value, 0);
+
+                    hits++;
+                    return;
+                }
+
+                mpf_clear(value);
+            }
+        }
+
+        misses++;
+        mpf_init(value);
+    }
+
+    /**
+     * Takes ownership of 'value', which must not be used afterwards
+     */
+    inline void release(mpz_t value)
+    {
+        int sizeClass = classOf((size_t) value->_mp_alloc);
+
+        if (sizeClass >= 0 && mpzBuckets[sizeClass].size() < capacity)
+        {
+            mpzBuckets[sizeClass].push_back(*value);
+        }
+        else
+        {
+            evictions++;
+            mpz_clear(value);
+        }
+    }
+
+    /**
+     * Takes ownership of 'value', which must not be used afterwards
+     */
+    inline void release(mpf_t value)
+    {
+        int sizeClass = classOf(mpf_get_prec(value) / GMP_NUMB_BITS + 1);
+
+        if (sizeClass >= 0 && mpfBuckets[sizeClass].size() < capacity)
+        {
+            mpfBuckets[sizeClass].push_back(*value);
+        }
+        else
+        {
+            evictions++;
+            mpf_clear(value);
+        }
+    }
+
+    /**
+     * Sets the maximum number of cached values per size class. Zero disables caching.
+     * Excess values are cleared.
+     */
+    void setCapacity(size_t capacity);
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    /**
+     * Number of cached values
+     */
+    size_t size() const;
+
+    /**
+     * Clears all cached values. Counters are retained.
+     */
+    void clear();
+
+    /**
+     * Prints counters and bucket sizes
+     */
+    void dump() const;
+
+    // Acquisitions served from the cache
+    uint64_t hits = 0;
+
+    // Acquisitions which had to initialize a new value
+    uint64_t misses = 0;
+
+    // Releases which cleared the value because the cache was full or the value too large
+    uint64_t evictions = 0;
+
+private:
+
+    /**
+     * Returns the size class for a limb count, or -1 if the value is too large to cache
+     */
+    static inline int classOf(size_t limbs)
+    {
+        int sizeClass = 0;
+        while (limbs > 1)
+        {
+            limbs >>= 1;
+            sizeClass++;
+        }
+
+        return sizeClass < SIZE_CLASSES ? sizeClass : -1;
+    }
+
+    size_t capacity = DEFAULT_CAPACITY;
+
+    std::vector<__mpz_struct> mpzBuckets[SIZE_CLASSES];
+    std::vector<__mpf_struct> mpfBuckets[SIZE_CLASSES];
+};
+
+}//ns
+
+#endif //LAKE_NUMCACHE_H
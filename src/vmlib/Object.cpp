@@ -1,17 +1,86 @@
 #include <inttypes.h>
+#include <algorithm>
+#include <clocale>
+#include <cmath>
 #include <iostream>
 #include "Object.h"
 #include "Stack.h"
 #include "ExprExpressionList.h"
 #include "AsmParser.h"
 #include "ExprFFI.h"
+#include "Bytecode.h"
 
 namespace lake {
 
 // Move to stdlib
 extern "C" Object* lake_double(Object* obj)
 {
-    return obj->mul(obj, lake::track(Object::create((uint64_t)2)));
+    return obj->mul(obj, Object::makeInt(2));
+}
+
+Object* Object::immediate(int64_t value)
+{
+    assert(value >= IMMEDIATE_INT_MIN && value <= IMMEDIATE_INT_MAX);
+
+    static std::vector<Object> immediates = []
+    {
+        std::vector<Object> table;
+        table.reserve(IMMEDIATE_INT_MAX - IMMEDIATE_INT_MIN + 1);
+
+        for (int64_t i = IMMEDIATE_INT_MIN; i <= IMMEDIATE_INT_MAX; i++)
+            table.emplace_back(i, FLAG_GC_PINNED | FLAG_CONST);
+
+        return table;
+    }();
+
+    return &immediates[value - IMMEDIATE_INT_MIN];
+}
+
+Object* Object::immediate(char value)
+{
+    static std::vector<Object> immediates = []
+    {
+        std::vector<Object> table;
+        table.reserve(256);
+
+        for (int i = 0; i < 256; i++)
+            table.emplace_back((char) i, FLAG_GC_PINNED | FLAG_CONST);
+
+        return table;
+    }();
+
+    return &immediates[(unsigned char) value];
+}
+
+mpz_t& Object::scratchInt()
+{
+    struct Scratch
+    {
+        mpz_t value;
+        Scratch() { mpz_init(value); }
+        ~Scratch() { mpz_clear(value); }
+    };
+
+    static thread_local Scratch scratch;
+    return scratch.value;
+}
+
+mpf_t& Object::scratchFloat()
+{
+    struct Scratch
+    {
+        mpf_t value;
+        Scratch() { mpf_init(value); }
+        ~Scratch() { mpf_clear(value); }
+    };
+
+    static thread_local Scratch scratch;
+
+    // The default precision may have been raised since the scratch value was created
+    if (mpf_get_prec(scratch.value) < mpf_get_default_prec())
+        mpf_set_prec(scratch.value, mpf_get_default_prec());
+
+    return scratch.value;
 }
 
 void ViewType::fromObjectAndViewType(Object &o, TokenType t)
@@ -63,9 +132,9 @@ void ViewType::fromObjectAndViewType(Object &o, TokenType t)
         else if (t == TokenType::TypeViewUint64)
             _uint64 = sgn ? -s : s;
     }
-    else if (t == TokenType::TypeViewFloat && t == TokenType::TypeViewDouble)
+    else if (t == TokenType::TypeViewFloat || t == TokenType::TypeViewDouble)
     {
-        double d = mpf_get_d(o.mpf);
+        double d = o.isDouble() ? o.double_value : mpf_get_d(o.mpf);
 
         if (t == TokenType::TypeViewDouble)
             _double = d;
@@ -74,8 +143,16 @@ void ViewType::fromObjectAndViewType(Object &o, TokenType t)
     }
     else if (t == TokenType::TypeViewPointer)
     {
-        // Doesn't matter if the data is in the utf8 field, as long as it's a pointer member
-        _ptr = o.ptr_value;
+        // Typed arrays pass their elements, and strings and ropes their characters. A rope is
+        // flattened, and the flattened copy lives until the rope changes.
+        if (o.isTypedArray())
+            _ptr = o.typed->raw();
+        else if (o.isString())
+            _ptr = (void*) o.str_value->c_str();
+        else if (o.isRope())
+            _ptr = (void*) o.rope->flatten().c_str();
+        else
+            _ptr = o.ptr_value;
     }
     else if (t == TokenType::TypeObject)
     {
@@ -99,6 +176,7 @@ FunctionData::FunctionData(const FunctionData& copy)
 {
     this->name = copy.name;
     this->body = copy.body;
+    this->code = copy.code;
     this->withStack = copy.withStack;
 
     this->locals = copy.locals;
@@ -107,7 +185,7 @@ FunctionData::FunctionData(const FunctionData& copy)
 
     if (copy.withStack)
     {
-        this->stack = (Stack*) lake::track(new (vm().stackpool.malloc()) Stack());
+        this->stack = (Stack*) lake::track(new Stack());
     }
     else
     {
@@ -115,6 +193,24 @@ FunctionData::FunctionData(const FunctionData& copy)
     }
 }
 
+/**
+ * Pins or unpins an object, which may be on a list being swept in the background
+ */
+static inline void setPinned(Object* obj, bool pinned)
+{
+    if (vm().sweeper.active())
+    {
+        if (pinned)
+            obj->setFlagAtomic(FLAG_GC_PINNED);
+        else
+            obj->clearFlagAtomic(FLAG_GC_PINNED);
+    }
+    else if (pinned)
+        obj->setFlag(FLAG_GC_PINNED);
+    else
+        obj->clearFlag(FLAG_GC_PINNED);
+}
+
 Object* FunctionData::evaluateBody(Object* functionObject)
 {
     // The function can be executed with its own stack (typically the case
@@ -130,20 +226,24 @@ Object* FunctionData::evaluateBody(Object* functionObject)
     Object* oldFunction = vm().current;
     vm().current = functionObject;
 
-    // Prevent GC while we're evaluating
-    functionObject->setFlag(FLAG_GC_PINNED);
-    body->setFlag(FLAG_GC_PINNED);
+    // Prevent GC while we're evaluating. The function may not be reachable otherwise, so it's also
+    // a root until it returns. If an exception unwinds past us, the caller drops the entry.
+    setPinned(functionObject, true);
 
-    Object* res = body->eval();
+    size_t depth = vm().activeFunctions.size();
+    vm().activeFunctions.push_back(functionObject);
 
-    functionObject->clearFlag(FLAG_GC_PINNED);
-    body->clearFlag(FLAG_GC_PINNED);
+    Object* res = vm().engine == VM::Engine::Bytecode ? BytecodeInterpreter::run(body) : body->eval();
+
+    vm().activeFunctions.resize(depth);
+
+    setPinned(functionObject, false);
 
     vm().current = oldFunction;
 
     // Restore stack
     if (withStack && stack != nullptr)
-        vm().stacks.pop_back();
+        vm().popStack();
     else
         vm().restoreStackBase();
 
@@ -163,8 +263,10 @@ void FunctionData::mark()
     for (Object* obj : args)
         obj->mark();
 
-    // Mark expression list items
-    body->mark();
+    // The body is not traced; if it's in a region, the region's literals are marked once per
+    // collection. Minor collections and scratch region sweeps mark the roots of all regions instead.
+    if (code != nullptr && !vm().minorMarking && vm().scratchMarking == 0)
+        code->mark();
 
     if (stack)
         stack->mark();
@@ -173,6 +275,35 @@ void FunctionData::mark()
 void ProjectionData::mark()
 {
     collection->mark();
+
+    if (lower != nullptr)
+        lower->mark();
+    if (upper != nullptr)
+        upper->mark();
+}
+
+/**
+ * GMP storage comes from the VM's number cache. Objects created without a VM, such as
+ * static singletons, are initialized directly.
+ */
+static inline void initNumber(mpz_t value)
+{
+    VM* owner = Process::instance().vm;
+
+    if (owner != nullptr)
+        owner->numcache.acquire(value);
+    else
+        mpz_init(value);
+}
+
+static inline void initNumber(mpf_t value)
+{
+    VM* owner = Process::instance().vm;
+
+    if (owner != nullptr)
+        owner->numcache.acquire(value);
+    else
+        mpf_init(value);
 }
 
 Object::Object(const Object& obj) : Object(obj.otype, FLAG_GC_PINNED)
@@ -181,16 +312,58 @@ Object::Object(const Object& obj) : Object(obj.otype, FLAG_GC_PINNED)
         mpz_set(mpz, obj.mpz);
     else if (isFloat())
         mpf_set(mpf, obj.mpf);
+    else if (isDouble())
+        double_value = obj.double_value;
+    else if ((otype == TokenType::TypeString || otype == TokenType::TypeSymbol) && obj.hasFlag(FLAG_INTERNED))
+    {
+        // Shared until either string is changed
+        str_value = InternTable::retain(obj.interned());
+        setFlag(FLAG_INTERNED);
+    }
     else if (otype == TokenType::TypeString || otype == TokenType::TypeSymbol)
         str_value = new std::string(*obj.str_value);
     else if (otype == TokenType::TypeBool)
         bool_value = obj.bool_value;
     else if (otype == TokenType::TypeFunction)
-        fndata = vm().fnpool.construct(*obj.fndata);
+        fndata = vm().fnpool.create(*obj.fndata);
     else if (otype == TokenType::TypeArray)
         array = new std::vector<Object*>(*obj.array);
+    else if (otype == TokenType::TypeTypedArray)
+        typed = new TypedArray(*obj.typed);
+    else if (otype == TokenType::TypeOrderedMap)
+        omap = new OrderedMap(*obj.omap);
+    else if (otype == TokenType::TypeOrderedSet)
+        oset = new OrderedSet(*obj.oset);
+
+    // Persistent collections are immutable, so copies share all nodes
+    else if (otype == TokenType::TypePersistentVector)
+        pvec = new PersistentVector(*obj.pvec);
+    else if (otype == TokenType::TypePersistentMap)
+        pmap = new PersistentMap(*obj.pmap);
+
+    // Rope nodes are immutable too, so a copy shares them until either rope changes
+    else if (otype == TokenType::TypeRope)
+        rope = new Rope(*obj.rope);
 
     // A bit subtle: dup/copy of a projection creates a real array of the projection
+    else if (otype == TokenType::TypeProjection && obj.projection->collection->isOrderedMap())
+    {
+        omap = new OrderedMap();
+        forEachInRange(obj.projection, [this](Object* key, Object* value) { omap->insert(key, value); });
+        otype = TokenType::TypeOrderedMap;
+    }
+    else if (otype == TokenType::TypeProjection && obj.projection->collection->isOrderedSet())
+    {
+        oset = new OrderedSet();
+        forEachInRange(obj.projection, [this](Object* key, Object*) { oset->insert(key, NoValue()); });
+        otype = TokenType::TypeOrderedSet;
+    }
+    else if (otype == TokenType::TypeProjection && obj.projection->collection->isTypedArray())
+    {
+        const TypedArray* source = obj.projection->collection->typed;
+        typed = new TypedArray(*source, obj.projection->start, source->size() - obj.projection->end);
+        otype = TokenType::TypeTypedArray;
+    }
     else if(otype == TokenType::TypeProjection)
     {
         array = new std::vector<Object*>(obj.projection->collection->array->begin()+obj.projection->start,
@@ -216,9 +389,11 @@ Object::Object(TokenType otype, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
     this->otype = otype;
 
     if (isInteger())
-        mpz_init(mpz);
+        initNumber(mpz);
     else if (isFloat())
-        mpf_init(mpf); // default is 53 bit precision
+        initNumber(mpf); // default is 53 bit precision
+    else if (isDouble())
+        double_value = 0;
 }
 
 
@@ -234,43 +409,79 @@ Object::Object(std::vector<Object*>* value, uint8_t flags) : flags(flags|FLAG_GC
     array = value;
 }
 
-Object::Object(std::unordered_map<Object*,Object*>* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+Object::Object(TypedArray* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+{
+    this->otype = TokenType::TypeTypedArray;
+    typed = value;
+}
+
+Object::Object(ObjectMap* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeUnorderedMap;
     umap = value;
 }
 
-Object::Object(std::unordered_set<Object*>* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+Object::Object(ObjectSet* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeUnorderedSet;
     uset = value;
 }
 
+Object::Object(OrderedMap* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+{
+    this->otype = TokenType::TypeOrderedMap;
+    omap = value;
+}
+
+Object::Object(OrderedSet* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+{
+    this->otype = TokenType::TypeOrderedSet;
+    oset = value;
+}
+
+Object::Object(PersistentVector* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+{
+    this->otype = TokenType::TypePersistentVector;
+    pvec = value;
+}
+
+Object::Object(PersistentMap* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+{
+    this->otype = TokenType::TypePersistentMap;
+    pmap = value;
+}
+
+Object::Object(Rope* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
+{
+    this->otype = TokenType::TypeRope;
+    rope = value;
+}
+
 Object::Object(int64_t value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeInt;
-    mpz_init(mpz);
+    initNumber(mpz);
     mpz_set_sx(mpz, value);
 }
 
 Object::Object(uint64_t value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeInt;
-    mpz_init(mpz);
+    initNumber(mpz);
     mpz_set_ux(mpz, value);
 }
 
 Object::Object(mpz_t value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeInt;
-    mpz_init(mpz);
+    initNumber(mpz);
     mpz_set(mpz, value);
 }
 
 Object::Object(mpf_t value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeFloat;
-    mpf_init(mpf);
+    initNumber(mpf);
     mpf_set(mpf, value);
 }
 
@@ -301,7 +512,7 @@ Object::Object(ProjectionData* projdata, uint8_t flags) : flags(flags|FLAG_GC_PI
 Object::Object(double value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeFloat;
-    mpf_init(mpf);
+    initNumber(mpf);
     mpf_set_d(mpf, value);
 }
 
@@ -313,6 +524,12 @@ Object::Object(char* value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
     setFlag(FLAG_FREESTORE);
 }
 
+Object::Object(InternedString* value, TokenType type, uint8_t flags) : flags(flags|FLAG_GC_PINNED|FLAG_INTERNED)
+{
+    this->otype = type;
+    this->str_value = value;
+}
+
 Object::Object(char value, uint8_t flags) : flags(flags|FLAG_GC_PINNED)
 {
     this->otype = TokenType::TypeChar;
@@ -335,23 +552,38 @@ void Object::track()
     // All objects are constructed pinned, track removes it
     clearFlag(FLAG_GC_PINNED);
 
-    vm().numObjects++;
+    size_t owned = ownedBytes();
 
-    // Put ourself at the head of the heap gc chain
-    prev = nullptr;
-    next = vm().heapHead;
-    if (next != nullptr)
-        next->prev = this;
-    vm().heapHead = this;
+    vm().numObjects++;
+    vm().numYoung++;
+    vm().externalBytes += owned;
+    vm().gcStats.allocated(otype, Heap::pageOf(this)->slotSize + owned);
+
+    // Let the collector find us through our page, in the nursery
+    vm().heap.track(this);
+
+    // Objects tracked during incremental marking are reachable, as there are no barriers on stacks.
+    // Likewise, objects tracked while sweeping survive the cycle, unless their page is already swept.
+    if (vm().gcPhase == VM::GCPhase::Marking)
+        mark();
+    else if (vm().gcPhase == VM::GCPhase::Sweeping && Heap::pageOf(this)->pendingSweep)
+        Heap::mark(this, false);
 }
 
 void Object::mark()
 {
-    if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-        return;
-
-    setFlag(FLAG_GC_REACHABLE);
+    // Leaves are black as soon as they're marked
+    if (markSelf() && !isLeaf())
+    {
+        if (vm().parallelMarking)
+            ParallelMarker::push(this);
+        else
+            vm().grayStack.push_back(this);
+    }
+}
 
+void Object::markChildren()
+{
     if (otype == TokenType::TypeFunction)
     {
         fndata->mark();
@@ -369,10 +601,7 @@ void Object::mark()
     }
     else if (otype == TokenType::TypeArray && array != nullptr)
     {
-        for (const auto& obj : *array)
-        {
-            obj->mark();
-        }
+        markAll(*array);
     }
     else if (otype == TokenType::TypeUnorderedMap && umap != nullptr)
     {
@@ -389,9 +618,40 @@ void Object::mark()
             obj->mark();
         }
     }
+    else if (otype == TokenType::TypeOrderedMap && omap != nullptr)
+    {
+        omap->forEach([](Object* key, Object* value)
+        {
+            key->mark();
+            value->mark();
+        });
+    }
+    else if (otype == TokenType::TypeOrderedSet && oset != nullptr)
+    {
+        oset->forEach([](Object* key, NoValue)
+        {
+            key->mark();
+        });
+    }
+    else if (otype == TokenType::TypePersistentVector && pvec != nullptr)
+    {
+        // Nodes shared by several versions are traced by the first of them this cycle
+        pvec->forEachUnvisited(vm().markEpoch, [](Object* obj)
+        {
+            obj->mark();
+        });
+    }
+    else if (otype == TokenType::TypePersistentMap && pmap != nullptr)
+    {
+        pmap->forEachUnvisited(vm().markEpoch, [](Object* key, Object* value)
+        {
+            key->mark();
+            value->mark();
+        });
+    }
 }
 
-Object* Object::destruct()
+void Object::destruct()
 {
     if (otype == TokenType::InvalidCollected)
         throw std::runtime_error("Destructing already collected object");
@@ -402,48 +662,139 @@ Object* Object::destruct()
     if (!hasFlag(FLAG_GC_TRACKED))
         throw std::runtime_error("BUG:Trying to destruct an untracked object");
 
+    vm().externalBytes -= ownedBytes();
+
     if (isInteger())
-        mpz_clear(mpz);
+        vm().numcache.release(mpz);
     else if (isFloat())
-        mpf_clear(mpf);
+        vm().numcache.release(mpf);
     else if (otype == TokenType::TypeFunction && fndata != nullptr)
-        vm().fnpool.free(fndata);
-    else if (otype == TokenType::TypeString || otype == TokenType::TypeSymbol)
+        vm().fnpool.destroy(fndata);
+    else
+        destructHeapData();
+
+    otype = TokenType::InvalidCollected;
+    ptr_value = nullptr;
+
+    if (gcstate == 0)
+        vm().numYoung--;
+    else if (gcstate & GC_REMEMBERED)
+        vm().remembered.erase(std::find(vm().remembered.begin(), vm().remembered.end(), this));
+
+    // Clears our bits in the page bitmaps, and puts the memory on the page's free list
+    vm().heap.free(this);
+}
+
+size_t Object::ownedBytes() const
+{
+    switch (otype)
+    {
+        // Integers are re-accounted by makeInt when limbs are swapped in after tracking. A float's
+        // limbs are fixed by its precision, so they're counted as for the number cache.
+        case TokenType::TypeInt:
+            return mpz_size(mpz) * sizeof(mp_limb_t);
+        case TokenType::TypeFloat:
+            return (mpf_get_prec(mpf) / GMP_NUMB_BITS + 1) * sizeof(mp_limb_t);
+        case TokenType::TypeString:
+        case TokenType::TypeSymbol:
+            // Interned strings belong to the intern table
+            if (str_value == nullptr || hasFlag(FLAG_INTERNED))
+                return 0;
+            return sizeof(std::string) + str_value->capacity();
+        case TokenType::TypePair:
+            return pair != nullptr ? sizeof(*pair) : 0;
+        case TokenType::TypeArray:
+            if (array == nullptr || hasFlag(FLAG_FOREIGN))
+                return 0;
+            return sizeof(*array) + array->capacity() * sizeof(Object*);
+        case TokenType::TypeTypedArray:
+            return typed != nullptr ? sizeof(TypedArray) + typed->capacity() * typed->elementSize() : 0;
+        case TokenType::TypeUnorderedMap:
+            if (umap == nullptr || hasFlag(FLAG_FOREIGN))
+                return 0;
+            return sizeof(*umap) + umap->allocatedBytes();
+        case TokenType::TypeUnorderedSet:
+            if (uset == nullptr || hasFlag(FLAG_FOREIGN))
+                return 0;
+            return sizeof(*uset) + uset->allocatedBytes();
+        case TokenType::TypeOrderedMap:
+            return omap != nullptr ? sizeof(*omap) + omap->allocatedBytes() : 0;
+        case TokenType::TypeOrderedSet:
+            return oset != nullptr ? sizeof(*oset) + oset->allocatedBytes() : 0;
+        case TokenType::TypePersistentVector:
+            return pvec != nullptr ? sizeof(*pvec) + pvec->allocatedBytes() : 0;
+        case TokenType::TypePersistentMap:
+            return pmap != nullptr ? sizeof(*pmap) + pmap->allocatedBytes() : 0;
+        case TokenType::TypeRope:
+            return rope != nullptr ? sizeof(*rope) + rope->allocatedBytes() : 0;
+        case TokenType::TypeFunction:
+            if (fndata == nullptr)
+                return 0;
+            return sizeof(FunctionData) + (fndata->locals.capacity() + fndata->args.capacity()) * sizeof(Object*);
+        case TokenType::TypeFFIStruct:
+        {
+            if (structdata == nullptr)
+                return 0;
+
+            // The struct's value buffers are sized by their element types
+            size_t bytes = sizeof(StructData) + structdata->name.capacity() +
+                           structdata->elementTypes.capacity() * sizeof(ffi_type*) + structdata->values.capacity() * sizeof(void*);
+            for (size_t i = 0; i < structdata->values.size() && i < structdata->elementTypes.size(); i++)
+                bytes += structdata->elementTypes[i]->size;
+            return bytes;
+        }
+        case TokenType::TypeFFISymbol:
+            if (symdata == nullptr)
+                return 0;
+            return sizeof(SymbolData) + symdata->name.capacity() + symdata->ffiArgTypes.capacity() * sizeof(ffi_type*);
+        case TokenType::TypeProjection:
+            return projection != nullptr ? sizeof(ProjectionData) : 0;
+        default:
+            return 0;
+    }
+}
+
+void Object::freeString()
+{
+    if (hasFlag(FLAG_INTERNED))
+    {
+        clearFlag(FLAG_INTERNED);
+        InternTable::instance().release(interned());
+    }
+    else
         delete str_value;
+}
+
+void Object::destructHeapData()
+{
+    if (otype == TokenType::TypeString || otype == TokenType::TypeSymbol)
+        freeString();
     else if (otype == TokenType::TypePair)
         delete pair;
     else if (otype == TokenType::TypeArray && !hasFlag(FLAG_FOREIGN))
         delete array;
+    else if (otype == TokenType::TypeTypedArray)
+        delete typed;
     else if (otype == TokenType::TypeUnorderedMap && !hasFlag(FLAG_FOREIGN))
         delete umap;
     else if (otype == TokenType::TypeUnorderedSet && !hasFlag(FLAG_FOREIGN))
         delete uset;
+    else if (otype == TokenType::TypeOrderedMap)
+        delete omap;
+    else if (otype == TokenType::TypeOrderedSet)
+        delete oset;
+    else if (otype == TokenType::TypePersistentVector)
+        delete pvec;
+    else if (otype == TokenType::TypePersistentMap)
+        delete pmap;
+    else if (otype == TokenType::TypeRope)
+        delete rope;
     else if (otype == TokenType::TypeFFIStruct)
         delete structdata;
     else if (otype == TokenType::TypeFFISymbol)
         delete symdata;
     else if (otype == TokenType::TypeProjection)
         delete projection;
-
-    otype = TokenType::InvalidCollected;
-    ptr_value = nullptr;
-
-    // Remove ourselves from the sweeplist
-    if (vm().heapHead == this)
-        vm().heapHead = this->next;
-    else
-    {
-        if (prev != nullptr)
-            prev->next = next;
-        if (next != nullptr)
-            next->prev = prev;
-    }
-
-    Object* res = next;
-
-    vm().pool.free(this);
-
-    return res;
 }
 
 // This should only be called from ExprCast, which makes a copy of the object being casted.
@@ -479,7 +830,37 @@ void Object::castTo(TokenType target)
         mpz_init_set(mpz, tmp_mpz);
         mpz_clear(tmp_mpz);
     }
-    else if (isNumeric() && (target == TokenType::TypeString|| target == TokenType::TypeSymbol))
+    else if (otype == TokenType::TypeInt && target == TokenType::TypeDouble)
+    {
+        double d = mpz_get_d(mpz);
+
+        mpz_clear(mpz);
+        double_value = d;
+    }
+    else if (otype == TokenType::TypeDouble && target == TokenType::TypeInt)
+    {
+        if (!std::isfinite(double_value))
+            throw std::runtime_error("Invalid type conversion: f64 is not finite");
+
+        mpz_init_set_d(mpz, double_value);
+    }
+    // Explicit conversion between arbitrary precision and native floats
+    else if (otype == TokenType::TypeFloat && target == TokenType::TypeDouble)
+    {
+        double d = mpf_get_d(mpf);
+
+        mpf_clear(mpf);
+        double_value = d;
+    }
+    else if (otype == TokenType::TypeDouble && target == TokenType::TypeFloat)
+    {
+        if (!std::isfinite(double_value))
+            throw std::runtime_error("Invalid type conversion: f64 is not finite");
+
+        double d = double_value;
+        mpf_init_set_d(mpf, d);
+    }
+    else if (isNumeric() && target == TokenType::TypeString)
     {
         str_value = new std::string(toString());
 
@@ -490,14 +871,41 @@ void Object::castTo(TokenType target)
 
         setFlag(FLAG_FREESTORE);
     }
+    else if (isNumeric() && target == TokenType::TypeSymbol)
+    {
+        InternedString* name = InternTable::instance().intern(toString());
+
+        if (otype == TokenType::TypeInt)
+            mpz_clear(mpz);
+        else if (otype == TokenType::TypeFloat)
+            mpf_clear(mpf);
+
+        str_value = name;
+        setFlag(FLAG_INTERNED);
+    }
+    // Symbols are always interned, while strings may share an interned text until they're changed
+    else if (otype == TokenType::TypeString && target == TokenType::TypeSymbol)
+    {
+        if (!hasFlag(FLAG_INTERNED))
+        {
+            InternedString* name = InternTable::instance().intern(*str_value);
+            freeString();
+
+            str_value = name;
+            setFlag(FLAG_INTERNED);
+        }
+    }
+    else if (otype == TokenType::TypeSymbol && target == TokenType::TypeString)
+    {
+        // Keeps sharing the interned text
+    }
     else if (otype == TokenType::TypeString && target == TokenType::TypeInt)
     {
         mpz_t tmp_mpz;
         mpz_init(tmp_mpz);
         mpz_set_str(tmp_mpz, str_value->data(), 0 /* use leading char to determine radix */);
 
-        if (hasFlag (FLAG_FREESTORE))
-            delete str_value;
+        freeString();
 
         mpz_init_set(mpz, tmp_mpz);
         mpz_clear(tmp_mpz);
@@ -508,20 +916,38 @@ void Object::castTo(TokenType target)
         mpf_init(tmp_mpf);
         mpf_set_str(tmp_mpf, str_value->data(), 0 /* use leading char to determine radix */);
 
-        if (hasFlag (FLAG_FREESTORE))
-            delete str_value;
+        freeString();
 
         mpf_init_set(mpf, tmp_mpf);
         mpf_clear(tmp_mpf);
     }
+    else if (otype == TokenType::TypeString && target == TokenType::TypeDouble)
+    {
+        // Like the assembler, accept "." regardless of locale
+        std::string value = *str_value;
+        std::replace(value.begin(), value.end(), '.', localeconv()->decimal_point[0]);
+
+        char* end = nullptr;
+        double d = strtod(value.c_str(), &end);
+        if (end == value.c_str())
+            throw std::runtime_error("Invalid type conversion: string is not an f64");
+
+        freeString();
+
+        double_value = d;
+    }
     else if (otype == TokenType::TypeString && target == TokenType::TypeBool)
     {
+        bool value = false;
         if (str_value != nullptr && str_value->compare("true")==0)
-            bool_value = true;
+            value = true;
         else if (str_value != nullptr && str_value->compare("false")==0)
-            bool_value = false;
+            value = false;
         else
             throw std::runtime_error("Invalid type conversion: string to bool accepts \"true\" and \"false\" only");
+
+        freeString();
+        bool_value = value;
     }
     else if (otype == TokenType::TypeInt && target == TokenType::TypeBool)
     {
@@ -549,6 +975,23 @@ void Object::castTo(TokenType target)
 
         setFlag(FLAG_FREESTORE);
     }
+    else if (otype == TokenType::TypeString && target == TokenType::TypeRope)
+    {
+        Rope* value = new Rope(*str_value);
+        freeString();
+
+        rope = value;
+    }
+    else if (otype == TokenType::TypeRope && target == TokenType::TypeString)
+    {
+        // Materializes the rope, copying each chunk once
+        std::string* value = new std::string();
+        rope->appendTo(*value);
+        delete rope;
+
+        str_value = value;
+        setFlag(FLAG_FREESTORE);
+    }
     else if (otype == TokenType::TypeViewPointer && target == TokenType::TypeString)
     {
         // Make a copy
@@ -572,16 +1015,19 @@ void Object::castTo(TokenType target)
         // This cast allows assembly source to be parsed into a function. Nice for building
         // macros and generally parsing snippets of assembly on demand.
 
-        ExprExpressionList* el = new ExprExpressionList();
-        lake::track(el);
+        // The code gets a region of its own, which is released with the last function using it
+        CodeArena* region = vm().newRegion();
+        ExprExpressionList* el = new (*region) ExprExpressionList(nullptr, region);
 
         std::istringstream input(*str_value);
 
         AsmParser p(vm());
-        p.parse(input, "macro", el);
+        p.parse(input, "macro", el, region);
 
-        fndata = vm().fnpool.construct((Stack*)nullptr);
+        freeString();
+        fndata = vm().fnpool.create((Stack*)nullptr);
         fndata->body = el;
+        fndata->code = region;
     }
     else
         throw std::runtime_error("Invalid type conversion");
@@ -615,6 +1061,117 @@ std::string Object::dump() const
     return res;
 }
 
+/**
+ * Shortest representation of an f64 that reads back to the same value. The lexer has no
+ * exponent notation, so canonical (externalized) values are written without one.
+ */
+static std::string formatDouble(double value, bool canonical)
+{
+    char buf[512];
+
+    if (!std::isfinite(value))
+        return std::isnan(value) ? "nan" : (value < 0 ? "-inf" : "inf");
+
+    for (int precision = 15; precision <= 17; precision++)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if (strtod(buf, nullptr) == value)
+            break;
+    }
+
+    if (canonical && strchr(buf, 'e') != nullptr)
+    {
+        int exponent = value == 0 ? 0 : (int) std::floor(std::log10(std::fabs(value)));
+        snprintf(buf, sizeof(buf), "%.*f", std::max(0, 16 - exponent), value);
+    }
+
+    std::string res(buf);
+
+    // Output uses "." regardless of locale, like the assembler
+    std::replace(res.begin(), res.end(), localeconv()->decimal_point[0], '.');
+
+    return res;
+}
+
+// Key classes of Object::order, in order
+static int orderRank(const Object* obj)
+{
+    if (obj->hasFlag(FLAG_ISNULL))
+        throw std::runtime_error("Null objects cannot be ordered");
+
+    switch (obj->otype)
+    {
+        case TokenType::TypeBool:
+            return 0;
+        case TokenType::TypeInt:
+        case TokenType::TypeFloat:
+        case TokenType::TypeDouble:
+            return 1;
+        case TokenType::TypeChar:
+            return 2;
+        case TokenType::TypeString:
+            return 3;
+        default:
+            throw std::runtime_error("Objects of type " + obj->typestring() + " cannot be ordered");
+    }
+}
+
+// Compares numbers by value, with NaN after everything else. Representations are compared
+// exactly, without converting to the narrower one.
+static int orderNumbers(const Object* lhs, const Object* rhs)
+{
+    bool lhsNaN = lhs->otype == TokenType::TypeDouble && std::isnan(lhs->double_value);
+    bool rhsNaN = rhs->otype == TokenType::TypeDouble && std::isnan(rhs->double_value);
+    if (lhsNaN || rhsNaN)
+        return (int) lhsNaN - (int) rhsNaN;
+
+    if (lhs->otype == rhs->otype)
+    {
+        if (lhs->otype == TokenType::TypeInt)
+            return mpz_cmp(lhs->mpz, rhs->mpz);
+        if (lhs->otype == TokenType::TypeFloat)
+            return mpf_cmp(lhs->mpf, rhs->mpf);
+        return (lhs->double_value > rhs->double_value) - (lhs->double_value < rhs->double_value);
+    }
+
+    // Enumerate the mixed cases with lhs having the lower type, and flip the result otherwise
+    if (lhs->otype > rhs->otype)
+        return -orderNumbers(rhs, lhs);
+
+    if (lhs->otype == TokenType::TypeInt && rhs->otype == TokenType::TypeFloat)
+        return -mpf_cmp_z(rhs->mpf, lhs->mpz);
+    if (lhs->otype == TokenType::TypeInt)
+        return mpz_cmp_d(lhs->mpz, rhs->double_value);
+    return mpf_cmp_d(lhs->mpf, rhs->double_value);
+}
+
+int Object::order(const Object* lhs, const Object* rhs)
+{
+    if (lhs == rhs)
+        return 0;
+
+    int lhsRank = orderRank(lhs);
+    int rhsRank = orderRank(rhs);
+    if (lhsRank != rhsRank)
+        return lhsRank - rhsRank;
+
+    int res = 0;
+    if (lhsRank == 0)
+        res = (int) lhs->bool_value - (int) rhs->bool_value;
+    else if (lhsRank == 1)
+        res = orderNumbers(lhs, rhs);
+    else if (lhsRank == 2)
+        res = (lhs->char_value > rhs->char_value) - (lhs->char_value < rhs->char_value);
+    else
+        res = lhs->str_value == rhs->str_value ? 0 : lhs->str_value->compare(*rhs->str_value);
+
+    if (res != 0)
+        return res < 0 ? -1 : 1;
+
+    // Equal numbers of different representations are distinct keys
+    return (int) lhs->otype - (int) rhs->otype;
+}
+
 std::string Object::typestring() const
 {
     return typestring(this->otype);
@@ -628,6 +1185,8 @@ std::string Object::typestring(TokenType otype) const
             return "int";
         case TokenType::TypeFloat:
             return "float";
+        case TokenType::TypeDouble:
+            return "f64";
         case TokenType::TypeBool:
             return "bool";
         case TokenType::TypeFunction:
@@ -637,6 +1196,7 @@ std::string Object::typestring(TokenType otype) const
         case TokenType::TypeSymbol:
             return "symbol";
         case TokenType::TypeArray:
+        case TokenType::TypeTypedArray:
             return "array";
         case TokenType::TypeUnorderedMap:
             return "map";
@@ -644,6 +1204,16 @@ std::string Object::typestring(TokenType otype) const
             return "pair";
         case TokenType::TypeUnorderedSet:
             return "set";
+        case TokenType::TypeOrderedMap:
+            return TOK_TYPEORDEREDMAP;
+        case TokenType::TypeOrderedSet:
+            return TOK_TYPEORDEREDSET;
+        case TokenType::TypePersistentVector:
+            return TOK_TYPEPERSISTENTVECTOR;
+        case TokenType::TypePersistentMap:
+            return TOK_TYPEPERSISTENTMAP;
+        case TokenType::TypeRope:
+            return TOK_TYPEROPE;
         case TokenType::TypeObject:
             return "object";
         case TokenType::TypeChar:
@@ -688,6 +1258,10 @@ void Object::externalize(std::ostream& str, int indentation) const
 
         freefunc(tmp, len + 1);
     }
+    else if (isDouble())
+    {
+        str << formatDouble(double_value, true);
+    }
     else if (otype == TokenType::TypeString || otype == TokenType::TypeSymbol)
     {
         if (str_value == nullptr)
@@ -696,6 +1270,15 @@ void Object::externalize(std::ostream& str, int indentation) const
         else
             str << '"' << *this->str_value << '"';
     }
+    else if (otype == TokenType::TypeRope)
+    {
+        str << '"';
+        rope->forEachChunk([&str](const char* data, size_t length)
+        {
+            str.write(data, length);
+        });
+        str << '"';
+    }
     else if (otype == TokenType::TypeBool)
     {
         str << ((char *) (bool_value ? "true" : "false")) << std::endl;
@@ -723,6 +1306,10 @@ void Object::externalize(std::ostream& str, int indentation) const
     {
         str << array->capacity();
     }
+    else if(otype == TokenType::TypeTypedArray)
+    {
+        str << TypedArray::kindName(typed->kind()) << " " << typed->capacity();
+    }
     else if(otype == TokenType::TypeUnorderedMap)
     {
         // map/set lacks capacity() members
@@ -732,6 +1319,12 @@ void Object::externalize(std::ostream& str, int indentation) const
     {
         str << "10";
     }
+    else if(otype == TokenType::TypeOrderedMap || otype == TokenType::TypeOrderedSet ||
+            otype == TokenType::TypePersistentVector || otype == TokenType::TypePersistentMap)
+    {
+        // Trees grow a node at a time, so there's no capacity
+        str << "0";
+    }
     else if(otype == TokenType::TypePair)
     {
         // NOOP, type has no arguments
@@ -773,6 +1366,10 @@ std::string Object::toString() const
 
         freefunc(tmp, len + 1);
     }
+    else if (isDouble())
+    {
+        res = formatDouble(double_value, false);
+    }
     else
     {
         if (hasFlag(FLAG_ISNULL))
@@ -783,6 +1380,10 @@ std::string Object::toString() const
         {
             res = this->str_value ? *this->str_value : "null";
         }
+        else if (otype == TokenType::TypeRope)
+        {
+            rope->appendTo(res);
+        }
         else if (otype == TokenType::TypeBool)
         {
             res = (char *) (bool_value ? "true" : "false");
@@ -828,6 +1429,25 @@ std::string Object::toString() const
             }
             res += "]";
         }
+        else if (otype == TokenType::TypeTypedArray)
+        {
+            res += "arr<";
+            res += TypedArray::kindName(typed->kind());
+            res += ">[";
+            for (size_t i = 0; i < typed->size(); i++)
+            {
+                if (i > 0)
+                    res += ",";
+
+                if (typed->kind() == TypedArray::Kind::Int64)
+                    res += std::to_string(typed->data<int64_t>()[i]);
+                else if (typed->kind() == TypedArray::Kind::Float64)
+                    res += formatDouble(typed->data<double>()[i], false);
+                else
+                    res += std::to_string(typed->data<uint8_t>()[i]);
+            }
+            res += "]";
+        }
         else if (otype == TokenType::TypeUnorderedMap)
         {
             res += "map[";
@@ -860,6 +1480,62 @@ std::string Object::toString() const
             }
             res += "]";
         }
+        else if (otype == TokenType::TypeOrderedMap)
+        {
+            res += "omap[";
+            size_t count = 0;
+            omap->forEach([&](Object* key, Object* value)
+            {
+                if (count++ > 0)
+                    res += ",";
+
+                res += key->toString();
+                res += "=>";
+                res += value->toString();
+            });
+            res += "]";
+        }
+        else if (otype == TokenType::TypePersistentVector)
+        {
+            res += "pvec[";
+            size_t count = 0;
+            pvec->forEach([&](Object* obj)
+            {
+                if (count++ > 0)
+                    res += ",";
+
+                res += obj->toString();
+            });
+            res += "]";
+        }
+        else if (otype == TokenType::TypePersistentMap)
+        {
+            res += "pmap[";
+            size_t count = 0;
+            pmap->forEach([&](Object* key, Object* value)
+            {
+                if (count++ > 0)
+                    res += ",";
+
+                res += key->toString();
+                res += "=>";
+                res += value->toString();
+            });
+            res += "]";
+        }
+        else if (otype == TokenType::TypeOrderedSet)
+        {
+            res += "oset[";
+            size_t count = 0;
+            oset->forEach([&](Object* key, NoValue)
+            {
+                if (count++ > 0)
+                    res += ",";
+
+                res += key->toString();
+            });
+            res += "]";
+        }
         else if (otype == TokenType::TypeFFISymbol)
         {
             res += "Symbol: ";
@@ -12,8 +12,15 @@
 #include <cstring>
 #include <ffi.h>
 #include <cfloat>
+#include <cmath>
 #include <sstream>
 #include "VMTypes.h"
+#include "TypedArray.h"
+#include "HashTable.h"
+#include "BTree.h"
+#include "Persistent.h"
+#include "Rope.h"
+#include "Intern.h"
 #include "Process.h"
 #include "VM.h"
 
@@ -23,6 +30,22 @@ class Object;
 class ExprExpressionList;
 class Stack;
 
+// Storage of umap and uset, hashed and compared with the std::hash and std::equal_to specializations below
+using ObjectMap = FlatHashMap<Object*, Object*>;
+using ObjectSet = FlatHashSet<Object*>;
+
+/**
+ * Three-way comparison of omap keys and oset elements; see Object::order
+ */
+struct ObjectOrder
+{
+    inline int operator()(const Object* lhs, const Object* rhs) const;
+};
+
+// Storage of omap and oset
+using OrderedMap = BTree<Object*, Object*, ObjectOrder>;
+using OrderedSet = BTree<Object*, NoValue, ObjectOrder>;
+
 #ifdef WIN32
 	#define PACK_ATTR
 	#pragma pack (push,1)
@@ -107,6 +130,9 @@ struct PACK_ATTR FunctionData
 
     bool withStack = false;
     ExprExpressionList* body = nullptr;
+
+    // Arena holding the body. If it's a collectable region, the function keeps it alive.
+    CodeArena* code = nullptr;
     std::string name = "";
 };
 
@@ -150,10 +176,100 @@ struct PACK_ATTR ProjectionData
     ssize_t start=0;
     ssize_t end=0;
 
+    // For omap and oset, the key range [lower, upper) instead of start and end. Null is unbounded.
+    Object* lower=nullptr;
+    Object* upper=nullptr;
+
     void mark();
 };
 
 inline Object* track(Object* obj);
+inline void accountGrowth(Object* owner, size_t before);
+
+/**
+ * Arithmetic kernels for Object::arith, with an overload for each numeric representation.
+ * ELEMENTWISE is the operation applied to typed arrays.
+ */
+struct AddKernel
+{
+    static constexpr TypedArray::Op ELEMENTWISE = TypedArray::Op::Add;
+
+    static inline void apply(mpz_t res, const mpz_t a, const mpz_t b) { mpz_add(res, a, b); }
+    static inline void apply(mpf_t res, const mpf_t a, const mpf_t b) { mpf_add(res, a, b); }
+    static inline double apply(double a, double b) { return a + b; }
+};
+
+struct SubKernel
+{
+    static constexpr TypedArray::Op ELEMENTWISE = TypedArray::Op::Sub;
+
+    static inline void apply(mpz_t res, const mpz_t a, const mpz_t b) { mpz_sub(res, a, b); }
+    static inline void apply(mpf_t res, const mpf_t a, const mpf_t b) { mpf_sub(res, a, b); }
+    static inline double apply(double a, double b) { return a - b; }
+};
+
+struct MulKernel
+{
+    static constexpr TypedArray::Op ELEMENTWISE = TypedArray::Op::Mul;
+
+    static inline void apply(mpz_t res, const mpz_t a, const mpz_t b) { mpz_mul(res, a, b); }
+    static inline void apply(mpf_t res, const mpf_t a, const mpf_t b) { mpf_mul(res, a, b); }
+    static inline double apply(double a, double b) { return a * b; }
+};
+
+struct DivKernel
+{
+    static constexpr TypedArray::Op ELEMENTWISE = TypedArray::Op::Div;
+
+    static inline void apply(mpz_t res, const mpz_t a, const mpz_t b) { mpz_div(res, a, b); }
+    static inline void apply(mpf_t res, const mpf_t a, const mpf_t b) { mpf_div(res, a, b); }
+    static inline double apply(double a, double b) { return a / b; }
+};
+
+/**
+ * Comparison kernels for Object::compare. GMP values are tested on the result of
+ * mpz_cmp/mpf_cmp, while doubles are compared directly so NaN compares false.
+ * ELEMENTWISE is the comparison applied to typed arrays.
+ */
+struct LessKernel
+{
+    static constexpr TypedArray::Cmp ELEMENTWISE = TypedArray::Cmp::Less;
+
+    static inline bool test(int cmp) { return cmp < 0; }
+    static inline bool test(double a, double b) { return a < b; }
+};
+
+struct LessEqualKernel
+{
+    static constexpr TypedArray::Cmp ELEMENTWISE = TypedArray::Cmp::LessEqual;
+
+    static inline bool test(int cmp) { return cmp <= 0; }
+    static inline bool test(double a, double b) { return a <= b; }
+};
+
+struct GreaterKernel
+{
+    static constexpr TypedArray::Cmp ELEMENTWISE = TypedArray::Cmp::Greater;
+
+    static inline bool test(int cmp) { return cmp > 0; }
+    static inline bool test(double a, double b) { return a > b; }
+};
+
+struct GreaterEqualKernel
+{
+    static constexpr TypedArray::Cmp ELEMENTWISE = TypedArray::Cmp::GreaterEqual;
+
+    static inline bool test(int cmp) { return cmp >= 0; }
+    static inline bool test(double a, double b) { return a >= b; }
+};
+
+struct NotEqualKernel
+{
+    static constexpr TypedArray::Cmp ELEMENTWISE = TypedArray::Cmp::NotEqual;
+
+    static inline bool test(int cmp) { return cmp != 0; }
+    static inline bool test(double a, double b) { return a != b; }
+};
 
 /**
  * A virtual machine Object is a variant type. All values pushed to
@@ -176,8 +292,12 @@ public:
         mpf_t mpf;
         mpz_t mpz;
 
+        /* TypeDouble, a native IEEE double stored inline */
+        double double_value;
+
         /* TypeString, a string containing utf8 encoded unicode characters.
-         * or TypeSymbol, naming a unique interned lisp-like symbol */
+         * or TypeSymbol, naming a unique interned lisp-like symbol.
+         * Symbols and string literals point to an InternedString; see FLAG_INTERNED */
         std::string* str_value;
 
         /* TypeChar, unicode code point */
@@ -189,13 +309,29 @@ public:
         /* TypeArray; growable arrays */
         std::vector<Object*>* array;
 
-        /* TypeUnorderedMap */
-        std::unordered_map<Object*,Object*>* umap;
+        /* TypeTypedArray; arrays of raw int64, f64 or byte elements */
+        TypedArray* typed;
 
         /* TypeUnorderedMap */
-        std::unordered_set<Object*>* uset;
+        ObjectMap* umap;
+
+        /* TypeUnorderedSet */
+        ObjectSet* uset;
+
+        /* TypeOrderedMap */
+        OrderedMap* omap;
+
+        /* TypeOrderedSet */
+        OrderedSet* oset;
 
-        // TODO: ordered map/set. Must define good hashes/compare functions for each object type (including nested maps, etc)
+        /* TypePersistentVector, one version of an immutable vector */
+        PersistentVector* pvec;
+
+        /* TypePersistentMap, one version of an immutable map */
+        PersistentMap* pmap;
+
+        /* TypeRope, a string stored as a tree of shared chunks */
+        Rope* rope;
 
         /* TypeFunction */
         FunctionData* fndata;
@@ -231,6 +367,9 @@ public:
     // By default, objects are pinned, e.g not eligible for gc. This flag is removed if track() is called
     uint8_t flags = FLAG_GC_PINNED;
 
+    // Generation and remembered set membership; see VM::GCMode
+    uint8_t gcstate = 0;
+
 #ifdef VM_DEBUG
     char* debug = nullptr;
 
@@ -249,10 +388,6 @@ public:
     }
 #endif
 
-    // Sweep chaining
-    Object* next = nullptr;
-    Object* prev = nullptr;
-
     Object() = delete;
 
     Object(const Object& obj);
@@ -275,8 +410,19 @@ public:
     explicit Object(ProjectionData* projdata, uint8_t flags = FLAG_GC_PINNED);
     explicit Object(std::pair<Object*,Object*>* value, uint8_t flags = FLAG_GC_PINNED);
     explicit Object(std::vector<Object*>* value, uint8_t flags = FLAG_GC_PINNED);
-    explicit Object(std::unordered_map<Object*,Object*>* value, uint8_t flags = FLAG_GC_PINNED);
-    explicit Object(std::unordered_set<Object*>* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(TypedArray* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(ObjectMap* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(ObjectSet* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(OrderedMap* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(OrderedSet* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(PersistentVector* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(PersistentMap* value, uint8_t flags = FLAG_GC_PINNED);
+    explicit Object(Rope* value, uint8_t flags = FLAG_GC_PINNED);
+
+    /**
+     * A string or symbol taking over a reference to an interned string
+     */
+    Object(InternedString* value, TokenType type, uint8_t flags = FLAG_GC_PINNED);
     explicit Object(bool value, uint8_t flags = FLAG_GC_PINNED);
 
     /**
@@ -285,8 +431,40 @@ public:
     explicit Object(TokenType otype, uint8_t flags = 0);
 
     /**
-     * Object creation wrapper which allocates from the pool. This is the
-     * preferred way to obtain new objects.
+     * Objects, including subclasses such as instructions and stacks, are allocated
+     * from the VM's heap
+     */
+    static inline void* operator new(size_t size)
+    {
+        return vm().heap.allocate(size);
+    }
+
+    static inline void operator delete(void* ptr)
+    {
+        vm().heap.free(ptr);
+    }
+
+    /**
+     * Instruction nodes are allocated from a code arena instead, and are never tracked
+     */
+    static inline void* operator new(size_t size, CodeArena& arena)
+    {
+        return arena.allocate(size);
+    }
+
+    // Only called if the constructor throws
+    static inline void operator delete(void* ptr, CodeArena& arena)
+    {
+        arena.discard(ptr);
+    }
+
+    /**
+     * Only called for nodes released with their code arena; the collector uses destruct()
+     */
+    virtual ~Object() = default;
+
+    /**
+     * Object creation wrapper. This is the preferred way to obtain new objects.
      *
      * Wrap calls to create with track(...) to make the returned object eligible
      * for garbage collection.
@@ -294,17 +472,32 @@ public:
     template<typename... Args>
     static inline Object* create(Args&&... args)
     {
-        return new (vm().pool.malloc()) Object(std::forward<Args>(args)...);
+        return new Object(std::forward<Args>(args)...);
     }
 
     /**
-     * Destruct contained data. The GC cycle / remove instruction calls this and places
-     * the object the freelist. The Object instance itself is only delete'ed when the
-     * freelist is full.
-     *
-     * \returns The next object on the free list, or nullptr if no more object
+     * Destruct contained data, and return the object's memory to the heap. The GC
+     * cycle / remove instruction calls this.
+     */
+    void destruct();
+
+    /**
+     * Deletes contained data which is allocated on the C++ heap. Unlike numbers and
+     * function data, this doesn't involve the VM, so a background sweep can call it.
      */
-    Object* destruct();
+    void destructHeapData();
+
+    /**
+     * Deletes the text of a string or symbol, or releases it if it's interned
+     */
+    void freeString();
+
+    /**
+     * Estimates the memory owned by the object outside of its heap slot, such as string
+     * characters and collection storage. This is what the VM accounts for tracked
+     * objects in VM::externalBytes; see accountGrowth.
+     */
+    size_t ownedBytes() const;
 
     // Avoid conversion from string literals
     Object(const char* value) = delete;
@@ -333,6 +526,79 @@ public:
         return OBJECT_ONE;
     }
 
+    /**
+     * Integers in this range, and all 8-bit chars, are represented by immediates: immortal,
+     * shared objects that are never allocated from the pool, tracked, swept or mutated.
+     * Producing a small value is thus a table lookup rather than an allocation, while values
+     * outside the range are promoted to regular tracked objects, preserving arbitrary precision.
+     */
+    static constexpr int64_t IMMEDIATE_INT_MIN = -1024;
+    static constexpr int64_t IMMEDIATE_INT_MAX = 4095;
+
+    /**
+     * Returns the immediate for a value in [IMMEDIATE_INT_MIN, IMMEDIATE_INT_MAX]
+     */
+    static Object* immediate(int64_t value);
+
+    /**
+     * Returns the immediate for a char
+     */
+    static Object* immediate(char value);
+
+    /**
+     * Returns an immediate for small values, otherwise a new tracked integer object.
+     */
+    static inline Object* makeInt(int64_t value)
+    {
+        if (value >= IMMEDIATE_INT_MIN && value <= IMMEDIATE_INT_MAX)
+            return immediate(value);
+
+        return lake::track(create(value));
+    }
+
+    /**
+     * Returns an immediate for small values, otherwise a new tracked integer object which
+     * takes over the limbs of 'value' by swapping. The caller still owns (and must clear) 'value'.
+     */
+    static inline Object* makeInt(mpz_t value)
+    {
+        if (mpz_fits_slong_p(value))
+        {
+            long small = mpz_get_si(value);
+            if (small >= IMMEDIATE_INT_MIN && small <= IMMEDIATE_INT_MAX)
+                return immediate((int64_t) small);
+        }
+
+        Object* res = lake::track(create(TokenType::TypeInt));
+        size_t before = res->ownedBytes();
+        mpz_swap(res->mpz, value);
+        accountGrowth(res, before);
+
+        return res;
+    }
+
+    /**
+     * Per-thread scratch integer. Arithmetic computes into this first, so that small
+     * results can be returned as immediates without allocating.
+     */
+    static mpz_t& scratchInt();
+
+    /**
+     * Per-thread scratch float, with at least the default precision
+     */
+    static mpf_t& scratchFloat();
+
+    /**
+     * Returns a new tracked f64 object
+     */
+    static inline Object* makeDouble(double value)
+    {
+        Object* res = lake::track(create(TokenType::TypeDouble));
+        res->double_value = value;
+
+        return res;
+    }
+
     /**
      * Set the default precision to be *at least* 'prec' bits.
      *
@@ -429,6 +695,8 @@ public:
             return mpz_get_si(mpz);
         else if (isFloat())
             return mpf_get_si(mpf);
+        else if (isDouble())
+            return (long) double_value;
         else
             throw std::runtime_error("Invalid conversion to long: Object is not an integer");
     }
@@ -441,6 +709,8 @@ public:
             return mpz_get_ux(mpz);
         else if (isFloat())
             return (unsigned long)mpf_get_ui(mpf);
+        else if (isDouble())
+            return (unsigned long) double_value;
         else
             throw std::runtime_error("Invalid conversion to long: Object is not an integer");
     }
@@ -482,6 +752,10 @@ public:
         {
             mpf_neg(mpf, mpf);
         }
+        else if (isDouble())
+        {
+            double_value = -double_value;
+        }
         else
             throw std::runtime_error("Negate/Logical not can only be applied to numeric and boolean objects");
 
@@ -498,6 +772,10 @@ public:
         {
             mpf_sub_ui(mpf, mpf, 1);
         }
+        else if (isDouble())
+        {
+            double_value -= 1;
+        }
         else
             throw std::runtime_error("Decrement can only be applied to numeric objects");
 
@@ -514,86 +792,116 @@ public:
         {
             mpf_add_ui(mpf, mpf, 1);
         }
+        else if (isDouble())
+        {
+            double_value += 1;
+        }
         else
             throw std::runtime_error("Increment can only be applied to numeric objects");
 
         return *this;
     }
 
-    inline Object* mp_binop2(Object* lhs, Object* rhs,
-                           std::function<void(mpz_t&,mpz_t&,mpz_t&)>& mpz_func,
-                           std::function<void(mpf_t&,mpf_t&,mpf_t&)>& mpf_func)
+    /**
+     * Applies an arithmetic kernel to operands with representation T. Quickened nodes
+     * call this directly once they have established the operand types.
+     */
+    template <typename Kernel, TokenType T>
+    static inline Object* arithAs(Object* lhs, Object* rhs)
     {
-        Object* res = lake::track(create(lhs->otype));
-
-        if (lhs->isInteger())
+        if (T == TokenType::TypeInt)
         {
-            mpz_func(const_cast<mpz_t&>(res->mpz), const_cast<mpz_t&>(lhs->mpz), const_cast<mpz_t&>(rhs->mpz));
+            mpz_t& res = scratchInt();
+            Kernel::apply(res, lhs->mpz, rhs->mpz);
+
+            return makeInt(res);
         }
-        else if (lhs->isFloat())
+        else if (T == TokenType::TypeFloat)
         {
-            mpf_func(const_cast<mpf_t&>(res->mpf), const_cast<mpf_t&>(lhs->mpf), const_cast<mpf_t&>(rhs->mpf));
+            Object* res = lake::track(create(TokenType::TypeFloat));
+            Kernel::apply(res->mpf, lhs->mpf, rhs->mpf);
+
+            return res;
         }
         else
         {
-            throw std::runtime_error("Invalid binary operand types");
+            return makeDouble(Kernel::apply(lhs->double_value, rhs->double_value));
         }
+    }
 
-        return res;
+    /**
+     * Applies an arithmetic kernel to operands of equal numeric type. Each instantiation
+     * compiles to a direct GMP or native call for every representation.
+     */
+    template <typename Kernel>
+    static inline Object* arith(Object* lhs, Object* rhs)
+    {
+        if (lhs->isTypedArray() || rhs->isTypedArray())
+            return lake::track(create(TypedArray::arith(Kernel::ELEMENTWISE, lhs, rhs)));
+        else if (lhs->isInteger())
+            return arithAs<Kernel, TokenType::TypeInt>(lhs, rhs);
+        else if (lhs->isFloat())
+            return arithAs<Kernel, TokenType::TypeFloat>(lhs, rhs);
+        else if (lhs->isDouble())
+            return arithAs<Kernel, TokenType::TypeDouble>(lhs, rhs);
+        else
+            throw std::runtime_error("Invalid binary operand types");
     }
 
-    inline int mp_cmp_op2(Object* lhs, Object* rhs,
-                  std::function<int(mpz_t&,mpz_t&)>& mpz_func,
-                  std::function<int(mpf_t&,mpf_t&)>& mpf_func)
+    /**
+     * Applies a comparison kernel to operands with representation T
+     */
+    template <typename Kernel, TokenType T>
+    static inline Object* compareAs(Object* lhs, Object* rhs)
     {
-        int res = 0;
+        bool res;
 
-        if (lhs->isInteger())
-        {
-            res = mpz_func(const_cast<mpz_t&>(lhs->mpz), const_cast<mpz_t&>(rhs->mpz));
-        }
+        if (T == TokenType::TypeInt)
+            res = Kernel::test(mpz_cmp(lhs->mpz, rhs->mpz));
+        else if (T == TokenType::TypeFloat)
+            res = Kernel::test(mpf_cmp(lhs->mpf, rhs->mpf));
+        else
+            res = Kernel::test(lhs->double_value, rhs->double_value);
+
+        return res ? &Object::trueObject() : &Object::falseObject();
+    }
+
+    /**
+     * Applies a comparison kernel to operands of equal numeric type
+     */
+    template <typename Kernel>
+    static inline Object* compare(Object* lhs, Object* rhs)
+    {
+        if (lhs->isTypedArray() || rhs->isTypedArray())
+            return lake::track(create(TypedArray::compare(Kernel::ELEMENTWISE, lhs, rhs)));
+        else if (lhs->isInteger())
+            return compareAs<Kernel, TokenType::TypeInt>(lhs, rhs);
         else if (lhs->isFloat())
-        {
-            res = mpf_func(const_cast<mpf_t&>(lhs->mpf), const_cast<mpf_t&>(rhs->mpf));
-        }
+            return compareAs<Kernel, TokenType::TypeFloat>(lhs, rhs);
+        else if (lhs->isDouble())
+            return compareAs<Kernel, TokenType::TypeDouble>(lhs, rhs);
         else
-        {
             throw std::runtime_error("Invalid comparison operand types");
-        }
-
-        return res;
     }
 
     inline Object* add(Object* lhs, Object* rhs)
     {
-        std::function<void(mpz_t&,mpz_t&,mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b, mpz_t& c) {mpz_add(a,b,c);};
-        std::function<void(mpf_t&,mpf_t&,mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b, mpf_t& c) {mpf_add(a,b,c);};
-
-        return mp_binop2(lhs, rhs, mpz_op, mpf_op);
+        return arith<AddKernel>(lhs, rhs);
     }
 
     inline Object* sub(Object* lhs, Object* rhs)
     {
-        std::function<void(mpz_t&,mpz_t&,mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b, mpz_t& c) {mpz_sub(a,b,c);};
-        std::function<void(mpf_t&,mpf_t&,mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b, mpf_t& c) {mpf_sub(a,b,c);};
-
-        return mp_binop2(lhs, rhs, mpz_op, mpf_op);
+        return arith<SubKernel>(lhs, rhs);
     }
 
     inline Object* mul(Object* lhs, Object* rhs)
     {
-        std::function<void(mpz_t&,mpz_t&,mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b, mpz_t& c) {mpz_mul(a,b,c);};
-        std::function<void(mpf_t&,mpf_t&,mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b, mpf_t& c) {mpf_mul(a,b,c);};
-
-        return mp_binop2(lhs, rhs, mpz_op, mpf_op);
+        return arith<MulKernel>(lhs, rhs);
     }
 
     inline Object* div(Object* lhs, Object* rhs)
     {
-        std::function<void(mpz_t&,mpz_t&,mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b, mpz_t& c) {mpz_div(a,b,c);};
-        std::function<void(mpf_t&,mpf_t&,mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b, mpf_t& c) {mpf_div(a,b,c);};
-
-        return mp_binop2(lhs, rhs, mpz_op, mpf_op);
+        return arith<DivKernel>(lhs, rhs);
     }
 
     inline Object* logicalOr(Object* lhs, Object* rhs)
@@ -622,100 +930,98 @@ public:
         return lhs->otype == rhs->otype ? &Object::trueObject() : &Object::falseObject();
     }
 
+    /**
+     * Numeric equality. Floats are equal if their relative difference is below the VM's epsilon.
+     */
+    static inline bool numericEquals(Object* lhs, Object* rhs)
+    {
+        if (lhs->isInteger())
+        {
+            return mpz_cmp(lhs->mpz, rhs->mpz) == 0;
+        }
+        else if (lhs->isFloat())
+        {
+            // https://randomascii.wordpress.com/2012/02/25/comparing-floating-point-numbers-2012-edition/
+            //  - Basically: when comparing against zero, use absolute epsilon
+            //  - Otherwise, use relative epsilon.
+            // Does it hold for arbitrary precision math...?
+            // Maybe allow optionally comparison with epsilon: (https://github.com/blynn/pbc/blob/master/ecc/hilbert.c), or mpf_reldiff
+            mpf_t& reldiff = scratchFloat();
+            mpf_reldiff(reldiff, lhs->mpf, rhs->mpf);
+
+            // Note: The epsilon can be set with "epsilon N"
+            // It's probably ok to use mpf_cmp against an mpf_t epsilon, mpf_cmp_d only allows for 1.11e-16 epsilon at best
+            // If reldiff is less than epsilon, consider it equal.
+            return mpf_cmp(reldiff, vm().epsilon) < 0;
+        }
+        else
+        {
+            // Same relative comparison as for mpf. Exact equality covers zeros and infinities.
+            double a = lhs->double_value;
+            double b = rhs->double_value;
+
+            return a == b || std::fabs(a - b) < vm().doubleEpsilon * std::fabs(a);
+        }
+    }
+
     inline Object* equals(Object* lhs, Object* rhs)
     {
+        if (lhs != nullptr && rhs != nullptr && (lhs->isTypedArray() || rhs->isTypedArray()))
+            return lake::track(create(TypedArray::compare(TypedArray::Cmp::Equal, lhs, rhs)));
+
         if (lhs == nullptr || rhs == nullptr || (lhs->otype != rhs->otype))
             throw std::runtime_error("eq only accept equal non-null types: bool, string and numeric");
 
         if (lhs->otype == TokenType::TypeBool && rhs->otype == TokenType::TypeBool)
             return lhs->bool_value == rhs->bool_value ? &Object::trueObject() : &Object::falseObject();
         else if (lhs->isNumeric() && rhs->isNumeric())
-        {
-            std::function<int(mpz_t&, mpz_t&)> mpz_op = [&](mpz_t &a, mpz_t &b) { return mpz_cmp(a, b); };
-
-            // https://randomascii.wordpress.com/2012/02/25/comparing-floating-point-numbers-2012-edition/
-            //  - Basically: when comparing against zero, use absolute epsilon
-            //  - Otherwise, use relative epsilon.
-            // Does it hold for arbitrary precision math...?
-            // Maybe allow optionally comparison with epsilon: (https://github.com/blynn/pbc/blob/master/ecc/hilbert.c), or mpf_reldiff
-            std::function<int(mpf_t&, mpf_t&)> mpf_op = [&](mpf_t &a, mpf_t &b)
-            {
-                mpf_t reldiff;
-                mpf_init(reldiff);
-                mpf_reldiff(reldiff, a, b);
-
-                // DEBUGGING
-                /*char* tmp = nullptr;
-                gmp_asprintf(&tmp, "%.Ff", reldiff);
-                std::cout << "RELDIFF: " << tmp << std::endl;*/
-
-                // Note: The epsilon can be set with "epsilon N"
-                // It's probably ok to use mpf_cmp against an mpf_t epsilon, mpf_cmp_d only allows for 1.11e-16 epsilon at best
-                auto res = mpf_cmp(reldiff, vm().epsilon);
-                mpf_clear(reldiff);
-
-                // If reldiff is less than epsilon, consider it equal.
-                return res < 0 ? 0 : -1;
-            };
-
-            return mp_cmp_op2(lhs, rhs, mpz_op, mpf_op) == 0 ? &Object::trueObject() : &Object::falseObject();
-        }
-        else if (lhs->otype == TokenType::TypeString && rhs->otype == TokenType::TypeString)
-            return (lhs->str_value->compare(*rhs->str_value) == 0) ? &Object::trueObject() : &Object::falseObject();
+            return numericEquals(lhs, rhs) ? &Object::trueObject() : &Object::falseObject();
+        else if ((lhs->isString() || lhs->isSymbol()) && lhs->otype == rhs->otype)
+            return lhs->sameText(rhs) ? &Object::trueObject() : &Object::falseObject();
+        else if (lhs->otype == TokenType::TypeRope && rhs->otype == TokenType::TypeRope)
+            return lhs->rope->equals(*rhs->rope) ? &Object::trueObject() : &Object::falseObject();
         else
             throw std::runtime_error("eq only accept bool, string and numeric operands");
     }
 
     inline Object* notEquals(Object* lhs, Object* rhs)
     {
+        if (lhs != nullptr && rhs != nullptr && (lhs->isTypedArray() || rhs->isTypedArray()))
+            return compare<NotEqualKernel>(lhs, rhs);
+
         if (lhs == nullptr || rhs == nullptr || (lhs->otype != rhs->otype))
             throw std::runtime_error("ne only accept equal non-null types: bool, string and numeric");
 
         if (lhs->otype == TokenType::TypeBool && rhs->otype == TokenType::TypeBool)
             return lhs->bool_value != rhs->bool_value ? &Object::trueObject() : &Object::falseObject();
         else if (lhs->isNumeric() && rhs->isNumeric())
-        {
-            std::function<int(mpz_t&, mpz_t&)> mpz_op = [&](mpz_t &a, mpz_t &b) { return mpz_cmp(a, b); };
-            std::function<int(mpf_t&, mpf_t&)> mpf_op = [&](mpf_t &a, mpf_t &b) { return mpf_cmp(a, b); };
-
-            return mp_cmp_op2(lhs, rhs, mpz_op, mpf_op) != 0 ? &Object::trueObject() : &Object::falseObject();
-        }
-        else if (lhs->otype == TokenType::TypeString && rhs->otype == TokenType::TypeString)
-            return (lhs->str_value->compare(*rhs->str_value) != 0) ? &Object::trueObject() : &Object::falseObject();
+            return compare<NotEqualKernel>(lhs, rhs);
+        else if ((lhs->isString() || lhs->isSymbol()) && lhs->otype == rhs->otype)
+            return !lhs->sameText(rhs) ? &Object::trueObject() : &Object::falseObject();
+        else if (lhs->otype == TokenType::TypeRope && rhs->otype == TokenType::TypeRope)
+            return !lhs->rope->equals(*rhs->rope) ? &Object::trueObject() : &Object::falseObject();
         else
             throw std::runtime_error("!= only accept bool and numeric operands");
     }
 
     inline Object* less(Object* lhs, Object* rhs)
     {
-        std::function<int(mpz_t&, mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b) {return mpz_cmp(a,b);};
-        std::function<int(mpf_t&, mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b) {return mpf_cmp(a,b);};
-
-        return mp_cmp_op2(lhs, rhs, mpz_op, mpf_op) < 0 ? &Object::trueObject() : &Object::falseObject();
+        return compare<LessKernel>(lhs, rhs);
     }
 
     inline Object* lessEqual(Object* lhs, Object* rhs)
     {
-        std::function<int(mpz_t&, mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b) {return mpz_cmp(a,b);};
-        std::function<int(mpf_t&, mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b) {return mpf_cmp(a,b);};
-
-        return mp_cmp_op2(lhs, rhs, mpz_op, mpf_op) <= 0 ? &Object::trueObject() : &Object::falseObject();
+        return compare<LessEqualKernel>(lhs, rhs);
     }
 
     inline Object* greater(Object* lhs, Object* rhs)
     {
-        std::function<int(mpz_t&, mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b) {return mpz_cmp(a,b);};
-        std::function<int(mpf_t&, mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b) {return mpf_cmp(a,b);};
-
-        return mp_cmp_op2(lhs, rhs, mpz_op, mpf_op) > 0 ? &Object::trueObject() : &Object::falseObject();
+        return compare<GreaterKernel>(lhs, rhs);
     }
 
     inline Object* greaterEqual(Object* lhs, Object* rhs)
     {
-        std::function<int(mpz_t&, mpz_t&)> mpz_op = [&] (mpz_t& a, mpz_t& b) {return mpz_cmp(a,b);};
-        std::function<int(mpf_t&, mpf_t&)> mpf_op = [&] (mpf_t& a, mpf_t& b) {return mpf_cmp(a,b);};
-
-        return mp_cmp_op2(lhs, rhs, mpz_op, mpf_op) >= 0 ? &Object::trueObject() : &Object::falseObject();
+        return compare<GreaterEqualKernel>(lhs, rhs);
     }
 
     inline void setFlag(int flag)    
@@ -730,7 +1036,69 @@ public:
 
     inline bool hasFlag(int flag) const
     {
-        return (flags & flag) != 0;
+        return (__atomic_load_n(&flags, __ATOMIC_RELAXED) & flag) != 0;
+    }
+
+    /**
+     * Used for flags of objects which may be on a list being swept in the background,
+     * which clears the reachable flag concurrently
+     */
+    inline void setFlagAtomic(int flag)
+    {
+        __atomic_fetch_or(&flags, (uint8_t) flag, __ATOMIC_RELAXED);
+    }
+
+    inline void clearFlagAtomic(int flag)
+    {
+        __atomic_fetch_and(&flags, (uint8_t) ~flag, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * Sets the object's mark bit in its heap page. Returns false if the object is already
+     * marked, untracked, or is an old object which a minor collection doesn't need to
+     * trace, or is outside of the scratch region being swept. During parallel marking,
+     * the bit is set atomically so only one worker gets to scan the object.
+     */
+    inline bool markSelf()
+    {
+        if (!hasFlag(FLAG_GC_TRACKED))
+            return false;
+
+        if (gcstate == GC_OLD && vm().minorMarking)
+            return false;
+
+        if (vm().scratchMarking != 0 && Heap::pageOf(this)->region != vm().scratchMarking)
+            return false;
+
+        return Heap::mark(this, vm().parallelMarking);
+    }
+
+    /* Distance, in objects, at which marking prefetches object headers ahead of use */
+    static constexpr size_t MARK_PREFETCH_DISTANCE = 8;
+
+    /**
+     * Hints the CPU to fetch the header of an object which marking is about to read or
+     * write, so the cache miss overlaps with the work on the objects before it.
+     */
+    static inline void prefetch(const Object* obj)
+    {
+        __builtin_prefetch(obj, 1, 3);
+    }
+
+    /**
+     * Marks each object in a vector, prefetching the headers of the objects further ahead
+     */
+    static inline void markAll(const std::vector<Object*>& objects)
+    {
+        const size_t count = objects.size();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i + MARK_PREFETCH_DISTANCE < count)
+                prefetch(objects[i + MARK_PREFETCH_DISTANCE]);
+
+            objects[i]->mark();
+        }
     }
 
     /**
@@ -768,6 +1136,51 @@ public:
         return otype == TokenType::TypeString;
     }
 
+    inline bool isRope() const
+    {
+        return otype == TokenType::TypeRope;
+    }
+
+    inline InternedString* interned() const
+    {
+        return static_cast<InternedString*>(str_value);
+    }
+
+    /**
+     * True if two strings or symbols have the same text. Interned strings are compared
+     * by pointer.
+     */
+    inline bool sameText(const Object* other) const
+    {
+        if (hasFlag(FLAG_INTERNED) && other->hasFlag(FLAG_INTERNED))
+            return str_value == other->str_value;
+
+        return *str_value == *other->str_value;
+    }
+
+    /**
+     * Hash of the text of a string or symbol, which is precomputed for interned strings
+     */
+    inline size_t textHash() const
+    {
+        return hasFlag(FLAG_INTERNED) ? interned()->hash : std::hash<std::string>()(*str_value);
+    }
+
+    /**
+     * Gives a string its own copy of an interned text before it's changed in place
+     */
+    inline void ownString()
+    {
+        if (hasFlag(FLAG_INTERNED))
+        {
+            InternedString* shared = interned();
+            str_value = new std::string(*shared);
+            clearFlag(FLAG_INTERNED);
+
+            InternTable::instance().release(shared);
+        }
+    }
+
     inline bool isSymbol() const
     {
         return otype == TokenType::TypeSymbol;
@@ -783,9 +1196,14 @@ public:
         return otype >= TokenType::TypeFloat && otype <= TokenType::TypeFloat;
     }
 
+    inline bool isDouble() const
+    {
+        return otype == TokenType::TypeDouble;
+    }
+
     inline bool isNumeric() const
     {
-        return isInteger() || isFloat();
+        return isInteger() || isFloat() || isDouble();
     }
 
     inline bool isArray() const
@@ -793,6 +1211,11 @@ public:
         return otype == TokenType::TypeArray;
     }
 
+    inline bool isTypedArray() const
+    {
+        return otype == TokenType::TypeTypedArray;
+    }
+
     inline bool isUnorderedSet() const
     {
         return otype == TokenType::TypeUnorderedSet;
@@ -803,6 +1226,37 @@ public:
         return otype == TokenType::TypeUnorderedMap;
     }
 
+    inline bool isOrderedSet() const
+    {
+        return otype == TokenType::TypeOrderedSet;
+    }
+
+    inline bool isOrderedMap() const
+    {
+        return otype == TokenType::TypeOrderedMap;
+    }
+
+    inline bool isPersistentVector() const
+    {
+        return otype == TokenType::TypePersistentVector;
+    }
+
+    inline bool isPersistentMap() const
+    {
+        return otype == TokenType::TypePersistentMap;
+    }
+
+    /**
+     * Total order of the keys of ordered collections. Bools come first, then numbers, chars
+     * and strings. Numbers are ordered by value regardless of representation; equal values of
+     * different representations are ordered int, float, f64, as they're different keys. NaN
+     * orders after all other numbers. Throws for other types.
+     *
+     * Returns a negative number, zero or a positive number as lhs is less than, equal to or
+     * greater than rhs.
+     */
+    static int order(const Object* lhs, const Object* rhs);
+
     inline bool isPair() const
     {
         return otype == TokenType::TypePair;
@@ -818,16 +1272,26 @@ public:
      */
     inline bool isContainer() const
     {
-        return isArray() || isUnorderedSet() || isUnorderedMap() || isPair() || isProjection();
+        return isArray() || isTypedArray() || isUnorderedSet() || isUnorderedMap() || isOrderedSet() ||
+               isOrderedMap() || isPersistentVector() || isPersistentMap() || isPair() || isProjection();
+    }
+
+    /**
+     * Numbers, strings, symbols, chars, bools and typed arrays reference no other objects,
+     * so the collector doesn't need to scan them. These types are adjacent in TokenType.
+     */
+    inline bool isLeaf() const
+    {
+        return otype >= TokenType::TypeInt && otype <= TokenType::TypeTypedArray;
     }
 
     /**
      * A sequence is anything that the "coll" functions can operate on,
-     * namely containers and strings.
+     * namely containers, strings and ropes.
      */
     inline bool isSequence() const
     {
-        return isContainer() || isString();
+        return isContainer() || isString() || isRope();
     }
 
     /**
@@ -842,11 +1306,20 @@ public:
     void track();
 
     /**
-     * Called by the GC to mark this object as reachable. Override to mark owned objects.
+     * Called by the GC to mark this object as reachable. Unless already marked or a
+     * leaf, the object is put on the VM's gray stack, from which the collector later
+     * calls markChildren. Marking is thus not recursive, and can be done in slices or by
+     * multiple threads, in which case each has its own gray stack.
      *
-     * Overrides should always call this base class method first to avoid cycles.
+     * Override only for untracked objects which forward marking to a tracked object.
      */
     virtual void mark();
+
+    /**
+     * Called by the GC to mark the objects referenced by this object. Override to
+     * mark owned objects.
+     */
+    virtual void markChildren();
 };
 
 inline Object* track(Object* obj)
@@ -855,6 +1328,76 @@ inline Object* track(Object* obj)
     return obj;
 }
 
+inline int ObjectOrder::operator()(const Object* lhs, const Object* rhs) const
+{
+    return Object::order(lhs, rhs);
+}
+
+/**
+ * Calls fn(key, value) in order for the entries of an omap or oset projection, which are
+ * the keys in [lower, upper). Sets pass each element as both key and value.
+ */
+template <typename Tree, typename Fn>
+void forEachInRange(const Tree& tree, const ProjectionData* projection, Fn fn)
+{
+    auto itr = projection->lower != nullptr ? tree.lowerBound(projection->lower) : tree.begin();
+    for (; !itr.atEnd(); ++itr)
+    {
+        if (projection->upper != nullptr && Object::order(itr.key(), projection->upper) >= 0)
+            break;
+
+        fn(itr.key(), itr.value());
+    }
+}
+
+template <typename Fn>
+void forEachInRange(const ProjectionData* projection, Fn fn)
+{
+    Object* coll = projection->collection;
+    if (coll->isOrderedMap())
+        forEachInRange(*coll->omap, projection, [&](Object* key, Object* value) { fn(key, value); });
+    else if (coll->isOrderedSet())
+        forEachInRange(*coll->oset, projection, [&](Object* key, NoValue) { fn(key, key); });
+    else
+        throw std::runtime_error("Key ranges are only supported by omap and oset");
+}
+
+/**
+ * Call after storing 'value' in a container, or in the locals, args or creator of
+ * a function, owned by 'owner'. Stacks don't need this as the collector always
+ * traces the stacks in use.
+ *
+ * Old objects which start referencing nursery objects are put in the remembered
+ * set, so minor collections find the reference without tracing the old generation.
+ * During incremental marking, the value is shaded if the owner is already marked.
+ * While a scratch region is open, a value stored into an object outside of its
+ * region is recorded as escaped.
+ */
+inline void writeBarrier(Object* owner, Object* value)
+{
+    if (value == nullptr || !value->hasFlag(FLAG_GC_TRACKED))
+        return;
+
+    if (owner->gcstate == GC_OLD && value->gcstate == 0)
+        vm().remember(owner);
+
+    if (vm().gcPhase == VM::GCPhase::Marking && Heap::isMarked(owner))
+        value->mark();
+
+    if (vm().heap.regionDepth > 0)
+        vm().escape(owner, value);
+}
+
+/**
+ * Call after growing a container or string in place, with the owner's ownedBytes()
+ * before the change, so the collector paces itself on the new size
+ */
+inline void accountGrowth(Object* owner, size_t before)
+{
+    if (owner->hasFlag(FLAG_GC_TRACKED))
+        vm().externalBytes += (int64_t) owner->ownedBytes() - (int64_t) before;
+}
+
 #ifdef WIN32
     #pragma pack(pop)
 #endif
@@ -863,10 +1406,61 @@ inline Object* track(Object* obj)
 
 
 #include "StdUtil.h"
+namespace lake {
+
+/**
+ * Hashes the limbs of a GMP number directly, rather than its string representation
+ */
+inline size_t hashLimbs(const mp_limb_t* limbs, size_t count, uint64_t seed)
+{
+    uint64_t h = seed;
+    for (size_t i = 0; i < count; i++)
+    {
+        h = (h ^ (uint64_t) limbs[i]) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+
+    return (size_t) h;
+}
+
+inline size_t hashInteger(const mpz_t value)
+{
+    return hashLimbs(value->_mp_d, (size_t) std::abs(value->_mp_size), value->_mp_size < 0 ? 1 : 0);
+}
+
+/**
+ * Equal floats may differ in precision, which only adds low zero limbs, so these are skipped
+ */
+inline size_t hashFloat(const mpf_t value)
+{
+    const mp_limb_t* limbs = value->_mp_d;
+    size_t count = (size_t) std::abs(value->_mp_size);
+
+    while (count > 0 && limbs[0] == 0)
+    {
+        limbs++;
+        count--;
+    }
+
+    if (count == 0)
+        return 0;
+
+    return hashLimbs(limbs, count, ((uint64_t) value->_mp_exp << 1) | (value->_mp_size < 0 ? 1 : 0));
+}
+
+}//ns
+
 namespace std
 {
 
-// TODO: specialize std::less<lake::Object*> for ordering
+// Object ordering, as used by omap and oset
+template <> struct less<lake::Object*>
+{
+    bool operator()(const lake::Object* obj, const lake::Object* other) const
+    {
+        return lake::Object::order(obj, other) < 0;
+    }
+};
 
 // Object equality testing
 template <> struct equal_to<lake::Object*>
@@ -879,9 +1473,9 @@ template <> struct equal_to<lake::Object*>
 
         // Comparing collections means comparing pointers
 
-        if (obj->otype == lake::TokenType::TypeString)
+        if (obj->otype == lake::TokenType::TypeString || obj->otype == lake::TokenType::TypeSymbol)
         {
-            res = obj->str_value->compare(*other->str_value) == 0;
+            res = obj->sameText(other);
         }
         else if (obj->otype == lake::TokenType::TypeInt)
         {
@@ -892,6 +1486,10 @@ template <> struct equal_to<lake::Object*>
             // TODO: configurable epsilon
             res = mpf_cmp(obj->mpf, other->mpf) == 0;
         }
+        else if (obj->otype == lake::TokenType::TypeDouble)
+        {
+            res = obj->double_value == other->double_value;
+        }
         else if (obj->otype == lake::TokenType::TypeBool)
         {
             res = obj->bool_value == other->bool_value;
@@ -924,6 +1522,10 @@ template <> struct equal_to<lake::Object*>
         {
             res = obj->array == other->array;
         }
+        else if (obj->otype == lake::TokenType::TypeTypedArray)
+        {
+            res = obj->typed == other->typed;
+        }
         else if (obj->otype == lake::TokenType::TypeUnorderedMap)
         {
             res = obj->umap == other->umap;
@@ -932,6 +1534,28 @@ template <> struct equal_to<lake::Object*>
         {
             res = obj->uset == other->uset;
         }
+        else if (obj->otype == lake::TokenType::TypeOrderedMap)
+        {
+            res = obj->omap == other->omap;
+        }
+        else if (obj->otype == lake::TokenType::TypeOrderedSet)
+        {
+            res = obj->oset == other->oset;
+        }
+        else if (obj->otype == lake::TokenType::TypePersistentVector)
+        {
+            // Versions are immutable, so copies of a version are equal
+            res = obj->pvec->sameVersion(*other->pvec);
+        }
+        else if (obj->otype == lake::TokenType::TypePersistentMap)
+        {
+            res = obj->pmap->sameVersion(*other->pmap);
+        }
+        else if (obj->otype == lake::TokenType::TypeRope)
+        {
+            // Ropes are compared by content, like strings
+            res = obj->rope->equals(*other->rope);
+        }
         else
         {
             throw std::runtime_error("Unsupported equality test");
@@ -949,17 +1573,22 @@ template <> struct hash<lake::Object*>
 
         hash_combine(seed, o->otype);
 
-        if (o->otype == lake::TokenType::TypeString)
+        if (o->otype == lake::TokenType::TypeString || o->otype == lake::TokenType::TypeSymbol)
         {
-            hash_combine(seed, *o->str_value);
+            hash_combine(seed, o->textHash());
         }
         else if (o->otype == lake::TokenType::TypeInt)
         {
-            hash_combine(seed, o->toString());
+            hash_combine(seed, lake::hashInteger(o->mpz));
         }
         else if (o->otype == lake::TokenType::TypeFloat)
         {
-            hash_combine(seed, o->toString());
+            hash_combine(seed, lake::hashFloat(o->mpf));
+        }
+        else if (o->otype == lake::TokenType::TypeDouble)
+        {
+            // Equal values must hash equally, and -0.0 == 0.0
+            hash_combine(seed, o->double_value == 0 ? 0.0 : o->double_value);
         }
         else if (o->otype == lake::TokenType::TypeViewPointer)
         {
@@ -981,6 +1610,10 @@ template <> struct hash<lake::Object*>
         {
             hash_combine(seed, (ptrdiff_t)o->array);
         }
+        else if (o->otype == lake::TokenType::TypeTypedArray)
+        {
+            hash_combine(seed, (ptrdiff_t)o->typed);
+        }
         else if (o->otype == lake::TokenType::TypeUnorderedMap)
         {
             hash_combine(seed, (ptrdiff_t)o->umap);
@@ -989,6 +1622,27 @@ template <> struct hash<lake::Object*>
         {
             hash_combine(seed, (ptrdiff_t)o->uset);
         }
+        else if (o->otype == lake::TokenType::TypeOrderedMap)
+        {
+            hash_combine(seed, (ptrdiff_t)o->omap);
+        }
+        else if (o->otype == lake::TokenType::TypeOrderedSet)
+        {
+            hash_combine(seed, (ptrdiff_t)o->oset);
+        }
+        else if (o->otype == lake::TokenType::TypePersistentVector)
+        {
+            hash_combine(seed, o->pvec->versionHash());
+        }
+        else if (o->otype == lake::TokenType::TypePersistentMap)
+        {
+            hash_combine(seed, o->pmap->versionHash());
+        }
+        else if (o->otype == lake::TokenType::TypeRope)
+        {
+            // Hashes the same as a string with the same content
+            hash_combine(seed, o->rope->flatten());
+        }
         else if (o->otype == lake::TokenType::TypeFFISymbol)
         {
             hash_combine(seed, o->symdata->name);
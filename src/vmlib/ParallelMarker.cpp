@@ -0,0 +1,145 @@
+#include <thread>
+#include "ParallelMarker.h"
+#include "VM.h"
+#include "Object.h"
+
+namespace lake {
+
+thread_local ParallelMarker::Worker* ParallelMarker::current = nullptr;
+
+void ParallelMarker::trace(int threads)
+{
+    workers.clear();
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(new Worker());
+
+    // The roots are dealt round robin, so each worker starts with some work
+    for (size_t i = 0; i < vm.grayStack.size(); i++)
+        workers[i % workers.size()]->local.push_back(vm.grayStack[i]);
+    vm.grayStack.clear();
+
+    idle.store(0);
+    available.store(0);
+
+    vm.parallelMarking = true;
+
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < workers.size(); i++)
+        helpers.emplace_back(&ParallelMarker::work, this, i);
+
+    work(0);
+
+    for (auto& helper : helpers)
+        helper.join();
+
+    vm.parallelMarking = false;
+
+    for (auto& worker : workers)
+        steals += worker->steals;
+
+    workers.clear();
+}
+
+void ParallelMarker::work(size_t index)
+{
+    Worker& self = *workers[index];
+    current = &self;
+
+    for (;;)
+    {
+        Object* obj;
+        while (take(self, obj))
+        {
+            obj->markChildren();
+
+            if (self.local.size() >= SHARE_THRESHOLD || (self.local.size() > 1 && idle.load(std::memory_order_relaxed) > 0))
+                share(self);
+        }
+
+        if (steal(index))
+            continue;
+
+        idle.fetch_add(1);
+
+        for (;;)
+        {
+            if (available.load() > 0)
+            {
+                idle.fetch_sub(1);
+                break;
+            }
+
+            if (idle.load() == (int) workers.size())
+            {
+                current = nullptr;
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ParallelMarker::take(Worker& self, Object*& obj)
+{
+    if (!self.local.empty())
+    {
+        obj = self.local.back();
+        self.local.pop_back();
+
+        // The next object is likely scanned right after this one
+        if (!self.local.empty())
+            Object::prefetch(self.local.back());
+
+        return true;
+    }
+
+    std::lock_guard<std::mutex> guard(self.lock);
+
+    if (self.shared.empty())
+        return false;
+
+    obj = self.shared.back();
+    self.shared.pop_back();
+    available.fetch_sub(1);
+
+    return true;
+}
+
+bool ParallelMarker::steal(size_t index)
+{
+    Worker& self = *workers[index];
+
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        Worker& victim = *workers[(index + i) % workers.size()];
+
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        size_t count = (victim.shared.size() + 1) / 2;
+        if (count == 0)
+            continue;
+
+        self.local.insert(self.local.end(), victim.shared.begin(), victim.shared.begin() + count);
+        victim.shared.erase(victim.shared.begin(), victim.shared.begin() + count);
+        available.fetch_sub((int64_t) count);
+
+        self.steals += count;
+        return true;
+    }
+
+    return false;
+}
+
+void ParallelMarker::share(Worker& self)
+{
+    size_t count = self.local.size() / 2;
+
+    std::lock_guard<std::mutex> guard(self.lock);
+
+    self.shared.insert(self.shared.end(), self.local.begin(), self.local.begin() + count);
+    self.local.erase(self.local.begin(), self.local.begin() + count);
+    available.fetch_add((int64_t) count);
+}
+
+}//ns
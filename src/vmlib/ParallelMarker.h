@@ -0,0 +1,85 @@
+#ifndef LAKE_PARALLELMARKER_H
+#define LAKE_PARALLELMARKER_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace lake {
+
+class VM;
+class Object;
+
+/**
+ * Traces the heap with a number of worker threads, after the roots have been put on the
+ * VM's gray stack. The calling thread is one of the workers.
+ *
+ * Each worker has a private gray stack, which Object::mark pushes to while the worker
+ * scans an object, and a shared deque. A worker moves the older half of its private
+ * stack to its deque when the stack grows large, or when other workers are idle. Idle
+ * workers steal half of another worker's deque. Wide objects, such as large arrays and
+ * stacks, are thus split across workers as their children are marked.
+ *
+ * Mark bits are set atomically while workers run (see Heap::mark), so each
+ * object is scanned by exactly one worker. Marking is done when all workers are idle, at
+ * which point every deque is empty, as only the owner adds to its deque.
+ */
+class ParallelMarker
+{
+public:
+
+    // Private stack size at which the older half is shared
+    static constexpr size_t SHARE_THRESHOLD = 256;
+
+    explicit ParallelMarker(VM& vm) : vm(vm) {}
+    ParallelMarker(const ParallelMarker&) = delete;
+    ParallelMarker& operator=(const ParallelMarker&) = delete;
+
+    /**
+     * Traces everything reachable from the VM's gray stack using 'threads' workers,
+     * leaving the gray stack empty
+     */
+    void trace(int threads);
+
+    /**
+     * Pushes a newly marked object on the calling worker's private stack
+     */
+    static inline void push(Object* obj)
+    {
+        current->local.push_back(obj);
+    }
+
+    // Objects stolen from other workers, for diagnostics
+    uint64_t steals = 0;
+
+private:
+
+    struct Worker
+    {
+        std::vector<Object*> local;
+        std::mutex lock;
+        std::deque<Object*> shared;
+        uint64_t steals = 0;
+    };
+
+    void work(size_t index);
+    bool take(Worker& self, Object*& obj);
+    bool steal(size_t index);
+    void share(Worker& self);
+
+    VM& vm;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Number of workers looking for work, and number of objects on shared deques
+    std::atomic<int> idle {0};
+    std::atomic<int64_t> available {0};
+
+    static thread_local Worker* current;
+};
+
+}//ns
+
+#endif //LAKE_PARALLELMARKER_H
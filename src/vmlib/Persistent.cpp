@@ -0,0 +1,787 @@
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include "Persistent.h"
+#include "HashTable.h"
+#include "Object.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace lake {
+
+PersistentVector::Node::Node(bool leaf) : refs(1), visited(0), leaf(leaf)
+{
+    std::fill(std::begin(children), std::end(children), nullptr);
+}
+
+PersistentVector::PersistentVector(const PersistentVector& copy) :
+    root(retain(copy.root)), tail(retain(copy.tail)), count(copy.count), shift(copy.shift)
+{
+}
+
+PersistentVector::PersistentVector(PersistentVector&& other) :
+    root(other.root), tail(other.tail), count(other.count), shift(other.shift), freshNodes(other.freshNodes)
+{
+    other.root = nullptr;
+    other.tail = nullptr;
+    other.count = 0;
+    other.shift = 0;
+    other.freshNodes = 0;
+}
+
+PersistentVector& PersistentVector::operator=(PersistentVector&& other)
+{
+    std::swap(root, other.root);
+    std::swap(tail, other.tail);
+    std::swap(count, other.count);
+    std::swap(shift, other.shift);
+    std::swap(freshNodes, other.freshNodes);
+
+    return *this;
+}
+
+PersistentVector::~PersistentVector()
+{
+    release(root);
+    release(tail);
+}
+
+PersistentVector::Node* PersistentVector::retain(Node* node)
+{
+    if (node != nullptr)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return node;
+}
+
+void PersistentVector::release(Node* node)
+{
+    if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if (!node->leaf)
+    {
+        for (Node* child : node->children)
+            release(child);
+    }
+
+    delete node;
+}
+
+PersistentVector::Node* PersistentVector::newNode(bool leaf)
+{
+    freshNodes++;
+    return new Node(leaf);
+}
+
+PersistentVector::Node* PersistentVector::copyNode(const Node* node)
+{
+    Node* res = newNode(node->leaf);
+
+    if (node->leaf)
+        std::copy(std::begin(node->values), std::end(node->values), std::begin(res->values));
+    else
+    {
+        for (size_t i = 0; i < WIDTH; i++)
+            res->children[i] = retain(node->children[i]);
+    }
+
+    return res;
+}
+
+void PersistentVector::replaceChild(Node* parent, size_t index, Node* child)
+{
+    Node* old = parent->children[index];
+    parent->children[index] = child;
+    release(old);
+}
+
+size_t PersistentVector::countNodes(const Node* node)
+{
+    if (node == nullptr)
+        return 0;
+
+    size_t res = 1;
+    if (!node->leaf)
+    {
+        for (Node* child : node->children)
+            res += countNodes(child);
+    }
+
+    return res;
+}
+
+PersistentVector::Node* PersistentVector::leafFor(size_t index) const
+{
+    if (index >= tailOffset())
+        return tail;
+
+    Node* node = root;
+    for (size_t level = shift; level > 0; level -= BITS)
+        node = node->children[(index >> level) & MASK];
+
+    return node;
+}
+
+Object* PersistentVector::get(size_t index) const
+{
+    if (index >= count)
+        throw std::runtime_error("pvec index is out of range");
+
+    return leafFor(index)->values[index & MASK];
+}
+
+PersistentVector PersistentVector::set(size_t index, Object* value) const
+{
+    if (index >= count)
+        throw std::runtime_error("pvec index is out of range");
+
+    PersistentVector res;
+    res.count = count;
+    res.shift = shift;
+
+    if (index >= tailOffset())
+    {
+        res.root = retain(root);
+        res.tail = res.copyNode(tail);
+        res.tail->values[index & MASK] = value;
+    }
+    else
+    {
+        res.tail = retain(tail);
+        res.root = res.setIn(shift, root, index, value);
+    }
+
+    return res;
+}
+
+PersistentVector::Node* PersistentVector::setIn(size_t level, const Node* node, size_t index, Object* value)
+{
+    Node* res = copyNode(node);
+
+    if (level == 0)
+        res->values[index & MASK] = value;
+    else
+    {
+        size_t sub = (index >> level) & MASK;
+        replaceChild(res, sub, setIn(level - BITS, node->children[sub], index, value));
+    }
+
+    return res;
+}
+
+PersistentVector PersistentVector::append(Object* value) const
+{
+    PersistentVector res;
+    res.count = count + 1;
+    res.shift = shift;
+
+    size_t tailStart = tailOffset();
+
+    // Room in the tail
+    if (count - tailStart < WIDTH)
+    {
+        res.root = retain(root);
+        res.tail = tail != nullptr ? res.copyNode(tail) : res.newNode(true);
+        res.tail->values[count - tailStart] = value;
+
+        return res;
+    }
+
+    // The full tail moves into the tree, growing it by a level if the root is full
+    if (root == nullptr)
+        res.root = retain(tail);
+    else if (tailStart == (WIDTH << shift))
+    {
+        res.root = res.newNode(false);
+        res.root->children[0] = retain(root);
+        res.root->children[1] = res.newPath(shift, retain(tail));
+        res.shift = shift + BITS;
+    }
+    else
+        res.root = res.pushTail(shift, root, retain(tail), tailStart);
+
+    res.tail = res.newNode(true);
+    res.tail->values[0] = value;
+
+    return res;
+}
+
+PersistentVector::Node* PersistentVector::newPath(size_t level, Node* node)
+{
+    if (level == 0)
+        return node;
+
+    Node* res = newNode(false);
+    res->children[0] = newPath(level - BITS, node);
+
+    return res;
+}
+
+PersistentVector::Node* PersistentVector::pushTail(size_t level, const Node* parent, Node* tailNode, size_t tailStart)
+{
+    Node* res = copyNode(parent);
+    size_t sub = (tailStart >> level) & MASK;
+
+    if (level == BITS)
+        replaceChild(res, sub, tailNode);
+    else
+    {
+        Node* child = parent->children[sub];
+        replaceChild(res, sub, child != nullptr ? pushTail(level - BITS, child, tailNode, tailStart) :
+                                                  newPath(level - BITS, tailNode));
+    }
+
+    return res;
+}
+
+PersistentVector PersistentVector::pop() const
+{
+    if (count == 0)
+        throw std::runtime_error("Cannot remove from an empty pvec");
+
+    if (count == 1)
+        return PersistentVector();
+
+    PersistentVector res;
+    res.count = count - 1;
+    res.shift = shift;
+
+    size_t tailStart = tailOffset();
+    if (count - tailStart > 1)
+    {
+        res.root = retain(root);
+        res.tail = res.copyNode(tail);
+        res.tail->values[count - tailStart - 1] = nullptr;
+
+        return res;
+    }
+
+    // The tail becomes empty, so the last leaf of the tree takes its place
+    res.tail = retain(leafFor(count - 2));
+    res.root = res.popTail(shift, root, count - 2);
+
+    if (res.root == nullptr)
+        res.shift = 0;
+    else if (shift > 0 && res.root->children[1] == nullptr)
+    {
+        // A root with a single child is replaced by the child
+        Node* only = retain(res.root->children[0]);
+        release(res.root);
+        res.freshNodes--;
+
+        res.root = only;
+        res.shift -= BITS;
+    }
+
+    return res;
+}
+
+PersistentVector::Node* PersistentVector::popTail(size_t level, const Node* node, size_t lastIndex)
+{
+    // A leaf root moves to the tail entirely
+    if (level == 0)
+        return nullptr;
+
+    size_t sub = (lastIndex >> level) & MASK;
+
+    Node* child = nullptr;
+    if (level > BITS)
+    {
+        child = popTail(level - BITS, node->children[sub], lastIndex);
+        if (child == nullptr && sub == 0)
+            return nullptr;
+    }
+    else if (sub == 0)
+        return nullptr;
+
+    Node* res = copyNode(node);
+    replaceChild(res, sub, child);
+
+    return res;
+}
+
+PersistentVector PersistentVector::erase(size_t index) const
+{
+    if (index >= count)
+        throw std::runtime_error("pvec index is out of range");
+
+    if (index == count - 1)
+        return pop();
+
+    PersistentVector res;
+    size_t i = 0;
+    forEach([&](Object* value)
+    {
+        if (i++ != index)
+            res = res.append(value);
+    });
+
+    // All nodes of a rebuilt vector are its own
+    res.freshNodes = countNodes(res.root) + countNodes(res.tail);
+
+    return res;
+}
+
+PersistentVector PersistentVector::insert(size_t index, Object* value) const
+{
+    if (index > count)
+        throw std::runtime_error("pvec index is out of range");
+
+    if (index == count)
+        return append(value);
+
+    PersistentVector res;
+    size_t i = 0;
+    forEach([&](Object* current)
+    {
+        if (i++ == index)
+            res = res.append(value);
+
+        res = res.append(current);
+    });
+
+    res.freshNodes = countNodes(res.root) + countNodes(res.tail);
+
+    return res;
+}
+
+size_t PersistentVector::versionHash() const
+{
+    size_t seed = count;
+    std::hash_combine(seed, (const void*) root);
+    std::hash_combine(seed, (const void*) tail);
+
+    return seed;
+}
+
+//
+// PersistentMap
+//
+
+// Hash bits consumed per level, and in total; nodes below the last level are collision nodes
+static constexpr size_t MAP_BITS = 5;
+static constexpr size_t HASH_BITS = sizeof(size_t) * 8;
+
+static inline size_t bitCount(uint32_t bits)
+{
+#ifdef _MSC_VER
+    return (size_t) __popcnt(bits);
+#else
+    return (size_t) __builtin_popcount(bits);
+#endif
+}
+
+static inline uint32_t bitFor(size_t hash, size_t shift)
+{
+    return 1u << ((hash >> shift) & 31);
+}
+
+// Position in a packed array of the item whose bit is 'bit'
+static inline size_t indexOf(uint32_t bitmap, uint32_t bit)
+{
+    return bitCount(bitmap & (bit - 1));
+}
+
+static inline size_t hashKey(Object* key)
+{
+    // Each level consumes the next bits, so they must all be well mixed
+    return hashing::mix(std::hash<Object*>()(key));
+}
+
+static inline bool equalKeys(Object* lhs, Object* rhs)
+{
+    return std::equal_to<Object*>()(lhs, rhs);
+}
+
+size_t PersistentMap::Node::dataCount() const
+{
+    return collision ? dataMap : bitCount(dataMap);
+}
+
+size_t PersistentMap::Node::childCount() const
+{
+    return bitCount(nodeMap);
+}
+
+PersistentMap::PersistentMap(const PersistentMap& copy) : root(retain(copy.root)), count(copy.count)
+{
+}
+
+PersistentMap::PersistentMap(PersistentMap&& other) : root(other.root), count(other.count), freshBytes(other.freshBytes)
+{
+    other.root = nullptr;
+    other.count = 0;
+    other.freshBytes = 0;
+}
+
+PersistentMap& PersistentMap::operator=(PersistentMap&& other)
+{
+    std::swap(root, other.root);
+    std::swap(count, other.count);
+    std::swap(freshBytes, other.freshBytes);
+
+    return *this;
+}
+
+PersistentMap::~PersistentMap()
+{
+    release(root);
+}
+
+PersistentMap::Node* PersistentMap::newNode(uint32_t dataMap, uint32_t nodeMap, bool collision, size_t hash)
+{
+    size_t entries = collision ? dataMap : bitCount(dataMap);
+    size_t bytes = sizeof(Node) + (2 * entries + bitCount(nodeMap)) * sizeof(void*);
+
+    Node* node = new (::operator new(bytes)) Node;
+    node->refs.store(1, std::memory_order_relaxed);
+    node->visited.store(0, std::memory_order_relaxed);
+    node->dataMap = dataMap;
+    node->nodeMap = nodeMap;
+    node->collision = collision;
+    node->hash = hash;
+
+    freshBytes += bytes;
+
+    return node;
+}
+
+PersistentMap::Node* PersistentMap::retain(Node* node)
+{
+    if (node != nullptr)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return node;
+}
+
+void PersistentMap::release(Node* node)
+{
+    if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    size_t children = node->childCount();
+    for (size_t i = 0; i < children; i++)
+        release(node->children()[i]);
+
+    node->~Node();
+    ::operator delete(node);
+}
+
+Object* PersistentMap::find(Object* key) const
+{
+    size_t hash = hashKey(key);
+    Node* node = root;
+
+    for (size_t shift = 0; node != nullptr; shift += MAP_BITS)
+    {
+        if (node->collision)
+        {
+            for (size_t i = 0; i < node->dataMap; i++)
+            {
+                if (equalKeys(node->entries()[2*i], key))
+                    return node->entries()[2*i+1];
+            }
+
+            return nullptr;
+        }
+
+        uint32_t bit = bitFor(hash, shift);
+        if (node->dataMap & bit)
+        {
+            Object** entry = node->entries() + 2 * indexOf(node->dataMap, bit);
+            return equalKeys(entry[0], key) ? entry[1] : nullptr;
+        }
+
+        if ((node->nodeMap & bit) == 0)
+            return nullptr;
+
+        node = node->children()[indexOf(node->nodeMap, bit)];
+    }
+
+    return nullptr;
+}
+
+PersistentMap PersistentMap::put(Object* key, Object* value) const
+{
+    PersistentMap res;
+    size_t hash = hashKey(key);
+    bool added = false;
+
+    if (root == nullptr)
+    {
+        res.root = res.newNode(bitFor(hash, 0), 0, false, 0);
+        res.root->entries()[0] = key;
+        res.root->entries()[1] = value;
+        added = true;
+    }
+    else
+        res.root = res.putIn(root, key, value, hash, 0, added);
+
+    res.count = count + (added ? 1 : 0);
+
+    return res;
+}
+
+PersistentMap::Node* PersistentMap::putIn(Node* node, Object* key, Object* value, size_t hash, size_t shift, bool& added)
+{
+    size_t entries = node->dataCount();
+    size_t children = node->childCount();
+
+    if (node->collision)
+    {
+        for (size_t i = 0; i < entries; i++)
+        {
+            if (equalKeys(node->entries()[2*i], key))
+            {
+                Node* res = newNode(node->dataMap, 0, true, node->hash);
+                std::copy(node->entries(), node->entries() + 2 * entries, res->entries());
+                res->entries()[2*i+1] = value;
+
+                return res;
+            }
+        }
+
+        Node* res = newNode(node->dataMap + 1, 0, true, node->hash);
+        std::copy(node->entries(), node->entries() + 2 * entries, res->entries());
+        res->entries()[2*entries] = key;
+        res->entries()[2*entries+1] = value;
+        added = true;
+
+        return res;
+    }
+
+    uint32_t bit = bitFor(hash, shift);
+
+    if (node->dataMap & bit)
+    {
+        size_t index = indexOf(node->dataMap, bit);
+        Object* existing = node->entries()[2*index];
+
+        if (equalKeys(existing, key))
+        {
+            Node* res = newNode(node->dataMap, node->nodeMap, false, 0);
+            std::copy(node->entries(), node->entries() + 2 * entries, res->entries());
+            res->entries()[2*index+1] = value;
+
+            for (size_t i = 0; i < children; i++)
+                res->children()[i] = retain(node->children()[i]);
+
+            return res;
+        }
+
+        // The existing entry and the new one move to a sub-node
+        Node* child = merge(existing, node->entries()[2*index+1], hashKey(existing), key, value, hash, shift + MAP_BITS);
+
+        Node* res = newNode(node->dataMap ^ bit, node->nodeMap | bit, false, 0);
+        std::copy(node->entries(), node->entries() + 2 * index, res->entries());
+        std::copy(node->entries() + 2 * (index + 1), node->entries() + 2 * entries, res->entries() + 2 * index);
+
+        size_t childIndex = indexOf(res->nodeMap, bit);
+        for (size_t i = 0, j = 0; i < children + 1; i++)
+            res->children()[i] = i == childIndex ? child : retain(node->children()[j++]);
+
+        added = true;
+
+        return res;
+    }
+
+    if (node->nodeMap & bit)
+    {
+        size_t index = indexOf(node->nodeMap, bit);
+        Node* child = putIn(node->children()[index], key, value, hash, shift + MAP_BITS, added);
+
+        Node* res = newNode(node->dataMap, node->nodeMap, false, 0);
+        std::copy(node->entries(), node->entries() + 2 * entries, res->entries());
+
+        for (size_t i = 0; i < children; i++)
+            res->children()[i] = i == index ? child : retain(node->children()[i]);
+
+        return res;
+    }
+
+    // A free slot
+    Node* res = newNode(node->dataMap | bit, node->nodeMap, false, 0);
+    size_t index = indexOf(res->dataMap, bit);
+
+    std::copy(node->entries(), node->entries() + 2 * index, res->entries());
+    res->entries()[2*index] = key;
+    res->entries()[2*index+1] = value;
+    std::copy(node->entries() + 2 * index, node->entries() + 2 * entries, res->entries() + 2 * (index + 1));
+
+    for (size_t i = 0; i < children; i++)
+        res->children()[i] = retain(node->children()[i]);
+
+    added = true;
+
+    return res;
+}
+
+PersistentMap::Node* PersistentMap::merge(Object* key1, Object* value1, size_t hash1,
+                                          Object* key2, Object* value2, size_t hash2, size_t shift)
+{
+    // All bits are used, so the hashes are equal
+    if (shift >= HASH_BITS)
+    {
+        Node* res = newNode(2, 0, true, hash1);
+        res->entries()[0] = key1;
+        res->entries()[1] = value1;
+        res->entries()[2] = key2;
+        res->entries()[3] = value2;
+
+        return res;
+    }
+
+    uint32_t bit1 = bitFor(hash1, shift);
+    uint32_t bit2 = bitFor(hash2, shift);
+
+    if (bit1 == bit2)
+    {
+        Node* res = newNode(0, bit1, false, 0);
+        res->children()[0] = merge(key1, value1, hash1, key2, value2, hash2, shift + MAP_BITS);
+
+        return res;
+    }
+
+    Node* res = newNode(bit1 | bit2, 0, false, 0);
+    size_t first = bit1 < bit2 ? 0 : 2;
+    res->entries()[first] = key1;
+    res->entries()[first+1] = value1;
+    res->entries()[2-first] = key2;
+    res->entries()[3-first] = value2;
+
+    return res;
+}
+
+PersistentMap PersistentMap::erase(Object* key) const
+{
+    PersistentMap res;
+    bool removed = false;
+
+    if (root != nullptr)
+        res.root = res.eraseIn(root, key, hashKey(key), 0, removed);
+
+    res.count = count - (removed ? 1 : 0);
+
+    return res;
+}
+
+PersistentMap::Node* PersistentMap::eraseIn(Node* node, Object* key, size_t hash, size_t shift, bool& removed)
+{
+    size_t entries = node->dataCount();
+    size_t children = node->childCount();
+
+    if (node->collision)
+    {
+        for (size_t i = 0; i < entries; i++)
+        {
+            if (equalKeys(node->entries()[2*i], key))
+            {
+                removed = true;
+
+                Node* res = newNode(node->dataMap - 1, 0, true, node->hash);
+                std::copy(node->entries(), node->entries() + 2 * i, res->entries());
+                std::copy(node->entries() + 2 * (i + 1), node->entries() + 2 * entries, res->entries() + 2 * i);
+
+                return res;
+            }
+        }
+
+        return retain(node);
+    }
+
+    uint32_t bit = bitFor(hash, shift);
+
+    if (node->dataMap & bit)
+    {
+        size_t index = indexOf(node->dataMap, bit);
+        if (!equalKeys(node->entries()[2*index], key))
+            return retain(node);
+
+        removed = true;
+
+        if (entries == 1 && children == 0)
+            return nullptr;
+
+        Node* res = newNode(node->dataMap ^ bit, node->nodeMap, false, 0);
+        std::copy(node->entries(), node->entries() + 2 * index, res->entries());
+        std::copy(node->entries() + 2 * (index + 1), node->entries() + 2 * entries, res->entries() + 2 * index);
+
+        for (size_t i = 0; i < children; i++)
+            res->children()[i] = retain(node->children()[i]);
+
+        return res;
+    }
+
+    if ((node->nodeMap & bit) == 0)
+        return retain(node);
+
+    size_t index = indexOf(node->nodeMap, bit);
+    Node* child = eraseIn(node->children()[index], key, hash, shift + MAP_BITS, removed);
+
+    if (!removed)
+    {
+        release(child);
+        return retain(node);
+    }
+
+    // A sub-node left with a single entry is inlined, so each map has a single representation
+    if (child != nullptr && child->childCount() == 0 && child->dataCount() == 1)
+    {
+        Node* res = newNode(node->dataMap | bit, node->nodeMap ^ bit, false, 0);
+        size_t entryIndex = indexOf(res->dataMap, bit);
+
+        std::copy(node->entries(), node->entries() + 2 * entryIndex, res->entries());
+        res->entries()[2*entryIndex] = child->entries()[0];
+        res->entries()[2*entryIndex+1] = child->entries()[1];
+        std::copy(node->entries() + 2 * entryIndex, node->entries() + 2 * entries, res->entries() + 2 * (entryIndex + 1));
+
+        for (size_t i = 0, j = 0; i < children; i++)
+        {
+            if (i != index)
+                res->children()[j++] = retain(node->children()[i]);
+        }
+
+        release(child);
+
+        return res;
+    }
+
+    if (child == nullptr)
+    {
+        if (entries == 0 && children == 1)
+            return nullptr;
+
+        Node* res = newNode(node->dataMap, node->nodeMap ^ bit, false, 0);
+        std::copy(node->entries(), node->entries() + 2 * entries, res->entries());
+
+        for (size_t i = 0, j = 0; i < children; i++)
+        {
+            if (i != index)
+                res->children()[j++] = retain(node->children()[i]);
+        }
+
+        return res;
+    }
+
+    Node* res = newNode(node->dataMap, node->nodeMap, false, 0);
+    std::copy(node->entries(), node->entries() + 2 * entries, res->entries());
+
+    for (size_t i = 0; i < children; i++)
+        res->children()[i] = i == index ? child : retain(node->children()[i]);
+
+    return res;
+}
+
+size_t PersistentMap::versionHash() const
+{
+    size_t seed = count;
+    std::hash_combine(seed, (const void*) root);
+
+    return seed;
+}
+
+}//ns
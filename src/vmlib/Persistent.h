@@ -0,0 +1,399 @@
+#ifndef LAKE_PERSISTENT_H
+#define LAKE_PERSISTENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+namespace lake {
+
+class Object;
+
+/**
+ * Storage of a pvec: an immutable vector whose updates return a new version sharing
+ * structure with the old one.
+ *
+ * Elements live in a radix tree of 32-wide nodes, with the last (up to) 32 elements in
+ * a separate tail node. Get, set, append and pop copy at most one root-to-leaf path,
+ * so they're O(log32 n) in time and memory; appending usually copies just the tail.
+ * Erasing or inserting anywhere but the end rebuilds the vector and is O(n).
+ *
+ * Nodes are reference counted, as any number of versions may share them. The counts
+ * are atomic since versions may be destroyed by the background sweeper while the
+ * mutator creates new ones.
+ */
+class PersistentVector
+{
+public:
+
+    static constexpr size_t BITS = 5;
+    static constexpr size_t WIDTH = 1 << BITS;
+    static constexpr size_t MASK = WIDTH - 1;
+
+    PersistentVector() = default;
+
+    /**
+     * Shares all nodes with the copy, which is O(1)
+     */
+    PersistentVector(const PersistentVector& copy);
+
+    PersistentVector(PersistentVector&& other);
+
+    PersistentVector& operator=(const PersistentVector&) = delete;
+
+    PersistentVector& operator=(PersistentVector&& other);
+
+    ~PersistentVector();
+
+    inline size_t size() const
+    {
+        return count;
+    }
+
+    /**
+     * Returns the element at 'index', which must be less than size()
+     */
+    Object* get(size_t index) const;
+
+    /**
+     * Returns a version where the element at 'index' is 'value'
+     */
+    PersistentVector set(size_t index, Object* value) const;
+
+    /**
+     * Returns a version with 'value' added at the end
+     */
+    PersistentVector append(Object* value) const;
+
+    /**
+     * Returns a version without the last element
+     */
+    PersistentVector pop() const;
+
+    /**
+     * Returns a version without the element at 'index'. This is O(n) unless it's the last one.
+     */
+    PersistentVector erase(size_t index) const;
+
+    /**
+     * Returns a version with 'value' inserted before the element at 'index'. This is O(n)
+     * unless 'index' is size().
+     */
+    PersistentVector insert(size_t index, Object* value) const;
+
+    /**
+     * Calls fn(element) for each element, in order or in reverse order
+     */
+    template <typename Fn>
+    void forEach(Fn fn, bool reverse = false) const
+    {
+        size_t tailStart = tailOffset();
+
+        if (!reverse)
+        {
+            for (size_t start = 0; start < tailStart; start += WIDTH)
+            {
+                Node* leaf = leafFor(start);
+                for (size_t i = 0; i < WIDTH; i++)
+                    fn(leaf->values[i]);
+            }
+
+            for (size_t i = 0; i < count - tailStart; i++)
+                fn(tail->values[i]);
+        }
+        else
+        {
+            for (size_t i = count - tailStart; i-- > 0;)
+                fn(tail->values[i]);
+
+            for (size_t start = tailStart; start > 0; start -= WIDTH)
+            {
+                Node* leaf = leafFor(start - WIDTH);
+                for (size_t i = WIDTH; i-- > 0;)
+                    fn(leaf->values[i]);
+            }
+        }
+    }
+
+    /**
+     * Calls fn(element) for the elements of the nodes which aren't stamped with 'epoch' yet,
+     * and stamps them, so a node shared by several versions is visited once per epoch.
+     * A tail is only shared by versions of the same size, so it's stamped like the tree.
+     */
+    template <typename Fn>
+    void forEachUnvisited(uint32_t epoch, Fn fn) const
+    {
+        if (root != nullptr && firstVisit(root, epoch))
+            visitUnvisited(root, shift, epoch, fn);
+
+        if (tail != nullptr && firstVisit(tail, epoch))
+        {
+            for (size_t i = 0; i < count - tailOffset(); i++)
+                fn(tail->values[i]);
+        }
+    }
+
+    /**
+     * True if both are the same version, such as a version and its copy
+     */
+    inline bool sameVersion(const PersistentVector& other) const
+    {
+        return root == other.root && tail == other.tail && count == other.count;
+    }
+
+    size_t versionHash() const;
+
+    /**
+     * The memory of the nodes allocated when this version was created. Nodes shared with
+     * other versions are accounted to the version which created them.
+     */
+    inline size_t allocatedBytes() const
+    {
+        return freshNodes * sizeof(Node);
+    }
+
+private:
+
+    struct Node
+    {
+        explicit Node(bool leaf);
+
+        std::atomic<uint32_t> refs;
+
+        // The last epoch of forEachUnvisited to visit the node
+        std::atomic<uint32_t> visited;
+
+        bool leaf;
+
+        union
+        {
+            Node* children[WIDTH];
+            Object* values[WIDTH];
+        };
+    };
+
+    // Index of the first element in the tail
+    inline size_t tailOffset() const
+    {
+        return count < WIDTH ? 0 : ((count - 1) >> BITS) << BITS;
+    }
+
+    Node* leafFor(size_t index) const;
+
+    static inline bool firstVisit(Node* node, uint32_t epoch)
+    {
+        return node->visited.load(std::memory_order_relaxed) != epoch &&
+               node->visited.exchange(epoch, std::memory_order_relaxed) != epoch;
+    }
+
+    template <typename Fn>
+    static void visitUnvisited(Node* node, size_t level, uint32_t epoch, Fn& fn)
+    {
+        if (level == 0)
+        {
+            for (size_t i = 0; i < WIDTH; i++)
+                fn(node->values[i]);
+            return;
+        }
+
+        for (Node* child : node->children)
+        {
+            if (child != nullptr && firstVisit(child, epoch))
+                visitUnvisited(child, level - BITS, epoch, fn);
+        }
+    }
+
+    Node* newNode(bool leaf);
+    Node* copyNode(const Node* node);
+    static Node* retain(Node* node);
+    static void release(Node* node);
+    static void replaceChild(Node* parent, size_t index, Node* child);
+    static size_t countNodes(const Node* node);
+
+    Node* newPath(size_t level, Node* node);
+    Node* pushTail(size_t level, const Node* parent, Node* tailNode, size_t tailStart);
+    Node* setIn(size_t level, const Node* node, size_t index, Object* value);
+    Node* popTail(size_t level, const Node* node, size_t lastIndex);
+
+    Node* root = nullptr;
+    Node* tail = nullptr;
+    size_t count = 0;
+
+    // Level of the root, which is a leaf at level 0
+    size_t shift = 0;
+
+    size_t freshNodes = 0;
+};
+
+/**
+ * Storage of a pmap: an immutable hash map whose updates return a new version sharing
+ * structure with the old one.
+ *
+ * This is a hash array mapped trie. Each node consumes 5 bits of the key's hash and has
+ * two bitmaps, one for entries stored inline and one for sub-nodes, with both packed
+ * in a single allocation after the header. Lookup, put and erase visit O(log32 n) nodes
+ * and copy the path they visit. Keys whose 64-bit hashes are equal end up in collision
+ * nodes, which are searched linearly.
+ *
+ * Erasing keeps the trie canonical: a sub-node left with a single entry is inlined into
+ * its parent. Nodes are reference counted like those of PersistentVector.
+ *
+ * Keys are hashed and compared like umap keys.
+ */
+class PersistentMap
+{
+public:
+
+    PersistentMap() = default;
+
+    PersistentMap(const PersistentMap& copy);
+
+    PersistentMap(PersistentMap&& other);
+
+    PersistentMap& operator=(const PersistentMap&) = delete;
+
+    PersistentMap& operator=(PersistentMap&& other);
+
+    ~PersistentMap();
+
+    inline size_t size() const
+    {
+        return count;
+    }
+
+    /**
+     * Returns the value of 'key', or nullptr if the key is absent
+     */
+    Object* find(Object* key) const;
+
+    /**
+     * Returns a version where 'key' maps to 'value'
+     */
+    PersistentMap put(Object* key, Object* value) const;
+
+    /**
+     * Returns a version without 'key', which shares everything with this one if the key is absent
+     */
+    PersistentMap erase(Object* key) const;
+
+    /**
+     * Calls fn(key, value) for each entry, in hash order
+     */
+    template <typename Fn>
+    void forEach(Fn fn) const
+    {
+        if (root != nullptr)
+            visit(root, fn);
+    }
+
+    /**
+     * Calls fn(key, value) for the entries of the nodes which aren't stamped with 'epoch' yet,
+     * and stamps them, as for PersistentVector
+     */
+    template <typename Fn>
+    void forEachUnvisited(uint32_t epoch, Fn fn) const
+    {
+        if (root != nullptr && firstVisit(root, epoch))
+            visitUnvisited(root, epoch, fn);
+    }
+
+    inline bool sameVersion(const PersistentMap& other) const
+    {
+        return root == other.root && count == other.count;
+    }
+
+    size_t versionHash() const;
+
+    /**
+     * The memory of the nodes allocated when this version was created, as for PersistentVector
+     */
+    inline size_t allocatedBytes() const
+    {
+        return freshBytes;
+    }
+
+private:
+
+    struct Node
+    {
+        std::atomic<uint32_t> refs;
+
+        // The last epoch of forEachUnvisited to visit the node
+        std::atomic<uint32_t> visited;
+
+        // Bitmap of inline entries, or for collision nodes, the number of entries
+        uint32_t dataMap;
+
+        // Bitmap of sub-nodes
+        uint32_t nodeMap;
+
+        bool collision;
+
+        // The hash shared by the keys of a collision node
+        size_t hash;
+
+        // Key and value of each entry, followed by the sub-nodes
+        inline Object** entries()
+        {
+            return reinterpret_cast<Object**>(this + 1);
+        }
+
+        inline Node** children()
+        {
+            return reinterpret_cast<Node**>(entries() + 2 * dataCount());
+        }
+
+        size_t dataCount() const;
+        size_t childCount() const;
+    };
+
+    template <typename Fn>
+    static void visit(Node* node, Fn& fn)
+    {
+        size_t entries = node->dataCount();
+        for (size_t i = 0; i < entries; i++)
+            fn(node->entries()[2*i], node->entries()[2*i+1]);
+
+        size_t children = node->childCount();
+        for (size_t i = 0; i < children; i++)
+            visit(node->children()[i], fn);
+    }
+
+    static inline bool firstVisit(Node* node, uint32_t epoch)
+    {
+        return node->visited.load(std::memory_order_relaxed) != epoch &&
+               node->visited.exchange(epoch, std::memory_order_relaxed) != epoch;
+    }
+
+    template <typename Fn>
+    static void visitUnvisited(Node* node, uint32_t epoch, Fn& fn)
+    {
+        size_t entries = node->dataCount();
+        for (size_t i = 0; i < entries; i++)
+            fn(node->entries()[2*i], node->entries()[2*i+1]);
+
+        size_t children = node->childCount();
+        for (size_t i = 0; i < children; i++)
+        {
+            Node* child = node->children()[i];
+            if (firstVisit(child, epoch))
+                visitUnvisited(child, epoch, fn);
+        }
+    }
+
+    Node* newNode(uint32_t dataMap, uint32_t nodeMap, bool collision, size_t hash);
+    static Node* retain(Node* node);
+    static void release(Node* node);
+
+    Node* putIn(Node* node, Object* key, Object* value, size_t hash, size_t shift, bool& added);
+    Node* merge(Object* key1, Object* value1, size_t hash1, Object* key2, Object* value2, size_t hash2, size_t shift);
+    Node* eraseIn(Node* node, Object* key, size_t hash, size_t shift, bool& removed);
+
+    Node* root = nullptr;
+    size_t count = 0;
+    size_t freshBytes = 0;
+};
+
+}//ns
+
+#endif //LAKE_PERSISTENT_H
@@ -0,0 +1,360 @@
+#include "Rope.h"
+
+namespace lake {
+
+Rope::Node::Node() : refs(1), depth(0), length(0), bytes(sizeof(Node)), left(nullptr), right(nullptr)
+{
+}
+
+Rope::Rope(const std::string& text)
+{
+    root = build(text.data(), text.size());
+}
+
+Rope::Rope(const Rope& copy) : root(retain(copy.root))
+{
+}
+
+Rope::Rope(Rope&& other) : root(other.root), freshBytes(other.freshBytes), flat(other.flat)
+{
+    other.root = nullptr;
+    other.freshBytes = 0;
+    other.flat = nullptr;
+}
+
+Rope& Rope::operator=(Rope&& other)
+{
+    std::swap(root, other.root);
+    std::swap(freshBytes, other.freshBytes);
+    std::swap(flat, other.flat);
+
+    return *this;
+}
+
+Rope::~Rope()
+{
+    release(root);
+    delete flat;
+}
+
+Rope::Node* Rope::retain(Node* node)
+{
+    if (node != nullptr)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return node;
+}
+
+void Rope::release(Node* node)
+{
+    if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if (node->depth > 0)
+    {
+        release(node->left);
+        release(node->right);
+    }
+
+    delete node;
+}
+
+void Rope::changed()
+{
+    delete flat;
+    flat = nullptr;
+}
+
+Rope::Node* Rope::leaf(const char* text, size_t length)
+{
+    Node* res = new Node();
+    res->text.assign(text, length);
+    res->length = length;
+    res->bytes += res->text.capacity();
+
+    freshBytes += res->bytes;
+    return res;
+}
+
+Rope::Node* Rope::build(const char* text, size_t length)
+{
+    if (length == 0)
+        return nullptr;
+
+    if (length <= LEAF_SIZE)
+        return leaf(text, length);
+
+    // Halves differ in length by at most one byte, so their depths differ by at most one
+    size_t half = length / 2;
+    return branch(build(text, half), build(text + half, length - half));
+}
+
+Rope::Node* Rope::branch(Node* left, Node* right)
+{
+    Node* res = new Node();
+    res->depth = std::max(left->depth, right->depth) + 1;
+    res->length = left->length + right->length;
+    res->left = left;
+    res->right = right;
+
+    freshBytes += res->bytes;
+    res->bytes += left->bytes + right->bytes;
+    return res;
+}
+
+/**
+ * Concatenates two balanced trees, descending the deeper one until the depths are close
+ * and rebalancing on the way back up
+ */
+Rope::Node* Rope::join(Node* left, Node* right)
+{
+    if (left == nullptr)
+        return right;
+    if (right == nullptr)
+        return left;
+
+    if (left->depth > right->depth + 1)
+    {
+        Node* ll = retain(left->left);
+        Node* lr = retain(left->right);
+        release(left);
+
+        return balance(ll, join(lr, right));
+    }
+
+    if (right->depth > left->depth + 1)
+    {
+        Node* rl = retain(right->left);
+        Node* rr = retain(right->right);
+        release(right);
+
+        return balance(join(left, rl), rr);
+    }
+
+    // Short leaves next to each other are merged, so concatenating short pieces doesn't
+    // leave a leaf per piece
+    if (left->depth == 0 && right->depth == 0 && left->length + right->length <= LEAF_SIZE)
+    {
+        std::string text;
+        text.reserve(left->length + right->length);
+        text.append(left->text).append(right->text);
+
+        release(left);
+        release(right);
+        return leaf(text.data(), text.size());
+    }
+
+    if (left->depth == 1 && right->depth == 0 && left->right->depth == 0 &&
+        left->right->length + right->length <= LEAF_SIZE)
+    {
+        Node* ll = retain(left->left);
+        Node* lr = retain(left->right);
+        release(left);
+
+        return branch(ll, join(lr, right));
+    }
+
+    if (left->depth == 0 && right->depth == 1 && right->left->depth == 0 &&
+        left->length + right->left->length <= LEAF_SIZE)
+    {
+        Node* rl = retain(right->left);
+        Node* rr = retain(right->right);
+        release(right);
+
+        return branch(join(left, rl), rr);
+    }
+
+    return branch(left, right);
+}
+
+/**
+ * Makes a node of two balanced trees, rotating if their depths differ by more than one
+ */
+Rope::Node* Rope::balance(Node* left, Node* right)
+{
+    if (left->depth > right->depth + 1)
+    {
+        Node* ll = retain(left->left);
+        Node* lr = retain(left->right);
+        release(left);
+
+        if (ll->depth >= lr->depth)
+            return balance(ll, balance(lr, right));
+
+        Node* lrl = retain(lr->left);
+        Node* lrr = retain(lr->right);
+        release(lr);
+
+        return balance(balance(ll, lrl), balance(lrr, right));
+    }
+
+    if (right->depth > left->depth + 1)
+    {
+        Node* rl = retain(right->left);
+        Node* rr = retain(right->right);
+        release(right);
+
+        if (rr->depth >= rl->depth)
+            return balance(balance(left, rl), rr);
+
+        Node* rll = retain(rl->left);
+        Node* rlr = retain(rl->right);
+        release(rl);
+
+        return balance(balance(left, rll), balance(rlr, rr));
+    }
+
+    return branch(left, right);
+}
+
+Rope::Node* Rope::sliceOf(const Node* node, size_t start, size_t end)
+{
+    if (start == 0 && end == node->length)
+        return retain(const_cast<Node*>(node));
+
+    if (node->depth == 0)
+        return leaf(node->text.data() + start, end - start);
+
+    size_t mid = node->left->length;
+
+    if (end <= mid)
+        return sliceOf(node->left, start, end);
+    if (start >= mid)
+        return sliceOf(node->right, start - mid, end - mid);
+
+    return join(sliceOf(node->left, start, mid), sliceOf(node->right, 0, end - mid));
+}
+
+char Rope::at(size_t index) const
+{
+    const Node* node = root;
+
+    while (node->depth > 0)
+    {
+        if (index < node->left->length)
+            node = node->left;
+        else
+        {
+            index -= node->left->length;
+            node = node->right;
+        }
+    }
+
+    return node->text[index];
+}
+
+void Rope::append(const char* text, size_t length)
+{
+    if (length == 0)
+        return;
+
+    changed();
+
+    // Extend the last leaf in place if no other rope shares the path to it
+    Node* last = root;
+    while (last != nullptr && last->depth > 0 && last->refs.load(std::memory_order_acquire) == 1)
+        last = last->right;
+
+    if (last != nullptr && last->depth == 0 && last->refs.load(std::memory_order_acquire) == 1 &&
+        last->length + length <= LEAF_SIZE)
+    {
+        size_t capacity = last->text.capacity();
+        last->text.append(text, length);
+        size_t grown = last->text.capacity() - capacity;
+
+        for (Node* node = root; node != nullptr; node = node->depth > 0 ? node->right : nullptr)
+        {
+            node->length += length;
+            node->bytes += grown;
+        }
+
+        freshBytes += grown;
+        return;
+    }
+
+    root = join(root, build(text, length));
+}
+
+void Rope::append(const Rope& other)
+{
+    changed();
+    root = join(root, retain(other.root));
+}
+
+void Rope::insert(size_t index, const Rope& other)
+{
+    Node* left = index > 0 ? sliceOf(root, 0, index) : nullptr;
+    Node* right = index < size() ? sliceOf(root, index, size()) : nullptr;
+    Node* middle = retain(other.root);
+
+    changed();
+    release(root);
+    root = join(join(left, middle), right);
+}
+
+void Rope::set(size_t index, char ch)
+{
+    Node* left = index > 0 ? sliceOf(root, 0, index) : nullptr;
+    Node* right = index + 1 < size() ? sliceOf(root, index + 1, size()) : nullptr;
+
+    changed();
+    release(root);
+    root = join(join(left, leaf(&ch, 1)), right);
+}
+
+void Rope::erase(size_t index)
+{
+    Node* left = index > 0 ? sliceOf(root, 0, index) : nullptr;
+    Node* right = index + 1 < size() ? sliceOf(root, index + 1, size()) : nullptr;
+
+    changed();
+    release(root);
+    root = join(left, right);
+}
+
+void Rope::clear()
+{
+    changed();
+    release(root);
+    root = nullptr;
+    freshBytes = 0;
+}
+
+Rope Rope::slice(size_t start, size_t end) const
+{
+    Rope res;
+    if (start < end)
+        res.root = res.sliceOf(root, start, end);
+
+    return res;
+}
+
+void Rope::appendTo(std::string& out) const
+{
+    out.reserve(out.size() + size());
+    forEachChunk([&out](const char* data, size_t length)
+    {
+        out.append(data, length);
+    });
+}
+
+const std::string& Rope::flatten() const
+{
+    if (flat == nullptr)
+    {
+        flat = new std::string();
+        appendTo(*flat);
+    }
+
+    return *flat;
+}
+
+bool Rope::equals(const Rope& other) const
+{
+    if (size() != other.size())
+        return false;
+
+    return root == other.root || flatten() == other.flatten();
+}
+
+}//ns
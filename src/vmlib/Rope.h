@@ -0,0 +1,191 @@
+#ifndef LAKE_ROPE_H
+#define LAKE_ROPE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <algorithm>
+
+namespace lake {
+
+/**
+ * Storage of a rope: a string kept as a balanced binary tree of chunks, for code that
+ * builds large strings a piece at a time.
+ *
+ * Concatenation and slicing are O(log n) and share the chunks they don't split, so
+ * copying a rope is O(1). The tree is kept AVL balanced by depth. Leaves hold up to
+ * LEAF_SIZE bytes; appending short pieces extends the last leaf in place as long as
+ * no other rope shares the path to it, which makes a rope a string builder as well.
+ *
+ * Nodes are reference counted with atomic counts, like those of PersistentVector.
+ * Clients needing contiguous characters, such as FFI and hashing, call flatten(),
+ * which caches the result until the rope changes.
+ */
+class Rope
+{
+public:
+
+    static constexpr size_t LEAF_SIZE = 512;
+
+    Rope() = default;
+
+    explicit Rope(const std::string& text);
+
+    /**
+     * Shares all nodes with the copy, which is O(1)
+     */
+    Rope(const Rope& copy);
+
+    Rope(Rope&& other);
+
+    Rope& operator=(const Rope&) = delete;
+
+    Rope& operator=(Rope&& other);
+
+    ~Rope();
+
+    /**
+     * Length in bytes
+     */
+    inline size_t size() const
+    {
+        return root != nullptr ? root->length : 0;
+    }
+
+    /**
+     * Depth of the tree, where a single leaf has depth 0
+     */
+    inline size_t depth() const
+    {
+        return root != nullptr ? root->depth : 0;
+    }
+
+    /**
+     * Returns the byte at 'index', which must be less than size()
+     */
+    char at(size_t index) const;
+
+    void append(const char* text, size_t length);
+
+    inline void append(const std::string& text)
+    {
+        append(text.data(), text.size());
+    }
+
+    /**
+     * Appends the contents of 'other', sharing its nodes
+     */
+    void append(const Rope& other);
+
+    /**
+     * Inserts the contents of 'other' before the byte at 'index'
+     */
+    void insert(size_t index, const Rope& other);
+
+    /**
+     * Replaces the byte at 'index'
+     */
+    void set(size_t index, char ch);
+
+    /**
+     * Removes the byte at 'index'
+     */
+    void erase(size_t index);
+
+    void clear();
+
+    /**
+     * Returns the bytes [start, end) as a rope sharing the nodes that aren't split
+     */
+    Rope slice(size_t start, size_t end) const;
+
+    /**
+     * Calls fn(const char* data, size_t length) for each chunk, in order
+     */
+    template <typename Fn>
+    void forEachChunk(Fn fn) const
+    {
+        if (root != nullptr)
+            visit(root, fn);
+    }
+
+    /**
+     * Appends the contents to 'out'
+     */
+    void appendTo(std::string& out) const;
+
+    /**
+     * The contents as a contiguous string. This is cached until the rope changes.
+     */
+    const std::string& flatten() const;
+
+    bool equals(const Rope& other) const;
+
+    /**
+     * The memory of the nodes allocated by this rope, as for PersistentVector. Nodes released
+     * by later changes aren't subtracted, so this is capped at the size of the whole tree. The
+     * cache of flatten() is not included, as it's created on reads.
+     */
+    inline size_t allocatedBytes() const
+    {
+        return root != nullptr ? std::min(freshBytes, root->bytes) : 0;
+    }
+
+private:
+
+    struct Node
+    {
+        Node();
+
+        std::atomic<uint32_t> refs;
+
+        // Leaves have depth 0
+        uint32_t depth;
+        size_t length;
+
+        // Memory of the subtree
+        size_t bytes;
+
+        Node* left;
+        Node* right;
+
+        // The characters of a leaf
+        std::string text;
+    };
+
+    template <typename Fn>
+    static void visit(const Node* node, Fn& fn)
+    {
+        if (node->depth == 0)
+            fn(node->text.data(), node->length);
+        else
+        {
+            visit(node->left, fn);
+            visit(node->right, fn);
+        }
+    }
+
+    // These return a new reference. Those taking non-const nodes take over the references passed.
+
+    Node* leaf(const char* text, size_t length);
+    Node* build(const char* text, size_t length);
+    Node* branch(Node* left, Node* right);
+    Node* join(Node* left, Node* right);
+    Node* balance(Node* left, Node* right);
+    Node* sliceOf(const Node* node, size_t start, size_t end);
+
+    static Node* retain(Node* node);
+    static void release(Node* node);
+
+    void changed();
+
+    Node* root = nullptr;
+    size_t freshBytes = 0;
+
+    mutable std::string* flat = nullptr;
+};
+
+}//ns
+
+#endif //LAKE_ROPE_H
@@ -0,0 +1,338 @@
+#ifndef LAKE_SLAB_H
+#define LAKE_SLAB_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace lake {
+
+/**
+ * Allocation statistics of a slab or the heap
+ */
+struct AllocStats
+{
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+
+    // Blocks in use, and the most blocks in use at any time. For slabs, the peak is
+    // sampled whenever the owner takes a batch of free blocks.
+    uint64_t live = 0;
+    uint64_t peak = 0;
+
+    // Memory reserved from the system
+    uint64_t chunks = 0;
+    uint64_t bytes = 0;
+};
+
+/**
+ * Fixed size allocator for VM structures which are not objects themselves, such as
+ * function data. Blocks are carved from large chunks and free blocks are chained
+ * through their first word, so allocate and free are constant time. Chunks are kept
+ * until the slab is destroyed.
+ *
+ * The thread owning the slab, usually the mutator, allocates and frees without locking.
+ * Other threads go through a Magazine, which caches free blocks locally and exchanges
+ * them with the slab's depot in batches, so locking is rare on either side.
+ *
+ * If huge pages are enabled, chunks are 2 MiB and backed by huge pages where the system
+ * supports it, which reduces TLB misses when a large number of blocks are in use.
+ */
+template<typename T>
+class Slab
+{
+    struct Block
+    {
+        Block* next;
+    };
+
+    // A list of free blocks moved between a magazine and the depot
+    struct Batch
+    {
+        Block* head;
+        size_t count;
+    };
+
+public:
+
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t HUGE_CHUNK_SIZE = 2 * 1024 * 1024;
+
+    static constexpr size_t BLOCK_ALIGN = alignof(T) > alignof(Block) ? alignof(T) : alignof(Block);
+    static constexpr size_t BLOCK_SIZE = ((sizeof(T) > sizeof(Block) ? sizeof(T) : sizeof(Block)) + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+
+    /**
+     * A cache of free blocks for a thread other than the owner
+     */
+    class Magazine
+    {
+    public:
+
+        // Number of blocks exchanged with the depot at a time
+        static constexpr size_t CAPACITY = 64;
+
+        explicit Magazine(Slab& slab) : slab(slab) {}
+        Magazine(const Magazine&) = delete;
+        Magazine& operator=(const Magazine&) = delete;
+
+        ~Magazine()
+        {
+            flush();
+        }
+
+        template<typename... Args>
+        T* create(Args&&... args)
+        {
+            if (cache.head == nullptr)
+                cache = slab.takeBatch();
+
+            Block* block = cache.head;
+            cache.head = block->next;
+            cache.count--;
+            allocations++;
+
+            return new (block) T(std::forward<Args>(args)...);
+        }
+
+        void destroy(T* ptr)
+        {
+            ptr->~T();
+
+            Block* block = (Block*) ptr;
+            block->next = cache.head;
+            cache.head = block;
+            frees++;
+
+            if (++cache.count >= 2 * CAPACITY)
+                flush();
+        }
+
+        /**
+         * Returns the cached blocks to the depot, and merges the statistics into the slab
+         */
+        void flush()
+        {
+            slab.putBatch(cache, allocations, frees);
+            cache = {nullptr, 0};
+            allocations = frees = 0;
+        }
+
+    private:
+
+        Slab& slab;
+        Batch cache {nullptr, 0};
+        uint64_t allocations = 0;
+        uint64_t frees = 0;
+    };
+
+    Slab() = default;
+    Slab(const Slab&) = delete;
+    Slab& operator=(const Slab&) = delete;
+
+    ~Slab()
+    {
+        for (auto& chunk : chunks)
+            releaseChunk(chunk.first, chunk.second);
+    }
+
+    /**
+     * Allocates a block and constructs it. Only called by the owner.
+     */
+    template<typename... Args>
+    inline T* create(Args&&... args)
+    {
+        if (freeList == nullptr)
+            refill();
+
+        Block* block = freeList;
+        freeList = block->next;
+
+        local.allocations++;
+
+        return new (block) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Destructs a block and frees it. Only called by the owner.
+     */
+    inline void destroy(T* ptr)
+    {
+        ptr->~T();
+
+        Block* block = (Block*) ptr;
+        block->next = freeList;
+        freeList = block;
+
+        local.frees++;
+    }
+
+    /**
+     * Backs chunks allocated from now on by huge pages, if available
+     */
+    void setHugePages(bool enable)
+    {
+        hugePages = enable;
+    }
+
+    /**
+     * Current statistics. Only called by the owner. Blocks cached by magazines count as
+     * live until flushed.
+     */
+    AllocStats stats()
+    {
+        std::lock_guard<std::mutex> lock(depotMutex);
+
+        AllocStats result = local;
+        result.allocations += remote.allocations;
+        result.frees += remote.frees;
+        result.live = result.allocations - result.frees;
+        result.peak = std::max(peak, result.live);
+        result.chunks = chunks.size();
+        result.bytes = reserved;
+        return result;
+    }
+
+private:
+
+    void refill()
+    {
+        std::lock_guard<std::mutex> lock(depotMutex);
+
+        if (depot.empty())
+            carve();
+
+        Batch batch = depot.back();
+        depot.pop_back();
+        freeList = batch.head;
+
+        peak = std::max(peak, local.allocations + remote.allocations - local.frees - remote.frees);
+    }
+
+    Batch takeBatch()
+    {
+        std::lock_guard<std::mutex> lock(depotMutex);
+
+        if (depot.empty())
+            carve();
+
+        Batch batch = depot.back();
+        depot.pop_back();
+        return batch;
+    }
+
+    void putBatch(Batch batch, uint64_t allocations, uint64_t frees)
+    {
+        std::lock_guard<std::mutex> lock(depotMutex);
+
+        if (batch.head != nullptr)
+            depot.push_back(batch);
+
+        remote.allocations += allocations;
+        remote.frees += frees;
+    }
+
+    /**
+     * Reserves a chunk and puts its blocks on the depot in batches. Called with the depot locked.
+     */
+    void carve()
+    {
+        size_t size = hugePages ? HUGE_CHUNK_SIZE : CHUNK_SIZE;
+        char* chunk = (char*) reserveChunk(size);
+        chunks.emplace_back(chunk, size);
+        reserved += size;
+
+        size_t count = size / BLOCK_SIZE;
+        for (size_t first = 0; first < count; first += Magazine::CAPACITY)
+        {
+            size_t last = std::min(first + Magazine::CAPACITY, count);
+            for (size_t i = first; i < last; i++)
+                ((Block*) (chunk + i * BLOCK_SIZE))->next = i + 1 < last ? (Block*) (chunk + (i + 1) * BLOCK_SIZE) : nullptr;
+
+            depot.push_back({(Block*) (chunk + first * BLOCK_SIZE), last - first});
+        }
+    }
+
+    void* reserveChunk(size_t size)
+    {
+        void* mem = nullptr;
+
+#ifdef __linux__
+        if (size == HUGE_CHUNK_SIZE)
+        {
+            mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mem != MAP_FAILED)
+                return mem;
+
+            // No reserved huge pages, so ask for transparent huge pages instead
+            mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED)
+                throw std::runtime_error("Out of memory allocating slab chunk");
+
+            madvise(mem, size, MADV_HUGEPAGE);
+            return mem;
+        }
+#endif
+
+#ifdef _WIN32
+        mem = _aligned_malloc(size, BLOCK_ALIGN);
+#else
+        if (posix_memalign(&mem, BLOCK_ALIGN < sizeof(void*) ? sizeof(void*) : BLOCK_ALIGN, size) != 0)
+            mem = nullptr;
+#endif
+
+        if (mem == nullptr)
+            throw std::runtime_error("Out of memory allocating slab chunk");
+
+        return mem;
+    }
+
+    void releaseChunk(void* chunk, size_t size)
+    {
+#ifdef __linux__
+        if (size == HUGE_CHUNK_SIZE)
+        {
+            munmap(chunk, size);
+            return;
+        }
+#endif
+
+#ifdef _WIN32
+        _aligned_free(chunk);
+#else
+        ::free(chunk);
+#endif
+    }
+
+    // Owner's free blocks and statistics
+    Block* freeList = nullptr;
+    AllocStats local;
+    uint64_t peak = 0;
+
+    bool hugePages = false;
+
+    // Batches of free blocks, shared with magazines
+    std::mutex depotMutex;
+    std::vector<Batch> depot;
+    AllocStats remote;
+
+    std::vector<std::pair<char*, size_t>> chunks;
+    uint64_t reserved = 0;
+};
+
+}//ns
+
+#endif //LAKE_SLAB_H
@@ -3,16 +3,8 @@
 
 namespace lake
 {
-    void Stack::mark()
+    void Stack::markChildren()
     {
-        if (hasFlag(FLAG_GC_REACHABLE) || !hasFlag(FLAG_GC_TRACKED))
-            return;
-
-        setFlag(FLAG_GC_REACHABLE);
-
-        for (auto& obj : items)
-        {
-            obj->mark();
-        }
+        markAll(items);
     }
 }
@@ -25,7 +25,7 @@ public:
      */
     std::vector<Object*> items;
 
-    void mark() override;
+    void markChildren() override;
 
     /**
      * Commit makes a note of the current size of the stack. Any data pushed after this
@@ -47,6 +47,11 @@ public:
      */
     inline ssize_t commitIndex() const { return commits.back()-1; }
 
+    /**
+     * Number of commits not yet reverted, including the initial implicit commit
+     */
+    inline size_t commitDepth() const { return commits.size(); }
+
     /**
      * Reverts the size to the last committed size. If commit() has not been called, the
      * entire stack is cleaned since there's an initial implicit commit whenever a stack
@@ -0,0 +1,114 @@
+#include "Sweeper.h"
+#include "VM.h"
+#include "Object.h"
+
+namespace lake {
+
+Sweeper::~Sweeper()
+{
+    if (thread.joinable())
+        thread.join();
+}
+
+void Sweeper::start(std::vector<Page*> detached)
+{
+    if (inFlight)
+        throw std::runtime_error("BUG: Background sweep already active");
+
+    inFlight = true;
+    completed.store(false, std::memory_order_relaxed);
+
+    pages = std::move(detached);
+    thread = std::thread(&Sweeper::run, this);
+}
+
+void Sweeper::run()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Slab<FunctionData>::Magazine functions(vm.fnpool);
+
+    for (Page* page : pages)
+    {
+        // Same rules as VM::sweepPage, without promotion
+        for (size_t word = 0; word < Page::WORDS; word++)
+        {
+            uint64_t dead = page->tracked[word] & ~page->marked[word];
+            page->marked[word] = 0;
+
+            Heap::forEachBit(dead, word * 64, [&](size_t index)
+            {
+                Object* obj = page->at(index);
+
+                if ((__atomic_load_n(&obj->flags, __ATOMIC_RELAXED) & FLAG_GC_PINNED) != 0)
+                    return;
+
+                freedExternalBytes += (int64_t) obj->ownedBytes();
+                freedSlotBytes += page->slotSize;
+
+                // The number cache is only used by the mutator, so values are merged by finish()
+                if (obj->isInteger())
+                    ints.push_back(*obj->mpz);
+                else if (obj->isFloat())
+                    floats.push_back(*obj->mpf);
+                else if (obj->otype == TokenType::TypeFunction && obj->fndata != nullptr)
+                    functions.destroy(obj->fndata);
+                else
+                    obj->destructHeapData();
+
+                if (obj->gcstate == 0)
+                    freedYoung++;
+
+                obj->otype = TokenType::InvalidCollected;
+                obj->ptr_value = nullptr;
+
+                Heap::freeDetached(page, index);
+                freed++;
+            });
+        }
+
+        vm.heap.giveBack(page);
+    }
+
+    pages.clear();
+    functions.flush();
+
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    completed.store(true, std::memory_order_release);
+}
+
+void Sweeper::finish()
+{
+    if (!inFlight)
+        return;
+
+    thread.join();
+    inFlight = false;
+
+    for (auto& value : ints)
+        vm.numcache.release(&value);
+
+    for (auto& value : floats)
+        vm.numcache.release(&value);
+
+    ints.clear();
+    floats.clear();
+
+    vm.heap.reattach((uint64_t) freed, freedSlotBytes);
+    vm.heap.releaseEmptyPages();
+
+    vm.numObjects -= freed;
+    vm.numYoung -= freedYoung;
+    vm.externalBytes -= freedExternalBytes;
+    vm.cycle.bytesFreed += (int64_t) freedSlotBytes + freedExternalBytes;
+    vm.cycle.objectsFreed += freed;
+    vm.cycle.sweepMicros = Histogram::micros(elapsed);
+    totalFreed += freed;
+    freed = freedYoung = freedExternalBytes = 0;
+    freedSlotBytes = 0;
+
+    vm.paceCollections();
+}
+
+}//ns
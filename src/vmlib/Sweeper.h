@@ -0,0 +1,95 @@
+#ifndef LAKE_SWEEPER_H
+#define LAKE_SWEEPER_H
+
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <mpir.h>
+
+namespace lake {
+
+class VM;
+class Object;
+struct Page;
+
+/**
+ * Sweeps the heap on a background thread, after a full collection has marked it.
+ *
+ * When marking completes, the VM detaches the heap pages and hands them to the sweeper.
+ * The mutator resumes allocating from new pages, and from pages the sweeper has handed
+ * back. For each page, the sweeper destructs unreachable objects, puts their slots on
+ * the page's free list, and clears the mark bitmap.
+ *
+ * Everything the mutator can reach after marking is either marked or tracked after the
+ * pages were detached, so the mutator and the sweeper never access the same unreachable
+ * object. Objects may be pinned by the mutator while being swept, so their flags are
+ * read atomically. Objects on detached pages which are tracked during the sweep are
+ * added to the bitmaps when the sweep is finished; see Heap.
+ *
+ * GMP values are returned to the number cache by finish(), as it's only used by the
+ * mutator. Function data is freed through a magazine of the function slab.
+ */
+class Sweeper
+{
+public:
+
+    explicit Sweeper(VM& vm) : vm(vm) {}
+    Sweeper(const Sweeper&) = delete;
+    Sweeper& operator=(const Sweeper&) = delete;
+
+    ~Sweeper();
+
+    /**
+     * Starts sweeping the detached heap pages. A sweep must not be active.
+     */
+    void start(std::vector<Page*> pages);
+
+    /**
+     * True from start() until finish(). Only used by the mutator.
+     */
+    inline bool active() const
+    {
+        return inFlight;
+    }
+
+    /**
+     * True if the active sweep has completed, so finish() won't block
+     */
+    inline bool done() const
+    {
+        return completed.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Waits for the active sweep, if any, and merges its results into the VM
+     */
+    void finish();
+
+    // Objects collected by background sweeps
+    uint64_t totalFreed = 0;
+
+private:
+
+    void run();
+
+    VM& vm;
+    std::thread thread;
+    bool inFlight = false;
+    std::atomic<bool> completed {false};
+
+    // Owned by the sweeper thread until completed
+    std::vector<Page*> pages;
+    int64_t freed = 0;
+    int64_t freedYoung = 0;
+    int64_t freedExternalBytes = 0;
+    size_t freedSlotBytes = 0;
+    std::chrono::steady_clock::duration elapsed {0};
+    std::vector<__mpz_struct> ints;
+    std::vector<__mpf_struct> floats;
+};
+
+}//ns
+
+#endif //LAKE_SWEEPER_H
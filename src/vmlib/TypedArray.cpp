@@ -0,0 +1,771 @@
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include "TypedArray.h"
+#include "Object.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// The kernels are plain loops which the compiler vectorizes. Where supported, the functions
+// running them are also compiled for AVX2, and the best version is picked at load time.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && !defined(_WIN32)
+    #define LAKE_SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+    #define LAKE_SIMD_CLONES
+#endif
+
+#ifdef _MSC_VER
+    #define LAKE_FORCE_INLINE __forceinline
+#else
+    #define LAKE_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace lake {
+
+static char* allocateElements(size_t bytes)
+{
+    void* mem = nullptr;
+
+    // Rounded up, so kernels may use full vector stores on the aligned buffer
+    bytes = (bytes + TypedArray::ALIGN - 1) & ~(TypedArray::ALIGN - 1);
+
+#ifdef _WIN32
+    mem = _aligned_malloc(bytes, TypedArray::ALIGN);
+#else
+    if (posix_memalign(&mem, TypedArray::ALIGN, bytes) != 0)
+        mem = nullptr;
+#endif
+
+    if (mem == nullptr)
+        throw std::runtime_error("Out of memory allocating typed array");
+
+    return (char*) mem;
+}
+
+static void releaseElements(char* mem)
+{
+#ifdef _WIN32
+    _aligned_free(mem);
+#else
+    ::free(mem);
+#endif
+}
+
+TypedArray::TypedArray(Kind kind, size_t capacity) : elementKind(kind)
+{
+    reserve(capacity);
+}
+
+TypedArray::TypedArray(const TypedArray& copy) : TypedArray(copy, 0, copy.count)
+{
+}
+
+TypedArray::TypedArray(const TypedArray& copy, size_t start, size_t end) : elementKind(copy.elementKind)
+{
+    if (start > end || end > copy.count)
+        throw std::runtime_error("Typed array range is out of bounds");
+
+    resize(end - start);
+
+    if (count > 0)
+        memcpy(buffer, copy.buffer + start * elementSize(), count * elementSize());
+}
+
+TypedArray::~TypedArray()
+{
+    if (buffer != nullptr)
+        releaseElements(buffer);
+}
+
+void TypedArray::reserve(size_t capacity)
+{
+    if (capacity <= cap)
+        return;
+
+    char* grown = allocateElements(capacity * elementSize());
+
+    if (buffer != nullptr)
+    {
+        memcpy(grown, buffer, count * elementSize());
+        releaseElements(buffer);
+    }
+
+    buffer = grown;
+    cap = capacity;
+}
+
+void TypedArray::resize(size_t size)
+{
+    if (size > cap)
+        reserve(std::max(size, cap * 2));
+
+    if (size > count)
+        memset(buffer + count * elementSize(), 0, (size - count) * elementSize());
+
+    count = size;
+}
+
+int64_t TypedArray::toInt64(Object* value)
+{
+    if (value->isInteger())
+    {
+        if (!mpz_fits_slong_p(value->mpz))
+            throw std::runtime_error("Integer is out of range for an int64 array element");
+
+        return (int64_t) mpz_get_si(value->mpz);
+    }
+    else if (value->isDouble() || value->isFloat())
+    {
+        double d = value->isDouble() ? value->double_value : mpf_get_d(value->mpf);
+        if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0))
+            throw std::runtime_error("Number is out of range for an int64 array element");
+
+        return (int64_t) d;
+    }
+    else
+        throw std::runtime_error("Typed array elements must be numbers");
+}
+
+double TypedArray::toFloat64(Object* value)
+{
+    if (value->isDouble())
+        return value->double_value;
+    else if (value->isFloat())
+        return mpf_get_d(value->mpf);
+    else if (value->isInteger())
+        return mpz_get_d(value->mpz);
+    else
+        throw std::runtime_error("Typed array elements must be numbers");
+}
+
+uint8_t TypedArray::toUint8(Object* value)
+{
+    int64_t v = toInt64(value);
+    if (v < 0 || v > 255)
+        throw std::runtime_error("Number is out of range for a _uint8 array element");
+
+    return (uint8_t) v;
+}
+
+size_t TypedArray::checkIndex(int64_t index) const
+{
+    if (index == -1 && count > 0)
+        return count - 1;
+
+    if (index < 0 || (size_t) index >= count)
+        throw std::runtime_error("Typed array index is out of range");
+
+    return (size_t) index;
+}
+
+Object* TypedArray::get(int64_t index) const
+{
+    size_t i = checkIndex(index);
+
+    if (elementKind == Kind::Int64)
+        return Object::makeInt(data<int64_t>()[i]);
+    else if (elementKind == Kind::Float64)
+        return Object::makeDouble(data<double>()[i]);
+    else
+        return Object::makeInt((int64_t) data<uint8_t>()[i]);
+}
+
+void TypedArray::set(int64_t index, Object* value)
+{
+    size_t i = checkIndex(index);
+
+    if (elementKind == Kind::Int64)
+        data<int64_t>()[i] = toInt64(value);
+    else if (elementKind == Kind::Float64)
+        data<double>()[i] = toFloat64(value);
+    else
+        data<uint8_t>()[i] = toUint8(value);
+}
+
+void TypedArray::append(Object* value)
+{
+    insert(count, value);
+}
+
+void TypedArray::insert(size_t index, Object* value)
+{
+    if (index > count)
+        throw std::runtime_error("Typed array index is out of range");
+
+    // Convert first, so a bad value leaves the array unchanged
+    int64_t i64 = 0;
+    double f64 = 0;
+    uint8_t u8 = 0;
+
+    if (elementKind == Kind::Int64)
+        i64 = toInt64(value);
+    else if (elementKind == Kind::Float64)
+        f64 = toFloat64(value);
+    else
+        u8 = toUint8(value);
+
+    resize(count + 1);
+
+    size_t width = elementSize();
+    memmove(buffer + (index + 1) * width, buffer + index * width, (count - 1 - index) * width);
+
+    if (elementKind == Kind::Int64)
+        data<int64_t>()[index] = i64;
+    else if (elementKind == Kind::Float64)
+        data<double>()[index] = f64;
+    else
+        data<uint8_t>()[index] = u8;
+}
+
+void TypedArray::erase(int64_t index)
+{
+    if (index == -1 && count == 0)
+        return;
+
+    size_t i = checkIndex(index);
+    size_t width = elementSize();
+
+    memmove(buffer + i * width, buffer + (i + 1) * width, (count - 1 - i) * width);
+    count--;
+}
+
+void TypedArray::reverse()
+{
+    if (elementKind == Kind::Int64)
+        std::reverse(data<int64_t>(), data<int64_t>() + count);
+    else if (elementKind == Kind::Float64)
+        std::reverse(data<double>(), data<double>() + count);
+    else
+        std::reverse(data<uint8_t>(), data<uint8_t>() + count);
+}
+
+bool TypedArray::contains(Object* value) const
+{
+    if (!value->isNumeric())
+        return false;
+
+    if (elementKind == Kind::Float64)
+    {
+        double d = toFloat64(value);
+        return std::find(data<double>(), data<double>() + count, d) != data<double>() + count;
+    }
+
+    // Values which can't be an element are simply not found
+    if (value->isInteger() && !mpz_fits_slong_p(value->mpz))
+        return false;
+
+    int64_t v = value->isInteger() ? (int64_t) mpz_get_si(value->mpz) : 0;
+    if (!value->isInteger())
+    {
+        double d = toFloat64(value);
+        if (d != (double) (int64_t) d)
+            return false;
+
+        v = (int64_t) d;
+    }
+
+    if (elementKind == Kind::Int64)
+        return std::find(data<int64_t>(), data<int64_t>() + count, v) != data<int64_t>() + count;
+    else if (v < 0 || v > 255)
+        return false;
+    else
+        return memchr(buffer, (int) v, count) != nullptr;
+}
+
+/*
+ * Kernels. Each applies an operation to every element, with the operands given either
+ * as two arrays, an array and a scalar, or a scalar and an array. The loops are forced
+ * inline into the dispatchers below, so they're vectorized for each target the
+ * dispatchers are compiled for.
+ */
+
+enum class Form : uint8_t { ArrayArray, ArrayScalar, ScalarArray };
+
+template <typename Kernel, typename T, typename R>
+static LAKE_FORCE_INLINE void runKernel(Form form, R* __restrict out, const T* __restrict a, const T* __restrict b, T sa, T sb, size_t n)
+{
+    if (form == Form::ArrayArray)
+    {
+        for (size_t i = 0; i < n; i++)
+            out[i] = Kernel::apply(a[i], b[i]);
+    }
+    else if (form == Form::ArrayScalar)
+    {
+        for (size_t i = 0; i < n; i++)
+            out[i] = Kernel::apply(a[i], sb);
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+            out[i] = Kernel::apply(sa, b[i]);
+    }
+}
+
+// Integer arithmetic goes through unsigned types, where overflow wraps rather than being undefined
+struct AddElements
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a + (uint64_t) b); }
+    static LAKE_FORCE_INLINE uint8_t apply(uint8_t a, uint8_t b) { return (uint8_t) (a + b); }
+    static LAKE_FORCE_INLINE double apply(double a, double b) { return a + b; }
+};
+
+struct SubElements
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a - (uint64_t) b); }
+    static LAKE_FORCE_INLINE uint8_t apply(uint8_t a, uint8_t b) { return (uint8_t) (a - b); }
+    static LAKE_FORCE_INLINE double apply(double a, double b) { return a - b; }
+};
+
+struct MulElements
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a * (uint64_t) b); }
+    static LAKE_FORCE_INLINE uint8_t apply(uint8_t a, uint8_t b) { return (uint8_t) (a * b); }
+    static LAKE_FORCE_INLINE double apply(double a, double b) { return a * b; }
+};
+
+// Divisors are checked for zero before the kernel runs
+struct DivElements
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return b == -1 ? (int64_t) (0 - (uint64_t) a) : a / b; }
+    static LAKE_FORCE_INLINE uint8_t apply(uint8_t a, uint8_t b) { return (uint8_t) (a / b); }
+    static LAKE_FORCE_INLINE double apply(double a, double b) { return a / b; }
+};
+
+#define LAKE_COMPARE_ELEMENTS(Name, op) \
+    struct Name \
+    { \
+        template <typename T> \
+        static LAKE_FORCE_INLINE uint8_t apply(T a, T b) { return (uint8_t) (a op b); } \
+    };
+
+LAKE_COMPARE_ELEMENTS(EqualElements, ==)
+LAKE_COMPARE_ELEMENTS(NotEqualElements, !=)
+LAKE_COMPARE_ELEMENTS(LessElements, <)
+LAKE_COMPARE_ELEMENTS(LessEqualElements, <=)
+LAKE_COMPARE_ELEMENTS(GreaterElements, >)
+LAKE_COMPARE_ELEMENTS(GreaterEqualElements, >=)
+
+#undef LAKE_COMPARE_ELEMENTS
+
+template <typename T>
+static LAKE_FORCE_INLINE void arithKernel(TypedArray::Op op, Form form, T* out, const T* a, const T* b, T sa, T sb, size_t n)
+{
+    switch (op)
+    {
+        case TypedArray::Op::Add: runKernel<AddElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Op::Sub: runKernel<SubElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Op::Mul: runKernel<MulElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Op::Div: runKernel<DivElements>(form, out, a, b, sa, sb, n); break;
+    }
+}
+
+template <typename T>
+static LAKE_FORCE_INLINE void compareKernel(TypedArray::Cmp cmp, Form form, uint8_t* out, const T* a, const T* b, T sa, T sb, size_t n)
+{
+    switch (cmp)
+    {
+        case TypedArray::Cmp::Equal: runKernel<EqualElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Cmp::NotEqual: runKernel<NotEqualElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Cmp::Less: runKernel<LessElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Cmp::LessEqual: runKernel<LessEqualElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Cmp::Greater: runKernel<GreaterElements>(form, out, a, b, sa, sb, n); break;
+        case TypedArray::Cmp::GreaterEqual: runKernel<GreaterEqualElements>(form, out, a, b, sa, sb, n); break;
+    }
+}
+
+template <typename T>
+static LAKE_FORCE_INLINE void fillKernel(T* __restrict out, T value, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = value;
+}
+
+// Dispatchers, one per element type, since function templates can't be cloned per target
+
+LAKE_SIMD_CLONES
+static void arithInt64(TypedArray::Op op, Form form, int64_t* out, const int64_t* a, const int64_t* b, int64_t sa, int64_t sb, size_t n)
+{
+    arithKernel(op, form, out, a, b, sa, sb, n);
+}
+
+LAKE_SIMD_CLONES
+static void arithFloat64(TypedArray::Op op, Form form, double* out, const double* a, const double* b, double sa, double sb, size_t n)
+{
+    arithKernel(op, form, out, a, b, sa, sb, n);
+}
+
+LAKE_SIMD_CLONES
+static void arithUint8(TypedArray::Op op, Form form, uint8_t* out, const uint8_t* a, const uint8_t* b, uint8_t sa, uint8_t sb, size_t n)
+{
+    arithKernel(op, form, out, a, b, sa, sb, n);
+}
+
+LAKE_SIMD_CLONES
+static void compareInt64(TypedArray::Cmp cmp, Form form, uint8_t* out, const int64_t* a, const int64_t* b, int64_t sa, int64_t sb, size_t n)
+{
+    compareKernel(cmp, form, out, a, b, sa, sb, n);
+}
+
+LAKE_SIMD_CLONES
+static void compareFloat64(TypedArray::Cmp cmp, Form form, uint8_t* out, const double* a, const double* b, double sa, double sb, size_t n)
+{
+    compareKernel(cmp, form, out, a, b, sa, sb, n);
+}
+
+LAKE_SIMD_CLONES
+static void compareUint8(TypedArray::Cmp cmp, Form form, uint8_t* out, const uint8_t* a, const uint8_t* b, uint8_t sa, uint8_t sb, size_t n)
+{
+    compareKernel(cmp, form, out, a, b, sa, sb, n);
+}
+
+LAKE_SIMD_CLONES
+static void fillInt64(int64_t* out, int64_t value, size_t n)
+{
+    fillKernel(out, value, n);
+}
+
+LAKE_SIMD_CLONES
+static void fillFloat64(double* out, double value, size_t n)
+{
+    fillKernel(out, value, n);
+}
+
+void TypedArray::fill(Object* value, size_t size)
+{
+    if (elementKind == Kind::Int64)
+    {
+        int64_t v = toInt64(value);
+        resize(size);
+        fillInt64(data<int64_t>(), v, count);
+    }
+    else if (elementKind == Kind::Float64)
+    {
+        double v = toFloat64(value);
+        resize(size);
+        fillFloat64(data<double>(), v, count);
+    }
+    else
+    {
+        uint8_t v = toUint8(value);
+        resize(size);
+        memset(buffer, v, count);
+    }
+}
+
+/**
+ * Operands of an element-wise operation: the array operands, and the scalar operand if any
+ */
+struct Operands
+{
+    Operands(Object* lhs, Object* rhs)
+    {
+        if (lhs->isTypedArray() && rhs->isTypedArray())
+        {
+            if (lhs->typed->kind() != rhs->typed->kind())
+                throw std::runtime_error("Typed array operands must have the same element type");
+            if (lhs->typed->size() != rhs->typed->size())
+                throw std::runtime_error("Typed array operands must have the same size");
+
+            form = Form::ArrayArray;
+        }
+        else if (lhs->isTypedArray())
+        {
+            form = Form::ArrayScalar;
+            scalar = rhs;
+        }
+        else if (rhs->isTypedArray())
+        {
+            form = Form::ScalarArray;
+            scalar = lhs;
+        }
+        else
+            throw std::runtime_error("Expected a typed array operand");
+
+        a = form == Form::ScalarArray ? nullptr : lhs->typed;
+        b = form == Form::ArrayScalar ? nullptr : rhs->typed;
+        array = a != nullptr ? a : b;
+    }
+
+    // Pointer to the elements of an array operand, or null for the scalar operand
+    template <typename T>
+    static const T* elements(TypedArray* operand)
+    {
+        return operand != nullptr ? operand->data<T>() : nullptr;
+    }
+
+    Form form;
+    TypedArray* a;
+    TypedArray* b;
+    TypedArray* array;
+    Object* scalar = nullptr;
+};
+
+TypedArray* TypedArray::arith(Op op, Object* lhs, Object* rhs)
+{
+    Operands operands(lhs, rhs);
+    Kind kind = operands.array->kind();
+    size_t n = operands.array->size();
+
+    TypedArray* res = new TypedArray(kind);
+    res->resize(n);
+
+    const bool scalarLhs = operands.form == Form::ScalarArray;
+
+    if (kind == Kind::Int64 || kind == Kind::Uint8)
+    {
+        int64_t s = operands.scalar != nullptr ? (kind == Kind::Int64 ? toInt64(operands.scalar) : toUint8(operands.scalar)) : 0;
+
+        // Check the divisors, which are all non-zero for integer division to be defined
+        if (op == Op::Div)
+        {
+            bool zero = false;
+            if (operands.form == Form::ArrayScalar)
+                zero = s == 0;
+            else if (kind == Kind::Int64)
+                zero = std::find(operands.b->data<int64_t>(), operands.b->data<int64_t>() + n, 0) != operands.b->data<int64_t>() + n;
+            else
+                zero = memchr(operands.b->raw(), 0, n) != nullptr;
+
+            if (zero)
+            {
+                delete res;
+                throw std::runtime_error("Division by zero in typed array");
+            }
+        }
+
+        if (kind == Kind::Int64)
+        {
+            arithInt64(op, operands.form, res->data<int64_t>(), Operands::elements<int64_t>(operands.a),
+                       Operands::elements<int64_t>(operands.b), scalarLhs ? s : 0, scalarLhs ? 0 : s, n);
+        }
+        else
+        {
+            arithUint8(op, operands.form, res->data<uint8_t>(), Operands::elements<uint8_t>(operands.a),
+                       Operands::elements<uint8_t>(operands.b), (uint8_t) (scalarLhs ? s : 0), (uint8_t) (scalarLhs ? 0 : s), n);
+        }
+    }
+    else
+    {
+        double s = operands.scalar != nullptr ? toFloat64(operands.scalar) : 0;
+
+        arithFloat64(op, operands.form, res->data<double>(), Operands::elements<double>(operands.a),
+                     Operands::elements<double>(operands.b), scalarLhs ? s : 0, scalarLhs ? 0 : s, n);
+    }
+
+    return res;
+}
+
+TypedArray* TypedArray::compare(Cmp cmp, Object* lhs, Object* rhs)
+{
+    Operands operands(lhs, rhs);
+    Kind kind = operands.array->kind();
+    size_t n = operands.array->size();
+
+    const bool scalarLhs = operands.form == Form::ScalarArray;
+
+    // Convert the scalar before allocating, as it may be out of range
+    int64_t si = 0;
+    double sd = 0;
+    if (operands.scalar != nullptr)
+    {
+        if (kind == Kind::Int64)
+            si = toInt64(operands.scalar);
+        else if (kind == Kind::Uint8)
+            si = toUint8(operands.scalar);
+        else
+            sd = toFloat64(operands.scalar);
+    }
+
+    TypedArray* res = new TypedArray(Kind::Uint8);
+    res->resize(n);
+
+    if (kind == Kind::Int64)
+    {
+        compareInt64(cmp, operands.form, res->data<uint8_t>(), Operands::elements<int64_t>(operands.a),
+                     Operands::elements<int64_t>(operands.b), scalarLhs ? si : 0, scalarLhs ? 0 : si, n);
+    }
+    else if (kind == Kind::Uint8)
+    {
+        compareUint8(cmp, operands.form, res->data<uint8_t>(), Operands::elements<uint8_t>(operands.a),
+                     Operands::elements<uint8_t>(operands.b), (uint8_t) (scalarLhs ? si : 0), (uint8_t) (scalarLhs ? 0 : si), n);
+    }
+    else
+    {
+        compareFloat64(cmp, operands.form, res->data<uint8_t>(), Operands::elements<double>(operands.a),
+                       Operands::elements<double>(operands.b), scalarLhs ? sd : 0, scalarLhs ? 0 : sd, n);
+    }
+
+    return res;
+}
+
+/*
+ * Reduction kernels. Partial results are kept in lanes, one per element of two vector
+ * registers, which the compiler combines with element-wise vector instructions. The lanes
+ * are folded at the end, so floating point reductions don't need reassociation enabled.
+ */
+
+struct SumReduction
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a + (uint64_t) b); }
+    static LAKE_FORCE_INLINE double apply(double a, double b) { return a + b; }
+};
+
+struct ProductReduction
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a * (uint64_t) b); }
+    static LAKE_FORCE_INLINE double apply(double a, double b) { return a * b; }
+};
+
+struct MinReduction
+{
+    template <typename A>
+    static LAKE_FORCE_INLINE A apply(A a, A b) { return b < a ? b : a; }
+};
+
+struct MaxReduction
+{
+    template <typename A>
+    static LAKE_FORCE_INLINE A apply(A a, A b) { return b > a ? b : a; }
+};
+
+struct AndReduction
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return a & b; }
+};
+
+struct OrReduction
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return a | b; }
+};
+
+struct XorReduction
+{
+    static LAKE_FORCE_INLINE int64_t apply(int64_t a, int64_t b) { return a ^ b; }
+};
+
+template <typename Kernel, typename A, typename T>
+static LAKE_FORCE_INLINE A runReduction(const T* __restrict a, size_t n, A identity)
+{
+    constexpr size_t LANES = 2 * TypedArray::ALIGN / sizeof(A);
+
+    A lanes[LANES];
+    for (size_t j = 0; j < LANES; j++)
+        lanes[j] = identity;
+
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+    {
+        for (size_t j = 0; j < LANES; j++)
+            lanes[j] = Kernel::apply(lanes[j], (A) a[i + j]);
+    }
+
+    A res = identity;
+    for (size_t j = 0; j < LANES; j++)
+        res = Kernel::apply(res, lanes[j]);
+
+    for (; i < n; i++)
+        res = Kernel::apply(res, (A) a[i]);
+
+    return res;
+}
+
+template <typename T>
+static LAKE_FORCE_INLINE int64_t intReduction(Reduction reduction, const T* a, size_t n)
+{
+    switch (reduction)
+    {
+        case Reduction::Sum: return runReduction<SumReduction>(a, n, (int64_t) 0);
+        case Reduction::Product: return runReduction<ProductReduction>(a, n, (int64_t) 1);
+        case Reduction::Min: return runReduction<MinReduction>(a, n, (int64_t) a[0]);
+        case Reduction::Max: return runReduction<MaxReduction>(a, n, (int64_t) a[0]);
+        case Reduction::Count: return (int64_t) n;
+        case Reduction::And: return runReduction<AndReduction>(a, n, (int64_t) -1);
+        case Reduction::Or: return runReduction<OrReduction>(a, n, (int64_t) 0);
+        case Reduction::Xor: return runReduction<XorReduction>(a, n, (int64_t) 0);
+    }
+
+    return 0;
+}
+
+LAKE_SIMD_CLONES
+static int64_t reduceInt64(Reduction reduction, const int64_t* a, size_t n)
+{
+    return intReduction(reduction, a, n);
+}
+
+LAKE_SIMD_CLONES
+static int64_t reduceUint8(Reduction reduction, const uint8_t* a, size_t n)
+{
+    return intReduction(reduction, a, n);
+}
+
+LAKE_SIMD_CLONES
+static double reduceFloat64(Reduction reduction, const double* a, size_t n)
+{
+    switch (reduction)
+    {
+        case Reduction::Sum: return runReduction<SumReduction>(a, n, 0.0);
+        case Reduction::Product: return runReduction<ProductReduction>(a, n, 1.0);
+        case Reduction::Min: return runReduction<MinReduction>(a, n, a[0]);
+        case Reduction::Max: return runReduction<MaxReduction>(a, n, a[0]);
+        default: return (double) n;
+    }
+}
+
+int64_t TypedArray::reduceInt(Reduction reduction, size_t start, size_t end) const
+{
+    if (start > end || end > count)
+        throw std::runtime_error("Typed array range is out of bounds");
+    if (elementKind == Kind::Float64)
+        throw std::runtime_error("Expected an int64 or _uint8 typed array");
+    if (start == end && (reduction == Reduction::Min || reduction == Reduction::Max))
+        throw std::runtime_error("Cannot reduce an empty range to a minimum or maximum");
+
+    if (elementKind == Kind::Int64)
+        return reduceInt64(reduction, data<int64_t>() + start, end - start);
+    else
+        return reduceUint8(reduction, data<uint8_t>() + start, end - start);
+}
+
+double TypedArray::reduceFloat(Reduction reduction, size_t start, size_t end) const
+{
+    if (start > end || end > count)
+        throw std::runtime_error("Typed array range is out of bounds");
+    if (elementKind != Kind::Float64)
+        throw std::runtime_error("Expected an f64 typed array");
+    if (start == end && (reduction == Reduction::Min || reduction == Reduction::Max))
+        throw std::runtime_error("Cannot reduce an empty range to a minimum or maximum");
+    if (reduction == Reduction::And || reduction == Reduction::Or || reduction == Reduction::Xor)
+        throw std::runtime_error("Bitwise reductions require integer elements");
+
+    return reduceFloat64(reduction, data<double>() + start, end - start);
+}
+
+bool TypedArray::kindOf(TokenType type, Kind& kind)
+{
+    if (type == TokenType::TypeInt)
+        kind = Kind::Int64;
+    else if (type == TokenType::TypeDouble)
+        kind = Kind::Float64;
+    else if (type == TokenType::TypeViewUint8)
+        kind = Kind::Uint8;
+    else
+        return false;
+
+    return true;
+}
+
+const char* TypedArray::kindName(Kind kind)
+{
+    if (kind == Kind::Int64)
+        return TOK_TYPEINT;
+    else if (kind == Kind::Float64)
+        return TOK_TYPEDOUBLE;
+    else
+        return TOK_TYPEVIEWUINT8;
+}
+
+}//ns
@@ -0,0 +1,187 @@
+#ifndef LAKE_TYPEDARRAY_H
+#define LAKE_TYPEDARRAY_H
+
+#include <cstdint>
+#include <cstddef>
+#include "VMTypes.h"
+
+namespace lake {
+
+class Object;
+
+/**
+ * Reduction operators built into accumulate. Count counts the elements; the bitwise
+ * operators are logical operators when applied to bools.
+ */
+enum class Reduction : uint8_t { Sum, Product, Min, Max, Count, And, Or, Xor };
+
+/**
+ * Storage of a typed array: a homogeneous array of raw int64, f64 or byte elements,
+ * kept contiguously in a buffer aligned for vector loads.
+ *
+ * Elements are boxed when read through the coll instructions, and unboxed when written.
+ * Integers written to an int64 array must fit in 64 bits, and to a byte array in 0..255.
+ * Doubles written to an int64 array are truncated.
+ *
+ * Element-wise arithmetic and comparison produce a new array, using kernels the compiler
+ * vectorizes. Either operand may be a scalar, which is then applied to every element.
+ * Integer arithmetic wraps around, like the corresponding C types, except that dividing
+ * by zero is an error. Comparisons produce a byte array of 0 and 1 elements, and compare
+ * floats exactly.
+ */
+class TypedArray
+{
+public:
+
+    enum class Kind : uint8_t { Int64, Float64, Uint8 };
+
+    enum class Op : uint8_t { Add, Sub, Mul, Div };
+
+    enum class Cmp : uint8_t { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+    // Alignment of the element buffer; the width of an AVX register
+    static constexpr size_t ALIGN = 32;
+
+    explicit TypedArray(Kind kind, size_t capacity = 0);
+
+    TypedArray(const TypedArray& copy);
+
+    /**
+     * Copies the elements in [start, end)
+     */
+    TypedArray(const TypedArray& copy, size_t start, size_t end);
+
+    TypedArray& operator=(const TypedArray&) = delete;
+
+    ~TypedArray();
+
+    inline Kind kind() const
+    {
+        return elementKind;
+    }
+
+    inline size_t size() const
+    {
+        return count;
+    }
+
+    inline size_t capacity() const
+    {
+        return cap;
+    }
+
+    inline size_t elementSize() const
+    {
+        return elementSize(elementKind);
+    }
+
+    static inline size_t elementSize(Kind kind)
+    {
+        return kind == Kind::Uint8 ? 1 : 8;
+    }
+
+    // Start of the elements, which is what FFI calls are passed
+    inline void* raw() const
+    {
+        return buffer;
+    }
+
+    template <typename T>
+    inline T* data() const
+    {
+        return (T*) buffer;
+    }
+
+    void reserve(size_t capacity);
+
+    /**
+     * Sets the number of elements. New elements are zero.
+     */
+    void resize(size_t size);
+
+    inline void clear()
+    {
+        count = 0;
+    }
+
+    /**
+     * Returns the element at 'index' as a number object. An index of -1 refers to the last element.
+     */
+    Object* get(int64_t index) const;
+
+    /**
+     * Sets the element at 'index'. An index of -1 refers to the last element.
+     */
+    void set(int64_t index, Object* value);
+
+    void append(Object* value);
+
+    void insert(size_t index, Object* value);
+
+    /**
+     * Removes the element at 'index'. An index of -1 removes the last element, if any.
+     */
+    void erase(int64_t index);
+
+    void reverse();
+
+    bool contains(Object* value) const;
+
+    /**
+     * Resizes the array to 'size' elements, all set to 'value'
+     */
+    void fill(Object* value, size_t size);
+
+    /**
+     * Element-wise arithmetic. At least one operand is a typed array; arrays must have
+     * the same kind and size.
+     */
+    static TypedArray* arith(Op op, Object* lhs, Object* rhs);
+
+    /**
+     * Element-wise comparison, producing a byte array
+     */
+    static TypedArray* compare(Cmp cmp, Object* lhs, Object* rhs);
+
+    /**
+     * Reduces the elements in [start, end) of an int64 or byte array. Int64 elements are
+     * reduced with wrap-around arithmetic, and bytes are widened to int64 first. Min and
+     * max require a non-empty range.
+     */
+    int64_t reduceInt(Reduction reduction, size_t start, size_t end) const;
+
+    /**
+     * Reduces the elements in [start, end) of an f64 array. The elements may be combined
+     * in any order, so sums and products can differ from a sequential loop in the last
+     * bits. Bitwise reductions are not supported.
+     */
+    double reduceFloat(Reduction reduction, size_t start, size_t end) const;
+
+    /**
+     * Maps an element type token (int, f64 or _uint8) to a kind. Returns false for other tokens.
+     */
+    static bool kindOf(TokenType type, Kind& kind);
+
+    /**
+     * Element type name, as used in source
+     */
+    static const char* kindName(Kind kind);
+
+private:
+
+    // Unboxes a number to the representation of the given kind, checking its range
+    static int64_t toInt64(Object* value);
+    static double toFloat64(Object* value);
+    static uint8_t toUint8(Object* value);
+
+    size_t checkIndex(int64_t index) const;
+
+    Kind elementKind;
+    char* buffer = nullptr;
+    size_t count = 0;
+    size_t cap = 0;
+};
+
+}//ns
+
+#endif //LAKE_TYPEDARRAY_H
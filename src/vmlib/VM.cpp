@@ -4,10 +4,11 @@
 #include "Stack.h"
 #include <algorithm>
 #include <iterator>
+#include <chrono>
 
 namespace lake {
 
-VM::VM() : heapHead(nullptr), current(nullptr),
+VM::VM() : current(nullptr),
            stacks(0),
            heapCountTriggerGC(1024*1024*128), // For stress testing deallocation logic, set to 0
            numObjects(0)
@@ -17,18 +18,21 @@ VM::VM() : heapHead(nullptr), current(nullptr),
     // The root stacked function
     root = lake::track(
             new Object(
-                    new (vm().fnpool.malloc()) FunctionData((Stack*)lake::track(
-                            new (vm().stackpool.malloc()) Stack()), "___root")));
+                    vm().fnpool.create((Stack*)lake::track(
+                            new Stack()), "___root")));
 
     // Let the GC know root has a stack
     root->fndata->withStack = true;
-    root->fndata->body = (ExprExpressionList *) lake::track(new ExprExpressionList(root));
+    root->fndata->body = new (code) ExprExpressionList(root, &code);
+    root->fndata->code = &code;
     mpf_init2(epsilon, 512);
     mpf_set_d(epsilon, DBL_EPSILON);
 }
 
 VM::~VM()
 {
+    for (CodeArena* region : regions)
+        delete region;
 }
 
 Object* VM::eval()
@@ -42,6 +46,25 @@ void VM::swap()
     stacks.back()->swap();
 }
 
+void VM::popStack()
+{
+    Stack* stack = stacks.back();
+    stacks.pop_back();
+
+    // Minor collections trace the stacks in use, but not the ones which were, so
+    // an old stack which may now reference nursery objects must be remembered
+    if (stack->gcstate == GC_OLD)
+        remember(stack);
+
+    // Likewise, incremental marking must scan a stack again if it was scanned while in use
+    if (gcPhase == GCPhase::Marking && Heap::isMarked(stack))
+        grayStack.push_back(stack);
+
+    // Closing a region only traces the stacks in use, so one which was may now reference its objects
+    if (heap.regionDepth > 0 && Heap::pageOf(stack)->region < heap.regionDepth)
+        addEscapedStack(stack);
+}
+
 void VM::lift(size_t count)
 {
     if (stacks.size() < 2)
@@ -119,61 +142,329 @@ void VM::remove(size_t count)
     if (count > source->size())
         throw std::runtime_error("Remove count larger than stack");
 
-    // Call destructors
+    // Call destructors. Objects tracked before an active background sweep may be on the list
+    // being swept, and objects may be on the gray stack while incremental marking is underway,
+    // so in both cases they're left to the collector.
+    bool eager = !sweeper.active() && gcPhase != GCPhase::Marking;
+
     for (size_t i=0; i < count; i++)
     {
         Object *v = pop();
-        if (v->hasFlag(FLAG_GC_TRACKED))
+        if (v->hasFlag(FLAG_GC_TRACKED) && eager)
             v->destruct();
     }
 }
 
 void VM::mark()
 {
+    markRoots();
+
+    if (markThreads > 1 && numObjects >= parallelMarkThreshold)
+        marker.trace(markThreads);
+    else
+        traceGray();
+}
+
+void VM::markRoots()
+{
+    // Nothing is traced before the roots are marked, so this starts the cycle's epoch
+    markEpoch++;
+
     root->mark();
 
     // Visit all live stacks
     for (auto& stack : stacks)
         stack->mark();
+
+    for (auto& function : activeFunctions)
+        function->mark();
+
+    // Literals referenced by the program
+    code.markRoots();
+
+    // Escaped objects are referenced from outside of their region without being traced
+    // from there when it's closed, so they're kept until then
+    Object::markAll(escaped);
+
+    for (Stack* stack : escapedStacks)
+        stack->mark();
+
+    // Minor collections don't trace old functions, which keep regions alive otherwise
+    if (minorMarking)
+    {
+        for (CodeArena* region : regions)
+            region->markRoots();
+    }
+}
+
+bool VM::traceGray(int64_t budget)
+{
+    // Gray objects pass through a small FIFO, and are prefetched as they enter it, so
+    // each object's header is likely in cache by the time it's scanned
+    const size_t distance = Object::MARK_PREFETCH_DISTANCE;
+    Object* pending[distance];
+    size_t first = 0, count = 0;
+
+    while (budget > 0 && (count > 0 || !grayStack.empty()))
+    {
+        if (count < distance && !grayStack.empty())
+        {
+            Object* obj = grayStack.back();
+            grayStack.pop_back();
+
+            Object::prefetch(obj);
+            pending[(first + count) % distance] = obj;
+            count++;
+            continue;
+        }
+
+        Object* obj = pending[first];
+        first = (first + 1) % distance;
+        count--;
+
+        obj->markChildren();
+        budget--;
+    }
+
+    // Objects not scanned within the budget stay gray
+    while (count > 0)
+    {
+        grayStack.push_back(pending[first]);
+        first = (first + 1) % distance;
+        count--;
+    }
+
+    return grayStack.empty();
+}
+
+void VM::remember(Object* obj)
+{
+    if ((obj->gcstate & GC_REMEMBERED) == 0)
+    {
+        obj->gcstate |= GC_REMEMBERED;
+        remembered.push_back(obj);
+    }
+}
+
+CodeArena* VM::newRegion()
+{
+    // Chunks count as bytes in use, so code created at runtime paces collections
+    CodeArena* region = new CodeArena(true, &externalBytes);
+
+    // Regions created while incremental marking is underway survive the cycle
+    if (gcPhase == GCPhase::Marking)
+        region->marked = true;
+
+    regions.push_back(region);
+    return region;
+}
+
+void VM::sweepRegions()
+{
+    size_t kept = 0;
+
+    for (CodeArena* region : regions)
+    {
+        if (region->marked || region->pinned)
+        {
+            region->marked = false;
+            regions[kept++] = region;
+        }
+        else
+            delete region;
+    }
+
+    regions.resize(kept);
+}
+
+void VM::openScratch(Stack* stack)
+{
+    if (!scratchRegions)
+        return;
+
+    heap.pushRegion();
+    scratch.push_back({stack, stack->commitDepth()});
+}
+
+void VM::closeScratch(Stack* stack, size_t commits)
+{
+    for (size_t i = scratch.size(); i-- > 0;)
+    {
+        if (scratch[i].stack == stack && scratch[i].commit == commits)
+        {
+            // Regions opened later are still open if their revert was skipped, say by an
+            // exception. They are merged into this one.
+            while (scratch.size() > i + 1)
+                closeRegion(false);
+
+            closeRegion(true);
+            return;
+        }
+    }
+}
+
+void VM::closeRegion(bool sweep)
+{
+    uint32_t depth = heap.regionDepth;
+    const std::vector<Page*>& regionPages = heap.currentRegionPages();
+
+    if (sweep && sweeper.active() && sweeper.done())
+        sweeper.finish();
+
+    // A collection in progress has its own use of the mark bits, so the region is left for it
+    if (sweep && gcActive && gcPhase == GCPhase::Idle && !sweeper.active())
+    {
+        int64_t numObjectsNow = numObjects;
+        scratchMarking = depth;
+        markEpoch++;
+
+        for (Stack* stack : stacks)
+            Object::markAll(stack->items);
+
+        for (Stack* stack : escapedStacks)
+            Object::markAll(stack->items);
+
+        Object::markAll(activeFunctions);
+        Object::markAll(escaped);
+
+        if (tailcallRequest != nullptr)
+            tailcallRequest->mark();
+
+        // Literals of code created in the region
+        for (CodeArena* region : regions)
+            region->markRoots();
+
+        // Pinned objects, such as functions being evaluated
+        for (Page* page : regionPages)
+        {
+            for (size_t word = 0; word < Page::WORDS; word++)
+            {
+                Heap::forEachBit(page->tracked[word], word * 64, [&](size_t index)
+                {
+                    Object* obj = page->at(index);
+                    if (obj->hasFlag(FLAG_GC_PINNED))
+                        obj->mark();
+                });
+            }
+        }
+
+        traceGray();
+        scratchMarking = 0;
+
+        // Old objects about to be destructed may be in the remembered set
+        remembered.erase(std::remove_if(remembered.begin(), remembered.end(), [&](Object* obj)
+        {
+            return Heap::pageOf(obj)->region == depth && !Heap::isMarked(obj) && !obj->hasFlag(FLAG_GC_PINNED);
+        }), remembered.end());
+
+        for (Page* page : regionPages)
+            sweepPage(page, false, false);
+
+        gcStats.scratchRegions++;
+        gcStats.scratchObjectsFreed += (uint64_t) (numObjectsNow - numObjects);
+    }
+
+    scratch.pop_back();
+
+    for (Page* page : heap.popRegion())
+        heap.adopt(page);
+
+    // Escaped objects promoted to the main heap are no longer special
+    if (heap.regionDepth == 0)
+    {
+        escaped.clear();
+        escapedStacks.clear();
+    }
+    else
+    {
+        escaped.erase(std::remove_if(escaped.begin(), escaped.end(), [](Object* obj)
+        {
+            return Heap::pageOf(obj)->region == 0;
+        }), escaped.end());
+    }
+}
+
+/**
+ * Adds an item to a list which may get the same item over and over. Duplicates are
+ * dropped each time the list reaches a power of two in size.
+ */
+template<typename T>
+static void addDistinct(std::vector<T*>& list, T* item)
+{
+    if (!list.empty() && list.back() == item)
+        return;
+
+    list.push_back(item);
+
+    size_t size = list.size();
+    if (size >= 1024 && (size & (size - 1)) == 0)
+    {
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+    }
+}
+
+void VM::addEscaped(Object* obj)
+{
+    addDistinct(escaped, obj);
+}
+
+void VM::addEscapedStack(Stack* stack)
+{
+    addDistinct(escapedStacks, stack);
 }
 
-// Should be able to do this in a thread. Only head access needs to be sync'ed
 void VM::sweep()
 {
     trace_debug("Sweeping...");
 
-    Object* object = heapHead;
+    for (Page* page : heap.pages)
+        sweepPage(page, false, gcMode == GCMode::Generational);
 
-    while (object != nullptr)
+    heap.releaseEmptyPages();
+}
+
+void VM::sweepPage(Page* page, bool minor, bool promoteSurvivors)
+{
+    for (size_t word = 0; word < Page::WORDS; word++)
     {
-        Object* curr = object;
+        uint64_t candidates = page->tracked[word];
+        if (minor)
+            candidates &= ~page->old[word];
+
+        uint64_t survivors = candidates & page->marked[word];
+
+        // Reachable, so unmark in preparation for the next GC cycle
+        page->marked[word] = 0;
 
         // Free unreachables. Note that we skip pinned objects.
         // A pinned object which is also tracked is typically a function being eval'ed (ExprInvoke pops
         // it from the stack, but it's still alive, of course.)
-        if (!curr->hasFlag(FLAG_GC_REACHABLE) && !curr->hasFlag(FLAG_GC_PINNED))
+        Heap::forEachBit(candidates & ~survivors, word * 64, [&](size_t index)
         {
-            if (!curr->hasFlag(FLAG_GC_TRACKED))
+            Object* obj = page->at(index);
+
+            if (obj->hasFlag(FLAG_GC_PINNED))
             {
-                throw std::runtime_error("Untracked object found on the sweep list");
+                survivors |= 1ULL << (index & 63);
+                return;
             }
-            else
-            {
-                //trace_debugf("GC:COLLECTING: %s", curr->dump().c_str());
 
-                // Deallocates content, puts itself on the free list. If free list full, deallocates itself.
-                object = curr->destruct();
+            // Deallocates content, and returns the memory to the page
+            obj->destruct();
+            numObjects--;
+            cycle.objectsFreed++;
+        });
 
-                numObjects--;
-            }
-        }
-        else
+        // Survivors are promoted by adding them to the old generation
+        if (promoteSurvivors)
         {
-            trace_debugf("GC:STILL ALIVE: %p", curr);// curr->dump().c_str());
+            Heap::forEachBit(survivors & ~page->old[word], word * 64, [&](size_t index)
+            {
+                page->at(index)->gcstate = GC_OLD;
+            });
 
-            // Reachable, so unmark in preparation for the next GC cycle
-            curr->clearFlag(FLAG_GC_REACHABLE);
-            object = object->next;
+            page->old[word] |= survivors;
         }
     }
 }
@@ -182,18 +473,379 @@ void VM::gc(bool explicitGC)
 {
     if (gcActive)
     {
+        if (sweeper.active())
+        {
+            // Until the previous sweep is merged, the object count includes what it collected
+            if (!explicitGC && !sweeper.done())
+                return;
+
+            sweeper.finish();
+
+            if (!explicitGC && numObjects+1 < heapCountTriggerGC && heapBytes() < nextGCBytes)
+                return;
+        }
+
         if (!explicitGC)
             trace_debug("GC TRIGGERED BY LOW SWEEPLIST CAPACITY");
 
+        finishCycle();
+
+        auto start = std::chrono::steady_clock::now();
         int numObjectsNow = numObjects;
+        bytesBeforeGC = heapBytes();
+
+        cycle = CollectionRecord();
+        cycle.objectsBefore = numObjects;
+
+        // Everything is traced, so the remembered set starts over
+        for (Object* obj : remembered)
+            obj->gcstate &= ~GC_REMEMBERED;
+        remembered.clear();
 
         mark();
+        sweepRegions();
+
+        auto marked = std::chrono::steady_clock::now();
+        cycle.markMicros = Histogram::micros(marked - start);
+        cycle.bytesFreed = bytesBeforeGC - heapBytes();
+
+        if (backgroundSweep && gcMode == GCMode::Full)
+        {
+            // The mutator allocates from other pages until the swept pages are handed back
+            sweeper.start(heap.detach());
+            gcPause += std::chrono::steady_clock::now() - start;
+
+            trace_debug("Sweeping in the background");
+            return;
+        }
+
         sweep();
 
+        auto end = std::chrono::steady_clock::now();
+        cycle.sweepMicros = Histogram::micros(end - marked);
+        cycle.bytesFreed = bytesBeforeGC - heapBytes();
+
+        gcPause += end - start;
+        paceCollections();
+
+        if (gcMode == GCMode::Generational)
+        {
+            numYoung = 0;
+            oldTriggerGC = std::max(4 * nurseryTriggerGC, 2 * numObjects);
+        }
+
         trace_debugf("Collected %zd objects, %zd remaining.\n", ssize_t(numObjectsNow - numObjects), ssize_t(numObjects));
     }
 }
 
+void VM::minorGC(bool explicitGC)
+{
+    if (gcActive)
+    {
+        if (!explicitGC)
+            trace_debug("MINOR GC TRIGGERED BY NURSERY SIZE");
+
+        sweeper.finish();
+        finishCycle();
+
+        auto start = std::chrono::steady_clock::now();
+        int64_t numObjectsNow = numObjects;
+
+        cycle = CollectionRecord();
+        cycle.kind = CollectionRecord::Kind::Minor;
+        cycle.objectsBefore = numYoung;
+        cycle.bytesBefore = heapBytes();
+
+        minorMarking = true;
+
+        // Stacks in use are mutated without write barriers, so old ones are traced like remembered objects
+        for (auto& stack : stacks)
+        {
+            if (stack->gcstate == GC_OLD)
+                remember(stack);
+        }
+
+        for (Object* obj : remembered)
+            obj->mark();
+
+        // Pinned nursery objects, such as functions being evaluated, may not be reachable from any stack
+        for (Page* page : heap.pages)
+        {
+            for (size_t word = 0; word < Page::WORDS; word++)
+            {
+                Heap::forEachBit(page->tracked[word] & ~page->old[word], word * 64, [&](size_t index)
+                {
+                    Object* obj = page->at(index);
+                    if (obj->hasFlag(FLAG_GC_PINNED))
+                        obj->mark();
+                });
+            }
+        }
+
+        mark();
+
+        minorMarking = false;
+
+        auto marked = std::chrono::steady_clock::now();
+        cycle.markMicros = Histogram::micros(marked - start);
+
+        // The marks of remembered objects are cleared by the sweep
+        for (Object* obj : remembered)
+            obj->gcstate = GC_OLD;
+        remembered.clear();
+
+        // All survivors are promoted, so no old object references the nursery afterwards
+        for (Page* page : heap.pages)
+            sweepPage(page, true, true);
+
+        heap.releaseEmptyPages();
+        numYoung = 0;
+
+        cycle.sweepMicros = Histogram::micros(std::chrono::steady_clock::now() - marked);
+        cycle.bytesAfter = heapBytes();
+        cycle.bytesFreed = cycle.bytesBefore - cycle.bytesAfter;
+        gcStats.collected(cycle, *this);
+
+        trace_debugf("Minor GC collected %zd objects, %zd remaining.\n", ssize_t(numObjectsNow - numObjects), ssize_t(numObjects));
+
+        if (gcMode == GCMode::Generational && numObjects >= oldTriggerGC)
+            gc(false);
+    }
+}
+
+void VM::gcSlice()
+{
+    if (!gcActive)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::microseconds(sliceMicros);
+
+    // Work is done in chunks, so the clock is only read between chunks
+    int64_t chunk = sliceMicros > 0 ? std::min<int64_t>(sliceBudget, 256) : sliceBudget;
+
+    // Time spent in the current phase of the cycle is added to its telemetry when the phase or slice ends
+    auto phaseStart = start;
+
+    if (gcPhase == GCPhase::Idle)
+    {
+        trace_debug("INCREMENTAL GC CYCLE STARTED");
+
+        // Slices are paced by object count until the cycle completes
+        bytesBeforeGC = heapBytes();
+
+        cycle = CollectionRecord();
+        cycle.kind = CollectionRecord::Kind::Incremental;
+        cycle.objectsBefore = numObjects;
+        nextGCBytes = heapLimit > 0 ? heapLimit : INT64_MAX;
+
+        for (Object* obj : remembered)
+            obj->gcstate &= ~GC_REMEMBERED;
+        remembered.clear();
+
+        gcPhase = GCPhase::Marking;
+        markRoots();
+    }
+
+    for (int64_t budget = sliceBudget; budget > 0 && gcPhase != GCPhase::Idle; budget -= chunk)
+    {
+        int64_t work = std::min(chunk, budget);
+
+        if (gcPhase == GCPhase::Marking)
+        {
+            if (traceGray(work))
+            {
+                // Stacks may have changed since they were scanned, which is the only way
+                // for a white object to become reachable without passing a barrier
+                for (auto& stack : stacks)
+                {
+                    if (Heap::isMarked(stack))
+                        grayStack.push_back(stack);
+                    else
+                        stack->mark();
+                }
+
+                for (auto& function : activeFunctions)
+                    function->mark();
+
+                // Objects may have escaped into objects which are now unreachable
+                Object::markAll(escaped);
+
+                for (Stack* stack : escapedStacks)
+                    stack->mark();
+
+                traceGray();
+
+                int64_t before = heapBytes();
+                sweepRegions();
+                cycle.bytesFreed += before - heapBytes();
+
+                auto now = std::chrono::steady_clock::now();
+                cycle.markMicros += Histogram::micros(now - phaseStart);
+                phaseStart = now;
+
+                gcPhase = GCPhase::Sweeping;
+                sweepCursor = 0;
+                sweepEnd = heap.pages.size();
+
+                for (Page* page : heap.pages)
+                    page->pendingSweep = true;
+            }
+        }
+        else
+        {
+            // Pages are swept whole, each costing its number of objects
+            while (work > 0 && sweepCursor < sweepEnd)
+            {
+                Page* page = heap.pages[sweepCursor++];
+                work -= std::max<int64_t>(page->used, 1);
+
+                int64_t before = heapBytes();
+                page->pendingSweep = false;
+                sweepPage(page, false, false);
+                cycle.bytesFreed += before - heapBytes();
+            }
+
+            if (sweepCursor == sweepEnd)
+            {
+                heap.releaseEmptyPages();
+
+                gcPhase = GCPhase::Idle;
+                incrementalTriggerGC = std::max(64 * sliceInterval, 2 * numObjects);
+
+                auto now = std::chrono::steady_clock::now();
+                cycle.sweepMicros += Histogram::micros(now - phaseStart);
+                gcPause += now - start;
+                paceCollections();
+
+                trace_debugf("Incremental GC cycle completed, %zd objects remaining.\n", ssize_t(numObjects));
+            }
+        }
+
+        if (sliceMicros > 0 && std::chrono::steady_clock::now() >= deadline)
+            break;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    if (gcPhase == GCPhase::Marking)
+        cycle.markMicros += Histogram::micros(end - phaseStart);
+    else if (gcPhase == GCPhase::Sweeping)
+        cycle.sweepMicros += Histogram::micros(end - phaseStart);
+
+    if (gcPhase != GCPhase::Idle)
+        gcPause += end - start;
+
+    gcStats.slices++;
+    gcStats.slice.add(Histogram::micros(end - start));
+
+    nextSliceGC = gcPhase == GCPhase::Idle ? incrementalTriggerGC : numObjects + sliceInterval;
+}
+
+void VM::gcForBytes()
+{
+    if (!gcActive)
+        return;
+
+    if (heapLimit > 0 && heapBytes() >= heapLimit)
+    {
+        // Collect all that can be collected before giving up
+        gc(true);
+        sweeper.finish();
+
+        if (heapBytes() >= heapLimit)
+        {
+            throw std::runtime_error("Heap limit exceeded: " + std::to_string(heapBytes()) +
+                                     " bytes in use, the limit is " + std::to_string(heapLimit));
+        }
+    }
+    else if (gcMode == GCMode::Incremental)
+    {
+        trace_debug("INCREMENTAL GC CYCLE TRIGGERED BY HEAP SIZE");
+        gcSlice();
+    }
+    else
+    {
+        trace_debug("GC TRIGGERED BY HEAP SIZE");
+        gc(false);
+    }
+}
+
+void VM::setHeapLimits(int64_t target, double growth, int64_t limit)
+{
+    if (target > 0)
+        heapTarget = nextGCBytes = target;
+    if (growth > 0)
+        growthFactor = growth;
+    if (limit > 0)
+        heapLimit = limit;
+
+    if (heapLimit > 0)
+        nextGCBytes = std::min(nextGCBytes, heapLimit);
+}
+
+void VM::paceCollections()
+{
+    auto now = std::chrono::steady_clock::now();
+    int64_t inUse = heapBytes();
+    int64_t live = std::max<int64_t>(bytesBeforeGC - cycle.bytesFreed, 0);
+
+    double elapsed = std::chrono::duration<double>(now - lastGCEnd).count();
+    double paused = std::chrono::duration<double>(gcPause).count();
+
+    // Bytes allocated since the last collection completed, including those allocated during this one
+    if (elapsed > paused)
+    {
+        int64_t allocated = std::max<int64_t>(bytesBeforeGC - liveBytes, 0) + std::max<int64_t>(inUse - live, 0);
+        allocationRate = (double) allocated / (elapsed - paused);
+    }
+
+    double stretch = 1.0;
+
+    double survival = bytesBeforeGC > 0 ? std::min(1.0, (double) live / (double) bytesBeforeGC) : 0.0;
+    if (survival > 0.5)
+        stretch += (survival - 0.5) * 2;
+
+    int64_t paced = std::max(heapTarget, (int64_t) ((double) live * growthFactor * stretch));
+
+    double room = allocationRate * paused * (1.0 - gcTimeGoal) / gcTimeGoal;
+    nextGCBytes = std::max(paced, live + (int64_t) std::min(room, (double) paced));
+
+    if (heapLimit > 0)
+        nextGCBytes = std::min(nextGCBytes, heapLimit);
+
+    trace_debugf("Collection left %zd bytes in use, the next one runs at %zd bytes.", ssize_t(live), ssize_t(nextGCBytes));
+
+    liveBytes = inUse;
+    lastGCEnd = now;
+    gcPause = std::chrono::steady_clock::duration(0);
+
+    cycle.bytesBefore = bytesBeforeGC;
+    cycle.bytesAfter = live;
+    gcStats.collected(cycle, *this);
+}
+
+void VM::finishCycle()
+{
+    if (gcPhase == GCPhase::Idle)
+        return;
+
+    int64_t budget = sliceBudget;
+    int64_t micros = sliceMicros;
+
+    sliceBudget = INT64_MAX;
+    sliceMicros = 0;
+
+    gcSlice();
+
+    // Marking ends the slice when switching to sweeping
+    if (gcPhase != GCPhase::Idle)
+        gcSlice();
+
+    sliceBudget = budget;
+    sliceMicros = micros;
+}
+
 void VM::dumpStack()
 {
     std::cout << "==========STACK (" << stacks.size() <<  ") ================================" << std::endl;
@@ -239,17 +891,55 @@ void VM::dumpStackHierarchy(Stack* stack, int indent)
 
 void VM::dumpSweepList()
 {
-    Object* object = heapHead;
+    sweeper.finish();
 
     std::cout << "SWEEP LIST: " << std::endl;
 
-    while (object != nullptr)
+    // Tracked objects, nursery first
+    for (bool old : {false, true})
     {
-        std::cout << "> " << object->dump() << std::endl;
-        object = object->next;
+        bool header = !old;
+
+        for (Page* page : heap.pages)
+        {
+            for (size_t word = 0; word < Page::WORDS; word++)
+            {
+                uint64_t objects = page->tracked[word] & (old ? page->old[word] : ~page->old[word]);
+
+                Heap::forEachBit(objects, word * 64, [&](size_t index)
+                {
+                    if (!header)
+                        std::cout << "OLD GENERATION: " << std::endl;
+                    header = true;
+
+                    std::cout << "> " << page->at(index)->dump() << std::endl;
+                });
+            }
+        }
     }
 }
 
+void VM::dumpAllocStats()
+{
+    sweeper.finish();
+
+    auto dump = [](const char* name, const AllocStats& stats)
+    {
+        std::cout << name << ": " << stats.allocations << " allocations, " << stats.frees << " frees, "
+                  << stats.live << " live, " << stats.peak << " peak, "
+                  << stats.chunks << " chunks, " << stats.bytes / 1024 << " KiB" << std::endl;
+    };
+
+    dump("Heap", heap.stats());
+    dump("Function data", fnpool.stats());
+
+    std::cout << "Code: " << code.size() << " nodes, " << code.bytes() / 1024 << " KiB, "
+              << regions.size() << " regions" << std::endl;
+
+    std::cout << "Bytes in use: " << heapBytes() << ", of which " << externalBytes << " outside the heap. Next collection at "
+              << nextGCBytes << " bytes, allocating " << (int64_t) (allocationRate / 1024) << " KiB/s" << std::endl;
+}
+
 void VM::externalize(std::ostream& str, int indentation)
 {
     for (auto& def : defines)
@@ -311,6 +1001,11 @@ void VM::restoreStackBase()
     stacks.back()->stackBase.pop_back();
 }
 
+void VM::setEngine(Engine engine)
+{
+    this->engine = engine;
+}
+
 void VM::setGCActive(bool active)
 {
     this->gcActive = active;
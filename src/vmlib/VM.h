@@ -6,8 +6,17 @@
 #include <mutex>
 #include <map>
 #include <assert.h>
+#include <cfloat>
+#include <cstdint>
+#include <chrono>
 #include <mpir.h>
-#include <boost/pool/object_pool.hpp>
+#include "Slab.h"
+#include "NumCache.h"
+#include "Heap.h"
+#include "CodeArena.h"
+#include "Sweeper.h"
+#include "ParallelMarker.h"
+#include "GCStats.h"
 
 namespace lake {
 
@@ -37,10 +46,52 @@ public:
      */
     mpf_t epsilon;
 
+    /**
+     * The same epsilon, for comparing f64 values
+     */
+    double doubleEpsilon = DBL_EPSILON;
+
     /**
      * Currently executing function; used by ExprCurrent.
      */
     Object* current = nullptr;
+
+    /**
+     * Engines for evaluating function bodies. The tree walker calls eval() on each
+     * expression object, while the bytecode engine lowers each body to a flat
+     * instruction array the first time it's invoked. The engines share objects,
+     * stacks and the GC, and can be selected per VM.
+     */
+    enum class Engine { TreeWalker, Bytecode };
+
+    Engine engine = Engine::TreeWalker;
+
+    void setEngine(Engine engine);
+
+    /**
+     * Quickening lets instruction nodes that observe the same operand types over and over
+     * replace themselves with specialized variants. A node asks for the replacement with
+     * requestRewrite, and the expression list evaluating it swaps the node in its slot
+     * once the node returns. Requests from nodes not evaluated directly by a list are
+     * discarded. The bytecode engine has its own specialized opcodes, so quickening only
+     * applies to the tree walker.
+     */
+    bool quicken = true;
+
+    inline bool quickening() const
+    {
+        return quicken && engine == Engine::TreeWalker;
+    }
+
+    inline void requestRewrite(Object* from, Object* to)
+    {
+        rewriteFrom = from;
+        rewriteTo = to;
+    }
+
+    // Pending rewrite request
+    Object* rewriteFrom = nullptr;
+    Object* rewriteTo = nullptr;
     
     /**
      * Starts evaluation of the root closure
@@ -59,23 +110,24 @@ public:
     // stack objects on this function.
     Object* root = nullptr;
 
-    // First Object on GC mark-list. This are all objects that are reachable and may be
-    // unreachable. Objects deemed unreachable are moved to the freelist for reuse.
-    Object* heapHead = nullptr;
-
-    // When objects are garbage collected, they're put on the free list. If the free list
-    // if full (given a configurable size using a vm instruction), the object is actually
-    // deallocated. Note that a destructor is still called, even if merely placed on the
-    // free list.
-    //
-    // The freelist improves allocation speed and counters heap fragmentation (since we'll
-    // request heap allocations with increasing rarity.)
+    // All objects live in the pages of the heap. Tracked objects, which may become
+    // unreachable, are found by the collector through the tracked bitmap of each page.
+    // Objects deemed unreachable are returned to the free list of their page for reuse.
     //
-    // freeHead points to the first object on freelist. The next/prev pointers of a
-    // deallocated object are repurposed to do freelist node chaining.
-    //
-    // When grabbing objects from the free-list, placement-new must be used
-    // (what about FunctionData? keep the emptied stack around!)
+    // Tracked objects which are not in the old generation bitmap form the nursery. Objects
+    // surviving a minor collection are added to the old generation bitmap.
+    Heap heap;
+
+    // Instruction nodes of the program. These are not objects the collector knows about;
+    // the literals they reference are marked through the arena's roots instead.
+    CodeArena code;
+
+    // Collectable arenas holding code created at runtime, see CodeArena
+    std::vector<CodeArena*> regions;
+
+    // Arena holding the expression list being evaluated by the tree walker. Quickened
+    // nodes are allocated in it, so they're released with the code they're installed in.
+    CodeArena* currentCode = &code;
 
     /* The total number of currently allocated objects. */
     int64_t numObjects;
@@ -83,8 +135,234 @@ public:
     /* The number of objects required to trigger a GC. */
     int64_t heapCountTriggerGC;
 
+    /**
+     * Memory owned by tracked objects outside of their heap slots, such as strings and
+     * collection storage (see Object::ownedBytes). Owned memory is added when an object is
+     * tracked, adjusted by accountGrowth when it grows in place, and removed when the object
+     * is collected. The chunks of code regions are included as well.
+     */
+    int64_t externalBytes = 0;
+
+    /* Bytes in use; see externalBytes */
+    inline int64_t heapBytes() const
+    {
+        return (int64_t) heap.usedBytes + externalBytes;
+    }
+
+    /**
+     * Full collections are also triggered by the number of bytes in use, which are the heap
+     * slots in use plus externalBytes. The minimum number of bytes in use which triggers a
+     * full collection is heapTarget; after that, paceCollections sets the trigger from the
+     * bytes surviving each collection.
+     *
+     * If heapLimit is set, a full collection is forced when the heap reaches it, and a
+     * runtime error is raised if the heap is still above the limit afterwards.
+     */
+    int64_t heapTarget = 64*1024*1024;
+
+    /* Heap growth between full collections, relative to the bytes surviving the last one */
+    double growthFactor = 2.0;
+
+    /* The share of time the collector aims to stay under */
+    double gcTimeGoal = 0.05;
+
+    /* If non-zero, the maximum number of bytes in use */
+    int64_t heapLimit = 0;
+
+    /* The number of bytes in use which triggers the next full collection */
+    int64_t nextGCBytes = 64*1024*1024;
+
+    /* Bytes in use when the last full collection completed, and when the one in progress started */
+    int64_t liveBytes = 0;
+    int64_t bytesBeforeGC = 0;
+
+    /* Bytes allocated per second by the mutator between the last two full collections */
+    double allocationRate = 0;
+
+    /**
+     * Sets heapTarget, growthFactor and heapLimit, where zero keeps the current setting
+     */
+    void setHeapLimits(int64_t target, double growth, int64_t limit);
+
     bool gcActive = true;
 
+    /**
+     * In full mode, every collection marks and sweeps the entire heap.
+     *
+     * In generational mode, a minor collection runs whenever nurseryTriggerGC objects
+     * have been tracked since the last collection. It only traces nursery objects,
+     * starting from the stacks and the remembered set, and sweeps the nursery list.
+     * Survivors are promoted to the old generation. A full collection runs when the
+     * old generation has doubled since the last full collection.
+     *
+     * Objects are referenced by raw pointers from stacks, containers and FFI buffers,
+     * so nothing is moved: promotion relinks survivors to the old list.
+     *
+     * Old objects which are mutated to reference nursery objects are found through
+     * writeBarrier, and are remembered until the next collection. This is maintained
+     * in all modes, so minor collections can also be requested explicitly.
+     *
+     * In incremental mode, a collection cycle is spread over slices which run as the
+     * mutator allocates, one slice per sliceInterval tracked objects. Each slice traces
+     * or sweeps at most sliceBudget objects, and stops after sliceMicros if set. Marking
+     * is tri-color: black objects are marked and scanned, gray objects are marked and on
+     * the gray stack, and white objects are unmarked. writeBarrier shades objects stored
+     * into black objects, and objects tracked while marking are shaded, so no black object
+     * references a white one. Stacks are mutated without barriers, and are scanned again
+     * when the gray stack runs empty, which ends marking.
+     *
+     * Sweeping processes the heap page by page. Objects tracked while sweeping are marked
+     * if their page is yet to be swept, so they survive the cycle.
+     */
+    enum class GCMode { Full, Generational, Incremental };
+
+    GCMode gcMode = GCMode::Full;
+
+    /* If set, collections in full mode sweep on a background thread; see Sweeper */
+    bool backgroundSweep = false;
+
+    /* Number of threads tracing the heap in full and minor collections */
+    int markThreads = 1;
+
+    /* Marking is only done in parallel if there are at least this many objects */
+    int64_t parallelMarkThreshold = 64*1024;
+
+    /* True while marking with multiple threads */
+    bool parallelMarking = false;
+
+    /* Functions being evaluated, and collections being iterated by foreach along with the current omap
+     * or oset key. These are roots as they may have been popped off the stack. */
+    std::vector<Object*> activeFunctions;
+
+    /* The number of nursery objects required to trigger a minor GC in generational mode */
+    int64_t nurseryTriggerGC = 4096;
+
+    /* The number of old objects required to trigger a full GC in generational mode */
+    int64_t oldTriggerGC = 64*1024;
+
+    /* The number of objects tracked since the last collection */
+    int64_t numYoung = 0;
+
+    /* True while a minor collection is marking */
+    bool minorMarking = false;
+
+    /* Old objects which may reference nursery objects */
+    std::vector<Object*> remembered;
+
+    /* Marked objects whose children are yet to be marked */
+    std::vector<Object*> grayStack;
+
+    enum class GCPhase { Idle, Marking, Sweeping };
+
+    /* Phase of the incremental cycle in progress, if any */
+    GCPhase gcPhase = GCPhase::Idle;
+
+    /* The number of objects required to start an incremental cycle */
+    int64_t incrementalTriggerGC = 64*1024;
+
+    /* The number of objects tracked between incremental slices */
+    int64_t sliceInterval = 1024;
+
+    /* The maximum number of objects traced or swept per incremental slice */
+    int64_t sliceBudget = 4096;
+
+    /* If non-zero, incremental slices also end after this many microseconds */
+    int64_t sliceMicros = 0;
+
+    /* Object count at which the next incremental slice runs */
+    int64_t nextSliceGC = 64*1024;
+
+    /* Collector and allocation telemetry */
+    GCStats gcStats;
+
+    /* Telemetry of the collection or incremental cycle in progress */
+    CollectionRecord cycle;
+
+    /* Pause time of the full collection or incremental cycle in progress, and the end of the last one */
+    std::chrono::steady_clock::duration gcPause {0};
+    std::chrono::steady_clock::time_point lastGCEnd = std::chrono::steady_clock::now();
+
+    /* Index of the next page to sweep in the incremental cycle, and the end of the pages to sweep */
+    size_t sweepCursor = 0;
+    size_t sweepEnd = 0;
+
+    /**
+     * Adds an old object to the remembered set. Called by writeBarrier.
+     */
+    void remember(Object* obj);
+
+    /**
+     * Scratch regions. If set, commit opens a region on the heap, and the revert matching
+     * the commit closes it. Objects allocated in between come from pages of the region's
+     * own. When the region is closed, the objects in it which are still reachable from
+     * outside survive, and the others are destructed right away rather than by a later
+     * collection.
+     *
+     * Closing a region only traces the region's objects, starting from the stacks, the
+     * functions being evaluated, and the objects which escaped: region objects stored by
+     * writeBarrier into a collection, local or argument owned by an object outside of the
+     * region, and stacks which went out of use while the region was open. Results stored
+     * into the commit slot are on the stack, so they survive as well.
+     *
+     * Objects are never moved, so survivors are promoted by handing their pages to the
+     * enclosing region, or to the main heap. While a collection is in progress, a region
+     * is closed without being swept.
+     */
+    bool scratchRegions = false;
+
+    /* An open scratch region, and the stack and commit which opened it */
+    struct ScratchRegion
+    {
+        Stack* stack;
+        size_t commit;
+    };
+
+    std::vector<ScratchRegion> scratch;
+
+    /* Region objects which may be referenced from outside of their region */
+    std::vector<Object*> escaped;
+
+    /* Stacks which may reference objects of an open region */
+    std::vector<Stack*> escapedStacks;
+
+    /* While a region is swept, its depth; marking skips objects outside of it */
+    uint32_t scratchMarking = 0;
+
+    /* Incremented as each marking starts, so shared pvec and pmap nodes are traced once per cycle */
+    uint32_t markEpoch = 0;
+
+    /**
+     * Called by commit on a stack. Opens a region if scratch regions are enabled.
+     */
+    void openScratch(Stack* stack);
+
+    /**
+     * Called by revert on a stack, after reverting it, with the number of commits it had
+     * before. Closes the region opened by the reverted commit, if any, along with regions
+     * opened after it which are still open.
+     */
+    void closeScratch(Stack* stack, size_t commits);
+
+    /**
+     * Closes the innermost region. If 'sweep' is set, unreachable objects in it are destructed.
+     */
+    void closeRegion(bool sweep);
+
+    /**
+     * Adds an object or stack to the escaped ones, which are kept alive until the regions close
+     */
+    void addEscaped(Object* obj);
+    void addEscapedStack(Stack* stack);
+
+    /**
+     * Called by writeBarrier while a region is open
+     */
+    inline void escape(Object* owner, Object* value)
+    {
+        if (Heap::pageOf(value)->region > Heap::pageOf(owner)->region)
+            addEscaped(value);
+    }
+
     /**
      * When this is set, an "invoke tail" is requested, at which point currently
      * evaluated expression lists return with a tailcall sentinel, all the way down
@@ -110,11 +388,93 @@ public:
         {
             gc(false);
         }
+        else if (heapBytes() >= nextGCBytes)
+        {
+            gcForBytes();
+        }
+        else if (gcMode == GCMode::Generational && numYoung >= nurseryTriggerGC)
+        {
+            minorGC(false);
+        }
+        else if (gcMode == GCMode::Incremental && numObjects >= nextSliceGC)
+        {
+            gcSlice();
+        }
     }
 
+    /**
+     * Marks the roots, and traces everything reachable from them
+     */
     void mark();
+
+    /**
+     * Puts the roots on the gray stack
+     */
+    void markRoots();
+
+    /**
+     * Traces gray objects until the gray stack is empty, or the budget is spent.
+     * Returns true if the gray stack is empty.
+     */
+    bool traceGray(int64_t budget = INT64_MAX);
+
     void sweep();
+
+    /**
+     * Creates a collectable arena for code created at runtime
+     */
+    CodeArena* newRegion();
+
+    /**
+     * Releases the regions not marked by the collection which just finished marking, and
+     * clears the marks of the others. Called by the mutator.
+     */
+    void sweepRegions();
+
+    /**
+     * Destructs the unmarked objects on a page, and clears its mark bits. A minor sweep
+     * only visits the nursery. Survivors are promoted if promoteSurvivors is set.
+     */
+    void sweepPage(Page* page, bool minor, bool promoteSurvivors);
     void gc(bool explicitGC=true);
+
+    /**
+     * Collects the nursery and promotes the survivors
+     */
+    void minorGC(bool explicitGC=true);
+
+    /**
+     * Runs a slice of the incremental cycle, starting a new cycle if none is in progress
+     */
+    void gcSlice();
+
+    /**
+     * Completes the incremental cycle in progress, if any
+     */
+    void finishCycle();
+
+    /**
+     * Called when the heap reaches nextGCBytes. Starts a collection or an incremental
+     * cycle, and enforces heapLimit.
+     */
+    void gcForBytes();
+
+    /**
+     * Sets nextGCBytes when a full collection or incremental cycle has completed, and
+     * adds it to gcStats.
+     *
+     * The survivors are the bytes in use when the cycle started minus those it freed, as the
+     * mutator may have allocated while a background sweep or incremental cycle ran. The next
+     * collection runs when the heap has grown to growthFactor times the survivors, but no
+     * sooner than at heapTarget bytes. The interval is stretched when most of the heap
+     * survived, as collecting as often would mostly retrace the same objects.
+     *
+     * The interval is also stretched to keep collections within gcTimeGoal of the time: at
+     * the measured allocationRate, the mutator needs room for pause * (1 - goal) / goal
+     * seconds of allocation to stay within the goal if the next pause is as long as the
+     * last. This is capped at twice the interval paced by survival.
+     */
+    void paceCollections();
     void setGCActive(bool active);
 
     /**
@@ -138,6 +498,11 @@ public:
      */
     void swap();
 
+    /**
+     * Removes the current stack from the stack of stacks
+     */
+    void popStack();
+
     void lift(size_t count);
     void sink(size_t count);
 
@@ -164,10 +529,18 @@ public:
     void dumpStack();
     void dumpStackHierarchy(Stack* stack, int indentation);
     void dumpSweepList();
+    void dumpAllocStats();
+
+    // Function data of function objects
+    Slab<FunctionData> fnpool;
+
+    // Recycled GMP storage for numeric objects
+    NumCache numcache;
+
+    ParallelMarker marker {*this};
 
-    boost::object_pool<Object> pool;
-    boost::object_pool<FunctionData> fnpool;
-    boost::object_pool<Stack> stackpool;
+    // Sweeps detached heap lists in the background; declared last, so it's joined first
+    Sweeper sweeper {*this};
 };
 
 }//ns
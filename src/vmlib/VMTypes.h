@@ -64,7 +64,9 @@ namespace lake {
 #define TOK_TYPEOBJECT "object"
 #define TOK_TYPEINT "int"
 #define TOK_TYPEFLOAT "float"
+#define TOK_TYPEDOUBLE "f64"
 #define TOK_TYPESTRING "string"
+#define TOK_TYPESYMBOL "symbol"
 #define TOK_TYPECHAR "char"
 #define TOK_TYPEBOOL "bool"
 #define TOK_TYPEVIEWPOINTER "ptr"
@@ -104,6 +106,11 @@ namespace lake {
 #define TOK_CHECKPOINT "checkpoint"
 #define TOK_TYPEUNORDEREDMAP "umap"
 #define TOK_TYPEUNORDEREDSET "uset"
+#define TOK_TYPEORDEREDMAP "omap"
+#define TOK_TYPEORDEREDSET "oset"
+#define TOK_TYPEPERSISTENTVECTOR "pvec"
+#define TOK_TYPEPERSISTENTMAP "pmap"
+#define TOK_TYPEROPE "rope"
 #define TOK_COLLFOREACH "foreach"
 #define TOK_COLL "coll"
 #define TOK_COLLAPPEND "append"
@@ -111,8 +118,15 @@ namespace lake {
 #define TOK_COLLSPREAD "spread"
 #define TOK_COLLRSPREAD "rspread"
 #define TOK_COLLPROJECTION "projection"
+#define TOK_COLLFILL "fill"
 #define TOK_TYPEPAIR "pair"
 #define TOK_ACCUMULATE "accumulate"
+#define TOK_SUM "sum"
+#define TOK_PRODUCT "product"
+#define TOK_MIN "min"
+#define TOK_MAX "max"
+#define TOK_COUNT "count"
+#define TOK_XOR "xor"
 #define TOK_DEFAULTPRECISION "precision"
 #define TOK_DEFAULTEPSILON "epsilon"
 #define TOK_CURRENT "current"
@@ -120,6 +134,9 @@ namespace lake {
 #define TOK_STACKHIERARCHY "stackhierarchy"
 #define TOK_FREELIST "freelist"
 #define TOK_SWEEPLIST "sweeplist"
+#define TOK_NUMCACHE "numcache"
+#define TOK_GCMINOR "minor"
+#define TOK_GCSTATS "stats"
 #define TOK_DTOR "dtor"
 #define TOK_RESERVE "reserve"
 #define TOK_COMMIT "commit"
@@ -150,13 +167,20 @@ enum class TokenType : uint8_t
     TypeObject,
     TypeInt,
     TypeFloat,
+    TypeDouble,
     TypeString,
     TypeSymbol,
     TypeChar,
     TypeBool,
+    TypeTypedArray,
     TypeArray,
     TypeUnorderedMap,
     TypeUnorderedSet,
+    TypeOrderedMap,
+    TypeOrderedSet,
+    TypePersistentVector,
+    TypePersistentMap,
+    TypeRope,
     TypePair,
     TypeFunction,
     TypeOperation,
@@ -338,10 +362,12 @@ enum class TokenType : uint8_t
  * To avoid calling (track) more than once=>debug aid
  */
 constexpr uint8_t FLAG_GC_TRACKED = 1;
+
 /**
- * Object was marked reachable during the mark phase
+ * If set, str_value is an InternedString shared with other objects, which is copied
+ * before the string is changed
  */
-constexpr uint8_t FLAG_GC_REACHABLE = 2;
+constexpr uint8_t FLAG_INTERNED = 2;
 
 /**
  * If set, never ever gc/destroy. Useful for singletons and sentinels
@@ -375,6 +401,18 @@ constexpr uint8_t FLAG_CONST = 64;
  */
 constexpr uint8_t FLAG_FOREIGN = 128;
 
+/**
+ * Collector state, kept in Object::gcstate. Mark bits are kept by the heap pages.
+ *
+ * Object survived a collection and is in the old generation
+ */
+constexpr uint8_t GC_OLD = 1;
+
+/**
+ * Old object in the remembered set, as it may reference nursery objects
+ */
+constexpr uint8_t GC_REMEMBERED = 2;
+
 }//ns
 
 #endif // Header guard
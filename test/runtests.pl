@@ -11,10 +11,12 @@ use POSIX qw(strftime);
 my $arg_loop;
 my $arg_exit_error;
 my $arg_sleep=5;
+my $arg_engine;
+my $arg_image;
 my $help;
 my $man;
 
-GetOptions ('help|?' => \$help, man => \$man, 'loop' => \$arg_loop, 'loop-sleep=n' => \$arg_sleep,'exit-on-error' => \$arg_exit_error) or pod2usage(2);
+GetOptions ('help|?' => \$help, man => \$man, 'loop' => \$arg_loop, 'loop-sleep=n' => \$arg_sleep,'exit-on-error' => \$arg_exit_error, 'engine=s' => \$arg_engine, 'image' => \$arg_image) or pod2usage(2);
 pod2usage(1) if $help;
 pod2usage(-exitval => 0, -verbose => 2) if $man;
 
@@ -50,7 +52,18 @@ while(1)
     for (0..$#tests)
     {
         my $fname = $tests[$_];
+
+        # Precompile to an image and run that instead of the source
+        if ($arg_image)
+        {
+            my $image = $fname;
+            $image =~ s/^test\/(.*)\.lake$/out\/$1.lakeb/;
+            system("out/lake -s $fname --image $image > /dev/null");
+            $fname = $image;
+        }
+
         my $runner = "out/lake -s $fname -r -t 2";
+        $runner .= " --engine $arg_engine" if $arg_engine;
 
         use IPC::Open3;
 
@@ -119,6 +132,10 @@ runtests.pl [options]
                             iterations (default 5)
         --exit-on-error     If a test fails, exit the
                             test runner
+        --engine NAME       Run tests using the given execution
+                            engine (tree or bytecode)
+        --image             Precompile each test to a binary
+                            image and run the image
         --man               Show manual
         --help              This page
 